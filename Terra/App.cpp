@@ -4,7 +4,14 @@
 #include <exception>
 #include <algorithm>
 #include <fstream>
+#include <future>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
 #include <thread>
+#include <unordered_map>
 
 #include <wx/cmdline.h>
 #include <wx/stdpaths.h>
@@ -14,6 +21,9 @@
 
 #include "./misc/StrCnv.hpp"
 #include "./misc/FileStream.hpp"
+#include "./misc/Hash.hpp"
+#include "./misc/LockFactory.hpp"
+#include "./misc/ParallelFor.hpp"
 #include "./gui/Util.hpp"
 #include "./plugin/PluginScanner.hpp"
 #include "./plugin/vst3/Vst3PluginFactory.hpp"
@@ -25,7 +35,11 @@
 #include "gui/SplashScreen.hpp"
 #include "resource/ResourceHelper.hpp"
 #include "file/ProjectObjectTable.hpp"
+#include "file/ProjectAutosaver.hpp"
+#include "file/ProjectContainer.hpp"
 #include "file/MidiFile.hpp"
+#include "file/AudioFileStreamer.hpp"
+#include "processor/MixerProcessor.hpp"
 #include "log/LoggingSupport.hpp"
 #include "log/LoggingStrategy.hpp"
 
@@ -36,6 +50,9 @@ NS_HWM_BEGIN
 double const kSampleRate = 44100;
 SampleCount const kBlockSize = 256;
 
+//! 自動保存でプロジェクトの変更を記録する間隔 [ms]
+int const kAutosaveInterval = 5000;
+
 wxSize const kMinimumWindowSize = { 450, 300 };
 wxSize const kDefaultWindowSize = { 640, 500 };
 
@@ -43,6 +60,44 @@ String GetPluginDescFileName() {
     return GetResourcePath(L"plugin_list.bin");
 }
 
+//! Project::ToSchema()で作成したスキーマに、プラグインの状態を設定する。
+/*! ToSchema()はプラグインの状態の代わりにそのハッシュ値（dump_hash）だけを設定するので、
+ *  ファイルに保存する前にこの関数で状態を取得する。
+ *  まだロードされていないプラグインの状態はプロジェクトファイルにあるので、dump_hashだけが設定されたままになる。
+ *  @param needs_dump ノードのIDとdump_hashを受け取って、状態を設定するかどうかを返す。空の場合はすべて設定する。
+ *  @param use_cache_while_editor_opened @sa Vst3AudioProcessor::GetDump()
+ */
+void AttachPluginDumps(Project *pj, schema::Project &schema,
+                       std::function<bool(UInt64 node_id, UInt64 dump_hash)> needs_dump = {},
+                       bool use_cache_while_editor_opened = false)
+{
+    std::unordered_map<UInt64, std::shared_ptr<Vst3AudioProcessor>> procs;
+    for(auto const &node: pj->GetGraph().GetNodes()) {
+        if(auto proc = std::dynamic_pointer_cast<Vst3AudioProcessor>(node->GetProcessor())) {
+            procs[node->GetID()] = proc;
+        }
+    }
+    
+    for(auto &node: *schema.mutable_graph()->mutable_nodes()) {
+        if(node.processor().has_vst3_data() == false) { continue; }
+        
+        auto vst3 = node.mutable_processor()->mutable_vst3_data();
+        if(vst3->has_dump() || vst3->dump_hash() == 0) { continue; }
+        if(needs_dump && needs_dump(node.id(), vst3->dump_hash()) == false) { continue; }
+        
+        auto found = procs.find(node.id());
+        if(found == procs.end()) { continue; }
+        
+        // 状態を取得するまでに変化していることがあるので、ハッシュ値も設定し直す。
+        UInt64 dump_hash = 0;
+        if(found->second->GetDump(*vst3->mutable_dump(), dump_hash, use_cache_while_editor_opened)) {
+            vst3->set_dump_hash(dump_hash);
+        } else {
+            vst3->clear_dump();
+        }
+    }
+}
+
 struct App::Impl
 {
     struct PluginListExporter
@@ -63,6 +118,8 @@ struct App::Impl
     PCKeyboardInput  pc_keys_;
     std::unique_ptr<AudioDeviceManager> adm_;
     std::unique_ptr<MidiDeviceManager> mdm_;
+    //! フリーズしたノードの出力を読み込む
+    std::unique_ptr<AudioFileStreamer> streamer_;
     std::vector<MidiDevice *> midi_ins_;
     std::vector<MidiDevice *> midi_outs_;
     ListenerService<ChangeProjectListener> cp_listeners_;
@@ -75,7 +132,34 @@ struct App::Impl
     ISplashScreen *splash_screen_ = nullptr;
     wxFrame *main_frame_ = nullptr;
     std::thread initialization_thread_;
+    //! OnExit()で、初期化スレッドの終了を待つ前に設定する。
+    std::atomic<bool> is_exiting_ { false };
     std::vector<String> vst3_paths_;
+    bool lazy_plugin_loading_ = false;
+    bool project_compression_enabled_ = true;
+    RealtimeThreadOptions realtime_thread_options_;
+    
+    //! 現在のプロジェクトの変更を記録する。
+    /*! プロジェクトの保存が完了したときにワーカースレッドから参照されるので、shared_ptrで保持する。
+     */
+    std::shared_ptr<ProjectAutosaver> autosaver_;
+    wxTimer autosave_timer_;
+    //! autosaver_に渡したプラグインの状態のハッシュ値（ノードのIDごと）
+    /*! ハッシュ値が変化していないプラグインの状態は、autosaver_が保持しているので、再び取得しなくてよい。
+     */
+    std::unordered_map<UInt64, UInt64> autosaved_dump_hashes_;
+    
+    //! 開いているプロジェクトファイルのリーダー
+    /*! まだロードされていないプラグインの状態は、保存するときにこのファイルから読み込む。
+     *  プラグインの状態を遅延して読み込むために、ファイルをマップしたままになっているので、
+     *  このファイルに上書き保存するときは、置き換える前にマップを解除する。
+     */
+    std::weak_ptr<ProjectContainerReader> project_file_reader_;
+    
+    //! プラグインスキャン用の子プロセスとして起動された場合に設定される
+    String scan_plugin_path_;
+    String scan_output_path_;
+    bool IsScanHelperMode() const { return scan_plugin_path_.empty() == false; }
     
     Impl()
     {
@@ -98,6 +182,11 @@ struct App::Impl
                 vst3_paths_.push_back(to_wstr(entry));
             }
         }
+        
+        lazy_plugin_loading_ = conf.lazy_plugin_loading();
+        project_compression_enabled_ = !conf.disable_project_compression();
+        realtime_thread_options_.cpu_mask_ = conf.audio_thread_cpu_mask();
+        realtime_thread_options_.lock_memory_ = conf.lock_memory_for_audio();
     }
     
     schema::Config SaveConfigImpl()
@@ -109,9 +198,95 @@ struct App::Impl
             paths->Add(to_utf8(entry));
         }
         
+        conf.set_lazy_plugin_loading(lazy_plugin_loading_);
+        conf.set_disable_project_compression(!project_compression_enabled_);
+        conf.set_audio_thread_cpu_mask(realtime_thread_options_.cpu_mask_);
+        conf.set_lock_memory_for_audio(realtime_thread_options_.lock_memory_);
+        
         return conf;
     }
     
+    //! 自動保存のファイル名（拡張子を除く）を返す。
+    /*! 保存されていないプロジェクトは、常に同じ名前になる。
+     */
+    static
+    String GetAutosavePathPrefix(wxFileName const &project_path)
+    {
+        String name = L"untitled";
+        if(project_path.IsOk()) {
+            auto const path = to_utf8(project_path.GetFullPath().ToStdWstring());
+            name = L"{:016x}"_format(FNV1a(kFNVOffsetBasis, path.begin(), path.end()));
+        }
+        
+        return GetTerraDir() + L"/autosave/" + name;
+    }
+    
+    void StartAutosave(Project *pj)
+    {
+        auto const last_schema = pj->GetLastSchema();
+        assert(last_schema);
+        autosaver_ = std::make_shared<ProjectAutosaver>(GetAutosavePathPrefix(pj->GetFullPath()), *last_schema);
+        
+        // 保存済みの状態はプラグインの状態を含まないので、最初の記録ですべて渡す。
+        autosaved_dump_hashes_.clear();
+    }
+    
+    //! 自動保存を終了して、記録したファイルを削除する。
+    /*! プロジェクトを閉じる前に保存するかどうかは確認されているので、記録は不要になる。
+     */
+    void StopAutosave()
+    {
+        if(!autosaver_) { return; }
+        
+        auto const path_prefix = autosaver_->GetPathPrefix();
+        autosaver_.reset();
+        ProjectAutosaver::RemoveRecoveryData(path_prefix);
+    }
+    
+    void OnAutosaveTimer()
+    {
+        auto pj = current_project_;
+        if(!pj || !autosaver_) { return; }
+        
+        // エディタでパラメータを操作している途中は、UIスレッドでの状態の取得で操作を妨げないように、次の機会まで記録を見送る。
+        auto const nodes = pj->GetGraph().GetNodes();
+        bool const is_editing = std::any_of(nodes.begin(), nodes.end(), [](auto const &node) {
+            auto proc = std::dynamic_pointer_cast<Vst3AudioProcessor>(node->GetProcessor());
+            return proc && proc->IsEditing();
+        });
+        if(is_editing) { return; }
+        
+        auto schema = pj->ToSchema();
+        cp_listeners_.Invoke([pj, &schema](ChangeProjectListener *li) {
+            li->OnBeforeSaveProject(pj, *schema);
+        });
+        
+        // 前回の記録から変化したプラグインの状態だけを取得する。
+        // まだロードされていないプラグインの状態は、復元するときにプロジェクトファイルから読み込む。
+        // エディタが開いていても、状態の変化が通知されていないプラグインからは状態を取得し直さない。
+        // （通知なしの変更は、エディタを閉じたあとの記録に含まれる）
+        AttachPluginDumps(pj, *schema, [this](UInt64 node_id, UInt64 dump_hash) {
+            auto found = autosaved_dump_hashes_.find(node_id);
+            return found == autosaved_dump_hashes_.end() || found->second != dump_hash;
+        }, true);
+        
+        std::unordered_map<UInt64, UInt64> dump_hashes;
+        for(auto const &node: schema->graph().nodes()) {
+            auto const &proc = node.processor();
+            if(proc.has_vst3_data() == false) { continue; }
+            
+            auto found = autosaved_dump_hashes_.find(node.id());
+            if(proc.vst3_data().has_dump()) {
+                dump_hashes[node.id()] = proc.vst3_data().dump_hash();
+            } else if(found != autosaved_dump_hashes_.end() && found->second == proc.vst3_data().dump_hash()) {
+                dump_hashes[node.id()] = found->second;
+            }
+        }
+        autosaved_dump_hashes_ = std::move(dump_hashes);
+        
+        autosaver_->Record(std::move(schema));
+    }
+    
     bool LoadConfig()
     {
         // コンフィグファイルなし
@@ -136,6 +311,145 @@ struct App::Impl
         return true;
     }
     
+    void ReportProgress(String msg)
+    {
+        TERRA_INFO_LOG(msg);
+        if(splash_screen_) {
+            splash_screen_->AddMessage(msg);
+        }
+    }
+    
+    //! グラフ内のまだロードされていないプラグインのリストを返す。
+    /*! @param only_audible trueの場合は、グラフの出力（AudioOutput, MidiOutput）に
+     *  直接または間接的に接続されているプラグインだけを返す。
+     *  ミキサーのミュートされた入力（ほかの入力のソロによるミュートを含む）を経由してしか出力に届かないプラグインは、
+     *  聞こえないので含めない。
+     */
+    static
+    std::vector<std::shared_ptr<Processor>> CollectUnloadedPlugins(GraphProcessor &graph, bool only_audible)
+    {
+        std::vector<GraphProcessor::Node const *> stack;
+        for(UInt32 i = 0, end = graph.GetNumAudioOutputs(); i < end; ++i) {
+            if(auto node = graph.GetNodeOf(graph.GetAudioOutput(i))) { stack.push_back(node.get()); }
+        }
+        for(UInt32 i = 0, end = graph.GetNumMidiOutputs(); i < end; ++i) {
+            if(auto node = graph.GetNodeOf(graph.GetMidiOutput(i))) { stack.push_back(node.get()); }
+        }
+        
+        // ミキサーの入力iには、 2*i / 2*i+1 番目のチャンネルが対応する。
+        auto is_muted_by_mixer = [](MixerProcessor const &mixer, GraphProcessor::AudioConnection const &conn) {
+            for(UInt32 ch = 0; ch < conn.num_channels_; ++ch) {
+                auto const input_index = (conn.downstream_channel_index_ + ch) / 2;
+                if(input_index < mixer.GetNumInputs() && mixer.IsEffectivelyMuted(input_index) == false) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        
+        // 出力から上流へたどって、聞こえるノードを集める。
+        std::set<GraphProcessor::Node const *> audible_nodes;
+        while(stack.empty() == false) {
+            auto node = stack.back();
+            stack.pop_back();
+            if(audible_nodes.insert(node).second == false) { continue; }
+            
+            auto proc = node->GetProcessor();
+            auto mixer = dynamic_cast<MixerProcessor const *>(proc.get());
+            for(auto const &conn: node->GetAudioConnections(BusDirection::kInputSide)) {
+                if(mixer && is_muted_by_mixer(*mixer, *conn)) { continue; }
+                stack.push_back(conn->upstream_);
+            }
+            for(auto const &conn: node->GetMidiConnections(BusDirection::kInputSide)) {
+                stack.push_back(conn->upstream_);
+            }
+        }
+        
+        auto is_audible = [&audible_nodes](GraphProcessor::Node const *node) {
+            return audible_nodes.count(node) > 0;
+        };
+        
+        std::vector<std::shared_ptr<Processor>> list;
+        for(auto &node: graph.GetNodes()) {
+            auto proc = node->GetProcessor();
+            auto plugin = dynamic_cast<PluginAudioProcessor *>(proc.get());
+            if(!plugin || plugin->IsLoaded()) { continue; }
+            // フリーズによって処理されていないプラグインは、フリーズを解除するときにロードされる。
+            if(graph.IsFrozen(node.get()) || graph.IsBypassedByFreeze(node.get())) { continue; }
+            if(only_audible && !is_audible(node.get())) { continue; }
+            
+            list.push_back(proc);
+        }
+        
+        return list;
+    }
+    
+    //! プラグインのロードに必要なファイルの読み込みを、まとめて行う。
+    /*! モジュールのロードと、遅延して読み込むように設定されたプラグインの状態の読み込みを、
+     *  並列に行う。プラグインの生成は行わないので、メインスレッド以外から呼び出してもよい。
+     *  この後で、メインスレッドからLoadPlugins()を呼び出す。
+     */
+    void PrepareToLoadPlugins(std::vector<std::shared_ptr<Processor>> const &procs)
+    {
+        std::set<std::string> module_paths;
+        std::vector<PluginAudioProcessor *> plugins;
+        
+        for(auto &proc: procs) {
+            auto plugin = dynamic_cast<PluginAudioProcessor *>(proc.get());
+            if(!plugin) { continue; }
+            
+            module_paths.insert(plugin->GetDescription().vst3info().filepath());
+            plugins.push_back(plugin);
+        }
+        
+        if(plugins.empty()) { return; }
+        
+        std::vector<std::string> module_list(module_paths.begin(), module_paths.end());
+        ReportProgress(L"Load {} plugin modules"_format(module_list.size()));
+        ParallelFor(module_list.size(), [&](size_t i) {
+            try {
+                factory_list_.FindOrCreateFactory(to_wstr(module_list[i]));
+            } catch(std::exception &e) {
+                // ロードに失敗したことは、LoadPlugins()でプラグインを生成するときに報告する。
+                TERRA_WARN_LOG(L"Failed to load the module {}: {}"_format(to_wstr(module_list[i]), to_wstr(e.what())));
+            }
+        });
+        
+        ReportProgress(L"Read {} plugin states"_format(plugins.size()));
+        ParallelFor(plugins.size(), [&](size_t i) {
+            plugins[i]->PrepareToLoad();
+        });
+    }
+    
+    //! プラグインをまとめてロードする。
+    /*! VST3では、プラグインの生成と状態の復元はメインスレッドで行う必要があるので、
+     *  メインスレッドから呼び出すこと。
+     *  ファイルの読み込みは、先にPrepareToLoadPlugins()で済ませておく。
+     *  @return ロードに失敗したプラグインのエラーメッセージのリスト
+     */
+    std::vector<String> LoadPlugins(std::vector<std::shared_ptr<Processor>> const &procs)
+    {
+        assert(wxIsMainThread());
+        
+        std::vector<PluginAudioProcessor *> plugins;
+        for(auto &proc: procs) {
+            auto plugin = dynamic_cast<PluginAudioProcessor *>(proc.get());
+            if(plugin && plugin->IsLoaded() == false) { plugins.push_back(plugin); }
+        }
+        
+        std::vector<String> errors;
+        for(size_t i = 0; i < plugins.size(); ++i) {
+            auto const result = plugins[i]->Load();
+            if(!result) {
+                errors.push_back(L"Failed to reload {}"_format(plugins[i]->GetName()));
+            }
+            
+            ReportProgress(L"Load plugins ({}/{})"_format(i+1, plugins.size()));
+        }
+        
+        return errors;
+    }
+    
     bool SaveConfig()
     {
         auto conf = SaveConfigImpl();
@@ -156,6 +470,248 @@ struct App::Impl
         
         return true;
     }
+    
+    //! 遅延ロードが有効な場合に、出力に接続されたプラグインをバックグラウンドでロードする。
+    /*! 現在のプロジェクトのグラフに接続が追加されるたびに、出力に到達可能になった未ロードのプラグインをロードする。
+     *  ファイルの読み込みはワーカースレッドで行い、プラグインの生成と状態の復元はメインスレッドで行う。
+     *  PluginAudioProcessorは、状態を復元してからプラグインを差し替えるので、
+     *  ロード中も再生が途切れることはない。
+     */
+    class LazyPluginLoader
+    :   public App::ChangeProjectListener
+    ,   public GraphProcessor::Listener
+    {
+    public:
+        LazyPluginLoader(Impl *owner)
+        :   owner_(owner)
+        {
+            owner_->cp_listeners_.AddListener(this);
+            th_ = std::thread([this] { Run(); });
+        }
+        
+        ~LazyPluginLoader()
+        {
+            owner_->cp_listeners_.RemoveListener(this);
+            if(graph_) { graph_->GetListeners().RemoveListener(this); }
+            
+            {
+                auto lock = std::unique_lock<std::mutex>(mtx_);
+                queue_.clear();
+                should_stop_ = true;
+            }
+            cv_.notify_all();
+            th_.join();
+        }
+        
+        void OnChangeCurrentProject(Project *prev_pj, Project *new_pj) override
+        {
+            if(graph_) { graph_->GetListeners().RemoveListener(this); }
+            graph_ = (new_pj ? &new_pj->GetGraph() : nullptr);
+            if(graph_) { graph_->GetListeners().AddListener(this); }
+            
+            auto lock = std::unique_lock<std::mutex>(mtx_);
+            queue_.clear();
+        }
+        
+        void OnAfterConnectionIsAdded(GraphProcessor::Connection const *conn) override
+        {
+            Update();
+        }
+        
+        //! 出力に聞こえるようになった未ロードのプラグインを、ロードの待ち行列に追加する。
+        void Update()
+        {
+            if(owner_->lazy_plugin_loading_ == false || !graph_) { return; }
+            
+            auto procs = CollectUnloadedPlugins(*graph_, true);
+            if(procs.empty()) { return; }
+            
+            {
+                auto lock = std::unique_lock<std::mutex>(mtx_);
+                for(auto &proc: procs) {
+                    if(std::find(queue_.begin(), queue_.end(), proc) == queue_.end()) {
+                        queue_.push_back(proc);
+                    }
+                }
+            }
+            cv_.notify_all();
+        }
+        
+    private:
+        Impl *owner_ = nullptr;
+        GraphProcessor *graph_ = nullptr;
+        std::thread th_;
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::deque<std::shared_ptr<Processor>> queue_;
+        bool should_stop_ = false;
+        
+        void Run()
+        {
+            for( ; ; ) {
+                std::vector<std::shared_ptr<Processor>> procs;
+                {
+                    auto lock = std::unique_lock<std::mutex>(mtx_);
+                    cv_.wait(lock, [this] { return should_stop_ || queue_.empty() == false; });
+                    if(should_stop_) { return; }
+                    
+                    procs.assign(queue_.begin(), queue_.end());
+                    queue_.clear();
+                }
+                
+                owner_->PrepareToLoadPlugins(procs);
+                
+                // プラグインの生成と状態の復元は、メインスレッドでまとめて行う。
+                // （デストラクタがメインスレッドでこのスレッドの終了を待つので、完了は待たない）
+                wxTheApp->CallAfter([owner = owner_, procs] {
+                    auto errors = owner->LoadPlugins(procs);
+                    if(errors.empty()) { return; }
+                    
+                    String msg;
+                    for(auto const &e: errors) { msg += e + L"\n"; }
+                    wxMessageBox(msg);
+                });
+            }
+        }
+    };
+    
+    std::unique_ptr<LazyPluginLoader> lazy_plugin_loader_;
+    
+    //! プロジェクトのシリアライズとファイルへの書き込みをバックグラウンドで行う。
+    /*! 書き込みは一時ファイルに行い、完了してから元のファイルと置き換えるので、
+     *  書き込み中にアプリケーションが終了しても、以前に保存したファイルが壊れることはない。
+     *  シリアライズした結果が前回書き込んだ内容と同じ場合は、書き込みを省略する。
+     */
+    class ProjectWriter
+    {
+    public:
+        ProjectWriter()
+        {
+            th_ = std::thread([this] { Run(); });
+        }
+        
+        ~ProjectWriter()
+        {
+            {
+                auto lock = std::unique_lock<std::mutex>(mtx_);
+                should_stop_ = true;
+            }
+            cv_.notify_all();
+            th_.join();
+        }
+        
+        //! @param compress プラグインの状態などのデータを圧縮して保存するかどうか
+        //! @param on_written 書き込みが完了したときにワーカースレッドから呼び出される。
+        //! @param dump_source schemaにdump_hashだけが設定されているプラグインの状態を読み込むファイル。
+        //! pathと同じファイルの場合は、ファイルを置き換える前にマップを解除する。
+        void Write(String path, std::unique_ptr<schema::Project> schema, bool compress,
+                   std::function<void(schema::Project const &)> on_written = {},
+                   std::shared_ptr<ProjectContainerReader> dump_source = nullptr)
+        {
+            {
+                auto lock = std::unique_lock<std::mutex>(mtx_);
+                // 同じファイルへの書き込みが溜まっている場合は、最新のものだけを書き込めばよい。
+                auto found = std::find_if(queue_.begin(), queue_.end(),
+                                          [&path](auto const &entry) { return entry.path_ == path; });
+                if(found != queue_.end()) {
+                    found->schema_ = std::move(schema);
+                    found->compress_ = compress;
+                    found->on_written_ = std::move(on_written);
+                    found->dump_source_ = std::move(dump_source);
+                } else {
+                    queue_.push_back({ std::move(path), std::move(schema), compress,
+                                       std::move(on_written), std::move(dump_source) });
+                }
+            }
+            cv_.notify_all();
+        }
+        
+    private:
+        struct Entry
+        {
+            String path_;
+            std::unique_ptr<schema::Project> schema_;
+            bool compress_ = true;
+            std::function<void(schema::Project const &)> on_written_;
+            std::shared_ptr<ProjectContainerReader> dump_source_;
+        };
+        
+        std::thread th_;
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::deque<Entry> queue_;
+        bool should_stop_ = false;
+        std::map<String, UInt64> last_written_hashes_;
+        
+        void Run()
+        {
+            for( ; ; ) {
+                Entry entry;
+                {
+                    auto lock = std::unique_lock<std::mutex>(mtx_);
+                    cv_.wait(lock, [this] { return should_stop_ || queue_.empty() == false; });
+                    // 終了時も、積まれている書き込みは完了させる。
+                    if(queue_.empty()) { return; }
+                    
+                    entry = std::move(queue_.front());
+                    queue_.pop_front();
+                }
+                
+                auto const error = WriteToFile(entry);
+                if(error.empty() && entry.on_written_) {
+                    entry.on_written_(*entry.schema_);
+                }
+                
+                if(error.empty() == false) {
+                    wxTheApp->CallAfter([error] { wxMessageBox(error, "Error", wxOK); });
+                }
+            }
+        }
+        
+        //! @return エラーメッセージ。成功した場合は空文字列
+        String WriteToFile(Entry &entry)
+        {
+            if(entry.dump_source_ && entry.dump_source_->ReadPluginDumps(*entry.schema_) == false) {
+                return L"Failed to read the plugin states from: " + entry.dump_source_->GetPath();
+            }
+            
+            std::string data;
+            if(ProjectContainer::Serialize(*entry.schema_, data, entry.compress_) == false) {
+                return L"Failed to serialize the project: " + entry.path_;
+            }
+            
+            auto const hash = FNV1a(kFNVOffsetBasis, data.begin(), data.end());
+            auto found = last_written_hashes_.find(entry.path_);
+            if(found != last_written_hashes_.end() && found->second == hash && wxFileExists(entry.path_)) {
+                return String();
+            }
+            
+            auto const tmp_path = entry.path_ + L".tmp";
+            {
+                auto ofs = open_ofstream(tmp_path, std::ios::out|std::ios::binary|std::ios::trunc);
+                ofs.write(data.data(), data.size());
+                ofs.close();
+                if(!ofs) {
+                    wxRemoveFile(tmp_path);
+                    return L"Failed to write the project: " + entry.path_;
+                }
+            }
+            
+            if(entry.dump_source_ && entry.dump_source_->GetPath() == entry.path_) {
+                entry.dump_source_->ReleaseFile();
+            }
+            
+            if(wxRenameFile(tmp_path, entry.path_, true) == false) {
+                wxRemoveFile(tmp_path);
+                return L"Failed to replace the project file: " + entry.path_;
+            }
+            
+            last_written_hashes_[entry.path_] = hash;
+            return String();
+        }
+    };
+    
+    std::unique_ptr<ProjectWriter> project_writer_;
 };
 
 App::App()
@@ -171,6 +727,9 @@ bool App::OnInit()
 {
     if(!wxApp::OnInit()) { return false; }
     
+    // プラグインスキャン用の子プロセスとして起動された場合は、OnRun()でスキャンだけを行う。
+    if(pimpl_->IsScanHelperMode()) { return true; }
+    
     wxInitAllImageHandlers();
     
     auto image = GetResourceAs<wxImage>(L"SplashScreen.png");
@@ -195,6 +754,9 @@ bool App::OnInit()
     
     // コンフィグデータの読み込み
     pimpl_->LoadConfig();
+    pimpl_->lazy_plugin_loader_ = std::make_unique<Impl::LazyPluginLoader>(pimpl_.get());
+    pimpl_->project_writer_ = std::make_unique<Impl::ProjectWriter>();
+    pimpl_->streamer_ = std::make_unique<AudioFileStreamer>();
     
     pimpl_->plugin_scanner_.SetDirectories(GetVst3PluginSearchPaths());
     
@@ -212,12 +774,13 @@ bool App::OnInit()
         pimpl_->plugin_scanner_.Import(dump_data);
         
         pimpl_->splash_screen_->AddMessage(L"Import plugin list");
-    } else {
-        TERRA_INFO_LOG(L"Begin plugin scanning asynchronously");
-        pimpl_->plugin_scanner_.ScanAsync();
-        pimpl_->splash_screen_->AddMessage(L"Scanning plugins...");
     }
     
+    // インポートしたスキャン結果から変更のあったモジュールだけがスキャンされる。
+    TERRA_INFO_LOG(L"Begin plugin scanning asynchronously");
+    pimpl_->plugin_scanner_.ScanAsync();
+    pimpl_->splash_screen_->AddMessage(L"Scanning plugins...");
+    
     pimpl_->initialization_thread_ = std::thread([this] { OnInitImpl(); });
     
     return true;
@@ -234,6 +797,7 @@ void App::OnInitImpl()
     
     pimpl_->adm_ = std::make_unique<AudioDeviceManager>();
     auto adm = pimpl_->adm_.get();
+    adm->SetRealtimeThreadOptions(pimpl_->realtime_thread_options_);
     
     auto audio_device_infos = adm->Enumerate();
     for(auto const &info: audio_device_infos) {
@@ -331,17 +895,44 @@ void App::OnInitImpl()
         if(pimpl_->initialization_thread_.joinable()) {
             pimpl_->initialization_thread_.join();
         }
+        
+        RecoverUntitledProject();
+        
+        pimpl_->autosave_timer_.Bind(wxEVT_TIMER, [this](wxTimerEvent &) { pimpl_->OnAutosaveTimer(); });
+        pimpl_->autosave_timer_.Start(kAutosaveInterval);
     });
 }
 
+int App::OnRun()
+{
+    if(pimpl_->IsScanHelperMode()) {
+        bool const successful = PluginScanner::ScanModuleAndExport(pimpl_->scan_plugin_path_,
+                                                                   pimpl_->scan_output_path_);
+        return successful ? 0 : 1;
+    }
+    
+    return wxApp::OnRun();
+}
+
 int App::OnExit()
 {
+    if(pimpl_->IsScanHelperMode()) {
+        return 0;
+    }
+    
+    pimpl_->is_exiting_ = true;
     if(pimpl_->initialization_thread_.joinable()) {
         pimpl_->initialization_thread_.join();
     }
     
+    pimpl_->autosave_timer_.Stop();
+    pimpl_->lazy_plugin_loader_.reset();
+    pimpl_->project_writer_.reset();
+    pimpl_->StopAutosave();
+    
     SetCurrentProject(nullptr);
     pimpl_->projects_.clear();
+    pimpl_->streamer_.reset();
     
     for(auto d: pimpl_->midi_ins_) { pimpl_->mdm_->Close(d); }
     for(auto d: pimpl_->midi_outs_) { pimpl_->mdm_->Close(d); }
@@ -410,6 +1001,7 @@ void App::ForceRescanPlugins()
 {
     pimpl_->plugin_scanner_.Abort();
     pimpl_->plugin_scanner_.ClearPluginDescriptions();
+    pimpl_->plugin_scanner_.ClearBlacklist();
     pimpl_->plugin_scanner_.ScanAsync();
 }
 
@@ -521,6 +1113,7 @@ std::unique_ptr<Project> App::CreateInitialProject()
 
 void App::ReplaceProject(std::unique_ptr<Project> pj)
 {
+    pimpl_->StopAutosave();
     SetCurrentProject(nullptr);
     pimpl_->projects_.clear();
     
@@ -529,13 +1122,46 @@ void App::ReplaceProject(std::unique_ptr<Project> pj)
     
     SetCurrentProject(p);
     auto &graph = p->GetGraph();
-    for(auto &node: graph.GetNodes()) {
-        if(auto vst3 = dynamic_cast<Vst3AudioProcessor *>(node->GetProcessor().get())) {
-            auto result = vst3->Load();
-            if(!result) {
-                wxMessageBox(L"Failed to reload {}"_format(vst3->GetName()));
-            }
+    
+    // 遅延ロードが有効な場合、出力に接続されていないプラグインは、
+    // 接続されたときにLazyPluginLoaderによってロードされる。
+    auto const procs = Impl::CollectUnloadedPlugins(graph, pimpl_->lazy_plugin_loading_);
+    
+    // ファイルの読み込みはワーカースレッドで行い、プラグインの生成と状態の復元はメインスレッドで行う。
+    std::vector<String> errors;
+    if(wxIsMainThread()) {
+        // 読み込みの間もUIが応答するように、イベントを処理しながら完了を待つ。
+        std::atomic<bool> done { false };
+        std::thread th([&] {
+            pimpl_->PrepareToLoadPlugins(procs);
+            done = true;
+        });
+        
+        while(done.load() == false) {
+            wxSafeYield(nullptr, true);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
         }
+        th.join();
+        
+        errors = pimpl_->LoadPlugins(procs);
+    } else {
+        pimpl_->PrepareToLoadPlugins(procs);
+        
+        // 初期化スレッドから呼び出された場合は、メインスレッドでのロードの完了を待つ。
+        // ただし、OnExit()がこのスレッドの終了を待っている場合は、メインスレッドでロードが行われないので、待つのをやめる。
+        auto loaded = std::make_shared<std::promise<std::vector<String>>>();
+        auto future = loaded->get_future();
+        CallAfter([this, procs, loaded] { loaded->set_value(pimpl_->LoadPlugins(procs)); });
+        while(future.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready) {
+            if(pimpl_->is_exiting_) { return; }
+        }
+        errors = future.get();
+    }
+    
+    if(errors.empty() == false) {
+        String msg;
+        for(auto const &e: errors) { msg += e + L"\n"; }
+        wxMessageBox(msg);
     }
     
     pimpl_->cp_listeners_.Invoke([p](ChangeProjectListener *li) {
@@ -551,6 +1177,7 @@ void App::ReplaceProject(std::unique_ptr<Project> pj)
     });
     
     p->UpdateLastSchema(std::move(schema));
+    pimpl_->StartAutosave(p);
     
     auto windows_title = wxFileName(p->GetFileName()).GetName();
     if(windows_title.empty()) {
@@ -585,27 +1212,8 @@ void App::OnFileOpen()
         return;
     }
     
-    auto file = dlg.GetPath();
-    std::ifstream is(file.ToStdString().c_str());
-    
-    auto schema = std::make_unique<schema::Project>();
-
-    bool successful = schema->ParseFromIstream(&is);
-    if(!successful) {
-        wxMessageBox(L"Failed to load file [{}]"_format(file.ToStdWstring()));
-        return;
-    }
-    
-    ProjectObjectTable scoped_objects;
-    
-    auto new_pj = Project::FromSchema(*schema);
-    assert(new_pj);
-    
-    new_pj->UpdateLastSchema(std::move(schema));
-    new_pj->SetFileName(wxFileName(file).GetFullName().ToStdWstring());
-    new_pj->SetProjectDirectory(wxFileName(wxFileName(file).GetPath(), ""));
-
-    ReplaceProject(std::move(new_pj));
+    // 自動保存の記録が残っている場合は、LoadProject()で復元するかどうかを確認する。
+    LoadProject(dlg.GetPath().ToStdWstring());
 }
 
 wxFileName SelectFileToSave(Project const *pj)
@@ -642,6 +1250,10 @@ bool App::OnFileSave(bool force_save_as, bool need_to_confirm_for_closing)
     auto pj = Project::GetCurrentProject();
     if(!pj) { return true; }
     
+    // スキーマを作成した後に、まだロードされていないプラグインがロードされて
+    // ファイルが閉じられることがないように、先に参照を取得しておく。
+    auto dump_source = pimpl_->project_file_reader_.lock();
+    
     auto schema = pj->ToSchema();
     assert(schema);
     
@@ -694,44 +1306,188 @@ bool App::OnFileSave(bool force_save_as, bool need_to_confirm_for_closing)
     pj->SetProjectDirectory(wxFileName(path.GetPath(), ""));
     schema->set_name(path.GetFullName());
     
-    std::ofstream os(path.GetFullPath().ToStdString());
-    schema->SerializeToOstream(&os);
+    // シリアライズとファイルへの書き込みは、UIを止めないようにバックグラウンドで行う。
+    // 書き込みが完了したら、それまでの自動保存の記録は不要になる。
+    // また、書き込みに成功するまでは保存済みとしない。
+    // （失敗した場合に、変更がないとみなされて保存や終了時の確認が省略されないように）
+    std::shared_ptr<schema::Project const> last_schema = std::move(schema);
+    auto on_written = [autosaver = std::weak_ptr<ProjectAutosaver>(pimpl_->autosaver_),
+                       path_prefix = Impl::GetAutosavePathPrefix(path),
+                       pj, path, last_schema](schema::Project const &saved)
+    {
+        if(auto p = autosaver.lock()) { p->OnSaved(path_prefix, saved); }
+        
+        wxTheApp->CallAfter([pj, path, last_schema] {
+            // 書き込み中にプロジェクトが閉じられた場合は何もしない。
+            if(Project::GetCurrentProject() != pj || pj->GetFullPath() != path) { return; }
+            pj->UpdateLastSchema(std::make_unique<schema::Project>(*last_schema));
+        });
+    };
     
-    pj->UpdateLastSchema(std::move(schema));
+    // last_schemaはプラグインの状態のハッシュ値だけを持っているので、保存済みの状態として比較に使う。
+    auto saved = std::make_unique<schema::Project>(*last_schema);
+    AttachPluginDumps(pj, *saved);
+    
+    pimpl_->project_writer_->Write(path.GetFullPath().ToStdWstring(),
+                                   std::move(saved),
+                                   pimpl_->project_compression_enabled_,
+                                   on_written,
+                                   dump_source);
     
     return true;
 }
 
-void App::LoadProject(String path)
+//! プラグインの状態を、プラグインをロードするときにファイルから読み込むように設定する。
+/*! dump_hashだけが設定されているプラグインの状態を、そのハッシュ値でファイルから探す。
+ *  ProjectObjectTableに、schemaから作成したノードが登録されている必要がある。
+ */
+void SetPluginDumpLoaders(schema::Project const &schema, std::shared_ptr<ProjectContainerReader> reader)
 {
-#if defined(_MSC_VER)
-    std::ifstream is(path.c_str());
-#else
-    std::ifstream is(to_utf8(path));
-#endif
-    if(is.fail()) {
-        wxMessageBox(L"Cannot open file [{}]"_format(path));
-        return;
+    auto objs = ProjectObjectTable::GetInstance();
+    for(auto const &schema_node: schema.graph().nodes()) {
+        auto const &proc_schema = schema_node.processor();
+        if(proc_schema.has_vst3_data() == false) { continue; }
+        
+        auto const &vst3 = proc_schema.vst3_data();
+        if(vst3.has_dump() || vst3.dump_hash() == 0) { continue; }
+        
+        auto node = objs->nodes_.Find(schema_node.id());
+        if(!node) { continue; }
+        
+        auto proc = std::dynamic_pointer_cast<Vst3AudioProcessor>(node->GetProcessor());
+        if(!proc) { continue; }
+        
+        auto const dump_hash = vst3.dump_hash();
+        proc->SetDumpLoader([reader, dump_hash](schema::Processor::Vst3::Dump &dump) {
+            return reader->ReadPluginDumpWithHash(dump_hash, dump);
+        });
+    }
+}
+
+//! 復元したプロジェクトのうち、プロジェクトファイルに状態が見つからないプラグインのdump_hashを取り除く。
+/*! 自動保存の記録は、ロードされていないプラグインの状態をdump_hashだけで参照している。
+ *  記録した後にプロジェクトファイルが変更されていた場合は、その状態は復元できない。
+ */
+void RemoveMissingPluginDumps(schema::Project &recovered, ProjectContainerReader const *reader)
+{
+    for(auto &node: *recovered.mutable_graph()->mutable_nodes()) {
+        if(node.processor().has_vst3_data() == false) { continue; }
+        
+        auto vst3 = node.mutable_processor()->mutable_vst3_data();
+        if(vst3->has_dump() || vst3->dump_hash() == 0) { continue; }
+        if(reader && reader->HasPluginDumpWithHash(vst3->dump_hash())) { continue; }
+        
+        TERRA_WARN_LOG(L"The state of the plugin is not found in the project file: "
+                       << to_wstr(vst3->desc().name()));
+        vst3->clear_dump_hash();
     }
+}
+
+void App::LoadProject(String path)
+{
+    std::unique_ptr<schema::Project> schema;
     
-    auto schema = std::make_unique<schema::Project>();
+    // 保存するときに同じファイルかどうかを判定できるように、パスを正規化しておく。
+    path = wxFileName(path).GetFullPath().ToStdWstring();
+    
+    // セクションに分割された形式の場合は、プラグインの状態を除いた部分だけを先に読み込む。
+    std::shared_ptr<ProjectContainerReader> reader = ProjectContainerReader::Open(path);
+    if(reader) {
+        schema = reader->ReadProject();
+    } else {
+        auto is = open_ifstream(path, std::ios::in|std::ios::binary);
+        if(is.fail()) {
+            wxMessageBox(L"Cannot open file [{}]"_format(path));
+            return;
+        }
+        
+        schema = std::make_unique<schema::Project>();
+        if(schema->ParseFromIstream(&is) == false) {
+            schema.reset();
+        }
+    }
     
-    bool successful = schema->ParseFromIstream(&is);
-    if(!successful) {
+    if(!schema) {
         wxMessageBox(L"Failed to load file [{}]"_format(path));
         return;
     }
     
+    auto recovered = RecoverProject(Impl::GetAutosavePathPrefix(wxFileName(path)));
+    if(recovered) {
+        RemoveMissingPluginDumps(*recovered, reader.get());
+    }
+    
     ProjectObjectTable scoped_objects;
     
-    auto new_pj = Project::FromSchema(*schema);
+    auto new_pj = Project::FromSchema(recovered ? *recovered : *schema);
     assert(new_pj);
     
-    new_pj->UpdateLastSchema(std::move(schema));
+    // 復元した状態にも、ロードされていなかったプラグインの状態は含まれていない。
+    if(reader) {
+        SetPluginDumpLoaders(recovered ? *recovered : *schema, reader);
+    }
+    
+    // プラグインの状態の読み込みに使われない場合は、readerはこの関数を抜けると破棄される。
+    pimpl_->project_file_reader_ = reader;
+    
+    auto p = new_pj.get();
+    new_pj->UpdateLastSchema(std::make_unique<schema::Project>(*schema));
     new_pj->SetFileName(wxFileName(path).GetFullName().ToStdWstring());
     new_pj->SetProjectDirectory(wxFileName(wxFileName(path).GetPath(), ""));
     
     ReplaceProject(std::move(new_pj));
+    
+    if(recovered) {
+        // 復元した状態は保存されていないので、ファイルの内容を保存済みの状態とする。
+        ProjectContainer::StripPluginDumps(*schema);
+        p->UpdateLastSchema(std::move(schema));
+        pimpl_->StartAutosave(p);
+    }
+}
+
+std::unique_ptr<schema::Project> App::RecoverProject(String const &autosave_path_prefix)
+{
+    if(ProjectAutosaver::HasRecoveryData(autosave_path_prefix) == false) {
+        return nullptr;
+    }
+    
+    wxMessageDialog dlg(nullptr,
+                        "This project was not closed properly. Do you want to recover the unsaved changes?",
+                        "Recover",
+                        wxYES_NO|wxCENTER);
+    dlg.SetYesNoLabels("Recover", "Discard");
+    if(dlg.ShowModal() != wxID_YES) {
+        ProjectAutosaver::RemoveRecoveryData(autosave_path_prefix);
+        return nullptr;
+    }
+    
+    auto recovered = ProjectAutosaver::Recover(autosave_path_prefix);
+    if(!recovered) {
+        wxMessageBox("Failed to recover the project.");
+    }
+    
+    return recovered;
+}
+
+void App::RecoverUntitledProject()
+{
+    auto recovered = RecoverProject(Impl::GetAutosavePathPrefix(wxFileName()));
+    if(!recovered) { return; }
+    
+    RemoveMissingPluginDumps(*recovered, nullptr);
+    
+    ProjectObjectTable scoped_objects;
+    
+    auto new_pj = Project::FromSchema(*recovered);
+    assert(new_pj);
+    
+    auto p = new_pj.get();
+    new_pj->UpdateLastSchema(std::move(recovered));
+    ReplaceProject(std::move(new_pj));
+    
+    // 復元した状態は保存されていないので、空のプロジェクトを保存済みの状態とする。
+    p->UpdateLastSchema(std::make_unique<schema::Project>());
+    pimpl_->StartAutosave(p);
 }
 
 void App::ImportFile(String path)
@@ -795,11 +1551,42 @@ void App::SetVst3PluginSearchPaths(std::vector<String> new_list)
     pimpl_->SaveConfig();
 }
 
+bool App::IsLazyPluginLoadingEnabled() const
+{
+    return pimpl_->lazy_plugin_loading_;
+}
+
+void App::SetLazyPluginLoadingEnabled(bool enable)
+{
+    pimpl_->lazy_plugin_loading_ = enable;
+    pimpl_->SaveConfig();
+}
+
+void App::UpdateLazyPluginLoading()
+{
+    if(pimpl_->lazy_plugin_loader_) {
+        pimpl_->lazy_plugin_loader_->Update();
+    }
+}
+
+bool App::IsProjectCompressionEnabled() const
+{
+    return pimpl_->project_compression_enabled_;
+}
+
+void App::SetProjectCompressionEnabled(bool enable)
+{
+    pimpl_->project_compression_enabled_ = enable;
+    pimpl_->SaveConfig();
+}
+
 namespace {
     wxCmdLineEntryDesc const cmdline_descs [] =
     {
         { wxCMD_LINE_SWITCH, "h", "help", "show help", wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
         { wxCMD_LINE_OPTION, "l", "logging-level", "set logging level to (Error|Warn|Info|Debug). the default value is \"Info\"", wxCMD_LINE_VAL_STRING, 0 },
+        { wxCMD_LINE_OPTION, nullptr, "scan-plugin", "(internal) scan the specified plugin module and exit", wxCMD_LINE_VAL_STRING, wxCMD_LINE_HIDDEN },
+        { wxCMD_LINE_OPTION, nullptr, "scan-output", "(internal) the file path to write the scanning result", wxCMD_LINE_VAL_STRING, wxCMD_LINE_HIDDEN },
         { wxCMD_LINE_NONE },
     };
 }
@@ -818,6 +1605,12 @@ bool App::OnCmdLineParsed(wxCmdLineParser& parser)
     level = level.Capitalize();
     logger->SetMostDetailedActiveLoggingLevel(level.ToStdWstring());
     
+    wxString scan_plugin, scan_output;
+    if(parser.Found("scan-plugin", &scan_plugin) && parser.Found("scan-output", &scan_output)) {
+        pimpl_->scan_plugin_path_ = scan_plugin.ToStdWstring();
+        pimpl_->scan_output_path_ = scan_output.ToStdWstring();
+    }
+    
     return true;
 }
 
@@ -24,6 +24,7 @@ public:
     using SingleInstance<App>::GetInstance;
     
     bool OnInit() override;
+    int OnRun() override;
     int OnExit() override;
     
     //! do initialization in the dedicated thread
@@ -91,6 +92,19 @@ public:
     std::vector<String> GetVst3PluginSearchPaths() const;
     void SetVst3PluginSearchPaths(std::vector<String> new_list);
     
+    //! 出力に接続されていないプラグインのロードを、接続されるまで遅延させるかどうか
+    bool IsLazyPluginLoadingEnabled() const;
+    void SetLazyPluginLoadingEnabled(bool enable);
+    
+    //! 接続の変更以外で、プラグインが出力に聞こえるかどうかが変わったときに呼び出す。（ミキサーのミュートやソロ）
+    /*! 遅延ロードが有効な場合は、聞こえるようになったプラグインをロードする。メインスレッドから呼び出すこと。
+     */
+    void UpdateLazyPluginLoading();
+    
+    //! プロジェクトファイルを圧縮して保存するかどうか
+    bool IsProjectCompressionEnabled() const;
+    void SetProjectCompressionEnabled(bool enable);
+    
 private:
     struct Impl;
     std::unique_ptr<Impl> pimpl_;
@@ -99,6 +113,13 @@ private:
     //! multiple project is not supported yet.
     void ReplaceProject(std::unique_ptr<Project> pj);
     
+    //! 自動保存の記録が残っている場合に、復元するかどうかを確認して、記録した状態を返す。
+    /*! @return 記録がないか、復元しない場合はnullptr
+     */
+    std::unique_ptr<schema::Project> RecoverProject(String const &autosave_path_prefix);
+    //! 保存されていないプロジェクトの自動保存の記録が残っている場合に、復元する。
+    void RecoverUntitledProject();
+    
     void OnInitCmdLine(wxCmdLineParser& parser) override;
     bool OnCmdLineParsed(wxCmdLineParser& parser) override;
 };
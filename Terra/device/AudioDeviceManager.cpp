@@ -1,8 +1,10 @@
+#include <chrono>
 #include <mutex>
 #include <portaudio.h>
 
 #include "./AudioDeviceManager.hpp"
 #include "../misc/Buffer.hpp"
+#include "../misc/Interleave.hpp"
 #include "../misc/StrCnv.hpp"
 
 NS_HWM_BEGIN
@@ -69,11 +71,15 @@ public:
                     double sample_rate,
                     SampleCount block_size,
                     std::vector<IAudioDeviceCallback *> &callbacks,
-                    PaStream *stream)
+                    PaStream *stream,
+                    bool is_non_interleaved,
+                    RealtimeThreadOptions const &thread_options)
     :   sample_rate_(sample_rate)
     ,   block_size_(block_size)
     ,   callbacks_(callbacks)
+    ,   thread_options_(thread_options)
     ,   stream_(stream)
+    ,   is_non_interleaved_(is_non_interleaved)
     {
         if(input) { input_ = *input; }
         if(output) { output_ = *output; }
@@ -87,8 +93,14 @@ public:
         
         num_inputs_ = (input_ ? input_->num_channels_ : 0);
         num_outputs_ = (output_ ? output_->num_channels_ : 0);
+        
+        // ノンインターリーブのストリームでは、デバイスのバッファを直接コールバックに渡すので、
+        // 入力の一時バッファは、デバイスから入力が渡されなかったときの無音としてだけ使用する。
         tmp_input_float_.resize(num_inputs_, block_size);
-        tmp_output_float_.resize(num_outputs_, block_size);
+        tmp_input_float_.fill(0.0);
+        if(!is_non_interleaved_) {
+            tmp_output_float_.resize(num_outputs_, block_size);
+        }
     }
     
     AudioDeviceImpl(AudioDeviceImpl const &rhs) = delete;
@@ -105,12 +117,29 @@ public:
     double GetSampleRate() const override { return sample_rate_; }
     SampleCount GetBlockSize() const override { return block_size_; }
     
+    double GetOutputLatency() const override
+    {
+        auto info = Pa_GetStreamInfo(stream_);
+        if(!info) { return 0; }
+        return info->outputLatency;
+    }
+    
     void Start() override
     {
         if(Pa_IsStreamStopped(stream_)) {
+            statistics_.Reset(block_size_ / sample_rate_);
+            current_thread_options_ = thread_options_;
+            needs_thread_configuration_ = true;
+            
             ForEachCallbacks([this](auto *cb) {
                 cb->StartProcessing(sample_rate_, block_size_, num_inputs_, num_outputs_);
             });
+            
+            // コールバックが StartProcessing() で確保したバッファもまとめてロックする。
+            if(current_thread_options_.lock_memory_) {
+                is_memory_locked_ = LockProcessMemory();
+            }
+            
             Pa_StartStream(stream_);
         }
     }
@@ -120,6 +149,11 @@ public:
         if(!Pa_IsStreamStopped(stream_)) {
             Pa_StopStream(stream_);
             ForEachCallbacks([](auto *cb) { cb->StopProcessing(); });
+            
+            if(is_memory_locked_) {
+                UnlockProcessMemory();
+                is_memory_locked_ = false;
+            }
         }
     }
     
@@ -128,14 +162,36 @@ public:
         return Pa_IsStreamStopped(stream_);
     }
     
+    ProcessingStatistics GetStatistics() const override
+    {
+        return statistics_.GetStatistics();
+    }
+    
     PaStream * GetStream() { return stream_; }
     
     PaStreamCallbackResult StreamCallback(const void *input, void *output,
                                           unsigned long block_size, const PaStreamCallbackTimeInfo *timeInfo,
                                           PaStreamCallbackFlags statusFlags)
     {
-        ClearBuffer<float>(output, block_size);
-        InvokeCallbacks<float>(input, output, block_size);
+        auto const begin = std::chrono::steady_clock::now();
+        
+        // PortAudioはストリームを開始するたびにスレッドを作り直すことがあるので、開始後の最初の呼び出しで設定する。
+        if(needs_thread_configuration_) {
+            ConfigureRealtimeThread(current_thread_options_, block_size_ / sample_rate_);
+            needs_thread_configuration_ = false;
+        } else {
+            EnableFlushDenormalsToZero();
+        }
+        
+        if(is_non_interleaved_) {
+            InvokeCallbacksNonInterleaved(input, output, block_size);
+        } else {
+            InvokeCallbacks<float>(input, output, block_size);
+        }
+        
+        auto const end = std::chrono::steady_clock::now();
+        RecordStatistics(std::chrono::duration<double>(end - begin).count(), statusFlags, block_size);
+        
         return paContinue;
     }
     
@@ -146,10 +202,33 @@ private:
     SampleCount block_size_ = 0;
     
     std::vector<IAudioDeviceCallback *> &callbacks_;
+    RealtimeThreadOptions const &thread_options_;
+    RealtimeThreadOptions current_thread_options_;
+    bool needs_thread_configuration_ = false;
+    bool is_memory_locked_ = false;
     PaStream *stream_ = nullptr;
     int num_inputs_ = 0;
     int num_outputs_ = 0;
+    bool is_non_interleaved_ = false;
     Buffer<float> tmp_input_float_, tmp_output_float_;
+    ProcessingStatisticsRecorder statistics_;
+    
+    void RecordStatistics(double duration, PaStreamCallbackFlags status_flags, SampleCount block_size)
+    {
+        using PI = ProcessingIncident;
+        
+        UInt32 xrun_flags = 0;
+        if(status_flags & paInputUnderflow) { xrun_flags |= PI::kInputUnderflow; }
+        if(status_flags & paInputOverflow) { xrun_flags |= PI::kInputOverflow; }
+        if(status_flags & paOutputUnderflow) { xrun_flags |= PI::kOutputUnderflow; }
+        if(status_flags & paOutputOverflow) { xrun_flags |= PI::kOutputOverflow; }
+        
+        ProcessingIncident incident;
+        if(statistics_.Record(duration, xrun_flags, block_size, incident)) {
+            ForEachCallbacks([&](IAudioDeviceCallback *cb) { cb->GetProcessingDetails(incident); });
+            statistics_.AddIncident(incident);
+        }
+    }
     
     //! @tparam F is a functor where its signature is `void(IAudioDeviceCallback *)`
     template<class F>
@@ -157,11 +236,23 @@ private:
         std::for_each(callbacks_.begin(), callbacks_.end(), f);
     }
     
-    template<class SampleType>
-    void ClearBuffer(void *output, SampleCount block_size)
+    //! デバイスのバッファをそのままコールバックに渡す。
+    /*! コールバックは出力バッファに加算するので、出力のクリアだけが必要になる。
+     */
+    void InvokeCallbacksNonInterleaved(const void *input, void *output, SampleCount block_size)
     {
-        auto *p = reinterpret_cast<SampleType *>(output);
-        std::fill_n(p, num_outputs_ * block_size, 0);
+        auto input_non_interleaved = (input
+                                      ? reinterpret_cast<float const * const *>(input)
+                                      : tmp_input_float_.data());
+        auto output_non_interleaved = reinterpret_cast<float **>(output);
+        
+        for(int ch = 0; ch < num_outputs_; ++ch) {
+            std::fill_n(output_non_interleaved[ch], block_size, 0);
+        }
+        
+        ForEachCallbacks([&](IAudioDeviceCallback *cb) {
+            cb->Process(block_size, input_non_interleaved, output_non_interleaved);
+        });
     }
     
     template<class SampleType>
@@ -170,13 +261,12 @@ private:
         SampleType const * const * input_non_interleaved = nullptr;
         SampleType ** output_non_interleaved = nullptr;
         
-        auto *pi = reinterpret_cast<SampleType const *>(input);
-        for(int ch = 0; ch < num_inputs_; ++ch) {
-            for(SampleCount smp = 0; smp < block_size; ++smp) {
-                tmp_input_float_.data()[ch][smp] = pi[smp * num_inputs_ + ch];
-            }
+        if(input) {
+            Deinterleave(reinterpret_cast<SampleType const *>(input), tmp_input_float_.data(),
+                         num_inputs_, block_size);
         }
         
+        // 出力はすべてInterleave()で上書きされるので、デバイスのバッファはクリアしなくてよい。
         tmp_output_float_.fill(0.0);
         
         input_non_interleaved = tmp_input_float_.data();
@@ -186,11 +276,9 @@ private:
             cb->Process(block_size, input_non_interleaved, output_non_interleaved);
         });
         
-        auto *po = reinterpret_cast<SampleType *>(output);
-        for(int ch = 0; ch < num_outputs_; ++ch) {
-            for(SampleCount smp = 0; smp < block_size; ++smp) {
-                po[smp * num_outputs_ + ch] = tmp_output_float_.data()[ch][smp];
-            }
+        if(output) {
+            Interleave(tmp_output_float_.data(), reinterpret_cast<SampleType *>(output),
+                       num_outputs_, block_size);
         }
     }
 };
@@ -202,6 +290,7 @@ public:
     {}
     
     std::vector<IAudioDeviceCallback *> callbacks_;
+    RealtimeThreadOptions thread_options_;
     std::unique_ptr<AudioDeviceImpl> device_;
     
     static
@@ -371,10 +460,24 @@ AudioDeviceManager::Open(AudioDeviceInfo const *input_device,
         return Error(ErrorCode::kDeviceNotFound, L"Device not found");
     }
     
+    // デバイスのバッファを直接処理できるように、まずノンインターリーブで開いてみて、
+    // ホストAPIが対応していない場合はインターリーブで開き直す。
+    auto open_stream = [&](PaStream **stream, bool non_interleaved) {
+        PaSampleFormat const format = paFloat32 | (non_interleaved ? paNonInterleaved : 0);
+        ip.sampleFormat = format;
+        op.sampleFormat = format;
+        return Pa_OpenStream(stream, pip, pop,
+                             sample_rate, block_size, flags,
+                             &Impl::StaticStreamCallback, pimpl_.get());
+    };
+    
     PaStream *stream;
-    PaError err = Pa_OpenStream(&stream, pip, pop,
-                                sample_rate, block_size, flags,
-                                &Impl::StaticStreamCallback, pimpl_.get());
+    bool is_non_interleaved = true;
+    PaError err = open_stream(&stream, true);
+    if(err != paNoError) {
+        is_non_interleaved = false;
+        err = open_stream(&stream, false);
+    }
     ShowErrorMsg(err);
     if(err != paNoError) {
         // todo portaudioのエラーコードに合わせて整理
@@ -384,7 +487,9 @@ AudioDeviceManager::Open(AudioDeviceInfo const *input_device,
     pimpl_->device_ = std::make_unique<AudioDeviceImpl>(input_device, output_device,
                                                         sample_rate, block_size,
                                                         pimpl_->callbacks_,
-                                                        stream);
+                                                        stream,
+                                                        is_non_interleaved,
+                                                        pimpl_->thread_options_);
     
     return pimpl_->device_.get();
 }
@@ -444,4 +549,14 @@ void AudioDeviceManager::RemoveAllCallbacks()
     pimpl_->callbacks_.clear();
 }
 
+void AudioDeviceManager::SetRealtimeThreadOptions(RealtimeThreadOptions const &options)
+{
+    pimpl_->thread_options_ = options;
+}
+
+RealtimeThreadOptions AudioDeviceManager::GetRealtimeThreadOptions() const
+{
+    return pimpl_->thread_options_;
+}
+
 NS_HWM_END
@@ -3,6 +3,8 @@
 #include "../misc/SingleInstance.hpp"
 #include "../misc/Either.hpp"
 #include "./DeviceIOType.hpp"
+#include "./ProcessingStatistics.hpp"
+#include "../misc/RealtimeThread.hpp"
 
 NS_HWM_BEGIN
 
@@ -55,6 +57,12 @@ public:
     virtual
     SampleCount GetBlockSize() const = 0;
     
+    //! 処理したオーディオデータが実際に出力されるまでの遅延時間（秒）を返す。
+    /*! デバイスがまだ開始されていないなどで取得できない場合は0を返す。
+     */
+    virtual
+    double GetOutputLatency() const = 0;
+    
     //! デバイスのフレーム処理を開始する。
     /*! @note デバイスオープン後、明示的に Start() を呼び出すまでは、デバイスのフレーム処理は開始しない。
      */
@@ -68,6 +76,12 @@ public:
     //! 指定したオーディオデバイスが停止中かどうかを返す。
     virtual
     bool IsStopped() const = 0;
+    
+    //! コールバックの処理時間と音切れの統計を返す。
+    /*! 統計は Start() を呼び出したときにクリアされる。
+     */
+    virtual
+    ProcessingStatistics GetStatistics() const = 0;
 };
 
 class IAudioDeviceCallback
@@ -91,6 +105,13 @@ public:
     
     virtual
     void StopProcessing() = 0;
+    
+    //! 直前の Process() で音切れが起きたときに、その原因を調べるための情報を追加する。
+    /*! Process() と同じスレッドから呼び出されるので、ブロックやメモリ確保をしてはいけない。
+     */
+    virtual
+    void GetProcessingDetails(ProcessingIncident &incident) const
+    {}
 };
 
 class AudioDeviceManager final
@@ -154,6 +175,12 @@ public:
      */
     void RemoveAllCallbacks();
     
+    //! オーディオスレッドの優先度やCPU、メモリのロックの設定を変更する。
+    /*! 変更は、次にデバイスを Start() したときから反映される。
+     */
+    void SetRealtimeThreadOptions(RealtimeThreadOptions const &options);
+    RealtimeThreadOptions GetRealtimeThreadOptions() const;
+    
 private:
     class Impl;
     std::unique_ptr<Impl> pimpl_;
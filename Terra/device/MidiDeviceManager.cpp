@@ -1,8 +1,13 @@
 #include "MidiDeviceManager.hpp"
 #include "RtMidi.h"
+
+#include <atomic>
+#include <thread>
+
 #include "../misc/StrCnv.hpp"
 #include "../misc/ArrayRef.hpp"
 #include "../misc/LockFactory.hpp"
+#include "../misc/RealtimeThread.hpp"
 #include "../misc/ThreadSafeRingBuffer.hpp"
 
 NS_HWM_BEGIN
@@ -17,6 +22,12 @@ namespace {
         auto const dur = clock_t::now().time_since_epoch();
         return std::chrono::duration<double>(dur).count();
     }
+    
+    clock_t::time_point to_time_point(double timestamp)
+    {
+        auto const dur = std::chrono::duration<double>(timestamp);
+        return clock_t::time_point(std::chrono::duration_cast<clock_t::duration>(dur));
+    }
 }
 
 DeviceMidiMessage DeviceMidiMessage::Create(MidiDevice *device,
@@ -257,7 +268,7 @@ struct MidiOut
             }
         }
         if(n == -1) { throw std::runtime_error("unknown device"); }
-        midi_out_.openPort(0, to_utf8(info_.name_id_));
+        midi_out_.openPort(n, to_utf8(info_.name_id_));
     }
     
     ~MidiOut()
@@ -275,20 +286,24 @@ struct MidiOut
     
     void SendMessages(std::vector<DeviceMidiMessage> const &ms)
     {
-        std::vector<UInt8> buf;
-        buf.reserve(3);
         for(auto const &m : ms) {
-            bool const successful = m.ToBytes(buf, running_status_);
-            if(!successful) { continue; }
-            midi_out_.sendMessage(&buf);
+            SendMessage(m);
         }
     }
     
+    void SendMessage(DeviceMidiMessage const &m)
+    {
+        bool const successful = m.ToBytes(buf_, running_status_);
+        if(!successful) { return; }
+        midi_out_.sendMessage(&buf_);
+    }
+    
 private:
     MidiDeviceInfo info_;
     RtMidiOut midi_out_;
     
     std::vector<DeviceMidiMessage> messages_;
+    std::vector<UInt8> buf_ = std::vector<UInt8>(3);
     UInt8 running_status_ = 0;
 
     static
@@ -306,9 +321,21 @@ private:
 struct MidiDeviceManager::Impl
 {
     static constexpr int kNumCapacity = 4096;
+    //! 送信待ちのメッセージがない場合に送信スレッドがキューを確認する間隔
+    static constexpr double kSenderPollingInterval = 0.001;
+    
     Impl()
     :   input_messages_(kNumCapacity)
-    {}
+    ,   output_messages_(kNumCapacity)
+    {
+        popped_messages_.reserve(kNumCapacity);
+        pending_messages_.reserve(kNumCapacity);
+    }
+    
+    ~Impl()
+    {
+        StopSenderThread();
+    }
     
     using MidiInPtr = std::shared_ptr<MidiIn>;
     using MidiOutPtr = std::shared_ptr<MidiOut>;
@@ -317,6 +344,120 @@ struct MidiDeviceManager::Impl
     std::vector<MidiOutPtr> outs_;
     SingleChannelThreadSafeRingBuffer<DeviceMidiMessage> input_messages_;
     
+    //! オーディオスレッドから送信スレッドへ渡されるメッセージ。
+    //! time_stamp_はここでは絶対時刻（get_timestamp()と同じ基準）に変換されている。
+    SingleChannelThreadSafeRingBuffer<DeviceMidiMessage> output_messages_;
+    std::atomic<double> output_latency_ = { 0.0 };
+    
+    //! 以下は送信スレッドからのみアクセスする
+    std::vector<DeviceMidiMessage> popped_messages_;
+    std::vector<DeviceMidiMessage> pending_messages_;
+    
+    //! 送信スレッドは、出力デバイスが開かれている間だけ動かす。
+    /*! 送信スレッドの開始と終了は、lf_sender_をロックして行う。
+     */
+    std::thread sender_thread_;
+    std::atomic<bool> sender_should_stop_ = { false };
+    LockFactory lf_sender_;
+    
+    //! 出力デバイスの有無に合わせて、送信スレッドを開始または終了する。
+    void UpdateSenderThread()
+    {
+        auto sender_lock = lf_sender_.make_lock();
+        
+        bool has_outputs = false;
+        {
+            auto lock = lf_out_.make_lock();
+            has_outputs = (outs_.empty() == false);
+        }
+        
+        if(has_outputs && sender_thread_.joinable() == false) {
+            sender_should_stop_.store(false);
+            sender_thread_ = std::thread([this] { SenderThreadProc(); });
+        } else if(has_outputs == false) {
+            StopSenderThreadImpl();
+        }
+    }
+    
+    void StopSenderThread()
+    {
+        auto sender_lock = lf_sender_.make_lock();
+        StopSenderThreadImpl();
+    }
+    
+    //! lf_sender_をロックした状態で呼び出すこと
+    void StopSenderThreadImpl()
+    {
+        sender_should_stop_.store(true);
+        if(sender_thread_.joinable()) { sender_thread_.join(); }
+    }
+    
+    void SenderThreadProc()
+    {
+        // オーディオスレッドより優先されないようにする。
+        // 失敗しても送信自体は行えるので、エラーは無視する。
+        RaiseThreadPriorityBelowRealtime();
+        
+        // 送信スレッドが止まっていた間のメッセージは送信しない。
+        pending_messages_.clear();
+        for(auto num = output_messages_.GetNumPoppable(); num > 0; num = output_messages_.GetNumPoppable()) {
+            popped_messages_.resize(num);
+            output_messages_.PopOverwrite(popped_messages_.data(), num);
+        }
+        
+        auto by_time_stamp = [](auto const &lhs, auto const &rhs) {
+            return lhs.time_stamp_ < rhs.time_stamp_;
+        };
+        
+        for( ; sender_should_stop_.load() == false; ) {
+            auto const num = output_messages_.GetNumPoppable();
+            if(num > 0) {
+                popped_messages_.resize(num);
+                if(output_messages_.PopOverwrite(popped_messages_.data(), num)) {
+                    // 同時刻のメッセージは、追加された順番を維持する
+                    std::stable_sort(popped_messages_.begin(), popped_messages_.end(), by_time_stamp);
+                    auto const num_old = pending_messages_.size();
+                    std::copy(popped_messages_.begin(), popped_messages_.end(),
+                              std::back_inserter(pending_messages_));
+                    std::inplace_merge(pending_messages_.begin(),
+                                       pending_messages_.begin() + num_old,
+                                       pending_messages_.end(),
+                                       by_time_stamp);
+                }
+            }
+            
+            auto const now = get_timestamp();
+            auto const end_of_due = std::find_if(pending_messages_.begin(), pending_messages_.end(),
+                                                 [now](auto const &m) { return m.time_stamp_ > now; });
+            
+            if(end_of_due != pending_messages_.begin()) {
+                auto lock = lf_out_.make_lock();
+                std::for_each(pending_messages_.begin(), end_of_due, [this](auto const &m) {
+                    if(auto out = FindOpenedOutput(m.device_)) {
+                        out->SendMessage(m);
+                    }
+                });
+                lock.unlock();
+                pending_messages_.erase(pending_messages_.begin(), end_of_due);
+            }
+            
+            auto wake_up_time = get_timestamp() + kSenderPollingInterval;
+            if(pending_messages_.empty() == false && pending_messages_.front().time_stamp_ < wake_up_time) {
+                wake_up_time = pending_messages_.front().time_stamp_;
+            }
+            std::this_thread::sleep_until(to_time_point(wake_up_time));
+        }
+    }
+    
+    //! lf_out_をロックした状態で呼び出すこと
+    MidiOut * FindOpenedOutput(MidiDevice const *device)
+    {
+        for(auto const &out: outs_) {
+            if(out.get() == device) { return out.get(); }
+        }
+        return nullptr;
+    }
+    
     void AddMidiMessage(DeviceMidiMessage const &m)
     {
         std::string str_bytes;
@@ -380,6 +521,7 @@ MidiDevice * MidiDeviceManager::Open(MidiDeviceInfo const &info, String *error)
                 auto lock = pimpl_->lf_out_.make_lock();
                 pimpl_->outs_.push_back(p);
             }
+            pimpl_->UpdateSenderThread();
             return p.get();
         }
     } catch(std::exception &e) {
@@ -428,6 +570,7 @@ void MidiDeviceManager::Close(MidiDevice const *device)
         pimpl_->outs_.erase(found);
         lock.unlock();
         
+        pimpl_->UpdateSenderThread();
         moved.reset(); // close the device here
         
     } else {
@@ -472,7 +615,32 @@ double MidiDeviceManager::GetMessages(std::vector<DeviceMidiMessage> &msg)
 //! システムメッセージには未対応。
 void MidiDeviceManager::SendMessages(std::vector<DeviceMidiMessage> const &msg, double epoch)
 {
+    auto const latency = pimpl_->output_latency_.load();
     
+    for(auto m: msg) {
+        m.time_stamp_ += epoch + latency;
+        
+        for( ; ; ) {
+            auto result = pimpl_->output_messages_.Push(&m, 1);
+            if(result.error_code() == ThreadSafeRingBufferErrorCode::kTokenUnavailable) { continue; }
+            else { break; }
+        }
+    }
+}
+
+void MidiDeviceManager::SetOutputLatency(double sec)
+{
+    pimpl_->output_latency_.store(sec);
+}
+
+double MidiDeviceManager::GetOutputLatency() const
+{
+    return pimpl_->output_latency_.load();
+}
+
+double MidiDeviceManager::GetTimestamp()
+{
+    return get_timestamp();
 }
 
 NS_HWM_END
@@ -74,8 +74,23 @@ public:
     //! MIDIメッセージを送信する。
     //! システムメッセージには未対応。
     //! 各DeviceMidiMessageのtime_stampは、epochからの時間として扱う
+    /*! メッセージは内部のキューに積まれるだけで、この関数はブロックしない。
+     *  実際の送信は、送信用の専用スレッドが (epoch + time_stamp_ + GetOutputLatency()) の時刻に行う。
+     *  キューが溢れた場合、溢れたメッセージは破棄される。
+     *  @note この関数は単一のスレッド（通常はオーディオスレッド）からのみ呼び出すこと。
+     */
     void SendMessages(std::vector<DeviceMidiMessage> const &ms, double epoch = 0);
     
+    //! MIDI出力の送信時刻に加算するレイテンシー（秒）
+    /*! 外部音源側の発音の遅れなどを補正するために使用する。負の値を設定すると送信を早める。
+     */
+    void SetOutputLatency(double sec);
+    double GetOutputLatency() const;
+    
+    //! GetMessages()が返すタイムスタンプ、およびSendMessages()のepochと同じ基準の現在時刻を返す。
+    static
+    double GetTimestamp();
+    
 private:
     struct Impl;
     std::unique_ptr<Impl> pimpl_;
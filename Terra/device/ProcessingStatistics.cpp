@@ -0,0 +1,149 @@
+#include "ProcessingStatistics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+NS_HWM_BEGIN
+
+namespace {
+    //! ヒストグラムで記録する範囲（デッドラインに対する比率）。これを超えた時間は最後のビンに入る。
+    double const kHistogramRange = 2.0;
+
+    void Increment(std::atomic<UInt64> &counter)
+    {
+        // 書き込むのはオーディオスレッドだけなので、read-modify-writeの命令は必要ない。
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+ProcessingStatisticsRecorder::ProcessingStatisticsRecorder()
+:   incident_queue_(kMaxRecentIncidents)
+{
+    Reset(0);
+}
+
+void ProcessingStatisticsRecorder::Reset(double deadline)
+{
+    deadline_ = deadline;
+    num_callbacks_ = 0;
+    num_deadline_misses_ = 0;
+    num_input_underflows_ = 0;
+    num_input_overflows_ = 0;
+    num_output_underflows_ = 0;
+    num_output_overflows_ = 0;
+    num_incidents_ = 0;
+    worst_callback_duration_ = 0;
+    for(auto &bin: histogram_) { bin = 0; }
+
+    std::unique_lock<std::mutex> lock(incidents_mutex_);
+    ProcessingIncident tmp;
+    while(incident_queue_.TryPop(tmp)) {}
+    recent_incidents_.clear();
+}
+
+bool ProcessingStatisticsRecorder::Record(double callback_duration, UInt32 xrun_flags, SampleCount block_size,
+                                          ProcessingIncident &incident)
+{
+    using PI = ProcessingIncident;
+
+    auto const deadline = deadline_.load(std::memory_order_relaxed);
+
+    Increment(num_callbacks_);
+    if(xrun_flags & PI::kInputUnderflow) { Increment(num_input_underflows_); }
+    if(xrun_flags & PI::kInputOverflow) { Increment(num_input_overflows_); }
+    if(xrun_flags & PI::kOutputUnderflow) { Increment(num_output_underflows_); }
+    if(xrun_flags & PI::kOutputOverflow) { Increment(num_output_overflows_); }
+
+    if(callback_duration > worst_callback_duration_.load(std::memory_order_relaxed)) {
+        worst_callback_duration_.store(callback_duration, std::memory_order_relaxed);
+    }
+
+    if(deadline > 0) {
+        auto const ratio = callback_duration / (deadline * kHistogramRange);
+        auto const bin = (UInt32)std::min<double>(std::max<double>(ratio, 0) * (kNumHistogramBins - 1),
+                                                  kNumHistogramBins - 1);
+        auto &count = histogram_[bin];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    UInt32 flags = (xrun_flags & PI::kXrunFlags);
+    if(deadline > 0 && callback_duration > deadline) {
+        Increment(num_deadline_misses_);
+        flags |= PI::kDeadlineMiss;
+    }
+
+    if(flags == 0) { return false; }
+
+    incident = ProcessingIncident();
+    incident.index_ = num_incidents_.load(std::memory_order_relaxed);
+    incident.time_ = std::chrono::system_clock::now();
+    incident.flags_ = flags;
+    incident.callback_duration_ = callback_duration;
+    incident.deadline_ = deadline;
+    incident.block_size_ = block_size;
+    Increment(num_incidents_);
+
+    return true;
+}
+
+void ProcessingStatisticsRecorder::AddIncident(ProcessingIncident const &incident)
+{
+    incident_queue_.TryPush(incident);
+}
+
+double ProcessingStatisticsRecorder::GetBinUpperBound(UInt32 bin, double deadline) const
+{
+    return deadline * kHistogramRange * (bin + 1) / (kNumHistogramBins - 1);
+}
+
+ProcessingStatistics ProcessingStatisticsRecorder::GetStatistics() const
+{
+    ProcessingStatistics stat;
+    stat.deadline_ = deadline_.load(std::memory_order_relaxed);
+    stat.num_callbacks_ = num_callbacks_.load(std::memory_order_relaxed);
+    stat.num_deadline_misses_ = num_deadline_misses_.load(std::memory_order_relaxed);
+    stat.num_input_underflows_ = num_input_underflows_.load(std::memory_order_relaxed);
+    stat.num_input_overflows_ = num_input_overflows_.load(std::memory_order_relaxed);
+    stat.num_output_underflows_ = num_output_underflows_.load(std::memory_order_relaxed);
+    stat.num_output_overflows_ = num_output_overflows_.load(std::memory_order_relaxed);
+    stat.worst_callback_duration_ = worst_callback_duration_.load(std::memory_order_relaxed);
+
+    std::array<UInt32, kNumHistogramBins> histogram;
+    UInt64 total = 0;
+    for(UInt32 i = 0; i < kNumHistogramBins; ++i) {
+        histogram[i] = histogram_[i].load(std::memory_order_relaxed);
+        total += histogram[i];
+    }
+
+    auto get_percentile = [&](double q) {
+        if(total == 0) { return 0.0; }
+
+        auto const threshold = (UInt64)std::ceil(total * q);
+        UInt64 sum = 0;
+        for(UInt32 i = 0; i < kNumHistogramBins - 1; ++i) {
+            sum += histogram[i];
+            if(sum >= threshold) {
+                return std::min(GetBinUpperBound(i, stat.deadline_), stat.worst_callback_duration_);
+            }
+        }
+        return stat.worst_callback_duration_;
+    };
+
+    stat.median_callback_duration_ = get_percentile(0.5);
+    stat.p99_callback_duration_ = get_percentile(0.99);
+    stat.p999_callback_duration_ = get_percentile(0.999);
+
+    std::unique_lock<std::mutex> lock(incidents_mutex_);
+    ProcessingIncident incident;
+    while(incident_queue_.TryPop(incident)) {
+        recent_incidents_.push_back(incident);
+        if(recent_incidents_.size() > kMaxRecentIncidents) {
+            recent_incidents_.pop_front();
+        }
+    }
+    stat.recent_incidents_.assign(recent_incidents_.begin(), recent_incidents_.end());
+
+    return stat;
+}
+
+NS_HWM_END
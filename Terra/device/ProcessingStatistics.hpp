@@ -0,0 +1,137 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "../misc/MpscQueue.hpp"
+
+NS_HWM_BEGIN
+
+//! オーディオデバイスのコールバックで起きた問題（音切れの原因）の記録
+struct ProcessingIncident
+{
+    enum Flags : UInt32 {
+        kInputUnderflow     = 1 << 0,
+        kInputOverflow      = 1 << 1,
+        kOutputUnderflow    = 1 << 2,
+        kOutputOverflow     = 1 << 3,
+        //! コールバックの処理時間が、ブロックの長さを超えた。
+        kDeadlineMiss       = 1 << 4,
+    };
+
+    static constexpr UInt32 kXrunFlags = kInputUnderflow | kInputOverflow | kOutputUnderflow | kOutputOverflow;
+
+    //! 処理に時間がかかったノード
+    struct NodeTiming
+    {
+        //! GraphProcessor::Node::GetID()の値
+        UInt64 node_id_ = 0;
+        double duration_ = 0; // 秒
+    };
+
+    static constexpr UInt32 kMaxSlowestNodes = 5;
+
+    //! 記録を開始してから何回目の問題か
+    UInt64 index_ = 0;
+    std::chrono::system_clock::time_point time_;
+    UInt32 flags_ = 0;
+    double callback_duration_ = 0; // 秒
+    double deadline_ = 0; // 秒
+    SampleCount block_size_ = 0;
+
+    //! 以下はIAudioDeviceCallback::GetProcessingDetails()で設定される。
+    UInt32 num_active_nodes_ = 0;
+    UInt32 num_slowest_nodes_ = 0;
+    std::array<NodeTiming, kMaxSlowestNodes> slowest_nodes_;
+};
+
+//! オーディオデバイスのコールバックの処理時間と、音切れの統計
+struct ProcessingStatistics
+{
+    UInt64 num_callbacks_ = 0;
+    UInt64 num_deadline_misses_ = 0;
+    UInt64 num_input_underflows_ = 0;
+    UInt64 num_input_overflows_ = 0;
+    UInt64 num_output_underflows_ = 0;
+    UInt64 num_output_overflows_ = 0;
+
+    //! 以下の時間はすべて秒単位
+    double deadline_ = 0;
+    double worst_callback_duration_ = 0;
+    double median_callback_duration_ = 0;
+    double p99_callback_duration_ = 0;
+    double p999_callback_duration_ = 0;
+
+    //! 最近の問題。古いものから順に並ぶ。
+    std::vector<ProcessingIncident> recent_incidents_;
+
+    UInt64 GetNumXruns() const
+    {
+        return num_input_underflows_ + num_input_overflows_ + num_output_underflows_ + num_output_overflows_;
+    }
+};
+
+//! コールバックの処理時間と音切れを、オーディオスレッドから記録する。
+/*! Record()とAddIncident()はオーディオスレッドから呼び出す。
+ *  これらはブロックもメモリ確保もしない。
+ *  GetStatistics()は、それ以外の任意のスレッドから呼び出せる。
+ *
+ *  処理時間の分布は、デッドラインの2倍までを等分したヒストグラムで記録するので、
+ *  パーセンタイル値の精度はデッドラインの1/128程度になる。
+ */
+class ProcessingStatisticsRecorder
+{
+public:
+    static constexpr UInt32 kNumHistogramBins = 256;
+    static constexpr UInt32 kMaxRecentIncidents = 64;
+
+    ProcessingStatisticsRecorder();
+
+    //! 統計をクリアする。
+    /*! @param deadline コールバックがこの時間（秒）以内に終わらなければならない。
+     *  @note オーディオスレッドがRecord()を呼び出していないときに呼び出すこと。
+     */
+    void Reset(double deadline);
+
+    //! コールバック1回分の結果を記録する。
+    /*! @param xrun_flags ProcessingIncident::kXrunFlagsの組み合わせ
+     *  @param [out] incident 問題が起きた場合は、その内容が書き込まれる。
+     *  @return 問題が起きた場合はtrue。
+     *  その場合は、incidentに詳細を追加してからAddIncident()を呼び出す。
+     */
+    bool Record(double callback_duration, UInt32 xrun_flags, SampleCount block_size,
+                ProcessingIncident &incident);
+
+    //! 問題の記録を追加する。
+    /*! 取り出されていない記録が溜まりすぎている場合は、この記録は捨てられる。
+     */
+    void AddIncident(ProcessingIncident const &incident);
+
+    ProcessingStatistics GetStatistics() const;
+
+private:
+    std::atomic<double> deadline_ { 0 };
+    std::atomic<UInt64> num_callbacks_ { 0 };
+    std::atomic<UInt64> num_deadline_misses_ { 0 };
+    std::atomic<UInt64> num_input_underflows_ { 0 };
+    std::atomic<UInt64> num_input_overflows_ { 0 };
+    std::atomic<UInt64> num_output_underflows_ { 0 };
+    std::atomic<UInt64> num_output_overflows_ { 0 };
+    std::atomic<UInt64> num_incidents_ { 0 };
+    std::atomic<double> worst_callback_duration_ { 0 };
+    std::array<std::atomic<UInt32>, kNumHistogramBins> histogram_;
+
+    mutable MpscQueue<ProcessingIncident> incident_queue_;
+
+    //! GetStatistics()で取り出した問題の記録を保持しておく。
+    mutable std::mutex incidents_mutex_;
+    mutable std::deque<ProcessingIncident> recent_incidents_;
+
+    double GetBinUpperBound(UInt32 bin, double deadline) const;
+};
+
+NS_HWM_END
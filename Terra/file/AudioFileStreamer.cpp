@@ -0,0 +1,381 @@
+#include "AudioFileStreamer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "./WaveFile.hpp"
+#include "../project/AnticipatedAudioQueue.hpp"
+
+NS_HWM_BEGIN
+
+namespace {
+    //! I/Oスレッドが一度に読み込むサンプル数
+    SampleCount const kStreamBlockSize = 4096;
+    //! I/Oスレッドが先読みの要求を確認する間隔
+    auto const kPollingInterval = std::chrono::milliseconds(5);
+    //! この大きさ（floatに変換したあとのバイト数）以下のファイルは、開くときにすべてメモリに読み込む。
+    size_t const kMaxPreloadedBytes = 4 * 1024 * 1024;
+}
+
+struct AudioFileStreamer::Stream::Impl
+{
+    Impl(String const &path, std::unique_ptr<WaveFileReader> reader, SampleCount read_ahead)
+    :   path_(path)
+    ,   num_channels_(reader->GetNumChannels())
+    ,   sample_rate_(reader->GetSampleRate())
+    ,   num_samples_(reader->GetNumSamples())
+    ,   reader_(std::move(reader))
+    {
+        auto const num_bytes = (size_t)num_samples_ * num_channels_ * sizeof(float);
+        if(num_bytes <= kMaxPreloadedBytes) {
+            preloaded_.resize(num_channels_, num_samples_);
+            if(reader_->Read(0, preloaded_)) {
+                // ファイルを開いたままにしておく必要はない。
+                reader_.reset();
+                return;
+            }
+            preloaded_.resize(0, 0);
+        }
+        
+        auto const num_blocks = std::max<SampleCount>((read_ahead + kStreamBlockSize - 1) / kStreamBlockSize, 2);
+        queue_ = std::make_unique<AnticipatedAudioQueue>(num_channels_, kStreamBlockSize, (UInt32)num_blocks);
+    }
+
+    String path_;
+    UInt32 num_channels_ = 0;
+    double sample_rate_ = 0;
+    SampleCount num_samples_ = 0;
+    //! I/Oスレッドだけが使用する
+    std::unique_ptr<WaveFileReader> reader_;
+    //! ファイル全体を読み込んだ場合は、このバッファから直接読み出す。
+    Buffer<float> preloaded_;
+    //! ファイル全体を読み込まなかった場合の先読みのキュー
+    std::unique_ptr<AnticipatedAudioQueue> queue_;
+    //! いずれかのI/Oスレッドが Fill() を実行中かどうか
+    std::atomic<bool> filling_ { false };
+    
+    bool IsPreloaded() const { return queue_ == nullptr; }
+
+    //! オーディオスレッドからI/Oスレッドへの、先読みの要求
+    /*! seq_が奇数の間は書き込み中であることを表す。（シーケンスロック）
+     */
+    struct Request
+    {
+        std::atomic<UInt64> seq_ { 0 };
+        std::atomic<UInt64> generation_ { 0 };
+        std::atomic<SampleCount> pos_ { 0 };
+        std::atomic<SampleCount> loop_begin_ { 0 };
+        //! ループしない場合は0
+        std::atomic<SampleCount> loop_end_ { 0 };
+    };
+
+    Request request_;
+
+    //! オーディオスレッドの状態
+    struct ReaderState
+    {
+        bool requested_ = false;
+        UInt64 generation_ = 0;
+        //! キューのデータの、先読みを要求した位置からの位置
+        UInt64 stream_pos_ = 0;
+        //! 次に読み出すと予想される再生位置
+        SampleCount expected_pos_ = 0;
+        SampleCount loop_begin_ = 0;
+        SampleCount loop_end_ = 0;
+    };
+
+    ReaderState reader_state_;
+
+    //! I/Oスレッドの状態
+    struct WriterState
+    {
+        bool started_ = false;
+        UInt64 generation_ = 0;
+        UInt64 stream_pos_ = 0;
+        SampleCount file_pos_ = 0;
+        SampleCount loop_begin_ = 0;
+        SampleCount loop_end_ = 0;
+    };
+
+    WriterState writer_state_;
+
+    void PostRequest(UInt64 generation, SampleCount pos, SampleCount loop_begin, SampleCount loop_end)
+    {
+        auto &req = request_;
+        auto const seq = req.seq_.load(std::memory_order_relaxed);
+        req.seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        req.generation_.store(generation, std::memory_order_relaxed);
+        req.pos_.store(pos, std::memory_order_relaxed);
+        req.loop_begin_.store(loop_begin, std::memory_order_relaxed);
+        req.loop_end_.store(loop_end, std::memory_order_relaxed);
+
+        req.seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    //! @return 書き込み中で読み出せなかった場合はfalse
+    bool LoadRequest(WriterState &dest) const
+    {
+        auto &req = request_;
+        auto const seq = req.seq_.load(std::memory_order_acquire);
+        if(seq % 2 == 1) { return false; }
+
+        WriterState tmp;
+        tmp.generation_ = req.generation_.load(std::memory_order_relaxed);
+        tmp.file_pos_ = req.pos_.load(std::memory_order_relaxed);
+        tmp.loop_begin_ = req.loop_begin_.load(std::memory_order_relaxed);
+        tmp.loop_end_ = req.loop_end_.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(req.seq_.load(std::memory_order_relaxed) != seq) { return false; }
+
+        dest = tmp;
+        return true;
+    }
+
+    //! I/Oスレッドから呼び出して、キューに空きがある分だけファイルを読み込む。
+    void Fill()
+    {
+        if(IsPreloaded()) { return; }
+        
+        // 他のI/Oスレッドが処理しているストリームは飛ばす。
+        if(filling_.exchange(true, std::memory_order_acquire)) { return; }
+        FillImpl();
+        filling_.store(false, std::memory_order_release);
+    }
+    
+    void FillImpl()
+    {
+        auto const requested = request_.seq_.load(std::memory_order_acquire);
+        if(requested == 0) { return; }
+
+        auto &ws = writer_state_;
+
+        WriterState req;
+        if(LoadRequest(req) && (ws.started_ == false || req.generation_ != ws.generation_)) {
+            ws = req;
+            ws.started_ = true;
+            ws.stream_pos_ = 0;
+        }
+
+        if(ws.started_ == false) { return; }
+
+        for(auto block = queue_->GetWritableBlock(); block; block = queue_->GetWritableBlock()) {
+            SampleCount length = kStreamBlockSize;
+            bool const looping = (ws.loop_end_ > ws.loop_begin_) && (ws.file_pos_ < ws.loop_end_);
+            if(looping) {
+                length = std::min<SampleCount>(length, ws.loop_end_ - ws.file_pos_);
+            }
+
+            BufferRef<float> dest { *block, 0, block->channels(), 0, (UInt32)length };
+            if(reader_->Read(ws.file_pos_, dest) == false) {
+                dest.fill(0);
+            }
+
+            queue_->PushBlock(ws.generation_, ws.stream_pos_, length);
+            ws.stream_pos_ += length;
+            ws.file_pos_ += length;
+            if(looping && ws.file_pos_ == ws.loop_end_) {
+                ws.file_pos_ = ws.loop_begin_;
+            }
+        }
+    }
+};
+
+AudioFileStreamer::Stream::Stream(std::unique_ptr<Impl> pimpl)
+:   pimpl_(std::move(pimpl))
+{}
+
+AudioFileStreamer::Stream::~Stream()
+{}
+
+String const & AudioFileStreamer::Stream::GetPath() const
+{
+    return pimpl_->path_;
+}
+
+UInt32 AudioFileStreamer::Stream::GetNumChannels() const
+{
+    return pimpl_->num_channels_;
+}
+
+double AudioFileStreamer::Stream::GetSampleRate() const
+{
+    return pimpl_->sample_rate_;
+}
+
+SampleCount AudioFileStreamer::Stream::GetNumSamples() const
+{
+    return pimpl_->num_samples_;
+}
+
+bool AudioFileStreamer::Stream::IsPreloaded() const
+{
+    return pimpl_->IsPreloaded();
+}
+
+bool AudioFileStreamer::Stream::Read(TransportInfo const &ti, BufferRef<float> dest)
+{
+    return Read(ti, 0, dest);
+}
+
+bool AudioFileStreamer::Stream::Read(TransportInfo const &ti, SampleCount origin, BufferRef<float> dest)
+{
+    SampleCount const pos = ti.play_.begin_.sample_ - origin;
+    SampleCount const num_samples = dest.samples();
+    
+    if(pimpl_->IsPreloaded()) {
+        dest.fill(0);
+        if(ti.playing_ == false) { return true; }
+        
+        auto const &src = pimpl_->preloaded_;
+        auto const begin = std::max<SampleCount>(pos, 0);
+        auto const end = std::min<SampleCount>(pos + num_samples, src.samples());
+        if(begin >= end) { return true; }
+        
+        auto const num_channels = std::min<UInt32>(src.channels(), dest.channels());
+        for(UInt32 ch = 0; ch < num_channels; ++ch) {
+            std::copy(src.data()[ch] + begin, src.data()[ch] + end, dest.get_channel_data(ch) + (begin - pos));
+        }
+        return true;
+    }
+    
+    auto &rs = pimpl_->reader_state_;
+
+    SampleCount const loop_begin = (ti.IsLooping() ? ti.loop_.begin_.sample_ - origin : 0);
+    SampleCount const loop_end = (ti.IsLooping() ? ti.loop_.end_.sample_ - origin : 0);
+
+    bool const jumped
+    =  rs.requested_ == false
+    || pos != rs.expected_pos_
+    || loop_begin != rs.loop_begin_
+    || loop_end != rs.loop_end_;
+
+    if(jumped) {
+        rs.requested_ = true;
+        rs.generation_ += 1;
+        rs.stream_pos_ = 0;
+        rs.expected_pos_ = pos;
+        rs.loop_begin_ = loop_begin;
+        rs.loop_end_ = loop_end;
+        pimpl_->PostRequest(rs.generation_, pos, loop_begin, loop_end);
+    }
+
+    if(ti.playing_ == false) {
+        dest.fill(0);
+        return true;
+    }
+
+    bool const filled = pimpl_->queue_->Pop(rs.generation_, rs.stream_pos_, num_samples, dest);
+    if(filled) {
+        // ファイルより多いチャンネルは無音にする。
+        for(UInt32 ch = pimpl_->num_channels_; ch < dest.channels(); ++ch) {
+            std::fill_n(dest.get_channel_data(ch), num_samples, 0);
+        }
+    } else {
+        dest.fill(0);
+    }
+
+    rs.stream_pos_ += num_samples;
+    rs.expected_pos_ = pos + num_samples;
+    if(loop_end > loop_begin && rs.expected_pos_ == loop_end) {
+        rs.expected_pos_ = loop_begin;
+    }
+
+    return filled;
+}
+
+struct AudioFileStreamer::Impl
+{
+    UInt32 num_threads_ = 0;
+    std::vector<std::thread> threads_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool should_stop_ = false;
+    bool notified_ = false;
+    std::vector<std::weak_ptr<Stream>> streams_;
+
+    void Run(UInt32 thread_index)
+    {
+        std::vector<StreamPtr> streams;
+
+        for( ; ; ) {
+            streams.clear();
+            {
+                auto lock = std::unique_lock<std::mutex>(mtx_);
+                // オーディオスレッドからは通知しないので、一定間隔で先読みの要求を確認する。
+                cv_.wait_for(lock, kPollingInterval, [this] { return should_stop_ || notified_; });
+                if(should_stop_) { return; }
+                notified_ = false;
+
+                auto it = streams_.begin();
+                while(it != streams_.end()) {
+                    if(auto s = it->lock()) {
+                        streams.push_back(std::move(s));
+                        ++it;
+                    } else {
+                        it = streams_.erase(it);
+                    }
+                }
+            }
+
+            // スレッドごとに異なる位置から処理して、各スレッドが別々のストリームを読み込むようにする。
+            auto const num_streams = streams.size();
+            auto const offset = num_streams * thread_index / num_threads_;
+            for(size_t i = 0; i < num_streams; ++i) {
+                streams[(offset + i) % num_streams]->pimpl_->Fill();
+            }
+        }
+    }
+};
+
+AudioFileStreamer::AudioFileStreamer(UInt32 num_threads)
+:   pimpl_(std::make_unique<Impl>())
+{
+    if(num_threads == 0) {
+        num_threads = std::clamp<UInt32>(std::thread::hardware_concurrency() / 2, 1, 4);
+    }
+    
+    pimpl_->num_threads_ = num_threads;
+    for(UInt32 i = 0; i < num_threads; ++i) {
+        pimpl_->threads_.emplace_back([this, i] { pimpl_->Run(i); });
+    }
+}
+
+AudioFileStreamer::~AudioFileStreamer()
+{
+    {
+        auto lock = std::unique_lock<std::mutex>(pimpl_->mtx_);
+        pimpl_->should_stop_ = true;
+    }
+    pimpl_->cv_.notify_all();
+    for(auto &th: pimpl_->threads_) {
+        th.join();
+    }
+}
+
+AudioFileStreamer::StreamPtr AudioFileStreamer::OpenStream(String const &path, SampleCount read_ahead)
+{
+    auto reader = WaveFileReader::Open(path);
+    if(!reader) { return nullptr; }
+
+    auto stream = StreamPtr(new Stream(std::make_unique<Stream::Impl>(path, std::move(reader), read_ahead)));
+    if(stream->IsPreloaded()) { return stream; }
+
+    {
+        auto lock = std::unique_lock<std::mutex>(pimpl_->mtx_);
+        pimpl_->streams_.push_back(stream);
+        pimpl_->notified_ = true;
+    }
+    pimpl_->cv_.notify_all();
+
+    return stream;
+}
+
+NS_HWM_END
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <memory>
+
+#include "../misc/Buffer.hpp"
+#include "../misc/SingleInstance.hpp"
+#include "../transport/TransportInfo.hpp"
+
+NS_HWM_BEGIN
+
+//! オーディオファイルを、オーディオスレッドからブロックせずに再生できるように先読みするクラス
+/*! ファイルの読み込みは、このクラスが持つI/Oスレッドで行う。
+ *  各ストリームは、オーディオスレッドが要求した再生位置から先のデータを、
+ *  ロックフリーのキュー（ AnticipatedAudioQueue ）に読み込んでおく。
+ *  小さいファイルは、開くときにすべてメモリに読み込み、I/Oスレッドを使用せずに読み出す。
+ */
+class AudioFileStreamer
+:   public SingleInstance<AudioFileStreamer>
+{
+public:
+    class Stream;
+    using StreamPtr = std::shared_ptr<Stream>;
+
+    //! 先読みに使用するサンプル数のデフォルト値
+    static constexpr SampleCount kDefaultReadAhead = 32768;
+    
+    //! @param num_threads I/Oスレッドの数。0の場合は、CPUのコア数から決める。
+    explicit
+    AudioFileStreamer(UInt32 num_threads = 0);
+    ~AudioFileStreamer();
+
+    //! ファイルを開いて、ストリームを作成する。
+    /*! ファイルが開けない場合や、対応していない形式の場合はnullptrを返す。
+     *  ストリームは、返されたshared_ptrがすべて破棄されると閉じられる。
+     *  @param read_ahead 再生位置から先読みしておくサンプル数
+     */
+    StreamPtr OpenStream(String const &path, SampleCount read_ahead = kDefaultReadAhead);
+
+    class Stream
+    {
+    public:
+        ~Stream();
+
+        Stream(Stream const &) = delete;
+        Stream & operator=(Stream const &) = delete;
+
+        String const & GetPath() const;
+        UInt32 GetNumChannels() const;
+        double GetSampleRate() const;
+        SampleCount GetNumSamples() const;
+        //! ファイル全体をメモリに読み込んでいるかどうか
+        bool IsPreloaded() const;
+
+        //! ti.play_の範囲のデータをdestに書き込む。
+        /*! オーディオスレッド（またはそれに準ずる単一のスレッド）から呼び出す。ロックやメモリ確保は行わない。
+         *  ファイルの先頭を、再生位置の0として扱う。
+         *
+         *  再生位置が前回の呼び出しから連続していない場合や、ループ範囲が変わった場合は、
+         *  I/Oスレッドに新しい位置からの先読みを要求する。
+         *  停止中は無音を書き込み、現在の再生位置からの先読みだけを行う。
+         *
+         *  @return 先読みが間に合わずに無音を書き込んだ場合はfalse
+         */
+        bool Read(TransportInfo const &ti, BufferRef<float> dest);
+        
+        //! 再生位置originをファイルの先頭として、 Read(ti, dest) と同様にデータを書き込む。
+        bool Read(TransportInfo const &ti, SampleCount origin, BufferRef<float> dest);
+
+    private:
+        friend AudioFileStreamer;
+        struct Impl;
+        std::unique_ptr<Impl> pimpl_;
+
+        Stream(std::unique_ptr<Impl> pimpl);
+    };
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> pimpl_;
+};
+
+NS_HWM_END
@@ -0,0 +1,263 @@
+#include "ProjectAutosaver.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <wx/filefn.h>
+#include <wx/filename.h>
+
+#include "./ProjectJournal.hpp"
+#include "../misc/FileStream.hpp"
+#include "../log/LoggingSupport.hpp"
+
+NS_HWM_BEGIN
+
+namespace {
+    //! この数のレコードを記録したら、スナップショットを作り直す。
+    Int32 const kMaxRecordsPerSnapshot = 64;
+
+    String GetSnapshotPath(String const &path_prefix) { return path_prefix + L".snapshot"; }
+    String GetJournalPath(String const &path_prefix) { return path_prefix + L".journal"; }
+}
+
+struct ProjectAutosaver::Impl
+{
+    struct Command
+    {
+        enum class Kind { kRecord, kSaved };
+        Kind kind_ = Kind::kRecord;
+        String path_prefix_;
+        std::unique_ptr<schema::Project> project_;
+    };
+
+    std::thread th_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<Command> queue_;
+    bool should_stop_ = false;
+    String requested_path_prefix_;
+
+    // 以下はワーカースレッドからのみアクセスする。
+    String path_prefix_;
+    //! 最後にファイルに記録した状態。変更の検出にだけ使うので、プラグインの状態は含まれていなくてもよい。
+    std::shared_ptr<schema::Project> base_;
+    //! 最後に渡された状態。渡されたプラグインの状態をすべて保持する。
+    /*! 記録に失敗した場合も、次の記録でプラグインの状態を引き継げるようにする。
+     */
+    std::shared_ptr<schema::Project> latest_;
+    UInt64 generation_ = 0;
+    bool has_snapshot_ = false;
+    Int32 num_records_ = 0;
+    std::ofstream journal_;
+
+    void Run()
+    {
+        for( ; ; ) {
+            Command cmd;
+            {
+                auto lock = std::unique_lock<std::mutex>(mtx_);
+                cv_.wait(lock, [this] { return should_stop_ || queue_.empty() == false; });
+                if(queue_.empty()) { return; }
+
+                cmd = std::move(queue_.front());
+                queue_.pop_front();
+            }
+
+            if(cmd.kind_ == Command::Kind::kRecord) {
+                OnRecord(std::move(cmd.project_));
+            } else {
+                OnSaved(cmd.path_prefix_, std::move(cmd.project_));
+            }
+        }
+    }
+
+    void OnRecord(std::unique_ptr<schema::Project> current)
+    {
+        // 変化していないプラグインの状態はdump_hashだけが設定されているので、
+        // レコードには、変化したプラグインの状態だけが含まれる。
+        auto record = ProjectJournal::MakeRecord(*base_, *current);
+        
+        // スナップショット用に、前回までに渡された状態を引き継ぐ。
+        ProjectJournal::InheritPluginDumps(*current, *latest_);
+        latest_ = std::move(current);
+        
+        if(!record) { return; }
+
+        if(has_snapshot_ == false || num_records_ >= kMaxRecordsPerSnapshot) {
+            if(WriteSnapshot(*latest_)) {
+                base_ = latest_;
+            }
+            return;
+        }
+
+        record->set_generation(generation_);
+        ProjectJournal::WriteRecord(journal_, *record);
+        journal_.flush();
+        if(!journal_) {
+            TERRA_ERROR_LOG(L"Failed to write the autosave journal: " << GetJournalPath(path_prefix_));
+            // 次の記録でスナップショットから作り直す。
+            has_snapshot_ = false;
+            return;
+        }
+
+        num_records_ += 1;
+        base_ = latest_;
+    }
+
+    void OnSaved(String const &path_prefix, std::unique_ptr<schema::Project> saved)
+    {
+        journal_.close();
+        ProjectAutosaver::RemoveRecoveryData(path_prefix_);
+
+        path_prefix_ = path_prefix;
+        base_ = std::move(saved);
+        latest_ = base_;
+        has_snapshot_ = false;
+    }
+
+    //! projectをスナップショットとして書き出し、ジャーナルファイルを空にする。
+    bool WriteSnapshot(schema::Project const &project)
+    {
+        journal_.close();
+        has_snapshot_ = false;
+
+        wxFileName(path_prefix_).Mkdir(wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+
+        schema::ProjectJournalSnapshot snapshot;
+        snapshot.set_generation(++generation_);
+        *snapshot.mutable_project() = project;
+
+        auto const snapshot_path = GetSnapshotPath(path_prefix_);
+        auto const tmp_path = snapshot_path + L".tmp";
+        {
+            auto ofs = open_ofstream(tmp_path, std::ios::out|std::ios::binary|std::ios::trunc);
+            snapshot.SerializeToOstream(&ofs);
+            ofs.close();
+            if(!ofs) {
+                TERRA_ERROR_LOG(L"Failed to write the autosave snapshot: " << tmp_path);
+                wxRemoveFile(tmp_path);
+                return false;
+            }
+        }
+
+        if(wxRenameFile(tmp_path, snapshot_path, true) == false) {
+            TERRA_ERROR_LOG(L"Failed to replace the autosave snapshot: " << snapshot_path);
+            wxRemoveFile(tmp_path);
+            return false;
+        }
+
+        // 古いレコードはgenerationが異なるので、ジャーナルファイルを空にする前に終了しても無視される。
+        journal_ = open_ofstream(GetJournalPath(path_prefix_), std::ios::out|std::ios::binary|std::ios::trunc);
+        if(!journal_) {
+            TERRA_ERROR_LOG(L"Failed to open the autosave journal: " << GetJournalPath(path_prefix_));
+            return false;
+        }
+
+        has_snapshot_ = true;
+        num_records_ = 0;
+        return true;
+    }
+};
+
+ProjectAutosaver::ProjectAutosaver(String path_prefix, schema::Project const &base)
+:   pimpl_(std::make_unique<Impl>())
+{
+    pimpl_->requested_path_prefix_ = path_prefix;
+    pimpl_->path_prefix_ = path_prefix;
+    pimpl_->base_ = std::make_shared<schema::Project>(base);
+    pimpl_->latest_ = pimpl_->base_;
+
+    // 前回の起動時に残ったファイルのレコードと区別できるように、起動ごとに異なる値から始める。
+    pimpl_->generation_ = std::chrono::system_clock::now().time_since_epoch().count();
+
+    pimpl_->th_ = std::thread([this] { pimpl_->Run(); });
+}
+
+ProjectAutosaver::~ProjectAutosaver()
+{
+    {
+        auto lock = std::unique_lock<std::mutex>(pimpl_->mtx_);
+        pimpl_->should_stop_ = true;
+    }
+    pimpl_->cv_.notify_all();
+    pimpl_->th_.join();
+}
+
+String ProjectAutosaver::GetPathPrefix() const
+{
+    auto lock = std::unique_lock<std::mutex>(pimpl_->mtx_);
+    return pimpl_->requested_path_prefix_;
+}
+
+void ProjectAutosaver::Record(std::unique_ptr<schema::Project> current)
+{
+    {
+        auto lock = std::unique_lock<std::mutex>(pimpl_->mtx_);
+        auto &queue = pimpl_->queue_;
+
+        // まだ処理されていない記録は、最新の状態で置き換えればよい。
+        // （置き換える記録にだけ含まれていたプラグインの状態は引き継ぐ）
+        if(queue.empty() == false && queue.back().kind_ == Impl::Command::Kind::kRecord) {
+            ProjectJournal::InheritPluginDumps(*current, *queue.back().project_);
+            queue.back().project_ = std::move(current);
+        } else {
+            Impl::Command cmd;
+            cmd.kind_ = Impl::Command::Kind::kRecord;
+            cmd.project_ = std::move(current);
+            queue.push_back(std::move(cmd));
+        }
+    }
+    pimpl_->cv_.notify_all();
+}
+
+void ProjectAutosaver::OnSaved(String path_prefix, schema::Project const &saved)
+{
+    {
+        auto lock = std::unique_lock<std::mutex>(pimpl_->mtx_);
+        pimpl_->requested_path_prefix_ = path_prefix;
+
+        Impl::Command cmd;
+        cmd.kind_ = Impl::Command::Kind::kSaved;
+        cmd.path_prefix_ = path_prefix;
+        cmd.project_ = std::make_unique<schema::Project>(saved);
+        pimpl_->queue_.push_back(std::move(cmd));
+    }
+    pimpl_->cv_.notify_all();
+}
+
+bool ProjectAutosaver::HasRecoveryData(String const &path_prefix)
+{
+    return wxFileExists(GetSnapshotPath(path_prefix));
+}
+
+std::unique_ptr<schema::Project> ProjectAutosaver::Recover(String const &path_prefix)
+{
+    auto ifs_snapshot = open_ifstream(GetSnapshotPath(path_prefix), std::ios::in|std::ios::binary);
+    if(!ifs_snapshot) { return nullptr; }
+
+    schema::ProjectJournalSnapshot snapshot;
+    if(snapshot.ParseFromIstream(&ifs_snapshot) == false) {
+        TERRA_ERROR_LOG(L"Failed to parse the autosave snapshot: " << GetSnapshotPath(path_prefix));
+        return nullptr;
+    }
+
+    std::vector<schema::ProjectJournalRecord> records;
+    auto ifs_journal = open_ifstream(GetJournalPath(path_prefix), std::ios::in|std::ios::binary);
+    if(ifs_journal) {
+        records = ProjectJournal::ReadRecords(ifs_journal);
+    }
+
+    return ProjectJournal::Replay(snapshot, records);
+}
+
+void ProjectAutosaver::RemoveRecoveryData(String const &path_prefix)
+{
+    for(auto const &path: { GetSnapshotPath(path_prefix), GetJournalPath(path_prefix) }) {
+        if(wxFileExists(path)) { wxRemoveFile(path); }
+    }
+}
+
+NS_HWM_END
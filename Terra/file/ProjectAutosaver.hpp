@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+
+#include <project.pb.h>
+
+NS_HWM_BEGIN
+
+//! プロジェクトの変更を、バックグラウンドでジャーナルファイルに記録する。
+/*! Record()に渡されたプロジェクトの状態は、ワーカースレッドで前回の状態と比較され、
+ *  変更された部分だけがジャーナルファイルに追記される。
+ *  記録したレコードが一定数を超えると、その時点の状態をスナップショットとして書き出し、
+ *  ジャーナルファイルを空にする。
+ *
+ *  ファイルは、path_prefixに拡張子を付けた名前で作成される。
+ *  アプリケーションが異常終了した場合は、Recover()で最後に記録した状態を復元できる。
+ */
+class ProjectAutosaver
+{
+public:
+    //! @param base 保存済みのプロジェクトの状態。これと異なる状態が記録されるまではファイルを作成しない。
+    ProjectAutosaver(String path_prefix, schema::Project const &base);
+    ~ProjectAutosaver();
+
+    ProjectAutosaver(ProjectAutosaver const &) = delete;
+    ProjectAutosaver & operator=(ProjectAutosaver const &) = delete;
+
+    String GetPathPrefix() const;
+
+    //! プロジェクトの現在の状態を記録する。
+    /*! 記録はワーカースレッドで行われるので、この関数はすぐに戻る。
+     *  前回の記録から変化していないプラグインの状態は、dump_hashだけを設定して渡せばよい。
+     *  （前回までに記録した状態を引き継ぐ）
+     */
+    void Record(std::unique_ptr<schema::Project> current);
+
+    //! プロジェクトが保存されたときに呼び出す。
+    /*! それまでに記録したファイルを削除して、savedを新しい基準にする。
+     *  別名で保存された場合に備えて、以降のファイル名をpath_prefixで指定する。
+     */
+    void OnSaved(String path_prefix, schema::Project const &saved);
+
+    //! 復元できるデータがあるかどうか
+    static
+    bool HasRecoveryData(String const &path_prefix);
+
+    //! 記録されたファイルから、最後に記録した状態を復元する。
+    /*! @return 復元できるデータがない場合はnullptr
+     */
+    static
+    std::unique_ptr<schema::Project> Recover(String const &path_prefix);
+
+    //! 記録されたファイルを削除する。
+    static
+    void RemoveRecoveryData(String const &path_prefix);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> pimpl_;
+};
+
+NS_HWM_END
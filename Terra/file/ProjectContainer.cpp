@@ -0,0 +1,497 @@
+#include "ProjectContainer.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "../misc/Compression.hpp"
+#include "../misc/Hash.hpp"
+#include "../misc/MappedFile.hpp"
+#include "../misc/ParallelFor.hpp"
+
+NS_HWM_BEGIN
+
+namespace {
+    char const kMagic[4] = { 'T', 'R', 'P', 'C' };
+    //! 1: 最初のバージョン
+    //! 2: セクションの圧縮（Section::compression, uncompressed_size, dictionary_id）
+    UInt32 const kVersion = 2;
+    size_t const kHeaderSize = sizeof(kMagic) + sizeof(UInt32) * 2;
+
+    using Section = schema::ProjectContainerToc::Section;
+    
+    //! これより小さいセクションは、圧縮しても効果が小さいので圧縮しない。
+    size_t const kMinSizeToCompress = 256;
+    
+    struct SectionData
+    {
+        Section::Kind kind_;
+        UInt64 id_ = 0;
+        std::string data_;
+        UInt64 content_hash_ = 0;
+        Section::Compression compression_ = Section::kNone;
+        UInt64 uncompressed_size_ = 0;
+        UInt64 dictionary_id_ = 0;
+        
+        //! 同じ辞書で圧縮するセクションをまとめるためのキー（プラグインのCID）
+        std::string dictionary_group_;
+    };
+    
+    //! 同じプラグインの状態が複数ある場合に、それらから辞書を作成して、各セクションに設定する。
+    std::vector<std::string> MakeDictionaries(std::vector<SectionData> &sections)
+    {
+        std::map<std::string, std::vector<SectionData *>> groups;
+        for(auto &section: sections) {
+            if(section.dictionary_group_.empty()) { continue; }
+            groups[section.dictionary_group_].push_back(&section);
+        }
+        
+        std::vector<std::string> dictionaries;
+        for(auto &entry: groups) {
+            auto &group = entry.second;
+            if(group.size() < 2) { continue; }
+            
+            std::vector<std::string const *> samples;
+            for(auto section: group) { samples.push_back(&section->data_); }
+            dictionaries.push_back(MakeCompressionDictionary(samples));
+            
+            for(auto section: group) { section->dictionary_id_ = dictionaries.size(); }
+        }
+        
+        return dictionaries;
+    }
+    
+    //! 各セクションを並列に圧縮する。圧縮してもサイズが小さくならないセクションはそのままにする。
+    void CompressSections(std::vector<SectionData> &sections, std::vector<std::string> const &dictionaries)
+    {
+        std::string const empty_dictionary;
+        
+        ParallelFor(sections.size(), [&](size_t i) {
+            auto &section = sections[i];
+            if(section.data_.size() < kMinSizeToCompress) {
+                section.dictionary_id_ = 0;
+                return;
+            }
+            
+            auto const &dictionary = (section.dictionary_id_ == 0
+                                      ? empty_dictionary
+                                      : dictionaries[section.dictionary_id_ - 1]);
+            
+            std::string compressed;
+            if(CompressData(section.data_.data(), section.data_.size(), dictionary, compressed)
+               && compressed.size() < section.data_.size())
+            {
+                section.uncompressed_size_ = section.data_.size();
+                section.data_ = std::move(compressed);
+                section.compression_ = Section::kZlib;
+            } else {
+                section.dictionary_id_ = 0;
+            }
+        });
+    }
+
+    UInt64 HashData(char const *data, size_t size)
+    {
+        return FNV1a(kFNVOffsetBasis, data, data + size);
+    }
+    
+    void AppendUInt32(std::string &out, UInt32 value)
+    {
+        for(int i = 0; i < 4; ++i) {
+            out.push_back((char)((value >> (i * 8)) & 0xFF));
+        }
+    }
+
+    UInt32 ReadUInt32(char const *data)
+    {
+        UInt32 value = 0;
+        for(int i = 0; i < 4; ++i) {
+            value |= (UInt32)(UInt8)data[i] << (i * 8);
+        }
+        return value;
+    }
+}
+
+namespace ProjectContainer
+{
+    bool Serialize(schema::Project const &project, std::string &out, bool compress)
+    {
+        std::vector<SectionData> sections;
+
+        auto add_section = [&](Section::Kind kind, UInt64 id, google::protobuf::Message const &msg,
+                               std::string dictionary_group = {})
+        {
+            SectionData section;
+            section.kind_ = kind;
+            section.id_ = id;
+            section.dictionary_group_ = std::move(dictionary_group);
+            if(msg.SerializeToString(&section.data_) == false) { return false; }
+            
+            sections.push_back(std::move(section));
+            return true;
+        };
+
+        auto core = project;
+        core.mutable_graph()->clear_nodes();
+        core.clear_sequences();
+        if(!add_section(Section::kCore, 0, core)) { return false; }
+
+        for(auto const &node: project.graph().nodes()) {
+            auto const &proc = node.processor();
+            if(proc.has_vst3_data() && proc.vst3_data().has_dump() == false && proc.vst3_data().dump_hash() != 0) {
+                return false;
+            }
+            
+            if(proc.has_vst3_data() && proc.vst3_data().has_dump()) {
+                // ハッシュ値は、プラグインの状態のセクションの目次に書き込まれる。
+                auto node_without_dump = node;
+                node_without_dump.mutable_processor()->mutable_vst3_data()->clear_dump();
+                node_without_dump.mutable_processor()->mutable_vst3_data()->clear_dump_hash();
+                if(!add_section(Section::kNode, node.id(), node_without_dump)) { return false; }
+                auto const &cid = proc.vst3_data().desc().vst3info().cid();
+                if(!add_section(Section::kPluginDump, node.id(), proc.vst3_data().dump(), cid)) { return false; }
+            } else {
+                if(!add_section(Section::kNode, node.id(), node)) { return false; }
+            }
+        }
+
+        for(int i = 0; i < project.sequences_size(); ++i) {
+            if(!add_section(Section::kSequence, i, project.sequences(i))) { return false; }
+        }
+
+        ParallelFor(sections.size(), [&](size_t i) {
+            auto &section = sections[i];
+            section.content_hash_ = HashData(section.data_.data(), section.data_.size());
+        });
+        
+        std::vector<std::string> dictionaries;
+        if(compress) {
+            dictionaries = MakeDictionaries(sections);
+            CompressSections(sections, dictionaries);
+        }
+        
+        schema::ProjectContainerToc toc;
+        UInt64 offset = 0;
+        auto add_toc_entry = [&](SectionData const &data) {
+            auto section = toc.add_sections();
+            section->set_kind(data.kind_);
+            section->set_id(data.id_);
+            section->set_offset(offset);
+            section->set_size(data.data_.size());
+            section->set_compression(data.compression_);
+            section->set_uncompressed_size(data.uncompressed_size_);
+            section->set_dictionary_id(data.dictionary_id_);
+            section->set_content_hash(data.content_hash_);
+            offset += data.data_.size();
+        };
+        
+        for(size_t i = 0; i < dictionaries.size(); ++i) {
+            SectionData dictionary;
+            dictionary.kind_ = Section::kDictionary;
+            dictionary.id_ = i + 1;
+            dictionary.data_ = std::move(dictionaries[i]);
+            sections.push_back(std::move(dictionary));
+        }
+        
+        for(auto const &section: sections) { add_toc_entry(section); }
+        
+        std::string toc_data;
+        if(toc.SerializeToString(&toc_data) == false) { return false; }
+
+        out.clear();
+        out.reserve(kHeaderSize + toc_data.size() + offset);
+        out.append(kMagic, sizeof(kMagic));
+        AppendUInt32(out, kVersion);
+        AppendUInt32(out, (UInt32)toc_data.size());
+        out.append(toc_data);
+        for(auto const &section: sections) { out.append(section.data_); }
+
+        return true;
+    }
+
+    bool IsContainer(void const *data, size_t size)
+    {
+        return size >= kHeaderSize && std::memcmp(data, kMagic, sizeof(kMagic)) == 0;
+    }
+    
+    UInt64 HashPluginDump(schema::Processor::Vst3::Dump const &dump)
+    {
+        auto const data = dump.SerializeAsString();
+        return HashData(data.data(), data.size());
+    }
+    
+    void StripPluginDumps(schema::Project &project)
+    {
+        for(auto &node: *project.mutable_graph()->mutable_nodes()) {
+            auto proc = node.mutable_processor();
+            if(proc->has_vst3_data() == false || proc->vst3_data().has_dump() == false) { continue; }
+            
+            auto vst3 = proc->mutable_vst3_data();
+            if(vst3->dump_hash() == 0) {
+                vst3->set_dump_hash(HashPluginDump(vst3->dump()));
+            }
+            vst3->clear_dump();
+        }
+    }
+}
+
+ProjectContainerReader::ProjectContainerReader()
+{}
+
+ProjectContainerReader::~ProjectContainerReader()
+{}
+
+std::unique_ptr<ProjectContainerReader> ProjectContainerReader::Open(String const &path)
+{
+    auto storage = std::make_shared<Storage>();
+    storage->file_ = MappedFile::Open(path);
+    if(!storage->file_) { return nullptr; }
+
+    std::unique_ptr<ProjectContainerReader> reader(new ProjectContainerReader());
+    if(reader->Initialize(std::move(storage)) == false) { return nullptr; }
+
+    reader->path_ = path;
+    return reader;
+}
+
+std::unique_ptr<ProjectContainerReader> ProjectContainerReader::FromData(std::string data)
+{
+    auto storage = std::make_shared<Storage>();
+    storage->buffer_ = std::move(data);
+
+    std::unique_ptr<ProjectContainerReader> reader(new ProjectContainerReader());
+    if(reader->Initialize(std::move(storage)) == false) { return nullptr; }
+
+    return reader;
+}
+
+String ProjectContainerReader::GetPath() const
+{
+    return path_;
+}
+
+char const * ProjectContainerReader::Storage::GetData() const
+{
+    return file_ ? static_cast<char const *>(file_->GetData()) : buffer_.data();
+}
+
+size_t ProjectContainerReader::Storage::GetSize() const
+{
+    return file_ ? file_->GetSize() : buffer_.size();
+}
+
+bool ProjectContainerReader::Initialize(std::shared_ptr<Storage const> storage)
+{
+    auto const bytes = storage->GetData();
+    auto const size = storage->GetSize();
+    
+    if(ProjectContainer::IsContainer(bytes, size) == false) { return false; }
+
+    auto const version = ReadUInt32(bytes + sizeof(kMagic));
+    if(version > kVersion) { return false; }
+
+    auto const toc_size = ReadUInt32(bytes + sizeof(kMagic) + sizeof(UInt32));
+    if(toc_size > size - kHeaderSize) { return false; }
+
+    schema::ProjectContainerToc toc;
+    if(toc.ParseFromArray(bytes + kHeaderSize, toc_size) == false) { return false; }
+
+    body_offset_ = kHeaderSize + toc_size;
+    auto const body_size = size - body_offset_;
+
+    for(auto const &section: toc.sections()) {
+        if(section.offset() > body_size || section.size() > body_size - section.offset()) { return false; }
+
+        section_indices_[SectionKey(section.kind(), section.id())] = sections_.size();
+        sections_.push_back(section);
+    }
+
+    storage_ = std::move(storage);
+    return true;
+}
+
+void ProjectContainerReader::ReleaseFile()
+{
+    auto storage = std::atomic_load(&storage_);
+    if(!storage->file_) { return; }
+    
+    auto copied = std::make_shared<Storage>();
+    copied->buffer_.assign(storage->GetData(), storage->GetSize());
+    std::atomic_store(&storage_, std::shared_ptr<Storage const>(std::move(copied)));
+    
+    // 読み込み中のスレッドが古い内容を参照しなくなるまで待つ。
+    while(storage.use_count() > 1) {
+        std::this_thread::yield();
+    }
+}
+
+bool ProjectContainerReader::GetSectionData(char const *body, Section const &section, std::string &buffer,
+                                            char const *&data, size_t &size) const
+{
+    if(section.compression() == Section::kNone) {
+        data = body + section.offset();
+        size = section.size();
+        return true;
+    }
+    
+    if(section.compression() != Section::kZlib) { return false; }
+    
+    std::string dictionary;
+    if(section.dictionary_id() != 0) {
+        auto found = section_indices_.find(SectionKey(Section::kDictionary, section.dictionary_id()));
+        if(found == section_indices_.end()) { return false; }
+        
+        auto const &dict_section = sections_[found->second];
+        dictionary.assign(body + dict_section.offset(), dict_section.size());
+    }
+    
+    if(DecompressData(body + section.offset(), section.size(), section.uncompressed_size(),
+                      dictionary, buffer) == false)
+    {
+        return false;
+    }
+    
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+bool ProjectContainerReader::ParseSection(char const *body, Section const &section,
+                                          google::protobuf::Message &msg) const
+{
+    std::string buffer;
+    char const *data = nullptr;
+    size_t size = 0;
+    if(GetSectionData(body, section, buffer, data, size) == false) { return false; }
+    
+    return msg.ParseFromArray(data, (int)size);
+}
+
+UInt64 ProjectContainerReader::GetPluginDumpHash(char const *body, UInt64 node_id) const
+{
+    auto found = section_indices_.find(SectionKey(Section::kPluginDump, node_id));
+    if(found == section_indices_.end()) { return 0; }
+    
+    auto const &section = sections_[found->second];
+    if(section.content_hash() != 0) { return section.content_hash(); }
+    
+    std::string buffer;
+    char const *data = nullptr;
+    size_t size = 0;
+    if(GetSectionData(body, section, buffer, data, size) == false) { return 0; }
+    
+    return HashData(data, size);
+}
+
+std::unique_ptr<schema::Project> ProjectContainerReader::ReadProject() const
+{
+    auto project = std::make_unique<schema::Project>();
+    auto const storage = std::atomic_load(&storage_);
+    auto const body = storage->GetData() + body_offset_;
+
+    auto found_core = section_indices_.find(SectionKey(Section::kCore, 0));
+    if(found_core == section_indices_.end()) { return nullptr; }
+    if(ParseSection(body, sections_[found_core->second], *project) == false) { return nullptr; }
+
+    // 圧縮されたセクションを並列に展開できるように、先に格納先を確保しておく。
+    std::vector<Section const *> sections;
+    std::vector<google::protobuf::Message *> messages;
+    for(auto const &section: sections_) {
+        if(section.kind() == Section::kNode) {
+            sections.push_back(&section);
+            messages.push_back(project->mutable_graph()->add_nodes());
+        } else if(section.kind() == Section::kSequence) {
+            sections.push_back(&section);
+            messages.push_back(project->add_sequences());
+        }
+    }
+    
+    std::atomic<bool> successful { true };
+    ParallelFor(sections.size(), [&](size_t i) {
+        if(ParseSection(body, *sections[i], *messages[i]) == false) {
+            successful = false;
+            return;
+        }
+        
+        if(sections[i]->kind() != Section::kNode) { return; }
+        
+        auto &node = static_cast<schema::Node &>(*messages[i]);
+        if(node.processor().has_vst3_data() == false) { return; }
+        
+        auto const hash = GetPluginDumpHash(body, node.id());
+        if(hash != 0) {
+            node.mutable_processor()->mutable_vst3_data()->set_dump_hash(hash);
+        }
+    });
+    
+    if(successful == false) { return nullptr; }
+    return project;
+}
+
+bool ProjectContainerReader::ReadPluginDump(UInt64 node_id, schema::Processor::Vst3::Dump &dump) const
+{
+    auto found = section_indices_.find(SectionKey(Section::kPluginDump, node_id));
+    if(found == section_indices_.end()) { return false; }
+
+    auto const storage = std::atomic_load(&storage_);
+    return ParseSection(storage->GetData() + body_offset_, sections_[found->second], dump);
+}
+
+ProjectContainerReader::Section const *
+ProjectContainerReader::FindPluginDumpWithHash(UInt64 dump_hash) const
+{
+    std::call_once(dump_hash_indices_flag_, [this] {
+        auto const storage = std::atomic_load(&storage_);
+        auto const body = storage->GetData() + body_offset_;
+        for(auto const &section: sections_) {
+            if(section.kind() != Section::kPluginDump) { continue; }
+            
+            auto const hash = GetPluginDumpHash(body, section.id());
+            if(hash != 0) { dump_hash_indices_[hash] = &section - sections_.data(); }
+        }
+    });
+    
+    auto found = dump_hash_indices_.find(dump_hash);
+    if(found == dump_hash_indices_.end()) { return nullptr; }
+    
+    return &sections_[found->second];
+}
+
+bool ProjectContainerReader::HasPluginDumpWithHash(UInt64 dump_hash) const
+{
+    return FindPluginDumpWithHash(dump_hash) != nullptr;
+}
+
+bool ProjectContainerReader::ReadPluginDumpWithHash(UInt64 dump_hash, schema::Processor::Vst3::Dump &dump) const
+{
+    auto section = FindPluginDumpWithHash(dump_hash);
+    if(!section) { return false; }
+    
+    auto const storage = std::atomic_load(&storage_);
+    return ParseSection(storage->GetData() + body_offset_, *section, dump);
+}
+
+bool ProjectContainerReader::ReadPluginDumps(schema::Project &project) const
+{
+    std::vector<schema::Processor::Vst3 *> targets;
+    for(auto &node: *project.mutable_graph()->mutable_nodes()) {
+        auto proc = node.mutable_processor();
+        if(proc->has_vst3_data() == false) { continue; }
+        
+        auto vst3 = proc->mutable_vst3_data();
+        if(vst3->has_dump() || vst3->dump_hash() == 0) { continue; }
+        
+        targets.push_back(vst3);
+    }
+    
+    std::atomic<bool> successful { true };
+    ParallelFor(targets.size(), [&](size_t i) {
+        if(ReadPluginDumpWithHash(targets[i]->dump_hash(), *targets[i]->mutable_dump()) == false) {
+            successful = false;
+        }
+    });
+    
+    return successful;
+}
+
+NS_HWM_END
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <project.pb.h>
+
+NS_HWM_BEGIN
+
+class MappedFile;
+
+//! プロジェクトを、ノードやシーケンス、プラグインの状態ごとのセクションに分けて保存するファイル形式
+/*! 目次を読み込めば、各セクションを個別に取り出せるので、
+ *  プロジェクトを開くときにプラグインの状態のような大きなデータをすべてメモリに展開せずに済む。
+ *
+ *  各セクションは個別に圧縮できる。
+ *
+ *  ファイルのレイアウト:
+ *  | マジックナンバー(4バイト) | バージョン(UInt32) | 目次のサイズ(UInt32) | ProjectContainerToc | セクション... |
+ */
+namespace ProjectContainer
+{
+    //! プロジェクトをこの形式でシリアライズする。
+    /*! @param compress trueの場合は、各セクションを並列に圧縮する。
+     *  同じプラグインの状態が複数ある場合は、それらから作成した辞書を使って圧縮する。
+     *  @return dump_hashだけが設定されていて、状態が含まれていないプラグインがある場合はfalse
+     */
+    bool Serialize(schema::Project const &project, std::string &out, bool compress);
+
+    //! データがこの形式で始まっているかどうか
+    bool IsContainer(void const *data, size_t size);
+    
+    //! プラグインの状態のハッシュ値（Processor.Vst3.dump_hash）を計算する。
+    /*! ファイルに書き込まれたプラグインの状態のセクションのハッシュ値と同じになる。
+     */
+    UInt64 HashPluginDump(schema::Processor::Vst3::Dump const &dump);
+    
+    //! プラグインの状態を、そのハッシュ値だけを残して取り除く。
+    /*! ハッシュ値が設定されていない場合は計算する。
+     *  プラグインの状態の大きなデータを比較せずに、プロジェクトの変更を検出するために使用する。
+     */
+    void StripPluginDumps(schema::Project &project);
+}
+
+//! ProjectContainer形式のデータから、必要なセクションだけを読み込む。
+/*! 読み込みはconstな関数で行われ、複数のスレッドから同時に呼び出せる。
+ */
+class ProjectContainerReader
+{
+public:
+    //! ファイルをメモリにマップして開く。
+    /*! @return ファイルを開けないか、ProjectContainer形式でない場合はnullptr
+     */
+    static
+    std::unique_ptr<ProjectContainerReader> Open(String const &path);
+
+    //! メモリ上のデータから作成する。
+    static
+    std::unique_ptr<ProjectContainerReader> FromData(std::string data);
+
+    ~ProjectContainerReader();
+    
+    //! Open()で開いたファイルのパス。FromData()で作成した場合は空文字列
+    String GetPath() const;
+
+    //! プラグインの状態を除いたプロジェクトを読み込む。
+    /*! プラグインの状態の代わりに、そのハッシュ値がdump_hashに設定される。
+     *  （目次にハッシュ値がない古いファイルの場合は、状態を読み込んで計算する）
+     */
+    std::unique_ptr<schema::Project> ReadProject() const;
+
+    //! node_idのノードのプラグインの状態を読み込む。
+    /*! @return 状態が保存されていない場合はfalse
+     */
+    bool ReadPluginDump(UInt64 node_id, schema::Processor::Vst3::Dump &dump) const;
+    
+    //! ハッシュ値がdump_hashのプラグインの状態が保存されているかどうか
+    bool HasPluginDumpWithHash(UInt64 dump_hash) const;
+    
+    //! ハッシュ値がdump_hashのプラグインの状態を読み込む。
+    /*! ノードのIDはプロジェクトを開くたびに変わるので、ReadProject()で読み込んだ後のプロジェクトからは、
+     *  ハッシュ値で状態を探す。
+     *  @return 状態が保存されていない場合はfalse
+     */
+    bool ReadPluginDumpWithHash(UInt64 dump_hash, schema::Processor::Vst3::Dump &dump) const;
+    
+    //! dump_hashだけが設定されているプラグインの状態を、並列に読み込んで設定する。
+    /*! @return 状態が保存されていないノードがある場合はfalse
+     */
+    bool ReadPluginDumps(schema::Project &project) const;
+    
+    //! ファイルのマップを解除して、内容をメモリにコピーする。
+    /*! マップされたままのファイルは（Windowsでは）置き換えられないので、
+     *  このファイルに上書き保存する前に呼び出す。
+     *  他のスレッドでの読み込みが完了して、マップが解除されるまで待機する。
+     */
+    void ReleaseFile();
+
+private:
+    using Section = schema::ProjectContainerToc::Section;
+    using SectionKey = std::pair<int, UInt64>;
+
+    //! ファイルの内容。ReleaseFile()で差し替えられるので、読み込み中はshared_ptrで保持する。
+    struct Storage
+    {
+        std::unique_ptr<MappedFile> file_;
+        std::string buffer_;
+        
+        char const * GetData() const;
+        size_t GetSize() const;
+    };
+    
+    String path_;
+    std::shared_ptr<Storage const> storage_;
+    size_t body_offset_ = 0; // 目次の後ろの、セクションが始まる位置
+    std::vector<Section> sections_; // ファイルに書き込まれた順
+    std::map<SectionKey, size_t> section_indices_;
+    
+    //! プラグインの状態のハッシュ値から、セクションを探すためのインデックス
+    /*! 目次にハッシュ値がない古いファイルでは、状態を展開して計算する必要があるので、必要になったときに作成する。
+     */
+    std::map<UInt64, size_t> mutable dump_hash_indices_;
+    std::once_flag mutable dump_hash_indices_flag_;
+    
+    //! @return 見つからない場合はnullptr
+    Section const * FindPluginDumpWithHash(UInt64 dump_hash) const;
+
+    ProjectContainerReader();
+    bool Initialize(std::shared_ptr<Storage const> storage);
+
+    //! @return セクションが見つからないか、パースに失敗した場合はfalse
+    bool ParseSection(char const *body, Section const &section, google::protobuf::Message &msg) const;
+    
+    //! セクションのデータを取得する。
+    /*! 圧縮されている場合はbufferに展開して、dataはbufferを指す。
+     *  @return 展開に失敗した場合はfalse
+     */
+    bool GetSectionData(char const *body, Section const &section, std::string &buffer,
+                        char const *&data, size_t &size) const;
+    
+    //! node_idのノードのプラグインの状態のハッシュ値を取得する。
+    /*! @return 状態が保存されていないか、ハッシュ値を計算できない場合は0
+     */
+    UInt64 GetPluginDumpHash(char const *body, UInt64 node_id) const;
+};
+
+NS_HWM_END
@@ -0,0 +1,275 @@
+#include "ProjectJournal.hpp"
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+
+#include <google/protobuf/util/message_differencer.h>
+
+#include "../misc/Hash.hpp"
+
+NS_HWM_BEGIN
+
+namespace ProjectJournal
+{
+    namespace {
+        bool IsSame(google::protobuf::Message const &lhs, google::protobuf::Message const &rhs)
+        {
+            return lhs.SerializeAsString() == rhs.SerializeAsString();
+        }
+        
+        //! プラグインの状態は、そのハッシュ値（dump_hash）で比較する。
+        /*! 状態が取り除かれたノードと、状態を含むノードを比較できるように、
+         *  また、大きな状態のデータを毎回シリアライズしなくて済むようにする。
+         */
+        bool IsSameNode(schema::Node const &lhs, schema::Node const &rhs)
+        {
+            google::protobuf::util::MessageDifferencer diff;
+            diff.IgnoreField(schema::Processor::Vst3::descriptor()->FindFieldByName("dump"));
+            return diff.Compare(lhs, rhs);
+        }
+
+        template<class Int>
+        void WriteInt(std::ostream &os, Int value)
+        {
+            char buf[sizeof(Int)];
+            for(size_t i = 0; i < sizeof(Int); ++i) {
+                buf[i] = (char)((value >> (i * 8)) & 0xFF);
+            }
+            os.write(buf, sizeof(Int));
+        }
+
+        template<class Int>
+        bool ReadInt(std::istream &is, Int &value)
+        {
+            char buf[sizeof(Int)];
+            if(!is.read(buf, sizeof(Int))) { return false; }
+
+            value = 0;
+            for(size_t i = 0; i < sizeof(Int); ++i) {
+                value |= (Int)(UInt8)buf[i] << (i * 8);
+            }
+            return true;
+        }
+
+        //! nodeがプラグインの状態を含まない場合に、同じハッシュ値のfromの状態を移す。
+        void InheritPluginDump(schema::Node &node, schema::Node &from)
+        {
+            if(node.processor().has_vst3_data() == false || from.processor().has_vst3_data() == false) { return; }
+            
+            auto vst3 = node.mutable_processor()->mutable_vst3_data();
+            auto from_vst3 = from.mutable_processor()->mutable_vst3_data();
+            if(vst3->has_dump() || vst3->dump_hash() == 0) { return; }
+            if(from_vst3->has_dump() == false || from_vst3->dump_hash() != vst3->dump_hash()) { return; }
+            
+            vst3->set_allocated_dump(from_vst3->release_dump());
+        }
+        
+        //! 一つのレコードとして読み込むデータサイズの上限。（壊れたサイズを読んだときに巨大なメモリを確保しないように）
+        UInt32 const kMaxRecordSize = 1024 * 1024 * 1024;
+    }
+
+    std::unique_ptr<schema::ProjectJournalRecord>
+    MakeRecord(schema::Project const &base, schema::Project const &current)
+    {
+        auto record = std::make_unique<schema::ProjectJournalRecord>();
+        bool changed = false;
+
+        if(IsSame(base.musical_parameters(), current.musical_parameters()) == false) {
+            *record->mutable_musical_parameters() = current.musical_parameters();
+            changed = true;
+        }
+
+        if(IsSame(base.transport(), current.transport()) == false) {
+            *record->mutable_transport() = current.transport();
+            changed = true;
+        }
+
+        if(IsSame(base.frame_rect(), current.frame_rect()) == false) {
+            *record->mutable_frame_rect() = current.frame_rect();
+            changed = true;
+        }
+
+        if(IsSame(base.processing_mode(), current.processing_mode()) == false) {
+            *record->mutable_processing_mode() = current.processing_mode();
+            changed = true;
+        }
+
+        std::unordered_map<UInt64, schema::Node const *> base_nodes;
+        for(auto const &node: base.graph().nodes()) {
+            base_nodes[node.id()] = &node;
+        }
+
+        for(auto const &node: current.graph().nodes()) {
+            auto found = base_nodes.find(node.id());
+            if(found == base_nodes.end() || IsSameNode(*found->second, node) == false) {
+                *record->add_updated_nodes() = node;
+                changed = true;
+            }
+
+            if(found != base_nodes.end()) { base_nodes.erase(found); }
+        }
+
+        // currentに見つからなかったノードは削除されている。
+        for(auto const &node: base.graph().nodes()) {
+            if(base_nodes.count(node.id())) {
+                record->add_removed_node_ids(node.id());
+                changed = true;
+            }
+        }
+
+        auto const &base_conns = base.graph().connections();
+        auto const &current_conns = current.graph().connections();
+        bool const conns_changed
+        = (base_conns.size() != current_conns.size())
+        || std::equal(base_conns.begin(), base_conns.end(), current_conns.begin(),
+                      [](auto const &lhs, auto const &rhs) { return IsSame(lhs, rhs); }) == false;
+
+        if(conns_changed) {
+            auto list = record->mutable_connections()->mutable_list();
+            list->CopyFrom(current_conns);
+            changed = true;
+        }
+
+        auto const num_sequences = current.sequences_size();
+        record->set_num_sequences(num_sequences);
+        if(base.sequences_size() != num_sequences) { changed = true; }
+
+        for(int i = 0; i < num_sequences; ++i) {
+            auto const &seq = current.sequences(i);
+            if(i < base.sequences_size() && IsSame(base.sequences(i), seq)) { continue; }
+
+            auto entry = record->add_updated_sequences();
+            entry->set_index(i);
+            *entry->mutable_sequence() = seq;
+            changed = true;
+        }
+
+        if(changed == false) { return nullptr; }
+        return record;
+    }
+
+    void ApplyRecord(schema::Project &project, schema::ProjectJournalRecord const &record)
+    {
+        if(record.has_musical_parameters()) {
+            *project.mutable_musical_parameters() = record.musical_parameters();
+        }
+
+        if(record.has_transport()) {
+            *project.mutable_transport() = record.transport();
+        }
+
+        if(record.has_frame_rect()) {
+            *project.mutable_frame_rect() = record.frame_rect();
+        }
+
+        if(record.has_processing_mode()) {
+            *project.mutable_processing_mode() = record.processing_mode();
+        }
+
+        auto graph = project.mutable_graph();
+        auto nodes = graph->mutable_nodes();
+
+        for(auto const id: record.removed_node_ids()) {
+            auto found = std::find_if(nodes->begin(), nodes->end(),
+                                      [id](auto const &node) { return node.id() == id; });
+            if(found != nodes->end()) {
+                nodes->erase(found);
+            }
+        }
+
+        for(auto const &node: record.updated_nodes()) {
+            auto found = std::find_if(nodes->begin(), nodes->end(),
+                                      [&node](auto const &x) { return x.id() == node.id(); });
+            if(found != nodes->end()) {
+                auto updated = node;
+                InheritPluginDump(updated, *found);
+                *found = std::move(updated);
+            } else {
+                *nodes->Add() = node;
+            }
+        }
+
+        if(record.has_connections()) {
+            graph->mutable_connections()->CopyFrom(record.connections().list());
+        }
+
+        auto sequences = project.mutable_sequences();
+        int const num_sequences = record.num_sequences();
+        while(sequences->size() > num_sequences) { sequences->RemoveLast(); }
+        while(sequences->size() < num_sequences) { sequences->Add(); }
+
+        for(auto const &entry: record.updated_sequences()) {
+            if(entry.index() >= (UInt32)num_sequences) { continue; }
+            *sequences->Mutable(entry.index()) = entry.sequence();
+        }
+    }
+
+    void InheritPluginDumps(schema::Project &project, schema::Project &from)
+    {
+        std::unordered_map<UInt64, schema::Node *> from_nodes;
+        for(auto &node: *from.mutable_graph()->mutable_nodes()) {
+            from_nodes[node.id()] = &node;
+        }
+        
+        for(auto &node: *project.mutable_graph()->mutable_nodes()) {
+            auto found = from_nodes.find(node.id());
+            if(found != from_nodes.end()) {
+                InheritPluginDump(node, *found->second);
+            }
+        }
+    }
+
+    bool WriteRecord(std::ostream &os, schema::ProjectJournalRecord const &record)
+    {
+        std::string data;
+        if(record.SerializeToString(&data) == false) { return false; }
+
+        WriteInt<UInt32>(os, (UInt32)data.size());
+        WriteInt<UInt64>(os, FNV1a(kFNVOffsetBasis, data.begin(), data.end()));
+        os.write(data.data(), data.size());
+
+        return os.good();
+    }
+
+    std::vector<schema::ProjectJournalRecord> ReadRecords(std::istream &is)
+    {
+        std::vector<schema::ProjectJournalRecord> records;
+
+        for( ; ; ) {
+            UInt32 size = 0;
+            UInt64 hash = 0;
+            if(!ReadInt(is, size) || !ReadInt(is, hash)) { break; }
+            if(size > kMaxRecordSize) { break; }
+
+            std::string data(size, '\0');
+            if(!is.read(&data[0], size)) { break; }
+            if(FNV1a(kFNVOffsetBasis, data.begin(), data.end()) != hash) { break; }
+
+            schema::ProjectJournalRecord record;
+            if(record.ParseFromString(data) == false) { break; }
+
+            records.push_back(std::move(record));
+        }
+
+        return records;
+    }
+
+    std::unique_ptr<schema::Project>
+    Replay(schema::ProjectJournalSnapshot const &snapshot,
+           std::vector<schema::ProjectJournalRecord> const &records)
+    {
+        auto project = std::make_unique<schema::Project>(snapshot.project());
+
+        for(auto const &record: records) {
+            // スナップショットを作り直す前に書き込まれた古いレコードは無視する。
+            if(record.generation() != snapshot.generation()) { continue; }
+            ApplyRecord(*project, record);
+        }
+
+        return project;
+    }
+}
+
+NS_HWM_END
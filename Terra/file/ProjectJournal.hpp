@@ -0,0 +1,50 @@
+#pragma once
+
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+#include <project.pb.h>
+
+NS_HWM_BEGIN
+
+//! 自動保存用に、プロジェクトの変更を差分として記録するための関数群
+/*! ジャーナルファイルは、以下の形式のレコードを順に並べたものになっている。
+ *  | データサイズ(UInt32) | データのFNV-1aハッシュ(UInt64) | シリアライズしたProjectJournalRecord |
+ *  書き込み中にアプリケーションが終了して末尾のレコードが壊れていても、それ以前のレコードは読み込める。
+ */
+namespace ProjectJournal
+{
+    //! baseからcurrentへの変更を表すレコードを作成する。
+    /*! プラグインの状態はdump_hashで比較する。
+     *  @return 変更がない場合はnullptr
+     */
+    std::unique_ptr<schema::ProjectJournalRecord>
+    MakeRecord(schema::Project const &base, schema::Project const &current);
+
+    //! MakeRecord()で作成したレコードをprojectに適用する。
+    /*! プラグインの状態を含まないノード（dump_hashだけが設定されている）で置き換える場合は、
+     *  ハッシュ値が同じであれば、既存のノードの状態を引き継ぐ。
+     */
+    void ApplyRecord(schema::Project &project, schema::ProjectJournalRecord const &record);
+    
+    //! projectのうち、プラグインの状態を含まないノードに、fromの同じノードの状態を移す。
+    /*! ノードのIDとdump_hashが同じ場合だけ移す。
+     *  自動保存では、前回の記録から変化していないプラグインの状態は、ハッシュ値だけで記録されるので、
+     *  前回の記録の状態を引き継ぐために使用する。
+     */
+    void InheritPluginDumps(schema::Project &project, schema::Project &from);
+
+    //! レコードをストリームに書き込む。
+    bool WriteRecord(std::ostream &os, schema::ProjectJournalRecord const &record);
+
+    //! ストリームの末尾か、壊れたレコードが見つかるまでレコードを読み込む。
+    std::vector<schema::ProjectJournalRecord> ReadRecords(std::istream &is);
+
+    //! スナップショットに、同じgenerationのレコードを順に適用する。
+    std::unique_ptr<schema::Project>
+    Replay(schema::ProjectJournalSnapshot const &snapshot,
+           std::vector<schema::ProjectJournalRecord> const &records);
+}
+
+NS_HWM_END
@@ -0,0 +1,389 @@
+#include "WaveFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include "../misc/FileStream.hpp"
+#include "../misc/Interleave.hpp"
+
+NS_HWM_BEGIN
+
+namespace {
+
+// WAVファイルの数値はリトルエンディアンで格納される。
+// 対応しているプラットフォームはすべてリトルエンディアンなので、そのまま読み書きする。
+
+UInt16 const kFormatTagPcm = 1;
+UInt16 const kFormatTagIeeeFloat = 3;
+UInt16 const kFormatTagExtensible = 0xFFFE;
+
+UInt32 const kRiffHeaderSize = 12;
+UInt32 const kChunkHeaderSize = 8;
+UInt32 const kFmtChunkSize = 16;
+//! データチャンクの先頭の位置
+UInt32 const kDataOffset = kRiffHeaderSize + kChunkHeaderSize + kFmtChunkSize + kChunkHeaderSize;
+
+template<class T>
+void WriteValue(std::ostream &os, T value)
+{
+    os.write(reinterpret_cast<char const *>(&value), sizeof(T));
+}
+
+template<class T>
+T ReadValue(char const *p)
+{
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+bool HasTag(char const *p, char const *tag)
+{
+    return std::memcmp(p, tag, 4) == 0;
+}
+
+//! ファイルのサンプルの形式
+enum class SampleFormat
+{
+    kInt8,  //!< 8bit符号なし整数
+    kInt16,
+    kInt24,
+    kInt32,
+    kFloat32,
+    kFloat64,
+};
+
+std::optional<SampleFormat> GetSampleFormat(UInt16 format_tag, UInt16 bits_per_sample)
+{
+    if(format_tag == kFormatTagPcm) {
+        switch(bits_per_sample) {
+            case 8: return SampleFormat::kInt8;
+            case 16: return SampleFormat::kInt16;
+            case 24: return SampleFormat::kInt24;
+            case 32: return SampleFormat::kInt32;
+        }
+    } else if(format_tag == kFormatTagIeeeFloat) {
+        switch(bits_per_sample) {
+            case 32: return SampleFormat::kFloat32;
+            case 64: return SampleFormat::kFloat64;
+        }
+    }
+    
+    return std::nullopt;
+}
+
+//! srcのnum_values個のサンプルを、[-1.0, 1.0]の範囲のfloatに変換する。
+void ConvertToFloat(char const *src, float *dest, size_t num_values, SampleFormat format)
+{
+    switch(format) {
+        case SampleFormat::kInt8:
+            for(size_t i = 0; i < num_values; ++i) {
+                dest[i] = ((Int32)(UInt8)src[i] - 128) / 128.0f;
+            }
+            break;
+        case SampleFormat::kInt16:
+            for(size_t i = 0; i < num_values; ++i) {
+                dest[i] = ReadValue<Int16>(src + i * 2) / 32768.0f;
+            }
+            break;
+        case SampleFormat::kInt24:
+            for(size_t i = 0; i < num_values; ++i) {
+                auto const p = reinterpret_cast<UInt8 const *>(src + i * 3);
+                // 上位に詰めてから算術シフトで符号拡張する。
+                auto const value = (Int32)(((UInt32)p[0] << 8) | ((UInt32)p[1] << 16) | ((UInt32)p[2] << 24)) >> 8;
+                dest[i] = value / 8388608.0f;
+            }
+            break;
+        case SampleFormat::kInt32:
+            for(size_t i = 0; i < num_values; ++i) {
+                dest[i] = (float)(ReadValue<Int32>(src + i * 4) / 2147483648.0);
+            }
+            break;
+        case SampleFormat::kFloat32:
+            std::memcpy(dest, src, num_values * sizeof(float));
+            break;
+        case SampleFormat::kFloat64:
+            for(size_t i = 0; i < num_values; ++i) {
+                dest[i] = (float)ReadValue<double>(src + i * 8);
+            }
+            break;
+    }
+}
+
+}   // namespace
+
+struct WaveFileWriter::Impl
+{
+    std::ofstream ofs_;
+    UInt32 num_channels_ = 0;
+    double sample_rate_ = 0;
+    SampleCount num_samples_ = 0;
+    std::vector<float> interleaved_;
+    std::vector<float const *> channel_ptrs_;
+    std::vector<float> silence_;
+    bool closed_ = false;
+
+    void WriteHeader(UInt32 data_size)
+    {
+        ofs_.write("RIFF", 4);
+        WriteValue<UInt32>(ofs_, kDataOffset - kChunkHeaderSize + data_size);
+        ofs_.write("WAVE", 4);
+
+        ofs_.write("fmt ", 4);
+        WriteValue<UInt32>(ofs_, kFmtChunkSize);
+        WriteValue<UInt16>(ofs_, kFormatTagIeeeFloat);
+        WriteValue<UInt16>(ofs_, (UInt16)num_channels_);
+        WriteValue<UInt32>(ofs_, (UInt32)sample_rate_);
+        WriteValue<UInt32>(ofs_, (UInt32)sample_rate_ * num_channels_ * sizeof(float));
+        WriteValue<UInt16>(ofs_, (UInt16)(num_channels_ * sizeof(float)));
+        WriteValue<UInt16>(ofs_, (UInt16)(sizeof(float) * 8));
+
+        ofs_.write("data", 4);
+        WriteValue<UInt32>(ofs_, data_size);
+    }
+};
+
+WaveFileWriter::WaveFileWriter(std::unique_ptr<Impl> pimpl)
+:   pimpl_(std::move(pimpl))
+{}
+
+std::unique_ptr<WaveFileWriter> WaveFileWriter::Create(String const &path, UInt32 num_channels, double sample_rate)
+{
+    if(num_channels == 0 || sample_rate <= 0) { return nullptr; }
+
+    auto pimpl = std::make_unique<Impl>();
+    pimpl->ofs_ = open_ofstream(path, std::ios::binary|std::ios::trunc);
+    if(!pimpl->ofs_) { return nullptr; }
+
+    pimpl->num_channels_ = num_channels;
+    pimpl->sample_rate_ = sample_rate;
+    pimpl->channel_ptrs_.resize(num_channels);
+
+    // サイズは Close() で確定する。
+    pimpl->WriteHeader(0);
+    if(!pimpl->ofs_) { return nullptr; }
+
+    return std::unique_ptr<WaveFileWriter>(new WaveFileWriter(std::move(pimpl)));
+}
+
+WaveFileWriter::~WaveFileWriter()
+{
+    Close();
+}
+
+UInt32 WaveFileWriter::GetNumChannels() const
+{
+    return pimpl_->num_channels_;
+}
+
+double WaveFileWriter::GetSampleRate() const
+{
+    return pimpl_->sample_rate_;
+}
+
+SampleCount WaveFileWriter::GetNumSamples() const
+{
+    return pimpl_->num_samples_;
+}
+
+bool WaveFileWriter::Write(BufferRef<float const> src)
+{
+    if(pimpl_->closed_) { return false; }
+
+    auto const num_samples = src.samples();
+    if(num_samples == 0) { return true; }
+
+    if(pimpl_->silence_.size() < num_samples) {
+        pimpl_->silence_.resize(num_samples);
+    }
+
+    for(UInt32 ch = 0; ch < pimpl_->num_channels_; ++ch) {
+        pimpl_->channel_ptrs_[ch] = (ch < src.channels()
+                                     ? src.get_channel_data(ch)
+                                     : pimpl_->silence_.data());
+    }
+
+    pimpl_->interleaved_.resize(num_samples * pimpl_->num_channels_);
+    Interleave(pimpl_->channel_ptrs_.data(), pimpl_->interleaved_.data(),
+               pimpl_->num_channels_, num_samples);
+
+    pimpl_->ofs_.write(reinterpret_cast<char const *>(pimpl_->interleaved_.data()),
+                       pimpl_->interleaved_.size() * sizeof(float));
+    if(!pimpl_->ofs_) { return false; }
+
+    pimpl_->num_samples_ += num_samples;
+    return true;
+}
+
+bool WaveFileWriter::Close()
+{
+    if(pimpl_->closed_) { return true; }
+    pimpl_->closed_ = true;
+
+    auto const data_size = (UInt32)(pimpl_->num_samples_ * pimpl_->num_channels_ * sizeof(float));
+    pimpl_->ofs_.seekp(0);
+    pimpl_->WriteHeader(data_size);
+    pimpl_->ofs_.close();
+
+    return !pimpl_->ofs_.fail();
+}
+
+struct WaveFileReader::Impl
+{
+    std::ifstream ifs_;
+    UInt32 num_channels_ = 0;
+    double sample_rate_ = 0;
+    SampleCount num_samples_ = 0;
+    SampleFormat format_ = SampleFormat::kFloat32;
+    //! 1サンプル（1チャンネル分）のバイト数
+    UInt32 bytes_per_sample_ = 0;
+    //! データチャンクの先頭の位置
+    std::streamoff data_offset_ = 0;
+    std::vector<char> raw_;
+    std::vector<float> interleaved_;
+    std::vector<float *> channel_ptrs_;
+    Buffer<float> discarded_;
+
+    bool ParseHeader()
+    {
+        char riff[kRiffHeaderSize];
+        if(!ifs_.read(riff, kRiffHeaderSize)) { return false; }
+        if(!HasTag(riff, "RIFF") || !HasTag(riff + 8, "WAVE")) { return false; }
+
+        bool has_fmt = false;
+        for( ; ; ) {
+            char header[kChunkHeaderSize];
+            if(!ifs_.read(header, kChunkHeaderSize)) { return false; }
+            auto const chunk_size = ReadValue<UInt32>(header + 4);
+
+            if(HasTag(header, "fmt ")) {
+                if(chunk_size < kFmtChunkSize) { return false; }
+                std::vector<char> fmt(chunk_size);
+                if(!ifs_.read(fmt.data(), chunk_size)) { return false; }
+
+                auto format_tag = ReadValue<UInt16>(fmt.data());
+                num_channels_ = ReadValue<UInt16>(fmt.data() + 2);
+                sample_rate_ = ReadValue<UInt32>(fmt.data() + 4);
+                auto const bits_per_sample = ReadValue<UInt16>(fmt.data() + 14);
+
+                // WAVE_FORMAT_EXTENSIBLEの場合は、SubFormatのGUIDの先頭2バイトが形式を表す。
+                if(format_tag == kFormatTagExtensible) {
+                    if(chunk_size < 40) { return false; }
+                    format_tag = ReadValue<UInt16>(fmt.data() + 24);
+                }
+
+                auto const format = GetSampleFormat(format_tag, bits_per_sample);
+                if(!format) { return false; }
+                if(num_channels_ == 0 || sample_rate_ <= 0) { return false; }
+                format_ = *format;
+                bytes_per_sample_ = bits_per_sample / 8;
+                has_fmt = true;
+            } else if(HasTag(header, "data")) {
+                if(!has_fmt) { return false; }
+                data_offset_ = ifs_.tellg();
+                num_samples_ = chunk_size / (num_channels_ * bytes_per_sample_);
+                return true;
+            } else {
+                ifs_.seekg(chunk_size, std::ios::cur);
+            }
+
+            // チャンクは2バイト境界に揃えられている。
+            if(chunk_size % 2 == 1) { ifs_.seekg(1, std::ios::cur); }
+        }
+    }
+};
+
+WaveFileReader::WaveFileReader(std::unique_ptr<Impl> pimpl)
+:   pimpl_(std::move(pimpl))
+{}
+
+std::unique_ptr<WaveFileReader> WaveFileReader::Open(String const &path)
+{
+    auto pimpl = std::make_unique<Impl>();
+    pimpl->ifs_ = open_ifstream(path, std::ios::binary);
+    if(!pimpl->ifs_) { return nullptr; }
+
+    if(pimpl->ParseHeader() == false) { return nullptr; }
+    pimpl->channel_ptrs_.resize(pimpl->num_channels_);
+
+    return std::unique_ptr<WaveFileReader>(new WaveFileReader(std::move(pimpl)));
+}
+
+WaveFileReader::~WaveFileReader()
+{}
+
+UInt32 WaveFileReader::GetNumChannels() const
+{
+    return pimpl_->num_channels_;
+}
+
+double WaveFileReader::GetSampleRate() const
+{
+    return pimpl_->sample_rate_;
+}
+
+SampleCount WaveFileReader::GetNumSamples() const
+{
+    return pimpl_->num_samples_;
+}
+
+bool WaveFileReader::Read(SampleCount pos, BufferRef<float> dest)
+{
+    dest.fill(0);
+
+    auto const num_file_channels = pimpl_->num_channels_;
+    auto const begin = std::max<SampleCount>(pos, 0);
+    auto const end = std::min<SampleCount>(pos + dest.samples(), pimpl_->num_samples_);
+    if(begin >= end) { return true; }
+
+    auto const length = end - begin;
+    auto const dest_offset = begin - pos;
+
+    auto const num_values = length * num_file_channels;
+    auto const bytes_per_sample = pimpl_->bytes_per_sample_;
+    
+    pimpl_->interleaved_.resize(num_values);
+    pimpl_->ifs_.clear();
+    pimpl_->ifs_.seekg(pimpl_->data_offset_ + begin * num_file_channels * bytes_per_sample);
+    
+    // 32bit浮動小数点数形式の場合は、変換せずにそのまま読み込む。
+    bool const needs_conversion = (pimpl_->format_ != SampleFormat::kFloat32);
+    char *read_to = reinterpret_cast<char *>(pimpl_->interleaved_.data());
+    if(needs_conversion) {
+        pimpl_->raw_.resize(num_values * bytes_per_sample);
+        read_to = pimpl_->raw_.data();
+    }
+    
+    if(!pimpl_->ifs_.read(read_to, num_values * bytes_per_sample)) {
+        return false;
+    }
+    
+    if(needs_conversion) {
+        ConvertToFloat(pimpl_->raw_.data(), pimpl_->interleaved_.data(), num_values, pimpl_->format_);
+    }
+
+    // destにないチャンネルは、読み捨て用のバッファに書き込む。
+    if(dest.channels() < num_file_channels && pimpl_->discarded_.samples() < length) {
+        pimpl_->discarded_.resize(1, length);
+    }
+
+    for(UInt32 ch = 0; ch < num_file_channels; ++ch) {
+        pimpl_->channel_ptrs_[ch] = (ch < dest.channels()
+                                     ? dest.get_channel_data(ch) + dest_offset
+                                     : pimpl_->discarded_.data()[0]);
+    }
+
+    Deinterleave(pimpl_->interleaved_.data(), pimpl_->channel_ptrs_.data(), num_file_channels, length);
+
+    if(num_file_channels == 1) {
+        for(UInt32 ch = 1; ch < dest.channels(); ++ch) {
+            std::copy_n(dest.get_channel_data(0) + dest_offset, length, dest.get_channel_data(ch) + dest_offset);
+        }
+    }
+
+    return true;
+}
+
+NS_HWM_END
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <memory>
+
+#include "../misc/Buffer.hpp"
+
+NS_HWM_BEGIN
+
+//! 32bit浮動小数点数形式のWAVファイルを書き出すクラス
+class WaveFileWriter
+{
+public:
+    //! ファイルを作成する。作成に失敗した場合はnullptrを返す。
+    static
+    std::unique_ptr<WaveFileWriter> Create(String const &path, UInt32 num_channels, double sample_rate);
+
+    //! Close() を呼び出していなければ、ここで閉じる。
+    ~WaveFileWriter();
+
+    WaveFileWriter(WaveFileWriter const &) = delete;
+    WaveFileWriter & operator=(WaveFileWriter const &) = delete;
+
+    UInt32 GetNumChannels() const;
+    double GetSampleRate() const;
+    //! これまでに書き込んだサンプル数
+    SampleCount GetNumSamples() const;
+
+    //! srcのデータを、ファイルの末尾に追加する。
+    /*! srcのチャンネル数がファイルのチャンネル数より少ない場合、足りないチャンネルには無音を書き込む。
+     */
+    bool Write(BufferRef<float const> src);
+
+    //! ヘッダーのサイズ情報を確定して、ファイルを閉じる。
+    bool Close();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> pimpl_;
+
+    WaveFileWriter(std::unique_ptr<Impl> pimpl);
+};
+
+//! WAVファイルを読み込むクラス
+/*! 8/16/24/32bit整数形式と、32/64bit浮動小数点数形式のリニアPCMのファイルに対応する。
+ *  読み込んだデータは、[-1.0, 1.0]の範囲のfloatに変換する。
+ */
+class WaveFileReader
+{
+public:
+    //! ファイルを開く。ファイルが存在しない場合や、対応していない形式の場合はnullptrを返す。
+    static
+    std::unique_ptr<WaveFileReader> Open(String const &path);
+
+    ~WaveFileReader();
+
+    WaveFileReader(WaveFileReader const &) = delete;
+    WaveFileReader & operator=(WaveFileReader const &) = delete;
+
+    UInt32 GetNumChannels() const;
+    double GetSampleRate() const;
+    SampleCount GetNumSamples() const;
+
+    //! ファイルのposの位置から、dest.samples()分のデータを読み込む。
+    /*! ファイルの範囲外の部分には無音を書き込む。
+     *  destのチャンネル数がファイルより多い場合、モノラルのファイルはすべてのチャンネルに同じデータを書き込み、
+     *  それ以外のファイルは足りないチャンネルに無音を書き込む。
+     *  @return 読み込みに失敗した場合はfalse
+     */
+    bool Read(SampleCount pos, BufferRef<float> dest);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> pimpl_;
+
+    WaveFileReader(std::unique_ptr<Impl> pimpl);
+};
+
+NS_HWM_END
@@ -13,6 +13,7 @@
 
 #include "../misc/StrCnv.hpp"
 #include "../misc/MathUtil.hpp"
+#include "../log/LoggingSupport.hpp"
 #include "../plugin/PluginScanner.hpp"
 #include "./Controls.hpp"
 #include "./PluginEditor.hpp"
@@ -40,6 +41,10 @@ enum
     ID_File_Save,
     ID_File_SaveAs,
     ID_View_ShowPianoRoll,
+    ID_Play_ProcessInDeviceBlocks,
+    ID_Play_ProcessInSubBlocks,
+    ID_Play_ProcessAhead,
+    ID_Play_ProcessNonLiveAhead,
 };
 
 class TransportPanel
@@ -470,14 +475,21 @@ private:
     void OnExit();
     void OnAbout(wxCommandEvent& event);
     void OnPlay(wxCommandEvent& event);
+    void OnChangeProcessingMode(Project::ProcessingMode::Kind kind);
+    void UpdateProcessingModeMenu(Project const *pj);
     void OnTimer();
+    void UpdateStatusBar();
+    void LogNewIncidents(ProcessingStatistics const &stat);
+    void LogDroppedParameterChanges();
     
+    void OnChangeCurrentProject(Project *prev_pj, Project *new_pj) override;
     void OnBeforeSaveProject(Project *pj, schema::Project &schema) override;
     void OnAfterLoadProject(Project *pj, schema::Project const &schema) override;
     
 private:
     std::string msg_;
     wxTimer timer_;
+    UInt64 num_logged_incidents_ = 0;
     MyPanel *my_panel_;
     ScopedListenerRegister<App::ChangeProjectListener> slr_change_project_;
 };
@@ -504,6 +516,15 @@ MainFrame::MainFrame(wxSize initial_size)
     
     wxMenu *menuPlay = new wxMenu;
     menuPlay->Append(ID_Play, "&Play\tSPACE", "Start playback", wxITEM_CHECK);
+    menuPlay->AppendSeparator();
+    menuPlay->AppendRadioItem(ID_Play_ProcessInDeviceBlocks, "Process in Device Blocks",
+                              "Process the project in the block size of the audio device");
+    menuPlay->AppendRadioItem(ID_Play_ProcessInSubBlocks, "Process in Sub-Blocks",
+                              "Split each block of the audio device into small sub-blocks for sample-accurate events");
+    menuPlay->AppendRadioItem(ID_Play_ProcessAhead, "Process Ahead in Large Blocks",
+                              "Process the project ahead in large blocks on a worker thread (adds latency)");
+    menuPlay->AppendRadioItem(ID_Play_ProcessNonLiveAhead, "Process Non-Live Tracks Ahead",
+                              "Process tracks that do not depend on live inputs ahead on a worker thread");
 
     wxMenu *menuHelp = new wxMenu;
     menuHelp->Append(wxID_ABOUT);
@@ -524,6 +545,18 @@ MainFrame::MainFrame(wxSize initial_size)
     Bind(wxEVT_COMMAND_MENU_SELECTED, [](auto &ev) { App::GetInstance()->OnFileSave(true, false); }, ID_File_SaveAs);
     Bind(wxEVT_COMMAND_MENU_SELECTED, [](auto &ev) { App::GetInstance()->ShowSettingDialog(); }, ID_Setting);
     Bind(wxEVT_COMMAND_MENU_SELECTED, [this](auto &ev) { OnPlay(ev); }, ID_Play);
+    Bind(wxEVT_COMMAND_MENU_SELECTED, [this](auto &ev) {
+        OnChangeProcessingMode(Project::ProcessingMode::Kind::kDeviceBlock);
+    }, ID_Play_ProcessInDeviceBlocks);
+    Bind(wxEVT_COMMAND_MENU_SELECTED, [this](auto &ev) {
+        OnChangeProcessingMode(Project::ProcessingMode::Kind::kFixedSubBlock);
+    }, ID_Play_ProcessInSubBlocks);
+    Bind(wxEVT_COMMAND_MENU_SELECTED, [this](auto &ev) {
+        OnChangeProcessingMode(Project::ProcessingMode::Kind::kLookahead);
+    }, ID_Play_ProcessAhead);
+    Bind(wxEVT_COMMAND_MENU_SELECTED, [this](auto &ev) {
+        OnChangeProcessingMode(Project::ProcessingMode::Kind::kAnticipative);
+    }, ID_Play_ProcessNonLiveAhead);
     
     Bind(wxEVT_MENU, [this](auto &ev) { OnAbout(ev); }, wxID_ABOUT);
     
@@ -531,6 +564,8 @@ MainFrame::MainFrame(wxSize initial_size)
     Bind(wxEVT_TIMER, [this](auto &ev) { OnTimer(); });
     timer_.Start(1000);
     
+    CreateStatusBar();
+    
     my_panel_ = new MyPanel(this, GetClientSize());
     
     slr_change_project_.reset(App::GetInstance()->GetChangeProjectListeners(), this);
@@ -571,8 +606,156 @@ void MainFrame::OnPlay(wxCommandEvent &ev)
     tp.SetPlaying(ev.IsChecked());
 }
 
+void MainFrame::OnChangeProcessingMode(Project::ProcessingMode::Kind kind)
+{
+    auto pj = Project::GetCurrentProject();
+    if(!pj) { return; }
+    
+    auto mode = pj->GetProcessingMode();
+    if(mode.kind_ == kind) { return; }
+    
+    mode.kind_ = kind;
+    pj->SetProcessingMode(mode);
+    
+    // 設定はオーディオ処理の開始時に反映されるので、デバイスを再開する。
+    auto adm = AudioDeviceManager::GetInstance();
+    auto dev = (adm ? adm->GetDevice() : nullptr);
+    if(dev && dev->IsStopped() == false) {
+        dev->Stop();
+        dev->Start();
+    }
+}
+
+void MainFrame::UpdateProcessingModeMenu(Project const *pj)
+{
+    if(!pj) { return; }
+    
+    int id = ID_Play_ProcessInDeviceBlocks;
+    switch(pj->GetProcessingMode().kind_) {
+        case Project::ProcessingMode::Kind::kDeviceBlock: id = ID_Play_ProcessInDeviceBlocks; break;
+        case Project::ProcessingMode::Kind::kFixedSubBlock: id = ID_Play_ProcessInSubBlocks; break;
+        case Project::ProcessingMode::Kind::kLookahead: id = ID_Play_ProcessAhead; break;
+        case Project::ProcessingMode::Kind::kAnticipative: id = ID_Play_ProcessNonLiveAhead; break;
+    }
+    GetMenuBar()->Check(id, true);
+}
+
 void MainFrame::OnTimer()
 {
+    UpdateStatusBar();
+    LogDroppedParameterChanges();
+}
+
+void MainFrame::UpdateStatusBar()
+{
+    auto adm = AudioDeviceManager::GetInstance();
+    auto dev = (adm ? adm->GetDevice() : nullptr);
+    if(!dev || dev->IsStopped()) {
+        SetStatusText(L"Audio device is not running.");
+        return;
+    }
+    
+    auto const stat = dev->GetStatistics();
+    auto to_ms = [](double sec) { return sec * 1000.0; };
+    
+    String text = L"Callback: median {:.2f} ms / p99 {:.2f} ms / worst {:.2f} ms (deadline {:.2f} ms)"
+                  L"    Xruns: {}    Deadline misses: {}"_format(to_ms(stat.median_callback_duration_),
+                                                              to_ms(stat.p99_callback_duration_),
+                                                              to_ms(stat.worst_callback_duration_),
+                                                              to_ms(stat.deadline_),
+                                                              stat.GetNumXruns(),
+                                                              stat.num_deadline_misses_);
+    
+    // 先行処理している場合、コールバックはキューのコピーしか行わないので、ワーカースレッドの処理時間も表示する。
+    ProcessingStatistics lookahead_stat;
+    auto pj = Project::GetCurrentProject();
+    if(pj && pj->GetLookaheadStatistics(lookahead_stat)) {
+        text += L"    Lookahead: median {:.2f} ms / p99 {:.2f} ms / worst {:.2f} ms (deadline {:.2f} ms)"
+                L"    Underruns: {}"_format(to_ms(lookahead_stat.median_callback_duration_),
+                                            to_ms(lookahead_stat.p99_callback_duration_),
+                                            to_ms(lookahead_stat.worst_callback_duration_),
+                                            to_ms(lookahead_stat.deadline_),
+                                            lookahead_stat.num_output_underflows_);
+    }
+    
+    SetStatusText(text);
+    
+    LogNewIncidents(stat);
+}
+
+void MainFrame::LogNewIncidents(ProcessingStatistics const &stat)
+{
+    auto const &incidents = stat.recent_incidents_;
+    
+    // デバイスが再開されて、統計がクリアされた。
+    if(incidents.empty() || incidents.back().index_ + 1 < num_logged_incidents_) {
+        num_logged_incidents_ = 0;
+    }
+    
+    if(incidents.empty() || incidents.back().index_ < num_logged_incidents_) { return; }
+    
+    std::vector<GraphProcessor::NodePtr> nodes;
+    if(auto pj = Project::GetCurrentProject()) { nodes = pj->GetGraph().GetNodes(); }
+    
+    auto get_node_name = [&](UInt64 node_id) -> String {
+        auto found = std::find_if(nodes.begin(), nodes.end(),
+                                  [node_id](auto const &node) { return node->GetID() == node_id; });
+        if(found == nodes.end()) { return L"(removed)"; }
+        return (*found)->GetProcessor()->GetName();
+    };
+    
+    using PI = ProcessingIncident;
+    for(auto const &incident: incidents) {
+        if(incident.index_ < num_logged_incidents_) { continue; }
+        
+        String causes;
+        auto add_cause = [&](UInt32 flag, wchar_t const *name) {
+            if((incident.flags_ & flag) == 0) { return; }
+            if(causes.empty() == false) { causes += L", "; }
+            causes += name;
+        };
+        add_cause(PI::kDeadlineMiss, L"deadline miss");
+        add_cause(PI::kInputUnderflow, L"input underflow");
+        add_cause(PI::kInputOverflow, L"input overflow");
+        add_cause(PI::kOutputUnderflow, L"output underflow");
+        add_cause(PI::kOutputOverflow, L"output overflow");
+        
+        String slowest_nodes;
+        for(UInt32 i = 0; i < incident.num_slowest_nodes_; ++i) {
+            auto const &timing = incident.slowest_nodes_[i];
+            if(i > 0) { slowest_nodes += L", "; }
+            slowest_nodes += L"{} ({:.2f} ms)"_format(get_node_name(timing.node_id_), timing.duration_ * 1000.0);
+        }
+        
+        TERRA_WARN_LOG(L"Audio processing incident #" << incident.index_ << L": " << causes
+                       << L"; callback " << L"{:.2f}"_format(incident.callback_duration_ * 1000.0)
+                       << L" ms (deadline " << L"{:.2f}"_format(incident.deadline_ * 1000.0)
+                       << L" ms), block size " << incident.block_size_
+                       << L", active nodes " << incident.num_active_nodes_
+                       << L", slowest nodes: [" << slowest_nodes << L"]");
+        
+        num_logged_incidents_ = incident.index_ + 1;
+    }
+}
+
+//! パラメータの変更のキューが溢れたプラグインを報告する。
+/*! キューへの追加はオーディオスレッドからも行われるので、破棄した数はプラグインに記録しておき、ここでログに出力する。
+ */
+void MainFrame::LogDroppedParameterChanges()
+{
+    auto pj = Project::GetCurrentProject();
+    if(!pj) { return; }
+    
+    for(auto const &node: pj->GetGraph().GetNodes()) {
+        auto proc = std::dynamic_pointer_cast<Vst3AudioProcessor>(node->GetProcessor());
+        if(!proc) { continue; }
+        
+        auto const num_dropped = proc->TakeNumDroppedParameterChanges();
+        if(num_dropped == 0) { continue; }
+        
+        TERRA_WARN_LOG(L"Parameter change queue of " << proc->GetName() << L" is full. "
+                       << num_dropped << L" changes were discarded.");
+    }
 }
 
 void MainFrame::OnBeforeSaveProject(Project *pj, schema::Project &schema)
@@ -589,8 +772,15 @@ void MainFrame::OnBeforeSaveProject(Project *pj, schema::Project &schema)
     schema_size->set_height(rect.GetHeight());
 }
 
+void MainFrame::OnChangeCurrentProject(Project *prev_pj, Project *new_pj)
+{
+    UpdateProcessingModeMenu(new_pj);
+}
+
 void MainFrame::OnAfterLoadProject(Project *pj, schema::Project const &schema)
 {
+    UpdateProcessingModeMenu(pj);
+    
     wxRect rc;
     if(schema.has_frame_rect()) {
         auto const &rect = schema.frame_rect();
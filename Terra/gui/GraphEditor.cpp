@@ -2,9 +2,11 @@
 
 #include <tuple>
 #include <wx/dnd.h>
+#include <wx/progdlg.h>
 
 #include "../App.hpp"
 #include "./PluginEditor.hpp"
+#include "./MixerEditor.hpp"
 #include "./Controls.hpp"
 #include "../plugin/PluginScanner.hpp"
 #include "./Util.hpp"
@@ -12,6 +14,8 @@
 #include "../file/ProjectObjectTable.hpp"
 #include "../misc/MathUtil.hpp"
 #include "../misc/Range.hpp"
+#include "../processor/AudioClipProcessor.hpp"
+#include "../processor/MixerProcessor.hpp"
 
 NS_HWM_BEGIN
 
@@ -48,6 +52,11 @@ wxSize const kNodeButtonSize = { 14, 14 };
 Int32 kNodeAlignmentSize = 10;
 int const kPinRadius = 6;
 wxSize const kLabelSize = { kDefaultNodeSize.GetWidth(), kDefaultNodeSize.GetHeight() - (kPinRadius * 4) };
+//! ノードの出力レベルのメーターの高さ
+int const kNodeMeterHeight = 4;
+int const kNodeMeterMargin = 4;
+//! メーターの表示を更新する間隔
+int const kMeterUpdateIntervalMsec = 33;
 
 class NodeComponent
 :   public IRenderableWindow<wxWindow>
@@ -57,6 +66,9 @@ public:
     struct Callback {
         virtual ~Callback() {}
         virtual void OnRequestToUnload(NodeComponent *nc) = 0;
+        virtual void OnRequestToFreeze(NodeComponent *nc) = 0;
+        virtual void OnRequestToUnfreeze(NodeComponent *nc) = 0;
+        virtual bool IsFrozen(NodeComponent const *nc) const = 0;
         //! ptはparent基準
         virtual void OnMouseMove(NodeComponent *nc, wxPoint pt_begin, wxPoint pt_end) = 0;
         //! ptはparent基準
@@ -161,6 +173,8 @@ public:
         //! There's always generic plugin views for every plugins even if the plugin provides no editor ui.
         if(auto p = dynamic_cast<Vst3AudioProcessor *>(node_->GetProcessor().get())) {
             enable_editor_button = true;
+        } else if(dynamic_cast<MixerProcessor *>(node_->GetProcessor().get())) {
+            enable_editor_button = true;
         }
         btn_open_editor_->Enable(enable_editor_button);
         btn_open_mixer_->Enable(node_->GetProcessor()->IsGainFaderEnabled());
@@ -312,9 +326,26 @@ public:
     {
         if(editor_frame_) { return; }
         
+        if(auto mixer = dynamic_cast<MixerProcessor *>(node_->GetProcessor().get())) {
+            editor_frame_ = CreateMixerEditorFrame(this,
+                                                   mixer,
+                                                   [this] {
+                                                       editor_frame_ = nullptr;
+                                                       btn_open_editor_->SetPushed(false);
+                                                   });
+            btn_open_editor_->SetPushed(true);
+            return;
+        }
+        
         auto proc = dynamic_cast<Vst3AudioProcessor *>(node_->GetProcessor().get());
         if(!proc) { return; }
         
+        // フリーズしたノードのプラグインはアンロードされているので、フリーズを解除してから開く。
+        if(callback_->IsFrozen(this)) {
+            callback_->OnRequestToUnfreeze(this);
+        }
+        if(proc->IsLoaded() == false) { return; }
+        
         editor_frame_ = CreatePluginEditorFrame(this,
                                                 proc->plugin_.get(),
                                                 [this] {
@@ -394,6 +425,70 @@ public:
                 p->RenderWithParentDC(dc);
             }
         }
+        
+        if(meter_rows_.empty() == false) {
+            auto const rc = GetMeterRect();
+            int const row_height = rc.GetHeight() / meter_rows_.size();
+            for(int i = 0; i < meter_rows_.size(); ++i) {
+                auto const rc_row = wxRect(rc.GetX(), rc.GetY() + row_height * i, rc.GetWidth(), row_height);
+                DrawLevelMeter(dc, rc_row, meter_rows_[i].peak_, meter_rows_[i].rms_);
+            }
+        }
+    }
+    
+    //! 出力レベルのメーターを表示する領域（クライアント座標）
+    wxRect GetMeterRect() const
+    {
+        auto const rc = lbl_plugin_name_->GetRect();
+        return wxRect(rc.GetX() + kNodeMeterMargin,
+                      rc.GetBottom() + 1 - kNodeMeterHeight,
+                      rc.GetWidth() - kNodeMeterMargin * 2,
+                      kNodeMeterHeight);
+    }
+    
+    //! オーディオスレッドが公開した出力レベルを読み出す。
+    /*! @return メーターの表示が変わる場合はtrue
+     */
+    bool UpdateMeter()
+    {
+        auto const &meter = node_->GetOutputMeter();
+        auto const num_channels = meter.GetNumChannels();
+        if(num_channels == 0) { return false; }
+        
+        if(meter.GetUpdateCount() == meter_update_count_) { return false; }
+        
+        meter_levels_.resize(num_channels);
+        meter_update_count_ = meter.GetLevels(meter_levels_.data());
+        
+        // 3チャンネル以上の場合は、すべてのチャンネルの最大値を1本のメーターで表示する。
+        if(num_channels <= 2) {
+            meter_rows_ = meter_levels_;
+        } else {
+            AudioMeter::Level max_level;
+            for(auto const &level: meter_levels_) {
+                max_level.peak_ = std::max(max_level.peak_, level.peak_);
+                max_level.rms_ = std::max(max_level.rms_, level.rms_);
+            }
+            meter_rows_.assign(1, max_level);
+        }
+        
+        // 描画される長さが変わらない場合は、再描画しない。
+        auto const length = GetMeterRect().GetWidth();
+        auto to_pixel = [length](float level) { return Round<int>(length * GetLevelMeterRatio(level)); };
+        
+        meter_pixels_.resize(meter_rows_.size() * 2, -1);
+        bool changed = false;
+        for(int i = 0; i < meter_rows_.size(); ++i) {
+            int const pixels[] = { to_pixel(meter_rows_[i].peak_), to_pixel(meter_rows_[i].rms_) };
+            for(int j = 0; j < 2; ++j) {
+                if(meter_pixels_[i * 2 + j] != pixels[j]) {
+                    meter_pixels_[i * 2 + j] = pixels[j];
+                    changed = true;
+                }
+            }
+        }
+        
+        return changed;
     }
     
     void OnLeftDown(wxMouseEvent& ev)
@@ -545,6 +640,8 @@ public:
          kID_Disconnect_Inputs = wxID_HIGHEST + 1,
          kID_Disconnect_Outputs,
          kID_RequestToUnload,
+         kID_RequestToFreeze,
+         kID_RequestToUnfreeze,
      };
      
     void ShowPopup()
@@ -554,9 +651,16 @@ public:
         //menu.Append(kID_Disconnect_Outputs, L"&Disconnect All Outputs", L"&Disconnect All Outputs");
         //menu.AppendSeparator();
         menu.Append(kID_RequestToUnload, "&Unload\tCTRL-u", "Unload this plugin");
+        if(callback_->IsFrozen(this)) {
+            menu.Append(kID_RequestToUnfreeze, "U&nfreeze", "Process this plugin again");
+        } else {
+            menu.Append(kID_RequestToFreeze, "&Freeze", "Render this plugin to a file and play it instead");
+        }
         
         menu.Bind(wxEVT_COMMAND_MENU_SELECTED, [this](auto &ev) {
             if(ev.GetId() == kID_RequestToUnload) { callback_->OnRequestToUnload(this); }
+            else if(ev.GetId() == kID_RequestToFreeze) { callback_->OnRequestToFreeze(this); }
+            else if(ev.GetId() == kID_RequestToUnfreeze) { callback_->OnRequestToUnfreeze(this); }
         });
         
         PopupMenu(&menu);
@@ -575,6 +679,12 @@ public:
     wxBoxSizer      *detail_box_ = nullptr;
     wxSlider        *sl_volume_ = nullptr;
     std::optional<Pin> selected_pin_;
+    UInt64 meter_update_count_ = 0;
+    std::vector<AudioMeter::Level> meter_levels_;
+    //! メーターに表示するレベル
+    std::vector<AudioMeter::Level> meter_rows_;
+    //! 最後に描画したメーターの長さ
+    std::vector<int> meter_pixels_;
     std::optional<wxPoint> delta_; // window 移動
     std::optional<wxPoint> pin_drag_begin_; // pin選択
     std::function<void()> request_to_unload_;
@@ -659,13 +769,21 @@ public:
         SetAutoLayout(true);
         Layout();
 
-        timer_.Bind(wxEVT_TIMER, [this](auto &ev) {
-            std::for_each(node_components_.begin(),
-                          node_components_.end(),
-                          [](auto &nc) { nc->Refresh(); }
-                          );
-        });
-        timer_.Start(100);
+        timer_.Bind(wxEVT_TIMER, [this](auto &ev) { UpdateMeters(); });
+        timer_.Start(kMeterUpdateIntervalMsec);
+    }
+    
+    //! ノードのメーターを更新して、表示が変わるメーターの領域だけを再描画する。
+    void UpdateMeters()
+    {
+        for(auto &nc: node_components_) {
+            if(nc->IsShown() == false) { continue; }
+            if(nc->UpdateMeter() == false) { continue; }
+            
+            auto rc = nc->GetMeterRect();
+            rc.Offset(nc->GetPosition());
+            RefreshRect(rc, false);
+        }
     }
 
     wxTimer timer_;
@@ -845,6 +963,10 @@ public:
     {
         auto menu_plugins = new wxMenu();
         const int kPluginIDStart = wxID_HIGHEST + 200;
+        const int kAddAudioClipID = wxID_HIGHEST + 199;
+        const int kAddMixerIDStart = wxID_HIGHEST + 190;
+        const UInt32 kMixerInputCounts[] = { 4, 8, 16 };
+        const UInt32 kNumMixerSends = 2;
         
         auto menu_inst = new wxMenu();
         auto menu_fx = new wxMenu();
@@ -893,10 +1015,21 @@ public:
         
         wxMenu menu;
         menu.AppendSubMenu(menu_plugins, "Load Plugin");
+        menu.Append(kAddAudioClipID, "Add Audio Clip...");
+        
+        auto menu_mixer = new wxMenu();
+        for(int i = 0; i < std::size(kMixerInputCounts); ++i) {
+            menu_mixer->Append(kAddMixerIDStart + i, "{} Inputs"_format(kMixerInputCounts[i]));
+        }
+        menu.AppendSubMenu(menu_mixer, "Add Mixer");
         
         menu.Bind(wxEVT_COMMAND_MENU_SELECTED, [&, this, pos = ev.GetPosition()](auto &ev) {
             auto const id = ev.GetId();
-            if(id >= kPluginIDStart) {
+            if(id == kAddAudioClipID) {
+                CallAfter([this, pos] { AddAudioClip(pos); });
+            } else if(kAddMixerIDStart <= id && id < kAddMixerIDStart + std::size(kMixerInputCounts)) {
+                AddMixer(kMixerInputCounts[id - kAddMixerIDStart], kNumMixerSends, pos);
+            } else if(id >= kPluginIDStart) {
                 auto const index = id - kPluginIDStart;
                 assert(index < descs.size());
                 AddNode(descs[index], pos);
@@ -927,6 +1060,52 @@ public:
         back->Raise();
     }
 
+    void AddAudioClip(wxPoint pt)
+    {
+        wxFileDialog dlg(this, "Add Audio Clip", "", "",
+                         "WAV File (*.wav)|*.wav",
+                         wxFD_OPEN|wxFD_FILE_MUST_EXIST);
+        if(dlg.ShowModal() == wxID_CANCEL) { return; }
+        
+        auto proc = AudioClipProcessor::Create(dlg.GetPath().ToStdWstring());
+        if(!proc) {
+            wxMessageBox("Failed to open {}"_format(dlg.GetPath().ToStdString()));
+            return;
+        }
+        
+        // サンプリングレートは変換しないので、異なる場合は追加するかどうかを確認する。
+        auto pj = Project::GetCurrentProject();
+        if(pj && proc->IsSampleRateMismatched(pj->GetSampleRate())) {
+            auto const msg = "The sample rate of {} ({}Hz) differs from the project ({}Hz).\n"
+                             "The clip will be played at a different speed and pitch. Add it anyway?"_format(
+                                dlg.GetFilename().ToStdString(), proc->GetSampleRate(), pj->GetSampleRate());
+            if(wxMessageBox(msg, "Sample rate mismatch", wxYES_NO|wxICON_WARNING, this) != wxYES) {
+                return;
+            }
+        }
+        
+        auto node = graph_->AddNode(std::move(proc));
+        
+        auto &back = node_components_.back();
+        
+        assert(back->node_ == node.get());
+        back->Show(true);
+        back->MoveConstrained(pt);
+        back->Raise();
+    }
+    
+    void AddMixer(UInt32 num_inputs, UInt32 num_sends, wxPoint pt)
+    {
+        auto node = graph_->AddNode(std::make_shared<MixerProcessor>(num_inputs, num_sends));
+        
+        auto &back = node_components_.back();
+        
+        assert(back->node_ == node.get());
+        back->Show(true);
+        back->MoveConstrained(pt);
+        back->Raise();
+    }
+    
     //! return true if removed.
     //! return false if not found.
     bool RemoveNode(Processor const *proc)
@@ -982,6 +1161,52 @@ public:
         });
     }
     
+    void OnRequestToFreeze(NodeComponent *nc) override
+    {
+        this->CallAfter([proc = nc->node_->GetProcessor().get(), this] {
+            auto pj = Project::GetCurrentProject();
+            auto node = graph_->GetNodeOf(proc);
+            if(!pj || !node) { return; }
+            
+            // アンロードされるプラグインのエディタは、先に閉じておく。
+            if(auto comp = FindNodeComponent(node.get())) { comp->CloseEditor(); }
+            for(auto &n: graph_->GetNodes()) {
+                if(n->HasPathTo(node.get()) == false) { continue; }
+                if(auto comp = FindNodeComponent(n.get())) { comp->CloseEditor(); }
+            }
+            
+            int const kProgressMax = 1000;
+            wxProgressDialog dlg("Freeze",
+                                 L"Rendering {}..."_format(node->GetProcessor()->GetName()),
+                                 kProgressMax, this,
+                                 wxPD_APP_MODAL|wxPD_AUTO_HIDE|wxPD_CAN_ABORT|wxPD_ELAPSED_TIME);
+            auto const error = pj->FreezeNode(node.get(), [&dlg, kProgressMax](double progress) {
+                return dlg.Update(std::min<int>(kProgressMax, (int)(progress * kProgressMax)));
+            });
+            if(error.empty() == false) {
+                wxMessageBox(error);
+            }
+        });
+    }
+    
+    void OnRequestToUnfreeze(NodeComponent *nc) override
+    {
+        auto pj = Project::GetCurrentProject();
+        if(!pj) { return; }
+        
+        wxBusyCursor busy;
+        auto const error = pj->UnfreezeNode(nc->node_);
+        if(error.empty() == false) {
+            wxMessageBox(error);
+        }
+    }
+    
+    bool IsFrozen(NodeComponent const *nc) const override
+    {
+        auto pj = Project::GetCurrentProject();
+        return pj && pj->IsFrozen(nc->node_);
+    }
+    
     //! ptはparent基準
     void OnMouseMove(NodeComponent *nc, wxPoint pt_begin, wxPoint pt_end) override
     {
@@ -1160,19 +1385,22 @@ private:
         wxPaintDC pdc(this);
         wxGCDC dc(pdc);
         dc.Clear();
+        
+        // メーターの更新のように一部の領域だけが無効化された場合は、その領域だけを描画し直す。
+        auto const rc_update = GetUpdateRegion().GetBox();
 
-        back_buffer_.Clear();
-        Render();
+        Render(rc_update);
                 
         wxMemoryDC memory_dc(back_buffer_.GetBitmap());
 
-        dc.Blit(wxPoint{0, 0}, GetClientSize(), &memory_dc, wxPoint {0, 0});
+        dc.Blit(rc_update.GetPosition(), rc_update.GetSize(), &memory_dc, rc_update.GetPosition());
     }
     
-    void Render()
+    void Render(wxRect const &rc_update)
     {
         wxMemoryDC memory_dc(back_buffer_.GetBitmap());
         wxGCDC dc(memory_dc);
+        dc.SetClippingRegion(rc_update);
         {
             dc.SetBackground(wxBrush(kGraphBackground));
             dc.Clear();
@@ -1181,6 +1409,10 @@ private:
         DrawGrid(dc);
 
         for(auto &nc: node_components_) {
+            // 影も含めて、再描画する領域に重ならないノードは描画しない。
+            auto const rc_node = nc->GetRect().Inflate(kShadowRadius);
+            if(rc_node.Intersects(rc_update) == false) { continue; }
+            
             nc->RenderWithParentDC(dc);
         }
 
@@ -0,0 +1,269 @@
+#include "MixerEditor.hpp"
+
+#include <wx/scrolwin.h>
+#include "../App.hpp"
+
+#include "./Util.hpp"
+#include "./PCKeyboardInput.hpp"
+#include "../misc/MathUtil.hpp"
+
+NS_HWM_BEGIN
+
+namespace {
+    BrushPen const kMixerBackground = HSVToColour(0, 0, 14 / 100.0);
+
+    //! dB値をスライダーの整数値に変換するときの倍率
+    double const kDBSliderScale = 10.0;
+    double const kPanSliderScale = 100.0;
+
+    wxSize const kMeterSize = { 24, 160 };
+    int const kStripWidth = 90;
+}
+
+//! AudioMeterから読み出したレベルを表示するパネル
+class LevelMeterPanel
+:   public wxPanel
+{
+public:
+    LevelMeterPanel(wxWindow *parent, UInt32 num_channels)
+    :   wxPanel(parent, wxID_ANY, wxDefaultPosition, kMeterSize)
+    ,   levels_(num_channels)
+    {
+        SetMinSize(kMeterSize);
+        SetBackgroundStyle(wxBG_STYLE_PAINT);
+        Bind(wxEVT_PAINT, [this](auto &) { OnPaint(); });
+    }
+
+    //! 表示が変わる場合だけ再描画する。
+    void SetLevels(AudioMeter::Level const *levels)
+    {
+        auto const length = GetClientSize().GetHeight();
+        auto to_pixel = [length](float level) { return Round<int>(length * GetLevelMeterRatio(level)); };
+
+        bool changed = false;
+        for(UInt32 ch = 0; ch < levels_.size(); ++ch) {
+            if(to_pixel(levels_[ch].peak_) != to_pixel(levels[ch].peak_) ||
+               to_pixel(levels_[ch].rms_) != to_pixel(levels[ch].rms_))
+            {
+                changed = true;
+            }
+            levels_[ch] = levels[ch];
+        }
+
+        if(changed) { Refresh(); }
+    }
+
+private:
+    std::vector<AudioMeter::Level> levels_;
+
+    void OnPaint()
+    {
+        wxPaintDC dc(this);
+
+        kMixerBackground.ApplyTo(dc);
+        dc.DrawRectangle(GetClientRect());
+
+        if(levels_.empty()) { return; }
+
+        auto const rc = GetClientRect();
+        int const width = rc.width / levels_.size();
+        for(UInt32 ch = 0; ch < levels_.size(); ++ch) {
+            auto const rc_ch = wxRect(rc.x + width * ch, rc.y, width - 1, rc.height);
+            DrawLevelMeter(dc, rc_ch, levels_[ch].peak_, levels_[ch].rms_);
+        }
+    }
+};
+
+//! ミキサーの1入力分のコントロール
+class MixerStrip
+:   public wxPanel
+{
+public:
+    MixerStrip(wxWindow *parent, MixerProcessor *mixer, UInt32 input_index)
+    :   wxPanel(parent, wxID_ANY, wxDefaultPosition, wxSize(kStripWidth, -1))
+    ,   mixer_(mixer)
+    ,   index_(input_index)
+    {
+        SetBackgroundColour(kMixerBackground.brush_.GetColour());
+
+        auto lbl_name = new wxStaticText(this, wxID_ANY, "In {}"_format(index_ + 1));
+        lbl_name->SetForegroundColour(*wxWHITE);
+
+        auto send_box = new wxBoxSizer(wxVERTICAL);
+        for(UInt32 j = 0; j < mixer_->GetNumSends(); ++j) {
+            auto sl = new wxSlider(this, wxID_ANY,
+                                   mixer_->GetSendLevel(index_, j) * kDBSliderScale,
+                                   MixerProcessor::kMinDB * kDBSliderScale,
+                                   MixerProcessor::kMaxDB * kDBSliderScale);
+            sl->SetToolTip("Send {}"_format(j + 1));
+            sl->Bind(wxEVT_SLIDER, [this, sl, j](auto &) {
+                mixer_->SetSendLevel(index_, j, sl->GetValue() / kDBSliderScale);
+            });
+            send_box->Add(sl, wxSizerFlags(0).Expand());
+        }
+
+        sl_pan_ = new wxSlider(this, wxID_ANY,
+                               mixer_->GetPan(index_) * kPanSliderScale,
+                               -kPanSliderScale, kPanSliderScale);
+        sl_pan_->SetToolTip("Pan");
+        sl_pan_->Bind(wxEVT_SLIDER, [this](auto &) {
+            mixer_->SetPan(index_, sl_pan_->GetValue() / kPanSliderScale);
+        });
+
+        btn_mute_ = new wxToggleButton(this, wxID_ANY, "M", wxDefaultPosition, wxSize(kStripWidth / 2 - 2, -1));
+        btn_mute_->SetValue(mixer_->IsMuted(index_));
+        btn_mute_->Bind(wxEVT_TOGGLEBUTTON, [this](auto &) {
+            mixer_->SetMute(index_, btn_mute_->GetValue());
+            App::GetInstance()->UpdateLazyPluginLoading();
+        });
+
+        btn_solo_ = new wxToggleButton(this, wxID_ANY, "S", wxDefaultPosition, wxSize(kStripWidth / 2 - 2, -1));
+        btn_solo_->SetValue(mixer_->IsSoloed(index_));
+        btn_solo_->Bind(wxEVT_TOGGLEBUTTON, [this](auto &) {
+            mixer_->SetSolo(index_, btn_solo_->GetValue());
+            App::GetInstance()->UpdateLazyPluginLoading();
+        });
+
+        sl_gain_ = new wxSlider(this, wxID_ANY,
+                                mixer_->GetGain(index_) * kDBSliderScale,
+                                MixerProcessor::kMinDB * kDBSliderScale,
+                                MixerProcessor::kMaxDB * kDBSliderScale,
+                                wxDefaultPosition, wxSize(-1, kMeterSize.GetHeight()),
+                                wxSL_VERTICAL|wxSL_INVERSE);
+        sl_gain_->SetToolTip("Gain");
+        sl_gain_->Bind(wxEVT_SLIDER, [this](auto &) {
+            mixer_->SetGain(index_, sl_gain_->GetValue() / kDBSliderScale);
+        });
+
+        meter_ = new LevelMeterPanel(this, 2);
+
+        auto button_box = new wxBoxSizer(wxHORIZONTAL);
+        button_box->Add(btn_mute_, wxSizerFlags(1));
+        button_box->Add(btn_solo_, wxSizerFlags(1));
+
+        auto fader_box = new wxBoxSizer(wxHORIZONTAL);
+        fader_box->Add(sl_gain_, wxSizerFlags(1).Expand());
+        fader_box->Add(meter_, wxSizerFlags(0).Expand());
+
+        auto vbox = new wxBoxSizer(wxVERTICAL);
+        vbox->Add(lbl_name, wxSizerFlags(0).Center().Border(wxALL, 2));
+        vbox->Add(send_box, wxSizerFlags(0).Expand());
+        vbox->Add(sl_pan_, wxSizerFlags(0).Expand());
+        vbox->Add(button_box, wxSizerFlags(0).Expand());
+        vbox->Add(fader_box, wxSizerFlags(1).Expand().Border(wxALL, 2));
+
+        SetSizer(vbox);
+    }
+
+    void SetLevels(AudioMeter::Level const *levels)
+    {
+        meter_->SetLevels(levels);
+    }
+
+private:
+    MixerProcessor *mixer_ = nullptr;
+    UInt32 index_ = 0;
+    wxSlider *sl_pan_ = nullptr;
+    wxSlider *sl_gain_ = nullptr;
+    wxToggleButton *btn_mute_ = nullptr;
+    wxToggleButton *btn_solo_ = nullptr;
+    LevelMeterPanel *meter_ = nullptr;
+};
+
+class MixerEditorFrame
+:   public wxFrame
+{
+public:
+    //! メーターを更新する間隔
+    static constexpr int kMeterUpdateIntervalMsec = 33;
+
+    MixerEditorFrame(wxWindow *parent,
+                     MixerProcessor *mixer,
+                     std::function<void()> on_destroy)
+    :   wxFrame(parent, wxID_ANY, mixer->GetName())
+    ,   mixer_(mixer)
+    ,   on_destroy_(on_destroy)
+    ,   input_levels_(mixer->GetInputMeter().GetNumChannels())
+    ,   output_levels_(mixer->GetOutputMeter().GetNumChannels())
+    {
+        auto scroll = new wxScrolledWindow(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxHSCROLL);
+        scroll->SetBackgroundColour(kMixerBackground.brush_.GetColour());
+
+        auto hbox = new wxBoxSizer(wxHORIZONTAL);
+        for(UInt32 i = 0; i < mixer_->GetNumInputs(); ++i) {
+            auto strip = new MixerStrip(scroll, mixer_, i);
+            strips_.push_back(strip);
+            hbox->Add(strip, wxSizerFlags(0).Expand().Border(wxRIGHT, 1));
+        }
+
+        {
+            auto out_box = new wxBoxSizer(wxVERTICAL);
+            auto lbl_out = new wxStaticText(scroll, wxID_ANY, "Out");
+            lbl_out->SetForegroundColour(*wxWHITE);
+            out_meter_ = new LevelMeterPanel(scroll, output_levels_.size());
+            out_meter_->SetMinSize(wxSize(kMeterSize.GetWidth() * output_levels_.size() / 2, kMeterSize.GetHeight()));
+            out_box->Add(lbl_out, wxSizerFlags(0).Center().Border(wxALL, 2));
+            out_box->Add(out_meter_, wxSizerFlags(1).Expand().Border(wxALL, 2));
+            hbox->Add(out_box, wxSizerFlags(0).Expand());
+        }
+
+        scroll->SetSizer(hbox);
+        scroll->SetScrollRate(10, 0);
+        scroll->FitInside();
+
+        auto size = hbox->GetMinSize();
+        SetClientSize(wxSize(std::min(size.GetWidth(), 1200), size.GetHeight()));
+
+        timer_.Bind(wxEVT_TIMER, [this](auto &) { OnTimer(); });
+        timer_.Start(kMeterUpdateIntervalMsec);
+
+        Show(true);
+
+        PCKeyboardInput::GetInstance()->ApplyTo(this);
+    }
+
+    bool Destroy() override
+    {
+        timer_.Stop();
+        on_destroy_();
+        return wxFrame::Destroy();
+    }
+
+private:
+    MixerProcessor *mixer_ = nullptr;
+    std::function<void()> on_destroy_;
+    std::vector<MixerStrip *> strips_;
+    LevelMeterPanel *out_meter_ = nullptr;
+    std::vector<AudioMeter::Level> input_levels_;
+    std::vector<AudioMeter::Level> output_levels_;
+    UInt64 last_input_update_ = 0;
+    UInt64 last_output_update_ = 0;
+    wxTimer timer_;
+
+    void OnTimer()
+    {
+        // オーディオスレッドがメーターを更新していなければ、何もしない。
+        auto const &input_meter = mixer_->GetInputMeter();
+        if(input_meter.GetUpdateCount() != last_input_update_) {
+            last_input_update_ = input_meter.GetLevels(input_levels_.data());
+            for(UInt32 i = 0; i < strips_.size(); ++i) {
+                strips_[i]->SetLevels(input_levels_.data() + i * 2);
+            }
+        }
+
+        auto const &output_meter = mixer_->GetOutputMeter();
+        if(output_meter.GetUpdateCount() != last_output_update_) {
+            last_output_update_ = output_meter.GetLevels(output_levels_.data());
+            out_meter_->SetLevels(output_levels_.data());
+        }
+    }
+};
+
+wxFrame * CreateMixerEditorFrame(wxWindow *parent,
+                                 MixerProcessor *mixer,
+                                 std::function<void()> on_destroy)
+{
+    return new MixerEditorFrame(parent, mixer, on_destroy);
+}
+
+NS_HWM_END
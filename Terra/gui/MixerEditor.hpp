@@ -0,0 +1,12 @@
+#pragma once
+
+#include <functional>
+#include "../processor/MixerProcessor.hpp"
+
+NS_HWM_BEGIN
+
+wxFrame * CreateMixerEditorFrame(wxWindow *parent,
+                                 MixerProcessor *mixer,
+                                 std::function<void()> on_destroy);
+
+NS_HWM_END
@@ -429,6 +429,19 @@ public:
     :   wxPanel(parent)
     {
         Bind(wxEVT_PAINT, [this](auto &ev) { OnPaint(); });
+        
+        chk_project_compression_ = new wxCheckBox(this, wxID_ANY, "Compress project files");
+        chk_project_compression_->SetForegroundColour(HSVToColour(0.0, 0.0, 0.9));
+        chk_project_compression_->SetBackgroundColour(kPanelBackgroundColour.brush_.GetColour());
+        chk_project_compression_->SetValue(App::GetInstance()->IsProjectCompressionEnabled());
+        
+        auto vbox = new wxBoxSizer(wxVERTICAL);
+        vbox->Add(chk_project_compression_, wxSizerFlags(0).Expand().Border());
+        SetSizer(vbox);
+        
+        chk_project_compression_->Bind(wxEVT_CHECKBOX, [this](auto &) {
+            App::GetInstance()->SetProjectCompressionEnabled(chk_project_compression_->GetValue());
+        });
     }
     
     void OnPaint()
@@ -439,6 +452,9 @@ public:
         kPanelBackgroundColour.ApplyTo(dc);
         dc.DrawRectangle(GetClientRect());
     }
+    
+private:
+    wxCheckBox *chk_project_compression_ = nullptr;
 };
 
 class AppearanceSettingPanel
@@ -475,9 +491,13 @@ public:
         btn_plus_ = new wxButton(this, wxID_ANY, "+");
         btn_minus_ = new wxButton(this, wxID_ANY, "-");
         btn_list_operation_ = new wxButton(this, wxID_ANY, "▼");
+        chk_lazy_loading_ = new wxCheckBox(this, wxID_ANY, "Load plugins lazily (only when connected to outputs)");
         
         st_dir_list_->SetForegroundColour(HSVToColour(0.0, 0.0, 0.9));
         st_dir_list_->SetBackgroundColour(kPanelBackgroundColour.brush_.GetColour());
+        chk_lazy_loading_->SetForegroundColour(HSVToColour(0.0, 0.0, 0.9));
+        chk_lazy_loading_->SetBackgroundColour(kPanelBackgroundColour.brush_.GetColour());
+        chk_lazy_loading_->SetValue(App::GetInstance()->IsLazyPluginLoadingEnabled());
         
         auto vbox = new wxBoxSizer(wxVERTICAL);
         st_dir_list_->SetMaxSize({1000, 50});
@@ -503,10 +523,15 @@ public:
             vbox->Add(hbox, wxSizerFlags(0).Expand().Border());
         }
         
+        vbox->Add(chk_lazy_loading_, wxSizerFlags(0).Expand().Border());
+        
         btn_plus_->Bind(wxEVT_BUTTON, [this](auto &) { OnAddDirectory(); });
         btn_minus_->Bind(wxEVT_BUTTON, [this](auto &) { OnRemoveDirectory(); });
         btn_list_operation_->Bind(wxEVT_BUTTON, [this](auto &) { OnShowListOperationMenu(); });
         lb_dir_list_->Bind(wxEVT_LISTBOX, [this](auto &) { OnListboxChanged(); });
+        chk_lazy_loading_->Bind(wxEVT_CHECKBOX, [this](auto &) {
+            App::GetInstance()->SetLazyPluginLoadingEnabled(chk_lazy_loading_->GetValue());
+        });
         
         OnRestoreList();
         OnListboxChanged();
@@ -653,6 +678,7 @@ private:
     wxButton *btn_plus_ = nullptr;
     wxButton *btn_minus_ = nullptr;
     wxButton *btn_list_operation_ = nullptr;
+    wxCheckBox *chk_lazy_loading_ = nullptr;
 };
 
 class LocationSettingPanel
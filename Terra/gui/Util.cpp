@@ -1,4 +1,5 @@
 #include "./Util.hpp"
+#include "../misc/MathUtil.hpp"
 
 NS_HWM_BEGIN
 
@@ -24,4 +25,52 @@ void ClearImage(wxImage &img)
     }
 }
 
+namespace {
+    //! メーターに表示するdBの範囲
+    double const kMeterMinDB = -60.0;
+    double const kMeterMaxDB = 6.0;
+}
+
+double GetLevelMeterRatio(float level)
+{
+    auto const db = LinearToDB(level);
+    return Clamp<double>((db - kMeterMinDB) / (kMeterMaxDB - kMeterMinDB), 0.0, 1.0);
+}
+
+void DrawLevelMeter(wxDC &dc, wxRect const &rc, float peak, float rms)
+{
+    static BrushPen const kBackground = HSVToColour(0.0, 0.0, 0.1);
+    static BrushPen const kNormal = HSVToColour(0.3, 0.7, 0.8);
+    static BrushPen const kOver = HSVToColour(0.0, 0.8, 0.9);
+    static wxPen const kPeakLine = wxPen(HSVToColour(0.3, 0.3, 1.0));
+    
+    kBackground.ApplyTo(dc);
+    dc.DrawRectangle(rc);
+    
+    bool const vertical = (rc.height >= rc.width);
+    auto const length = vertical ? rc.height : rc.width;
+    
+    auto const rms_len = Round<int>(length * GetLevelMeterRatio(rms));
+    if(rms_len > 0) {
+        (rms >= 1.0f ? kOver : kNormal).ApplyTo(dc);
+        if(vertical) {
+            dc.DrawRectangle(rc.x, rc.GetBottom() + 1 - rms_len, rc.width, rms_len);
+        } else {
+            dc.DrawRectangle(rc.x, rc.y, rms_len, rc.height);
+        }
+    }
+    
+    auto const peak_len = Round<int>(length * GetLevelMeterRatio(peak));
+    if(peak_len > 0) {
+        dc.SetPen(peak >= 1.0f ? kOver.pen_ : kPeakLine);
+        if(vertical) {
+            auto const y = rc.GetBottom() + 1 - peak_len;
+            dc.DrawLine(rc.x, y, rc.GetRight() + 1, y);
+        } else {
+            auto const x = rc.x + peak_len - 1;
+            dc.DrawLine(x, rc.y, x, rc.GetBottom() + 1);
+        }
+    }
+}
+
 NS_HWM_END
@@ -37,6 +37,15 @@ struct BrushPenSet
 
 void ClearImage(wxImage &img);
 
+//! 線形なレベル値を、メーターの表示範囲での位置 [0.0 .. 1.0] に変換する。
+double GetLevelMeterRatio(float level);
+
+//! rcの中に、線形なレベル値peakとrmsを表すメーターを描画する。
+/*! rcの縦横の長さが長いほうの方向にメーターを伸ばす。
+ *  RMSをバーで、ピークを線で表示する。
+ */
+void DrawLevelMeter(wxDC &dc, wxRect const &rc, float peak, float rms);
+
 class GraphicsBuffer
 {
 public:
@@ -0,0 +1,176 @@
+#include "AudioMeter.hpp"
+
+#include <cmath>
+#include <thread>
+
+#include "./MathUtil.hpp"
+#include "./VectorOps.hpp"
+
+NS_HWM_BEGIN
+
+AudioMeter::AudioMeter(UInt32 num_channels)
+:   num_channels_(num_channels)
+,   peaks_(num_channels)
+,   mean_squares_(num_channels)
+,   published_(std::make_unique<std::atomic<float>[]>(num_channels * 2))
+{
+    for(UInt32 i = 0; i < num_channels * 2; ++i) {
+        published_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+AudioMeter::~AudioMeter()
+{}
+
+UInt32 AudioMeter::GetNumChannels() const
+{
+    return num_channels_;
+}
+
+void AudioMeter::SetSampleRate(double sample_rate)
+{
+    assert(sample_rate > 0);
+    sample_rate_ = sample_rate;
+}
+
+void AudioMeter::Process(BufferRef<float const> const &buf)
+{
+    SampleCount const num_samples = buf.samples();
+    if(num_samples == 0) { return; }
+
+    float const release = DBToLinear(-kPeakReleaseDBPerSec * num_samples / sample_rate_);
+    float const alpha = 1.0 - std::exp(-num_samples / (kRmsTimeConstant * sample_rate_));
+
+    for(UInt32 ch = 0; ch < num_channels_; ++ch) {
+        float peak = 0;
+        float square_sum = 0;
+        if(ch < buf.channels()) {
+            auto const *src = buf.data()[ch + buf.channel_from()] + buf.sample_from();
+            AccumulatePeakAndSquareSum(src, num_samples, peak, square_sum);
+        }
+
+        peaks_[ch] = std::max(peak, peaks_[ch] * release);
+        mean_squares_[ch] += (square_sum / num_samples - mean_squares_[ch]) * alpha;
+    }
+
+    Publish();
+}
+
+void AudioMeter::Process(BufferRef<float> const &buf)
+{
+    Process(BufferRef<float const>(buf.data(), buf.channel_from(), buf.channels(), buf.sample_from(), buf.samples()));
+}
+
+void AudioMeter::Reset()
+{
+    std::fill(peaks_.begin(), peaks_.end(), 0);
+    std::fill(mean_squares_.begin(), mean_squares_.end(), 0);
+    Publish();
+}
+
+void AudioMeter::SetLevels(Level const *levels)
+{
+    for(UInt32 ch = 0; ch < num_channels_; ++ch) {
+        peaks_[ch] = levels[ch].peak_;
+        mean_squares_[ch] = levels[ch].rms_ * levels[ch].rms_;
+    }
+    Publish();
+}
+
+void AudioMeter::Publish()
+{
+    // シーケンスロックは書き込み側が1つの場合にしか使えない。（peaks_とmean_squares_も保護されていない）
+    // Process() 以外から Reset() を呼び出すのは、レベルを計算するスレッドが止まっているときか、
+    // そのスレッドを止めるロックを取得しているときだけなので、書き込みが同時に行われることはない。
+    auto const seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for(UInt32 ch = 0; ch < num_channels_; ++ch) {
+        published_[ch * 2].store(peaks_[ch], std::memory_order_relaxed);
+        published_[ch * 2 + 1].store(std::sqrt(mean_squares_[ch]), std::memory_order_relaxed);
+    }
+
+    seq_.store(seq + 2, std::memory_order_release);
+}
+
+UInt64 AudioMeter::GetLevels(Level *dest) const
+{
+    for( ; ; ) {
+        auto const seq_begin = seq_.load(std::memory_order_acquire);
+        if(seq_begin & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        for(UInt32 ch = 0; ch < num_channels_; ++ch) {
+            dest[ch].peak_ = published_[ch * 2].load(std::memory_order_relaxed);
+            dest[ch].rms_ = published_[ch * 2 + 1].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(seq_.load(std::memory_order_relaxed) == seq_begin) {
+            return seq_begin / 2;
+        }
+    }
+}
+
+UInt64 AudioMeter::GetUpdateCount() const
+{
+    return seq_.load(std::memory_order_acquire) / 2;
+}
+
+AudioLevelQueue::AudioLevelQueue(UInt32 num_channels, UInt32 capacity)
+:   num_channels_(num_channels)
+,   entries_(capacity)
+,   levels_(num_channels * capacity)
+{
+    assert(capacity > 0);
+}
+
+bool AudioLevelQueue::Push(UInt64 generation, UInt64 end_position, AudioMeter const &meter)
+{
+    assert(meter.GetNumChannels() == num_channels_);
+    
+    auto const pushed = num_pushed_.load(std::memory_order_relaxed);
+    if(pushed - num_popped_.load(std::memory_order_acquire) >= entries_.size()) { return false; }
+    
+    auto const index = pushed % entries_.size();
+    entries_[index].generation_ = generation;
+    entries_[index].end_position_ = end_position;
+    meter.GetLevels(levels_.data() + index * num_channels_);
+    
+    num_pushed_.store(pushed + 1, std::memory_order_release);
+    return true;
+}
+
+void AudioLevelQueue::PublishUntil(UInt64 generation, UInt64 position, AudioMeter &meter)
+{
+    assert(meter.GetNumChannels() == num_channels_);
+    
+    auto popped = num_popped_.load(std::memory_order_relaxed);
+    auto const pushed = num_pushed_.load(std::memory_order_acquire);
+    
+    AudioMeter::Level const *latest = nullptr;
+    for( ; popped < pushed; ++popped) {
+        auto const index = popped % entries_.size();
+        auto const &entry = entries_[index];
+        if(entry.generation_ < generation) { continue; }
+        if(entry.generation_ > generation || entry.end_position_ > position) { break; }
+        
+        latest = levels_.data() + index * num_channels_;
+    }
+    
+    // エントリーを書き込み側に返す前に公開する。
+    if(latest) { meter.SetLevels(latest); }
+    
+    num_popped_.store(popped, std::memory_order_release);
+}
+
+void AudioLevelQueue::Clear()
+{
+    num_pushed_.store(0);
+    num_popped_.store(0);
+}
+
+NS_HWM_END
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "./Buffer.hpp"
+
+NS_HWM_BEGIN
+
+//! オーディオスレッドで計算したチャンネルごとのピーク/RMSレベルを、ロックせずに他のスレッドに公開するクラス
+/*! レベルの計算はオーディオスレッド（またはそれに準ずる単一のスレッド）だけが行い、
+ *  GUIスレッドなどは GetLevels() でいつでも最新のレベルを読み出せる。
+ *  公開する値はシーケンスロックで保護しているので、読み出し側がチャンネル間で不整合な値を得ることはなく、
+ *  書き込み側が読み出し側を待つこともない。
+ */
+class AudioMeter
+{
+public:
+    //! 線形なレベル値
+    struct Level
+    {
+        float peak_ = 0;
+        float rms_ = 0;
+    };
+
+    //! ピークレベルが1秒あたりに下降するdB値
+    static constexpr double kPeakReleaseDBPerSec = 48.0;
+    //! RMSを求める時定数（秒）
+    static constexpr double kRmsTimeConstant = 0.3;
+
+    explicit
+    AudioMeter(UInt32 num_channels);
+    ~AudioMeter();
+
+    AudioMeter(AudioMeter const &) = delete;
+    AudioMeter & operator=(AudioMeter const &) = delete;
+
+    UInt32 GetNumChannels() const;
+
+    //! オーディオスレッドで Process() を呼び出す前に、サンプリングレートを設定する。
+    void SetSampleRate(double sample_rate);
+
+    //! bufのレベルを計算して公開する。
+    /*! オーディオスレッドから呼び出す。ロックやメモリ確保は行わない。
+     *  bufのチャンネル数がGetNumChannels()より少ない場合、足りないチャンネルは無音として扱う。
+     */
+    void Process(BufferRef<float const> const &buf);
+    void Process(BufferRef<float> const &buf);
+
+    //! レベルを無音の状態に戻して公開する。
+    /*! Process() と同じスレッドから呼び出す。
+     */
+    void Reset();
+    
+    //! 別に計算したレベルを公開する。
+    /*! 以降の Process() は、このレベルから続けて計算する。
+     *  Process() と同じスレッドから呼び出す。ロックやメモリ確保は行わない。
+     *  @param levels GetNumChannels()個の要素を持つ配列
+     */
+    void SetLevels(Level const *levels);
+
+    //! 公開されている最新のレベルをdestに書き込む。どのスレッドから呼び出してもよい。
+    /*! @param dest GetNumChannels()個の要素を持つ配列
+     *  @return レベルが公開された回数。前回の呼び出しから値が変わっていなければ、レベルは更新されていない。
+     */
+    UInt64 GetLevels(Level *dest) const;
+
+    //! レベルが公開された回数
+    UInt64 GetUpdateCount() const;
+
+private:
+    UInt32 num_channels_ = 0;
+    double sample_rate_ = 44100.0;
+
+    // オーディオスレッドだけが使用する値
+    std::vector<float> peaks_;
+    std::vector<float> mean_squares_;
+
+    // [peak, rms]をチャンネル数分並べたもの
+    std::unique_ptr<std::atomic<float>[]> published_;
+    //! 書き込み中は奇数になるシーケンス番号
+    std::atomic<UInt64> seq_ = { 0 };
+
+    void Publish();
+};
+
+//! 先行して計算したレベルを、その位置が再生されたときに AudioMeter に公開するためのキュー
+/*! 書き込み側（先行処理のスレッド）と読み出し側（オーディオスレッド）がそれぞれ1つずつの場合に、ロックせずに使用できる。
+ *  レベルには、 AnticipatedAudioQueue のブロックと同じ世代（generation）と位置を付けて書き込む。
+ */
+class AudioLevelQueue
+{
+public:
+    AudioLevelQueue(UInt32 num_channels, UInt32 capacity);
+    
+    UInt32 GetNumChannels() const { return num_channels_; }
+    UInt32 GetCapacity() const { return (UInt32)entries_.size(); }
+    
+    //! 書き込み側から呼び出す。
+    //! meterで公開されている最新のレベルを、end_positionまでの出力のレベルとして追加する。
+    /*! @return キューに空きがない場合は、追加せずにfalseを返す。
+     */
+    bool Push(UInt64 generation, UInt64 end_position, AudioMeter const &meter);
+    
+    //! 読み出し側から呼び出す。
+    //! positionまでに再生し終えたレベルのうち、最新のものをmeterに公開する。
+    /*! generationより古い世代のレベルは破棄する。
+     *  （読み出し側が世代の更新を知る前に書き込まれた、新しい世代のレベルは破棄しない）
+     */
+    void PublishUntil(UInt64 generation, UInt64 position, AudioMeter &meter);
+    
+    //! キューを空にする。書き込み側と読み出し側のどちらも使用していないときに呼び出す。
+    void Clear();
+
+private:
+    struct Entry
+    {
+        UInt64 generation_ = 0;
+        UInt64 end_position_ = 0;
+    };
+    
+    UInt32 num_channels_ = 0;
+    std::vector<Entry> entries_;
+    //! エントリーごとに、チャンネル数分のレベルを並べたもの
+    std::vector<AudioMeter::Level> levels_;
+    std::atomic<UInt64> num_pushed_ { 0 };
+    std::atomic<UInt64> num_popped_ { 0 };
+};
+
+NS_HWM_END
@@ -0,0 +1,168 @@
+#include "ChildProcess.hpp"
+
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+extern char **environ;
+#endif
+
+#include "./StrCnv.hpp"
+
+NS_HWM_BEGIN
+
+namespace {
+    //! 子プロセスの状態を確認する間隔
+    std::chrono::milliseconds const kPollingInterval { 10 };
+
+    using clock_t = std::chrono::steady_clock;
+}
+
+#if defined(_MSC_VER)
+
+namespace {
+    //! CommandLineToArgvWの規則に従ってクォートする
+    std::wstring quote_argument(std::wstring const &arg)
+    {
+        if(arg.empty() == false && arg.find_first_of(L" \t\n\v\"") == std::wstring::npos) {
+            return arg;
+        }
+
+        std::wstring quoted = L"\"";
+        for(auto it = arg.begin(); ; ++it) {
+            int num_backslashes = 0;
+            for( ; it != arg.end() && *it == L'\\'; ++it) { ++num_backslashes; }
+
+            if(it == arg.end()) {
+                quoted.append(num_backslashes * 2, L'\\');
+                break;
+            } else if(*it == L'"') {
+                quoted.append(num_backslashes * 2 + 1, L'\\');
+                quoted.push_back(*it);
+            } else {
+                quoted.append(num_backslashes, L'\\');
+                quoted.push_back(*it);
+            }
+        }
+        quoted.push_back(L'"');
+        return quoted;
+    }
+}
+
+ChildProcessResult RunChildProcess(String const &exe_path,
+                                   std::vector<String> const &args,
+                                   std::chrono::milliseconds timeout,
+                                   std::atomic<bool> const *should_abort)
+{
+    using Status = ChildProcessResult::Status;
+    ChildProcessResult result;
+
+    std::wstring cmdline = quote_argument(exe_path);
+    for(auto const &arg: args) {
+        cmdline += L" " + quote_argument(arg);
+    }
+
+    STARTUPINFOW si = {};
+    si.cb = sizeof(si);
+    PROCESS_INFORMATION pi = {};
+
+    std::vector<wchar_t> buf(cmdline.begin(), cmdline.end());
+    buf.push_back(L'\0');
+
+    auto const created = CreateProcessW(exe_path.c_str(), buf.data(),
+                                        nullptr, nullptr, FALSE, CREATE_NO_WINDOW,
+                                        nullptr, nullptr, &si, &pi);
+    if(!created) {
+        result.status_ = Status::kFailedToLaunch;
+        return result;
+    }
+
+    auto const deadline = clock_t::now() + timeout;
+
+    for( ; ; ) {
+        auto const wait_result = WaitForSingleObject(pi.hProcess, (DWORD)kPollingInterval.count());
+        if(wait_result == WAIT_OBJECT_0) {
+            DWORD exit_code = 0;
+            GetExitCodeProcess(pi.hProcess, &exit_code);
+            result.status_ = Status::kExited;
+            result.exit_code_ = (int)exit_code;
+            break;
+        }
+
+        bool const aborted = (should_abort && should_abort->load());
+        if(aborted || clock_t::now() >= deadline) {
+            TerminateProcess(pi.hProcess, 1);
+            WaitForSingleObject(pi.hProcess, INFINITE);
+            result.status_ = (aborted ? Status::kAborted : Status::kTimedOut);
+            break;
+        }
+    }
+
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+
+    return result;
+}
+
+#else
+
+ChildProcessResult RunChildProcess(String const &exe_path,
+                                   std::vector<String> const &args,
+                                   std::chrono::milliseconds timeout,
+                                   std::atomic<bool> const *should_abort)
+{
+    using Status = ChildProcessResult::Status;
+    ChildProcessResult result;
+
+    std::vector<std::string> utf8_args;
+    utf8_args.push_back(to_utf8(exe_path));
+    for(auto const &arg: args) { utf8_args.push_back(to_utf8(arg)); }
+
+    std::vector<char *> argv;
+    for(auto &arg: utf8_args) { argv.push_back(&arg[0]); }
+    argv.push_back(nullptr);
+
+    pid_t pid = 0;
+    auto const spawn_result = posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ);
+    if(spawn_result != 0) {
+        result.status_ = Status::kFailedToLaunch;
+        return result;
+    }
+
+    auto const deadline = clock_t::now() + timeout;
+
+    for( ; ; ) {
+        int status = 0;
+        auto const waited = waitpid(pid, &status, WNOHANG);
+        if(waited == pid) {
+            result.status_ = Status::kExited;
+            // シグナルによって終了した（クラッシュした）場合は、負の値を終了コードとする。
+            result.exit_code_ = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+            break;
+        } else if(waited == -1) {
+            result.status_ = Status::kExited;
+            result.exit_code_ = -1;
+            break;
+        }
+
+        bool const aborted = (should_abort && should_abort->load());
+        if(aborted || clock_t::now() >= deadline) {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            result.status_ = (aborted ? Status::kAborted : Status::kTimedOut);
+            break;
+        }
+
+        std::this_thread::sleep_for(kPollingInterval);
+    }
+
+    return result;
+}
+
+#endif
+
+NS_HWM_END
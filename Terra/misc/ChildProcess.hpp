@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+NS_HWM_BEGIN
+
+struct ChildProcessResult
+{
+    enum class Status {
+        kExited,            //!< プロセスが終了した（exit_code_に終了コードが入る）
+        kTimedOut,          //!< タイムアウトしたため、プロセスを強制終了した
+        kAborted,           //!< 中断要求があったため、プロセスを強制終了した
+        kFailedToLaunch,    //!< プロセスを起動できなかった
+    };
+
+    Status status_ = Status::kFailedToLaunch;
+    int exit_code_ = -1;
+
+    //! プロセスが正常に終了コード0で終了したかどうか
+    bool IsSucceeded() const { return status_ == Status::kExited && exit_code_ == 0; }
+};
+
+//! 子プロセスを起動し、その終了を待つ。
+/*! この関数は、wxExecute()と違ってメインスレッド以外から呼び出せる。
+ *  @param exe_path 実行ファイルのパス
+ *  @param args コマンドライン引数（実行ファイルのパスは含まない）
+ *  @param timeout この時間が経過してもプロセスが終了しない場合は、プロセスを強制終了する。
+ *  @param should_abort nullptrでなければ、待機中にこのフラグがtrueになった時点でプロセスを強制終了する。
+ */
+ChildProcessResult RunChildProcess(String const &exe_path,
+                                   std::vector<String> const &args,
+                                   std::chrono::milliseconds timeout,
+                                   std::atomic<bool> const *should_abort = nullptr);
+
+NS_HWM_END
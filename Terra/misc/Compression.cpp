@@ -0,0 +1,86 @@
+#include "Compression.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <zlib.h>
+
+NS_HWM_BEGIN
+
+namespace {
+    //! zlibのウィンドウサイズ。これより前の辞書のデータは参照されない。
+    size_t const kMaxDictionarySize = 32 * 1024;
+    
+    //! deflateの最大圧縮率（約1032:1）に余裕を持たせた値。
+    /*! 展開後のサイズはファイルに書かれた値なので、これを超える値は壊れたデータとして扱い、
+     *  メモリを確保する前に失敗させる。
+     */
+    size_t const kMaxCompressionRatio = 1100;
+    size_t const kMaxCompressionOverhead = 1024;
+}
+
+bool CompressData(void const *data, size_t size, std::string const &dictionary, std::string &out)
+{
+    z_stream zs = {};
+    if(deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK) { return false; }
+
+    bool successful = true;
+    if(dictionary.empty() == false) {
+        successful = (deflateSetDictionary(&zs, (Bytef const *)dictionary.data(), (uInt)dictionary.size()) == Z_OK);
+    }
+
+    if(successful) {
+        out.resize(deflateBound(&zs, (uLong)size));
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = (uInt)size;
+        zs.next_out = (Bytef *)&out[0];
+        zs.avail_out = (uInt)out.size();
+
+        successful = (deflate(&zs, Z_FINISH) == Z_STREAM_END);
+        out.resize(zs.total_out);
+    }
+
+    deflateEnd(&zs);
+    return successful;
+}
+
+bool DecompressData(void const *data, size_t size, size_t uncompressed_size,
+                    std::string const &dictionary, std::string &out)
+{
+    if(size > (std::numeric_limits<size_t>::max() - kMaxCompressionOverhead) / kMaxCompressionRatio) { return false; }
+    if(uncompressed_size > size * kMaxCompressionRatio + kMaxCompressionOverhead) { return false; }
+    
+    z_stream zs = {};
+    if(inflateInit(&zs) != Z_OK) { return false; }
+
+    out.resize(uncompressed_size);
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = (uInt)size;
+    zs.next_out = (Bytef *)(out.empty() ? nullptr : &out[0]);
+    zs.avail_out = (uInt)out.size();
+
+    auto result = inflate(&zs, Z_FINISH);
+    if(result == Z_NEED_DICT && dictionary.empty() == false) {
+        if(inflateSetDictionary(&zs, (Bytef const *)dictionary.data(), (uInt)dictionary.size()) == Z_OK) {
+            result = inflate(&zs, Z_FINISH);
+        }
+    }
+
+    bool const successful = (result == Z_STREAM_END && zs.total_out == uncompressed_size);
+    inflateEnd(&zs);
+    return successful;
+}
+
+std::string MakeCompressionDictionary(std::vector<std::string const *> const &samples)
+{
+    std::string dictionary;
+    if(samples.empty()) { return dictionary; }
+
+    auto const size_per_sample = kMaxDictionarySize / samples.size();
+    for(auto sample: samples) {
+        dictionary.append(*sample, 0, std::min(size_per_sample, sample->size()));
+    }
+
+    return dictionary;
+}
+
+NS_HWM_END
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+NS_HWM_BEGIN
+
+//! dataをzlib形式で圧縮する。
+/*! @param dictionary 空でない場合は、プリセット辞書として使用する。
+ *  展開するときにも同じ辞書を指定する必要がある。
+ */
+bool CompressData(void const *data, size_t size, std::string const &dictionary, std::string &out);
+
+//! CompressData()で圧縮したデータを展開する。
+/*! @param uncompressed_size 展開後のサイズ。これと異なるサイズに展開された場合は失敗する。
+ *  圧縮後のサイズに対して大きすぎる値の場合は、展開せずに失敗する。
+ */
+bool DecompressData(void const *data, size_t size, size_t uncompressed_size,
+                    std::string const &dictionary, std::string &out);
+
+//! 同じ種類のデータを圧縮するためのプリセット辞書を作成する。
+/*! zlibが参照できる範囲（32KB）に収まるように、各サンプルの先頭部分を均等に集める。
+ *  （同じプラグインの状態データは、ヘッダや構造が共通していることが多いため）
+ */
+std::string MakeCompressionDictionary(std::vector<std::string const *> const &samples);
+
+NS_HWM_END
@@ -0,0 +1,21 @@
+#pragma once
+
+NS_HWM_BEGIN
+
+UInt64 const kFNVOffsetBasis = 14695981039346656037ull;
+UInt64 const kFNVPrime = 1099511628211ull;
+
+//! FNV-1aハッシュを計算する。
+/*! 大きなデータは、前回の戻り値をhashに渡して分割して計算できる。
+ */
+template<class Iter>
+UInt64 FNV1a(UInt64 hash, Iter begin, Iter end)
+{
+    for( ; begin != end; ++begin) {
+        hash ^= (UInt8)*begin;
+        hash *= kFNVPrime;
+    }
+    return hash;
+}
+
+NS_HWM_END
@@ -0,0 +1,168 @@
+#include "Interleave.hpp"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HWM_INTERLEAVE_USE_SSE 1
+#include <xmmintrin.h>
+#else
+#define HWM_INTERLEAVE_USE_SSE 0
+#endif
+
+NS_HWM_BEGIN
+
+namespace {
+    void DeinterleaveScalar(float const *src, float * const *dest,
+                            int num_channels, int channel_from, int channel_to,
+                            SampleCount sample_from, SampleCount num_samples)
+    {
+        for(int ch = channel_from; ch < channel_to; ++ch) {
+            auto *d = dest[ch];
+            for(SampleCount smp = sample_from; smp < num_samples; ++smp) {
+                d[smp] = src[smp * num_channels + ch];
+            }
+        }
+    }
+
+    void InterleaveScalar(float const * const *src, float *dest,
+                          int num_channels, int channel_from, int channel_to,
+                          SampleCount sample_from, SampleCount num_samples)
+    {
+        for(int ch = channel_from; ch < channel_to; ++ch) {
+            auto const *s = src[ch];
+            for(SampleCount smp = sample_from; smp < num_samples; ++smp) {
+                dest[smp * num_channels + ch] = s[smp];
+            }
+        }
+    }
+
+#if HWM_INTERLEAVE_USE_SSE
+    void Deinterleave2(float const *src, float * const *dest, SampleCount num_samples)
+    {
+        auto *l = dest[0];
+        auto *r = dest[1];
+        SampleCount smp = 0;
+        for( ; smp + 4 <= num_samples; smp += 4) {
+            auto a = _mm_loadu_ps(src + smp * 2);     // L0 R0 L1 R1
+            auto b = _mm_loadu_ps(src + smp * 2 + 4); // L2 R2 L3 R3
+            _mm_storeu_ps(l + smp, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(r + smp, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+        DeinterleaveScalar(src, dest, 2, 0, 2, smp, num_samples);
+    }
+
+    void Interleave2(float const * const *src, float *dest, SampleCount num_samples)
+    {
+        auto const *l = src[0];
+        auto const *r = src[1];
+        SampleCount smp = 0;
+        for( ; smp + 4 <= num_samples; smp += 4) {
+            auto a = _mm_loadu_ps(l + smp);
+            auto b = _mm_loadu_ps(r + smp);
+            _mm_storeu_ps(dest + smp * 2, _mm_unpacklo_ps(a, b));
+            _mm_storeu_ps(dest + smp * 2 + 4, _mm_unpackhi_ps(a, b));
+        }
+        InterleaveScalar(src, dest, 2, 0, 2, smp, num_samples);
+    }
+
+    //! 4チャンネルずつのグループを、4x4の転置で処理する。
+    //! @return SIMD命令で処理したチャンネル数
+    int Deinterleave4N(float const *src, float * const *dest, int num_channels, SampleCount num_samples)
+    {
+        int const num_grouped = num_channels / 4 * 4;
+        SampleCount const num_vectorized = num_samples / 4 * 4;
+
+        for(int ch = 0; ch < num_grouped; ch += 4) {
+            auto *d0 = dest[ch + 0];
+            auto *d1 = dest[ch + 1];
+            auto *d2 = dest[ch + 2];
+            auto *d3 = dest[ch + 3];
+
+            for(SampleCount smp = 0; smp < num_vectorized; smp += 4) {
+                auto const *s = src + smp * num_channels + ch;
+                auto r0 = _mm_loadu_ps(s);
+                auto r1 = _mm_loadu_ps(s + num_channels);
+                auto r2 = _mm_loadu_ps(s + num_channels * 2);
+                auto r3 = _mm_loadu_ps(s + num_channels * 3);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps(d0 + smp, r0);
+                _mm_storeu_ps(d1 + smp, r1);
+                _mm_storeu_ps(d2 + smp, r2);
+                _mm_storeu_ps(d3 + smp, r3);
+            }
+        }
+
+        DeinterleaveScalar(src, dest, num_channels, 0, num_grouped, num_vectorized, num_samples);
+        return num_grouped;
+    }
+
+    int Interleave4N(float const * const *src, float *dest, int num_channels, SampleCount num_samples)
+    {
+        int const num_grouped = num_channels / 4 * 4;
+        SampleCount const num_vectorized = num_samples / 4 * 4;
+
+        for(int ch = 0; ch < num_grouped; ch += 4) {
+            auto const *s0 = src[ch + 0];
+            auto const *s1 = src[ch + 1];
+            auto const *s2 = src[ch + 2];
+            auto const *s3 = src[ch + 3];
+
+            for(SampleCount smp = 0; smp < num_vectorized; smp += 4) {
+                auto r0 = _mm_loadu_ps(s0 + smp);
+                auto r1 = _mm_loadu_ps(s1 + smp);
+                auto r2 = _mm_loadu_ps(s2 + smp);
+                auto r3 = _mm_loadu_ps(s3 + smp);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                auto *d = dest + smp * num_channels + ch;
+                _mm_storeu_ps(d, r0);
+                _mm_storeu_ps(d + num_channels, r1);
+                _mm_storeu_ps(d + num_channels * 2, r2);
+                _mm_storeu_ps(d + num_channels * 3, r3);
+            }
+        }
+
+        InterleaveScalar(src, dest, num_channels, 0, num_grouped, num_vectorized, num_samples);
+        return num_grouped;
+    }
+#endif
+}
+
+void Deinterleave(float const *src, float * const *dest, int num_channels, SampleCount num_samples)
+{
+    if(num_channels == 1) {
+        std::copy_n(src, num_samples, dest[0]);
+        return;
+    }
+
+    int ch = 0;
+#if HWM_INTERLEAVE_USE_SSE
+    if(num_channels == 2) {
+        Deinterleave2(src, dest, num_samples);
+        return;
+    }
+    ch = Deinterleave4N(src, dest, num_channels, num_samples);
+#endif
+
+    DeinterleaveScalar(src, dest, num_channels, ch, num_channels, 0, num_samples);
+}
+
+void Interleave(float const * const *src, float *dest, int num_channels, SampleCount num_samples)
+{
+    if(num_channels == 1) {
+        std::copy_n(src[0], num_samples, dest);
+        return;
+    }
+
+    int ch = 0;
+#if HWM_INTERLEAVE_USE_SSE
+    if(num_channels == 2) {
+        Interleave2(src, dest, num_samples);
+        return;
+    }
+    ch = Interleave4N(src, dest, num_channels, num_samples);
+#endif
+
+    InterleaveScalar(src, dest, num_channels, ch, num_channels, 0, num_samples);
+}
+
+NS_HWM_END
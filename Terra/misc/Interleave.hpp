@@ -0,0 +1,19 @@
+#pragma once
+
+NS_HWM_BEGIN
+
+//! インターリーブされたsrcを、チャンネルごとのバッファdestに分配する。
+/*! 2チャンネルと、4チャンネル単位のグループはSIMD命令で転置する。
+ *  （4, 8, 32チャンネルなどのデバイスは、すべてのチャンネルがSIMD命令で処理される）
+ *
+ *  @param src num_channels * num_samples個のサンプルを持つバッファ
+ *  @param dest num_channels個のチャンネルのバッファ。各チャンネルはnum_samples個のサンプルを持つ。
+ */
+void Deinterleave(float const *src, float * const *dest, int num_channels, SampleCount num_samples);
+
+//! チャンネルごとのバッファsrcを、インターリーブしてdestに書き込む。
+/*! Deinterleave()の逆の処理を行う。
+ */
+void Interleave(float const * const *src, float *dest, int num_channels, SampleCount num_samples);
+
+NS_HWM_END
@@ -0,0 +1,110 @@
+#include "MappedFile.hpp"
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "./StrCnv.hpp"
+
+NS_HWM_BEGIN
+
+#if defined(_MSC_VER)
+
+struct MappedFile::Impl
+{
+    size_t size_ = 0;
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+    void const *data_ = nullptr;
+
+    ~Impl()
+    {
+        if(data_) { UnmapViewOfFile(data_); }
+        if(mapping_) { CloseHandle(mapping_); }
+        if(file_ != INVALID_HANDLE_VALUE) { CloseHandle(file_); }
+    }
+};
+
+std::unique_ptr<MappedFile> MappedFile::Open(String const &path)
+{
+    auto pimpl = std::make_unique<Impl>();
+
+    // マップしている間も、ファイルの削除や名前の変更（上書き保存のための置き換え）を許可する。
+    pimpl->file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_DELETE, nullptr,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(pimpl->file_ == INVALID_HANDLE_VALUE) { return nullptr; }
+
+    LARGE_INTEGER size;
+    if(GetFileSizeEx(pimpl->file_, &size) == FALSE || size.QuadPart == 0) { return nullptr; }
+    pimpl->size_ = (size_t)size.QuadPart;
+
+    pimpl->mapping_ = CreateFileMappingW(pimpl->file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(pimpl->mapping_ == nullptr) { return nullptr; }
+
+    pimpl->data_ = MapViewOfFile(pimpl->mapping_, FILE_MAP_READ, 0, 0, 0);
+    if(pimpl->data_ == nullptr) { return nullptr; }
+
+    return std::unique_ptr<MappedFile>(new MappedFile(std::move(pimpl)));
+}
+
+#else
+
+struct MappedFile::Impl
+{
+    size_t size_ = 0;
+    void *data_ = nullptr;
+
+    ~Impl()
+    {
+        if(data_) { munmap(data_, size_); }
+    }
+};
+
+std::unique_ptr<MappedFile> MappedFile::Open(String const &path)
+{
+    auto pimpl = std::make_unique<Impl>();
+
+    int const fd = open(to_utf8(path).c_str(), O_RDONLY);
+    if(fd == -1) { return nullptr; }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    pimpl->size_ = (size_t)st.st_size;
+
+    void *data = mmap(nullptr, pimpl->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED) { return nullptr; }
+    pimpl->data_ = data;
+
+    return std::unique_ptr<MappedFile>(new MappedFile(std::move(pimpl)));
+}
+
+#endif
+
+MappedFile::MappedFile(std::unique_ptr<Impl> pimpl)
+:   pimpl_(std::move(pimpl))
+{}
+
+MappedFile::~MappedFile()
+{}
+
+void const * MappedFile::GetData() const
+{
+    return pimpl_->data_;
+}
+
+size_t MappedFile::GetSize() const
+{
+    return pimpl_->size_;
+}
+
+NS_HWM_END
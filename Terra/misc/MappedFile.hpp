@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+
+NS_HWM_BEGIN
+
+//! 読み込み専用でメモリにマップしたファイル
+/*! ファイルの内容は、アクセスされたときに必要な部分だけがOSによって読み込まれる。
+ */
+class MappedFile
+{
+public:
+    //! ファイルをマップする。ファイルが存在しない場合や、空の場合、マップに失敗した場合はnullptrを返す。
+    static
+    std::unique_ptr<MappedFile> Open(String const &path);
+
+    ~MappedFile();
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile & operator=(MappedFile const &) = delete;
+
+    void const * GetData() const;
+    size_t GetSize() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> pimpl_;
+
+    MappedFile(std::unique_ptr<Impl> pimpl);
+};
+
+NS_HWM_END
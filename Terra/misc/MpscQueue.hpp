@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+
+NS_HWM_BEGIN
+
+//! 複数のスレッドから追加し、一つのスレッドから取り出せるロックフリーな固定長キュー
+/*! 領域はコンストラクタで確保され、TryPush/TryPopは動的なメモリ確保もブロックもしない。
+ *  そのため、TryPopはオーディオスレッドから呼び出せる。
+ *  （Dmitry Vyukovのbounded MPMC queueをもとにしている）
+ *  @tparam T デフォルト構築可能でコピー代入可能な型
+ */
+template<class T>
+class MpscQueue
+{
+public:
+    using value_type = T;
+
+    //! @param capacity キューの容量。2の冪乗に切り上げられる。
+    explicit
+    MpscQueue(UInt32 capacity)
+    {
+        assert(capacity > 0);
+
+        UInt32 size = 1;
+        while(size < capacity) { size <<= 1; }
+
+        mask_ = size - 1;
+        cells_ = std::make_unique<Cell[]>(size);
+        for(UInt32 i = 0; i < size; ++i) {
+            cells_[i].sequence_.store(i, std::memory_order_relaxed);
+        }
+
+        push_pos_.store(0, std::memory_order_relaxed);
+        pop_pos_.store(0, std::memory_order_relaxed);
+    }
+
+    MpscQueue(MpscQueue const &) = delete;
+    MpscQueue & operator=(MpscQueue const &) = delete;
+
+    UInt32 GetCapacity() const { return mask_ + 1; }
+
+    //! データを追加する。複数のスレッドから同時に呼び出せる。
+    /*! @return キューが満杯の場合はfalse
+     */
+    bool TryPush(T const &value)
+    {
+        auto pos = push_pos_.load(std::memory_order_relaxed);
+
+        for( ; ; ) {
+            auto &cell = cells_[pos & mask_];
+            auto const seq = cell.sequence_.load(std::memory_order_acquire);
+            auto const diff = (std::intptr_t)seq - (std::intptr_t)pos;
+
+            if(diff == 0) {
+                if(push_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value_ = value;
+                    cell.sequence_.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(diff < 0) {
+                return false;
+            } else {
+                pos = push_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //! データを取り出す。一つのスレッドからだけ呼び出せる。
+    /*! @return キューが空の場合はfalse
+     */
+    bool TryPop(T &value)
+    {
+        auto const pos = pop_pos_.load(std::memory_order_relaxed);
+        auto &cell = cells_[pos & mask_];
+        auto const seq = cell.sequence_.load(std::memory_order_acquire);
+
+        if((std::intptr_t)seq - (std::intptr_t)(pos + 1) < 0) {
+            return false;
+        }
+
+        value = cell.value_;
+        cell.sequence_.store(pos + mask_ + 1, std::memory_order_release);
+        pop_pos_.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence_;
+        T value_;
+    };
+
+    size_t mask_ = 0;
+    std::unique_ptr<Cell[]> cells_;
+    // 追加側と取り出し側が同じキャッシュラインを奪い合わないように離しておく。
+    alignas(64) std::atomic<size_t> push_pos_;
+    alignas(64) std::atomic<size_t> pop_pos_;
+};
+
+NS_HWM_END
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+NS_HWM_BEGIN
+
+//! ハードウェアのスレッド数（取得できない場合は1）を返す。
+inline
+UInt32 GetDefaultNumWorkers()
+{
+    return std::max<UInt32>(1, std::thread::hardware_concurrency());
+}
+
+//! [0, num) の各インデックスについて、f(index) を複数のスレッドで並列に呼び出す。
+/*! すべての呼び出しが完了するまでブロックする。
+ *  fは、異なるインデックスに対して同時に呼び出されても安全でなければならない。
+ *  @param num_workers 使用するスレッドの最大数。0の場合はGetDefaultNumWorkers()を使用する。
+ */
+template<class F>
+void ParallelFor(size_t num, F f, UInt32 num_workers = 0)
+{
+    if(num == 0) { return; }
+    if(num_workers == 0) { num_workers = GetDefaultNumWorkers(); }
+
+    auto const num_threads = std::min<size_t>(num, num_workers);
+    std::atomic<size_t> next_index { 0 };
+
+    auto worker = [&] {
+        for( ; ; ) {
+            auto const index = next_index.fetch_add(1);
+            if(index >= num) { return; }
+            f(index);
+        }
+    };
+
+    if(num_threads == 1) {
+        worker();
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < num_threads; ++i) {
+        threads.emplace_back(worker);
+    }
+
+    for(auto &th: threads) { th.join(); }
+}
+
+NS_HWM_END
@@ -0,0 +1,188 @@
+#include "RealtimeThread.hpp"
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#endif
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define HWM_USE_SSE_CSR 1
+#include <xmmintrin.h>
+#else
+#define HWM_USE_SSE_CSR 0
+#endif
+
+#if defined(_MSC_VER)
+#define HWM_NOINLINE __declspec(noinline)
+#else
+#define HWM_NOINLINE __attribute__((noinline))
+#endif
+
+NS_HWM_BEGIN
+
+namespace {
+    //! オーディオスレッドで使われる可能性があるスタックの大きさ
+    size_t const kStackPrefaultSize = 64 * 1024;
+    size_t const kPageSize = 4096;
+
+#if defined(__linux__)
+    //! JACKなどと同程度の優先度にする。（カーネルのIRQスレッドより下に収まる値）
+    int const kLinuxRealtimePriority = 70;
+    //! RaiseThreadPriorityBelowRealtime() で設定する優先度
+    int const kLinuxBelowRealtimePriority = kLinuxRealtimePriority - 10;
+#endif
+
+    //! スタックの先の方のページを書き込んでおき、処理中にページフォルトが起きないようにする。
+    /*! @param lock_memory 書き込んだページをロックして、スワップアウトされないようにするかどうか。
+     *  オーディオスレッドは LockProcessMemory() のあとで作られることがあるので、スタックは個別にロックする。
+     *  @return ロックに失敗した場合はfalse
+     */
+    HWM_NOINLINE
+    bool PrefaultStack(bool lock_memory)
+    {
+        // ロックしない場合は書き込むだけなので、未使用の警告を抑制する。
+        [[maybe_unused]] volatile char buf[kStackPrefaultSize];
+        // Windowsのガードページを順に伸ばせるように、スタックの上（アドレスの大きい方）から書き込む。
+        for(size_t i = kStackPrefaultSize; i > 0; ) {
+            i = (i >= kPageSize ? i - kPageSize : 0);
+            buf[i] = 0;
+        }
+        
+#if defined(__linux__)
+        if(lock_memory) {
+            return mlock(const_cast<char const *>(buf), kStackPrefaultSize) == 0;
+        }
+#endif
+        return lock_memory == false;
+    }
+
+#if !defined(_MSC_VER)
+    bool SetFifoPriority(int priority)
+    {
+        // LinuxではRLIMIT_RTPRIOで許可されていない場合は失敗する。
+        // （rtkitによる優先度の取得は、D-Busへの依存が増えるので行わない）
+        sched_param param = {};
+        param.sched_priority = priority;
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+#endif
+
+    bool RaiseThreadPriority([[maybe_unused]] double period)
+    {
+#if defined(_MSC_VER)
+        return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#elif defined(__APPLE__)
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+
+        auto to_abs_time = [&timebase](double sec) {
+            return (uint32_t)(sec * 1000.0 * 1000.0 * 1000.0 * timebase.denom / timebase.numer);
+        };
+
+        thread_time_constraint_policy_data_t policy;
+        policy.period = to_abs_time(period);
+        policy.computation = to_abs_time(period * 0.5);
+        policy.constraint = to_abs_time(period);
+        policy.preemptible = true;
+
+        auto const result = thread_policy_set(pthread_mach_thread_np(pthread_self()),
+                                              THREAD_TIME_CONSTRAINT_POLICY,
+                                              (thread_policy_t)&policy,
+                                              THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+        return result == KERN_SUCCESS;
+#elif defined(__linux__)
+        return SetFifoPriority(kLinuxRealtimePriority);
+#else
+        return false;
+#endif
+    }
+
+    bool SetThreadAffinity(UInt64 cpu_mask)
+    {
+        if(cpu_mask == 0) { return true; }
+
+#if defined(_MSC_VER)
+        return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)cpu_mask) != 0;
+#elif defined(__linux__)
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for(int i = 0; i < 64; ++i) {
+            if(cpu_mask & (1ull << i)) { CPU_SET(i, &cpus); }
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+        return false;
+#endif
+    }
+}
+
+bool ConfigureRealtimeThread(RealtimeThreadOptions const &options, double period)
+{
+    EnableFlushDenormalsToZero();
+
+    bool successful = PrefaultStack(options.lock_memory_);
+    successful = RaiseThreadPriority(period) && successful;
+    successful = SetThreadAffinity(options.cpu_mask_) && successful;
+    return successful;
+}
+
+bool RaiseThreadPriorityBelowRealtime()
+{
+#if defined(_MSC_VER)
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST) != 0;
+#elif defined(__linux__)
+    return SetFifoPriority(kLinuxBelowRealtimePriority);
+#else
+    auto const min = sched_get_priority_min(SCHED_FIFO);
+    auto const max = sched_get_priority_max(SCHED_FIFO);
+    return SetFifoPriority(min + (max - min) / 2);
+#endif
+}
+
+void EnableFlushDenormalsToZero()
+{
+#if HWM_USE_SSE_CSR
+    UInt32 const kFlushToZero = 0x8000;
+    UInt32 const kDenormalsAreZero = 0x0040;
+    auto const csr = _mm_getcsr();
+    if((csr & (kFlushToZero | kDenormalsAreZero)) != (kFlushToZero | kDenormalsAreZero)) {
+        _mm_setcsr(csr | kFlushToZero | kDenormalsAreZero);
+    }
+#elif defined(__aarch64__)
+    UInt64 const kFlushToZero = 1ull << 24;
+    UInt64 fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    if((fpcr & kFlushToZero) == 0) {
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | kFlushToZero));
+    }
+#endif
+}
+
+bool LockProcessMemory()
+{
+#if defined(__linux__)
+    // MCL_FUTUREを指定すると、プラグインのロードなどでこのあと確保されるメモリまですべてロックされ、
+    // RLIMIT_MEMLOCKを超えて確保に失敗するようになるので、現在のページだけをロックする。
+    return mlockall(MCL_CURRENT) == 0;
+#else
+    return false;
+#endif
+}
+
+void UnlockProcessMemory()
+{
+#if defined(__linux__)
+    munlockall();
+#endif
+}
+
+NS_HWM_END
@@ -0,0 +1,61 @@
+#pragma once
+
+NS_HWM_BEGIN
+
+//! オーディオ処理を行うスレッドの設定
+struct RealtimeThreadOptions
+{
+    //! スレッドを実行するCPUのビットマスク。0の場合はCPUを固定しない。
+    /*! 他の処理に使われないように分離したCPUを指定することで、割り込みによる遅延を減らせる。
+     *  macOSではスレッドを特定のCPUに固定できないので無視される。
+     */
+    UInt64 cpu_mask_ = 0;
+
+    //! オーディオ処理中のページフォルトを避けるため、プロセスのメモリをロックする。
+    bool lock_memory_ = false;
+};
+
+//! 呼び出したスレッドを、オーディオ処理に適した設定にする。
+/*! 以下の設定を行う。
+ *  - スレッドの優先度をリアルタイム処理用に上げる。
+ *    （Windowsは THREAD_PRIORITY_TIME_CRITICAL、macOSは THREAD_TIME_CONSTRAINT_POLICY、Linuxは SCHED_FIFO）
+ *  - options.cpu_mask_ が指定されていれば、スレッドをそのCPUに固定する。
+ *  - スタックのページを、あらかじめ物理メモリに割り当てておく。
+ *    options.lock_memory_ が指定されていれば、そのページをロックする。（Linuxのみ）
+ *  - EnableFlushDenormalsToZero() を呼び出す。
+ *
+ *  @param period オーディオ処理を呼び出す間隔（秒）。macOSでスレッドの優先度を設定するために使用する。
+ *  @return すべての設定が成功した場合はtrue
+ */
+bool ConfigureRealtimeThread(RealtimeThreadOptions const &options, double period);
+
+//! 呼び出したスレッドの優先度を、オーディオ処理を行うスレッドより一段低いリアルタイム処理用の優先度に上げる。
+/*! MIDIの送信スレッドのように、処理は軽いがタイミングの正確さが必要なスレッドに使用する。
+ *  ConfigureRealtimeThread() で設定したスレッドより優先されることはないので、オーディオ処理を妨げない。
+ *  （Windowsは THREAD_PRIORITY_HIGHEST、Linuxは ConfigureRealtimeThread() より低い優先度の SCHED_FIFO。
+ *   macOSでは THREAD_TIME_CONSTRAINT_POLICY のスレッドが常に優先されるので、 SCHED_FIFO を設定する）
+ *
+ *  @return 成功した場合はtrue
+ */
+bool RaiseThreadPriorityBelowRealtime();
+
+//! 呼び出したスレッドの浮動小数点演算で、非正規化数を0として扱うようにする。(FTZ/DAZ)
+/*! 非正規化数の演算は非常に遅く、リバーブのテールなどで処理時間が急増する原因になる。
+ *  プラグインがこの設定を変更することもあるので、オーディオ処理のたびに呼び出す。
+ *  設定がすでに有効な場合は、何もしない。
+ */
+void EnableFlushDenormalsToZero();
+
+//! プロセスのメモリをロックし、スワップアウトされないようにする。
+/*! 現在確保されているページは、この時点で物理メモリに割り当てられる。
+ *  （グラフやプラグインが StartProcessing() で確保したバッファも含む）
+ *  この後で確保されるメモリはロックしない。オーディオ処理を行うスレッドのスタックは、
+ *  ConfigureRealtimeThread() でロックする。
+ *  @return 成功した場合はtrue。Linux以外では何もせずにfalseを返す。
+ */
+bool LockProcessMemory();
+
+//! LockProcessMemory() でロックしたメモリを解放する。
+void UnlockProcessMemory();
+
+NS_HWM_END
@@ -1,5 +1,6 @@
 #include "TransitionalVolume.hpp"
 #include "MathUtil.hpp"
+#include "VectorOps.hpp"
 
 NS_HWM_BEGIN
 
@@ -41,10 +42,14 @@ TransitionalVolume & TransitionalVolume::operator=(TransitionalVolume &&rhs)
 }
 
 void TransitionalVolume::update_transition(Int32 step)
+{
+    update_transition_to(target_db_.load(), step);
+}
+
+void TransitionalVolume::update_transition_to(double goal, Int32 step)
 {
     assert(step >= 1);
     
-    auto const goal = target_db_.load();
     if(fabs(current_db_ - goal) < kTolerance) {
         current_db_ = goal;
     }
@@ -56,6 +61,47 @@ void TransitionalVolume::update_transition(Int32 step)
     }
 }
 
+void TransitionalVolume::apply(BufferRef<float> buf)
+{
+    Int32 const num_samples = buf.samples();
+    if(num_samples == 0) { return; }
+    
+    auto multiply = [&buf](Int32 sample_from, Int32 length, double gain) {
+        if(gain == 1 || length == 0) { return; }
+        for(UInt32 ch = 0; ch < buf.channels(); ++ch) {
+            auto *data = buf.get_channel_data(ch) + sample_from;
+            if(gain == 0) {
+                std::fill_n(data, length, 0);
+            } else {
+                MultiplyByGain(data, length, gain);
+            }
+        }
+    };
+    
+    auto const goal = target_db_.load();
+    if(fabs(current_db_ - goal) < kTolerance) {
+        current_db_ = goal;
+        multiply(0, num_samples, get_current_linear_gain());
+        return;
+    }
+    
+    // 目的の値に達するまでのサンプル数だけ、1サンプルごとに amount_ dBずつ推移させる。
+    // 最小のdB値から推移する場合も、最初のサンプルは無音ではなく、最小のdB値のゲインから始める。
+    auto const diff = goal - current_db_;
+    Int32 const num_ramp = std::min<double>(num_samples, std::ceil(fabs(diff) / amount_));
+    float const gain_begin = DBToLinear(current_db_);
+    float const ratio = DBToLinear(diff > 0 ? amount_ : -amount_);
+    
+    for(UInt32 ch = 0; ch < buf.channels(); ++ch) {
+        MultiplyByExponentialRamp(buf.get_channel_data(ch), num_ramp, gain_begin, ratio);
+    }
+    
+    update_transition_to(goal, num_samples);
+    
+    // ブロックの途中で目的の値に達した場合は、残りのサンプルに目的の値のゲインを掛ける。
+    multiply(num_ramp, num_samples - num_ramp, get_current_linear_gain());
+}
+
 double TransitionalVolume::get_current_db() const
 {
     return current_db_;
@@ -2,6 +2,8 @@
 
 #include <atomic>
 
+#include "./Buffer.hpp"
+
 NS_HWM_BEGIN
 
 //! 目的の音量に達するまでなめらかに音量を推移するクラス
@@ -31,6 +33,16 @@ public:
     //! この関数は、get_current_XXX()関数と同じスレッドから呼び出すこと
     void update_transition(Int32 step);
     
+    //! bufに音量を適用して、buf.samples()サンプル分だけ推移を進める。
+    /*! 音量が推移している間は、サンプルごとに音量を変化させる。
+     *  （dB値で一定の速度で推移するので、線形なゲインとしては指数的に変化する）
+     *  音量が目的の値に達している場合は、推移の計算を行わずに一定のゲインを掛ける。
+     *  ゲインが1の場合は、bufに何もしない。
+     *
+     *  @note この関数は、update_transition()関数と同じスレッドから呼び出すこと
+     */
+    void apply(BufferRef<float> buf);
+    
     //! 現在推移中の出力レベルをdB値として返す
     /*! @note この関数は、update_transition()関数と同じスレッドから呼び出すこと
      */
@@ -67,6 +79,8 @@ private:
     double max_db_;
     double current_db_ = 0;
     std::atomic<double> target_db_ = {0};
+    
+    void update_transition_to(double goal, Int32 step);
 };
 
 NS_HWM_END
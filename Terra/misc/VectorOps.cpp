@@ -0,0 +1,156 @@
+#include "VectorOps.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HWM_VECTOR_OPS_USE_SSE 1
+#include <xmmintrin.h>
+#else
+#define HWM_VECTOR_OPS_USE_SSE 0
+#endif
+
+NS_HWM_BEGIN
+
+namespace {
+#if HWM_VECTOR_OPS_USE_SSE
+    float HorizontalSum(__m128 v)
+    {
+        alignas(16) float tmp[4];
+        _mm_store_ps(tmp, v);
+        return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+    }
+
+    float HorizontalMax(__m128 v)
+    {
+        alignas(16) float tmp[4];
+        _mm_store_ps(tmp, v);
+        return std::max(std::max(tmp[0], tmp[1]), std::max(tmp[2], tmp[3]));
+    }
+#endif
+}
+
+void AddWithGain(float const *src, float *dest, SampleCount num_samples, float gain)
+{
+    SampleCount smp = 0;
+#if HWM_VECTOR_OPS_USE_SSE
+    auto const g = _mm_set1_ps(gain);
+    for( ; smp + 4 <= num_samples; smp += 4) {
+        auto const s = _mm_loadu_ps(src + smp);
+        auto const d = _mm_loadu_ps(dest + smp);
+        _mm_storeu_ps(dest + smp, _mm_add_ps(d, _mm_mul_ps(s, g)));
+    }
+#endif
+
+    for( ; smp < num_samples; ++smp) {
+        dest[smp] += src[smp] * gain;
+    }
+}
+
+void AddWithLinearRamp(float const *src, float *dest, SampleCount num_samples,
+                       float gain_begin, float gain_end)
+{
+    if(num_samples <= 0) { return; }
+
+    if(gain_begin == gain_end) {
+        AddWithGain(src, dest, num_samples, gain_begin);
+        return;
+    }
+
+    float const step = (gain_end - gain_begin) / num_samples;
+
+    SampleCount smp = 0;
+#if HWM_VECTOR_OPS_USE_SSE
+    auto g = _mm_setr_ps(gain_begin, gain_begin + step, gain_begin + step * 2, gain_begin + step * 3);
+    auto const g_step = _mm_set1_ps(step * 4);
+    for( ; smp + 4 <= num_samples; smp += 4) {
+        auto const s = _mm_loadu_ps(src + smp);
+        auto const d = _mm_loadu_ps(dest + smp);
+        _mm_storeu_ps(dest + smp, _mm_add_ps(d, _mm_mul_ps(s, g)));
+        g = _mm_add_ps(g, g_step);
+    }
+#endif
+
+    for( ; smp < num_samples; ++smp) {
+        dest[smp] += src[smp] * (gain_begin + step * smp);
+    }
+}
+
+void MultiplyByGain(float *data, SampleCount num_samples, float gain)
+{
+    SampleCount smp = 0;
+#if HWM_VECTOR_OPS_USE_SSE
+    auto const g = _mm_set1_ps(gain);
+    for( ; smp + 4 <= num_samples; smp += 4) {
+        _mm_storeu_ps(data + smp, _mm_mul_ps(_mm_loadu_ps(data + smp), g));
+    }
+#endif
+
+    for( ; smp < num_samples; ++smp) {
+        data[smp] *= gain;
+    }
+}
+
+void MultiplyByExponentialRamp(float *data, SampleCount num_samples, float gain_begin, float ratio)
+{
+    if(ratio == 1.0f) {
+        MultiplyByGain(data, num_samples, gain_begin);
+        return;
+    }
+
+    float gain = gain_begin;
+
+    SampleCount smp = 0;
+#if HWM_VECTOR_OPS_USE_SSE
+    if(num_samples >= 4) {
+        float const r2 = ratio * ratio;
+        auto g = _mm_setr_ps(gain, gain * ratio, gain * r2, gain * r2 * ratio);
+        auto const g_ratio = _mm_set1_ps(r2 * r2);
+        for( ; smp + 4 <= num_samples; smp += 4) {
+            _mm_storeu_ps(data + smp, _mm_mul_ps(_mm_loadu_ps(data + smp), g));
+            g = _mm_mul_ps(g, g_ratio);
+        }
+        _mm_store_ss(&gain, g);
+    }
+#endif
+
+    for( ; smp < num_samples; ++smp) {
+        data[smp] *= gain;
+        gain *= ratio;
+    }
+}
+
+void AccumulatePeakAndSquareSum(float const *src, SampleCount num_samples,
+                                float &peak, float &square_sum)
+{
+    float p = peak;
+    float sum = 0;
+
+    SampleCount smp = 0;
+#if HWM_VECTOR_OPS_USE_SSE
+    if(num_samples >= 4) {
+        auto const zero = _mm_setzero_ps();
+        auto vp = _mm_setzero_ps();
+        auto vsum = _mm_setzero_ps();
+        for( ; smp + 4 <= num_samples; smp += 4) {
+            auto const s = _mm_loadu_ps(src + smp);
+            // |x| = max(x, -x)
+            vp = _mm_max_ps(vp, _mm_max_ps(s, _mm_sub_ps(zero, s)));
+            vsum = _mm_add_ps(vsum, _mm_mul_ps(s, s));
+        }
+        p = std::max(p, HorizontalMax(vp));
+        sum = HorizontalSum(vsum);
+    }
+#endif
+
+    for( ; smp < num_samples; ++smp) {
+        auto const s = src[smp];
+        p = std::max(p, std::fabs(s));
+        sum += s * s;
+    }
+
+    peak = p;
+    square_sum += sum;
+}
+
+NS_HWM_END
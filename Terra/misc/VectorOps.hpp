@@ -0,0 +1,30 @@
+#pragma once
+
+NS_HWM_BEGIN
+
+//! dest[i] += src[i] * gain
+void AddWithGain(float const *src, float *dest, SampleCount num_samples, float gain);
+
+//! srcに、gain_beginからgain_endへ線形に推移するゲインを掛けてdestに加算する。
+/*! i番目のサンプルには、 gain_begin + (gain_end - gain_begin) * i / num_samples のゲインが掛かる。
+ *  （gain_endは、次のブロックの先頭のゲインとして扱う）
+ */
+void AddWithLinearRamp(float const *src, float *dest, SampleCount num_samples,
+                       float gain_begin, float gain_end);
+
+//! data[i] *= gain
+void MultiplyByGain(float *data, SampleCount num_samples, float gain);
+
+//! data[i] *= gain_begin * pow(ratio, i)
+/*! dB値で一定の速度で推移するゲインを掛けるときに使用する。
+ */
+void MultiplyByExponentialRamp(float *data, SampleCount num_samples, float gain_begin, float ratio);
+
+//! srcの絶対値の最大値と、二乗和を求め、それぞれpeakとsquare_sumに反映する。
+/*! peakには、現在の値とsrcの絶対値の最大値の大きいほうを、
+ *  square_sumには、現在の値にsrcの二乗和を加算した値を書き込む。
+ */
+void AccumulatePeakAndSquareSum(float const *src, SampleCount num_samples,
+                                float &peak, float &square_sum);
+
+NS_HWM_END
@@ -1,11 +1,17 @@
 #include "PluginScanner.hpp"
 
 #include <atomic>
+#include <map>
 #include <thread>
 #include <wx/dir.h>
+#include <wx/filename.h>
+#include <wx/stdpaths.h>
 #include <plugin_desc.pb.h>
 
+#include "../misc/ChildProcess.hpp"
+#include "../misc/FileStream.hpp"
 #include "../misc/ScopeExit.hpp"
+#include "../misc/Hash.hpp"
 #include "../misc/StrCnv.hpp"
 #include "../misc/ListenerService.hpp"
 #include <pluginterfaces/vst/ivstaudioprocessor.h>
@@ -30,6 +36,124 @@ bool Contains(Container &c, ClassInfo::CID const &cid) {
     });
 }
 
+namespace {
+    //! 1つのプラグインモジュールのスキャンにかけられる最大の時間
+    std::chrono::milliseconds const kScanTimeout { 30 * 1000 };
+    
+    //! モジュールを構成するファイルのリストを返す。
+    //! macOSのバンドルの場合は、バンドル内のすべてのファイルをソートした順番で返す。
+    std::vector<String> GetModuleFiles(String const &module_path)
+    {
+        if(wxDir::Exists(module_path) == false) {
+            return { module_path };
+        }
+        
+        wxArrayString files;
+        wxDir::GetAllFiles(module_path, &files);
+        files.Sort();
+        
+        std::vector<String> list;
+        for(auto const &f: files) { list.push_back(f.ToStdWstring()); }
+        return list;
+    }
+    
+    bool ModuleExists(String const &module_path)
+    {
+        return wxFileExists(module_path) || wxDir::Exists(module_path);
+    }
+}
+
+//! プラグインモジュールのサイズと更新日時（ハッシュ値は必要なときにだけ計算する）
+struct ModuleStat
+{
+    UInt64 size_ = 0;
+    Int64 mtime_ = 0;
+    
+    bool operator==(ModuleStat const &rhs) const { return size_ == rhs.size_ && mtime_ == rhs.mtime_; }
+    bool operator!=(ModuleStat const &rhs) const { return !(*this == rhs); }
+};
+
+std::optional<ModuleStat> GetModuleStat(String const &module_path)
+{
+    if(ModuleExists(module_path) == false) { return std::nullopt; }
+    
+    ModuleStat stat;
+    for(auto const &file: GetModuleFiles(module_path)) {
+        wxFileName fn(file);
+        auto const size = wxFileName::GetSize(file);
+        if(size == wxInvalidSize) { return std::nullopt; }
+        stat.size_ += size.GetValue();
+        
+        auto const mtime = fn.GetModificationTime();
+        if(mtime.IsValid() == false) { return std::nullopt; }
+        stat.mtime_ = std::max<Int64>(stat.mtime_, mtime.GetTicks());
+    }
+    
+    return stat;
+}
+
+//! モジュールの内容からハッシュ値を計算する。
+//! バンドルの場合は、バンドル内の相対パスも計算に含める。
+std::optional<UInt64> CalculateModuleHash(String const &module_path)
+{
+    UInt64 hash = kFNVOffsetBasis;
+    std::vector<char> buf(64 * 1024);
+    
+    for(auto const &file: GetModuleFiles(module_path)) {
+        auto const relative_path = to_utf8(file.substr(std::min(module_path.size(), file.size())));
+        hash = FNV1a(hash, relative_path.begin(), relative_path.end());
+        
+        auto ifs = open_ifstream(file, std::ios::in|std::ios::binary);
+        if(!ifs) { return std::nullopt; }
+        
+        while(ifs) {
+            ifs.read(buf.data(), buf.size());
+            hash = FNV1a(hash, buf.data(), buf.data() + ifs.gcount());
+        }
+    }
+    
+    return hash;
+}
+
+//! モジュールをロードして、含まれるオーディオプラグインの情報をlistに追加する。
+//! @throw std::exception
+void LoadModuleDescriptions(String const &module_path, schema::PluginDescriptionList &list)
+{
+    auto factory_list = Vst3PluginFactoryList::GetInstance();
+    auto factory = factory_list->FindOrCreateFactory(module_path);
+    
+    if (!factory) {
+        return;
+    }
+    
+    auto const num = factory->GetComponentCount();
+    for (int i = 0; i < num; ++i) {
+        auto info = factory->GetComponentInfo(i);
+        
+        //! カテゴリがkVstAudioEffectClassでないComponentは、オーディオプラグインではないので無視する。
+        if (info.category() != hwm::to_wstr(kVstAudioEffectClass)) {
+            continue;
+        }
+        
+        auto &desc = *list.add_list();
+        desc.set_name(to_utf8(info.name()));
+        auto vi = desc.mutable_vst3info();
+        vi->set_filepath(to_utf8(module_path));
+        std::string const cid(info.cid().begin(), info.cid().end());
+        vi->set_cid(cid);
+        vi->set_category(to_utf8(info.category()));
+        vi->set_cardinality(info.cardinality());
+        
+        if (info.has_classinfo2()) {
+            auto ci2 = vi->mutable_classinfo2();
+            ci2->set_subcategories(to_utf8(info.classinfo2().sub_categories()));
+            ci2->set_vendor(to_utf8(info.classinfo2().vendor()));
+            ci2->set_version(to_utf8(info.classinfo2().version()));
+            ci2->set_sdk_version(to_utf8(info.classinfo2().sdk_version()));
+        }
+    }
+}
+
 struct PluginScanner::Impl
 {
     Impl()
@@ -41,76 +165,145 @@ struct PluginScanner::Impl
     std::vector<String> path_to_scan_;
     LockFactory lf_;
     std::vector<schema::PluginDescription> pds_;
+    //! モジュールのパスをキーにした、スキャン済みのモジュールの情報
+    std::map<String, schema::PluginModuleInfo> modules_;
+    //! スキャンに失敗したモジュールのパスと、そのときのサイズと更新日時
+    std::map<String, ModuleStat> blacklist_;
+    UInt32 num_workers_ = 0;
     std::thread th_;
     std::atomic<bool> scanning_;
     std::atomic<bool> should_abort_;
     ListenerService<PluginScanner::Listener> listeners_;
+    
+    //! モジュールがブラックリストに含まれているかどうかを返す。
+    /*! 登録したときからサイズか更新日時が変わっている場合は、モジュールが更新されて問題が直っているかもしれないので、
+     *  ブラックリストから取り除いてfalseを返す。
+     */
+    bool IsBlacklisted(String const &path)
+    {
+        ModuleStat blacklisted_stat;
+        {
+            auto lock = lf_.make_lock();
+            auto found = blacklist_.find(path);
+            if(found == blacklist_.end()) { return false; }
+            blacklisted_stat = found->second;
+        }
+        
+        auto stat = GetModuleStat(path);
+        if(stat && *stat == blacklisted_stat) { return true; }
+        
+        hwm::wdout << L"Remove the changed plugin module from the blacklist: " << path << std::endl;
+        auto lock = lf_.make_lock();
+        blacklist_.erase(path);
+        return false;
+    }
+    
+    //! @param stat 登録するモジュールのサイズと更新日時。省略した場合は、現在のモジュールから取得する。
+    void AddToBlacklist(String const &path, std::optional<ModuleStat> stat = std::nullopt)
+    {
+        if(!stat) { stat = GetModuleStat(path); }
+        
+        auto lock = lf_.make_lock();
+        blacklist_[path] = stat.value_or(ModuleStat {});
+    }
+    
+    std::optional<schema::PluginModuleInfo> FindModuleInfo(String const &path) const
+    {
+        auto lock = lf_.make_lock();
+        auto found = modules_.find(path);
+        if(found == modules_.end()) { return std::nullopt; }
+        return found->second;
+    }
+    
+    void SetModuleInfo(schema::PluginModuleInfo const &info)
+    {
+        auto lock = lf_.make_lock();
+        modules_[to_wstr(info.filepath())] = info;
+    }
+    
+    //! 指定したモジュールのスキャン結果をすべて取り除く
+    void RemoveModule(String const &path)
+    {
+        auto lock = lf_.make_lock();
+        auto const utf8_path = to_utf8(path);
+        pds_.erase(std::remove_if(pds_.begin(), pds_.end(), [&utf8_path](auto const &desc) {
+            return desc.vst3info().filepath() == utf8_path;
+        }), pds_.end());
+        modules_.erase(path);
+    }
+    
+    //! ファイルが存在しなくなったモジュールのスキャン結果を取り除く
+    void RemoveMissingModules()
+    {
+        auto lock = lf_.make_lock();
+        std::vector<String> missing;
+        for(auto const &desc: pds_) {
+            auto const path = to_wstr(desc.vst3info().filepath());
+            if(ModuleExists(path) == false) { missing.push_back(path); }
+        }
+        for(auto const &entry: modules_) {
+            if(ModuleExists(entry.first) == false) { missing.push_back(entry.first); }
+        }
+        lock.unlock();
+        
+        for(auto const &path: missing) {
+            hwm::wdout << L"Remove the missing plugin module: " << path << std::endl;
+            RemoveModule(path);
+        }
+    }
+    
+    //! モジュールが前回のスキャン時から変更されているかどうかを返す。
+    /*! サイズと更新日時が一致すればハッシュ値の計算は行わない。
+     *  サイズか更新日時だけが変わっていてハッシュ値が一致する場合は、キャッシュの情報を更新してfalseを返す。
+     */
+    bool NeedToScan(String const &path)
+    {
+        auto info = FindModuleInfo(path);
+        if(!info) { return true; }
+        
+        auto stat = GetModuleStat(path);
+        if(!stat) { return true; }
+        
+        if(*stat == ModuleStat { info->size(), info->mtime() }) { return false; }
+        
+        auto hash = CalculateModuleHash(path);
+        if(!hash || *hash != info->content_hash()) { return true; }
+        
+        info->set_size(stat->size_);
+        info->set_mtime(stat->mtime_);
+        SetModuleInfo(*info);
+        return false;
+    }
+    
+    //! @return the number of added descriptions.
+    int AddDescriptions(schema::PluginDescriptionList const &list)
+    {
+        auto lock = lf_.make_lock();
+        int num_added = 0;
+        for(auto const &desc: list.list()) {
+            if(desc.has_vst3info() == false) { continue; }
+            auto maybe_cid = to_cid(desc.vst3info().cid());
+            if(!maybe_cid || Contains(pds_, *maybe_cid)) { continue; }
+            pds_.push_back(desc);
+            ++num_added;
+        }
+        return num_added;
+    }
 };
 
+//! スキャン対象のプラグインモジュールのパスを集める
 class PluginScanner::Traverser
 :   public wxDirTraverser
 {
 public:
-    Traverser(PluginScanner &owner)
-    :   owner_(owner)
+    Traverser(std::vector<String> &found)
+    :   found_(found)
     {}
     
-	void LoadFactory(wxString const &FileorDirName)
-	{
-        if(FileorDirName.Contains("EQuivocate")) {
-            return;
-        }
-        
-		auto factory_list = Vst3PluginFactoryList::GetInstance();
-		auto factory = factory_list->FindOrCreateFactory(FileorDirName.ToStdWstring());
-
-		if (!factory) {
-            return;
-		}
-
-		auto const num = factory->GetComponentCount();
-		for (int i = 0; i < num; ++i) {
-			auto info = factory->GetComponentInfo(i);
-
-			//! カテゴリがkVstAudioEffectClassでないComponentは、オーディオプラグインではないので無視する。
-			if (info.category() != hwm::to_wstr(kVstAudioEffectClass)) {
-				continue;
-			}
-
-			auto lock = owner_.pimpl_->lf_.make_lock();
-			auto &pds = owner_.pimpl_->pds_;
-
-			if (Contains(pds, info.cid())) { continue; }
-
-			schema::PluginDescription desc;
-			desc.set_name(to_utf8(info.name()));
-			auto vi = desc.mutable_vst3info();
-			vi->set_filepath(FileorDirName.ToUTF8());
-			std::string const cid(info.cid().begin(), info.cid().end());
-			vi->set_cid(cid);
-			vi->set_category(to_utf8(info.category()));
-			vi->set_cardinality(info.cardinality());
-
-			if (info.has_classinfo2()) {
-				auto ci2 = vi->mutable_classinfo2();
-				ci2->set_subcategories(to_utf8(info.classinfo2().sub_categories()));
-				ci2->set_vendor(to_utf8(info.classinfo2().vendor()));
-				ci2->set_version(to_utf8(info.classinfo2().version()));
-				ci2->set_sdk_version(to_utf8(info.classinfo2().sdk_version()));
-			}
-
-			pds.push_back(desc);
-
-			owner_.pimpl_->listeners_.Invoke([this](auto *li) {
-				li->OnScanningProgressUpdated(&owner_);
-			});
-		}
-	}
-
     wxDirTraverseResult OnFile(wxString const &filename) override
     {
 #if SMTG_OS_MACOS == 0
-        if(filename.EndsWith(L"vst3")) { LoadFactory(filename); }
+        if(filename.EndsWith(L"vst3")) { found_.push_back(filename.ToStdWstring()); }
 #endif
         return wxDIR_CONTINUE;
     }
@@ -118,13 +311,17 @@ public:
     wxDirTraverseResult OnDir(wxString const &dirname) override
     {
 #if SMTG_OS_MACOS
-        if(dirname.EndsWith(L"vst3")) { LoadFactory(dirname); }
+        if(dirname.EndsWith(L"vst3")) {
+            found_.push_back(dirname.ToStdWstring());
+            // バンドルの中は探索しない
+            return wxDIR_IGNORE;
+        }
 #endif
         return wxDIR_CONTINUE;
     }
     
 private:
-    PluginScanner &owner_;
+    std::vector<String> &found_;
 };
 
 PluginScanner::PluginScanner()
@@ -172,6 +369,36 @@ void PluginScanner::ClearPluginDescriptions()
 {
     auto lock = pimpl_->lf_.make_lock();
     pimpl_->pds_.clear();
+    pimpl_->modules_.clear();
+}
+
+std::vector<String> PluginScanner::GetBlacklist() const
+{
+    auto lock = pimpl_->lf_.make_lock();
+    std::vector<String> list;
+    for(auto const &entry: pimpl_->blacklist_) {
+        list.push_back(entry.first);
+    }
+    return list;
+}
+
+void PluginScanner::ClearBlacklist()
+{
+    auto lock = pimpl_->lf_.make_lock();
+    pimpl_->blacklist_.clear();
+}
+
+void PluginScanner::SetNumWorkers(UInt32 num)
+{
+    auto lock = pimpl_->lf_.make_lock();
+    pimpl_->num_workers_ = num;
+}
+
+UInt32 PluginScanner::GetNumWorkers() const
+{
+    auto lock = pimpl_->lf_.make_lock();
+    if(pimpl_->num_workers_ > 0) { return pimpl_->num_workers_; }
+    return std::max<UInt32>(1, std::thread::hardware_concurrency());
 }
 
 std::string PluginScanner::Export()
@@ -185,6 +412,19 @@ std::string PluginScanner::Export()
         dest->CopyFrom(pd);
     }
     
+    auto lock = pimpl_->lf_.make_lock();
+    for(auto const &entry: pimpl_->blacklist_) {
+        auto info = list.add_blacklisted_modules();
+        info->set_filepath(to_utf8(entry.first));
+        info->set_size(entry.second.size_);
+        info->set_mtime(entry.second.mtime_);
+    }
+    
+    for(auto const &entry: pimpl_->modules_) {
+        list.add_modules()->CopyFrom(entry.second);
+    }
+    lock.unlock();
+    
     return list.SerializeAsString();
 }
 
@@ -192,24 +432,38 @@ void PluginScanner::Import(std::string const &str)
 {
     schema::PluginDescriptionList pd_list;
     pd_list.ParseFromString(str);
-
-    std::vector<schema::PluginDescription> new_list;
-    for(auto &x: pd_list.list()) {
-        schema::PluginDescription desc;
-        desc.CopyFrom(x);
-        new_list.push_back(desc);
+    
+    pimpl_->AddDescriptions(pd_list);
+    
+    // 以前のバージョンのブラックリストには、サイズと更新日時が記録されていないので、現在の状態で登録し直す。
+    for(auto const &path: pd_list.blacklist()) {
+        pimpl_->AddToBlacklist(to_wstr(path));
     }
     
-    auto lock = pimpl_->lf_.make_lock();
+    for(auto const &info: pd_list.blacklisted_modules()) {
+        pimpl_->AddToBlacklist(to_wstr(info.filepath()), ModuleStat { info.size(), info.mtime() });
+    }
     
-    auto &pds = pimpl_->pds_;
+    for(auto const &info: pd_list.modules()) {
+        pimpl_->SetModuleInfo(info);
+    }
+}
+
+bool PluginScanner::ScanModuleAndExport(String const &module_path, String const &output_path)
+{
+    schema::PluginDescriptionList list;
     
-    for(auto &x: pd_list.list()) {
-        if(x.has_vst3info() == false) { continue; }
-        auto maybe_cid = to_cid(x.vst3info().cid());
-        if(!maybe_cid || Contains(pds, *maybe_cid)) { continue; }
-        pds.push_back(x);
+    try {
+        LoadModuleDescriptions(module_path, list);
+    } catch(std::exception &e) {
+        hwm::dout << "Failed to load the plugin module: " << e.what() << std::endl;
+        return false;
     }
+    
+    auto ofs = open_ofstream(output_path, std::ios::out|std::ios::binary);
+    if(!ofs) { return false; }
+    
+    return list.SerializeToOstream(&ofs);
 }
 
 PluginScanner::IListenerService & PluginScanner::GetListeners()
@@ -234,7 +488,8 @@ void PluginScanner::ScanAsync()
         
         auto path_to_scan = GetDirectories();
         
-        Traverser tr(*this);
+        std::vector<String> modules;
+        Traverser tr(modules);
         for(auto path: path_to_scan) {
             if(pimpl_->should_abort_.load()) {
                 break;
@@ -251,6 +506,93 @@ void PluginScanner::ScanAsync()
             }
         }
         
+        pimpl_->RemoveMissingModules();
+        
+        // 前回のスキャン時から変更されていないモジュールはスキャンしない
+        modules.erase(std::remove_if(modules.begin(), modules.end(), [this](auto const &m) {
+            return pimpl_->IsBlacklisted(m) || pimpl_->NeedToScan(m) == false;
+        }), modules.end());
+        
+        auto const exe_path = wxStandardPaths::Get().GetExecutablePath().ToStdWstring();
+        std::atomic<size_t> next_index { 0 };
+        
+        auto scan_modules = [&, this] {
+            for( ; ; ) {
+                if(pimpl_->should_abort_.load()) { return; }
+                
+                auto const index = next_index.fetch_add(1);
+                if(index >= modules.size()) { return; }
+                
+                auto const &module_path = modules[index];
+                auto const output_path = wxFileName::CreateTempFileName("TerraPluginScan").ToStdWstring();
+                HWM_SCOPE_EXIT([&output_path] {
+                    if(output_path.empty() == false) { wxRemoveFile(output_path); }
+                });
+                
+                if(output_path.empty()) {
+                    hwm::wdout << L"Failed to create a temporary file to scan: " << module_path << std::endl;
+                    continue;
+                }
+                
+                auto const result = RunChildProcess(exe_path,
+                                                    { L"--scan-plugin", module_path, L"--scan-output", output_path },
+                                                    kScanTimeout,
+                                                    &pimpl_->should_abort_);
+                
+                using Status = ChildProcessResult::Status;
+                if(result.status_ == Status::kAborted) {
+                    return;
+                } else if(result.status_ == Status::kFailedToLaunch) {
+                    hwm::wdout << L"Failed to launch the plugin scanning process: " << module_path << std::endl;
+                    continue;
+                } else if(result.IsSucceeded() == false) {
+                    hwm::wdout
+                    << L"Plugin scanning {} (exit code: {}). Add to the blacklist: {}"_format(
+                        (result.status_ == Status::kTimedOut ? L"timed out" : L"failed"),
+                        result.exit_code_,
+                        module_path)
+                    << std::endl;
+                    pimpl_->AddToBlacklist(module_path);
+                    continue;
+                }
+                
+                schema::PluginDescriptionList list;
+                auto ifs = open_ifstream(output_path, std::ios::in|std::ios::binary);
+                if(!ifs || list.ParseFromIstream(&ifs) == false) {
+                    hwm::wdout << L"Failed to read the plugin scanning result: " << module_path << std::endl;
+                    continue;
+                }
+                
+                // 変更されたモジュールの古いスキャン結果を置き換える
+                pimpl_->RemoveModule(module_path);
+                
+                auto stat = GetModuleStat(module_path);
+                auto hash = CalculateModuleHash(module_path);
+                if(stat && hash) {
+                    schema::PluginModuleInfo info;
+                    info.set_filepath(to_utf8(module_path));
+                    info.set_size(stat->size_);
+                    info.set_mtime(stat->mtime_);
+                    info.set_content_hash(*hash);
+                    pimpl_->SetModuleInfo(info);
+                }
+                
+                if(pimpl_->AddDescriptions(list) > 0) {
+                    pimpl_->listeners_.Invoke([this](auto *li) {
+                        li->OnScanningProgressUpdated(this);
+                    });
+                }
+            }
+        };
+        
+        auto const num_workers = std::min<size_t>(GetNumWorkers(), modules.size());
+        std::vector<std::thread> workers;
+        for(size_t i = 0; i < num_workers; ++i) {
+            workers.emplace_back(scan_modules);
+        }
+        
+        for(auto &w: workers) { w.join(); }
+        
         pimpl_->scanning_ = false;
 
         pimpl_->listeners_.Invoke([this](auto *li) {
@@ -24,9 +24,28 @@ struct PluginScanner
     std::vector<schema::PluginDescription> GetPluginDescriptions() const;
     void ClearPluginDescriptions();
 
+    //! スキャンに失敗した（クラッシュまたはタイムアウトした）プラグインのパスのリスト
+    /*! ここに含まれるプラグインは、ClearBlacklist()を呼び出すか、
+     *  モジュールのサイズか更新日時が変わるまで、スキャン対象から外される。
+     */
+    std::vector<String> GetBlacklist() const;
+    void ClearBlacklist();
+    
+    //! スキャンに使用する子プロセスの最大数を設定する。0を指定するとハードウェアのスレッド数を使用する。
+    void SetNumWorkers(UInt32 num);
+    UInt32 GetNumWorkers() const;
+
     std::string Export();
     void Import(std::string const &str);
     
+    //! 指定したプラグインモジュールを現在のプロセス内でロードして、
+    //! プラグインの情報をPluginDescriptionListとしてoutput_pathに書き出す。
+    /*! ScanAsync()が起動するスキャン用の子プロセスから呼び出される。
+     *  @return 書き出しに成功した場合はtrue
+     */
+    static
+    bool ScanModuleAndExport(String const &module_path, String const &output_path);
+    
     struct Listener : public IListenerBase
     {
     protected:
@@ -46,6 +65,12 @@ struct PluginScanner
 
     IListenerService & GetListeners();
     
+    //! プラグインのスキャンを開始する。
+    /*! プラグインモジュールは、このアプリケーション自身を
+     *  `--scan-plugin <module> --scan-output <file>` オプション付きで起動した子プロセスの中でロードされる。
+     *  そのため、スキャン中にプラグインがクラッシュしたりハングアップしても、このプロセスには影響しない。
+     *  子プロセスは最大GetNumWorkers()個まで並列に起動される。
+     */
     void ScanAsync();
     void Wait();
     void Abort();
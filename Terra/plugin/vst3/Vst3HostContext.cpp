@@ -60,6 +60,9 @@ tresult PLUGIN_API Vst3Plugin::HostContext::createInstance(TUID cid, TUID iid, v
 tresult PLUGIN_API Vst3Plugin::HostContext::beginEdit (Vst::ParamID id)
 {
     hwm::dout << "Begin edit   [{}]"_format(id) << std::endl;
+    if(plugin_) {
+        plugin_->BeginEdit();
+    }
     return kResultOk;
 }
 
@@ -73,6 +76,9 @@ tresult PLUGIN_API Vst3Plugin::HostContext::performEdit (Vst::ParamID id, Vst::P
 tresult PLUGIN_API Vst3Plugin::HostContext::endEdit (Vst::ParamID id)
 {
     hwm::dout << "End edit     [{}]"_format(id) << std::endl;
+    if(plugin_) {
+        plugin_->EndEdit();
+    }
     return kResultOk;
 }
 
@@ -113,6 +119,9 @@ tresult PLUGIN_API Vst3Plugin::HostContext::restartComponent (int32 flags)
 tresult PLUGIN_API Vst3Plugin::HostContext::setDirty (TBool state)
 {
     hwm::dout << "Plugin has dirty [{}]"_format(state != 0) << std::endl;
+    if(state && plugin_) {
+        plugin_->NotifyStateChanged();
+    }
     return kResultOk;
 }
 
@@ -247,9 +247,45 @@ void Vst3Plugin::SetProgramIndex(UInt32 index, UnitID id)
 	pimpl_->SetProgramIndex(index, id);
 }
 
-void Vst3Plugin::EnqueueParameterChange(Vst::ParamID id, Vst::ParamValue value)
+void Vst3Plugin::EnqueueParameterChange(Vst::ParamID id, Vst::ParamValue value, SampleCount offset)
 {
-	pimpl_->PushBackParameterChange(id, value);
+    pimpl_->NotifyStateChanged();
+	pimpl_->PushBackParameterChange(id, value, offset);
+}
+
+void Vst3Plugin::EnqueueAutomatedParameterChange(Vst::ParamID id, Vst::ParamValue value, SampleCount offset)
+{
+	pimpl_->PushBackParameterChange(id, value, offset);
+}
+
+UInt64 Vst3Plugin::TakeNumDroppedParameterChanges()
+{
+    return pimpl_->TakeNumDroppedParameterChanges();
+}
+
+void Vst3Plugin::NotifyStateChanged()
+{
+    pimpl_->NotifyStateChanged();
+}
+
+UInt64 Vst3Plugin::GetStateVersion() const
+{
+    return pimpl_->GetStateVersion();
+}
+
+void Vst3Plugin::BeginEdit()
+{
+    pimpl_->BeginEdit();
+}
+
+void Vst3Plugin::EndEdit()
+{
+    pimpl_->EndEdit();
+}
+
+bool Vst3Plugin::IsEditing() const
+{
+    return pimpl_->IsEditing();
 }
 
 void Vst3Plugin::RestartComponent(Steinberg::int32 flags)
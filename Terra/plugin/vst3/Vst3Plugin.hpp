@@ -261,9 +261,41 @@ public:
 
 	//! パラメータの変更を次回の再生フレームでAudioProcessorに送信して適用するために、
 	//! 変更する情報をキューに貯める
-	void	EnqueueParameterChange(Steinberg::Vst::ParamID id, Steinberg::Vst::ParamValue value);
+    /*! ユーザーの操作やエディットコントローラーからの変更に使用する。プラグインの状態が変化したものとして扱う。
+     *  @param offset 次回の再生フレームの先頭からのサンプル位置
+     */
+	void	EnqueueParameterChange(Steinberg::Vst::ParamID id, Steinberg::Vst::ParamValue value, SampleCount offset = 0);
+    
+    //! オートメーションのように、ホストが再生中に送るパラメータの変更をキューに貯める。
+    /*! プラグインの状態が変化したものとして扱わない。
+     *  （毎フレーム送られるので、状態のダンプのキャッシュが使われなくなってしまうため）
+     */
+    void    EnqueueAutomatedParameterChange(Steinberg::Vst::ParamID id, Steinberg::Vst::ParamValue value, SampleCount offset = 0);
 
 	void	RestartComponent(Steinberg::int32 flag);
+    
+    //! キューが満杯で破棄したパラメータの変更の数を返して、0に戻す。
+    /*! オーディオスレッド以外から呼び出して、ログの出力などに使用する。
+     */
+    UInt64  TakeNumDroppedParameterChanges();
+    
+    //! プラグインの状態が変化した可能性があることを記録する。
+    void    NotifyStateChanged();
+    //! プラグインの状態が変化するたびに増加する値を返す。
+    /*! 前回SaveData()を呼び出したときと値が変わっていなければ、状態は変化していないとみなせる。
+     *  GUIやエディットコントローラー、MIDIのコントロールチェンジの割り当て、
+     *  プラグイン自身の処理（outputParameterChanges）によるパラメータの変更で増加する。
+     *  EnqueueAutomatedParameterChange() による変更では増加しない。
+     *  ただし、エディタを開いている間は、プラグインがホストに通知せずに状態を変更することがあるので、
+     *  この値を信用してはいけない。
+     */
+    UInt64  GetStateVersion() const;
+    
+    //! エディタでのパラメータの操作の開始と終了を記録する。（IComponentHandlerのbeginEdit()とendEdit()）
+    void    BeginEdit();
+    void    EndEdit();
+    //! エディタでパラメータを操作している途中かどうか
+    bool    IsEditing() const;
 
 	void Process(ProcessInfo &pi);
     
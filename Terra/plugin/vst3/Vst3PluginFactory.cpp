@@ -5,6 +5,7 @@
 #include <stdexcept>
 #include <vector>
 #include <map>
+#include <future>
 
 #include <pluginterfaces/base/ftypes.h>
 #include <public.sdk/source/vst/hosting/module.h>
@@ -135,16 +136,19 @@ public:
 	}
     
     void OnVst3PluginIsCreated(Vst3Plugin const *p) {
+        auto lock = lf_loaded_plugins_.make_lock();
         loaded_plugins_.push_back(p);
     }
         
     void OnVst3PluginIsDestructed(Vst3Plugin const *p) {
+        auto lock = lf_loaded_plugins_.make_lock();
         auto found = std::find(loaded_plugins_.begin(), loaded_plugins_.end(), p);
         assert(found != loaded_plugins_.end());
         loaded_plugins_.erase(found);
     }
     
     UInt32 GetNumLoadedPlugins() const {
+        auto lock = lf_loaded_plugins_.make_lock();
         return loaded_plugins_.size();
     }
 
@@ -158,6 +162,8 @@ private:
 	factory_ptr				factory_;
 	FactoryInfo				factory_info_;
 	std::vector<ClassInfo>	class_info_list_;
+    //! プラグインは複数のスレッドから並列に生成・破棄されることがある
+    LockFactory lf_loaded_plugins_;
     std::vector<Vst3Plugin const *> loaded_plugins_;
 };
 
@@ -341,8 +347,11 @@ UInt32 Vst3PluginFactory::GetNumLoadedPlugins() const {
 class Vst3PluginFactoryList::Impl
 {
 public:
+    using FactoryPtr = std::shared_ptr<Vst3PluginFactory>;
     LockFactory lf_;
-    std::map<String, std::shared_ptr<Vst3PluginFactory>> table_;
+    std::map<String, FactoryPtr> table_;
+    //! 他のスレッドでロード中のモジュール
+    std::map<String, std::shared_future<FactoryPtr>> loading_;
 };
 
 Vst3PluginFactoryList::Vst3PluginFactoryList()
@@ -357,24 +366,45 @@ std::shared_ptr<Vst3PluginFactory> Vst3PluginFactoryList::FindOrCreateFactory(St
     auto lock = pimpl_->lf_.make_lock();
     
     auto found = pimpl_->table_.find(module_path);
-    if(found == pimpl_->table_.end()) {
-        std::shared_ptr<Vst3PluginFactory> factory;
-        try {
-            factory = std::make_shared<Vst3PluginFactory>(module_path);
-        } catch(std::exception &e) {
-            hwm::dout << "Failed to create Vst3PluginFactory: " << e.what() << std::endl;
-            return {};
-        }
-        
-        found = pimpl_->table_.emplace(module_path, factory).first;
+    if(found != pimpl_->table_.end()) {
+        return found->second;
+    }
+    
+    // 同じモジュールを別のスレッドがロード中の場合は、その完了を待つ。
+    auto loading = pimpl_->loading_.find(module_path);
+    if(loading != pimpl_->loading_.end()) {
+        auto future = loading->second;
+        lock.unlock();
+        return future.get();
+    }
+    
+    // モジュールのロードには時間がかかることがあるので、
+    // 異なるモジュールは複数のスレッドから並列にロードできるように、ロックを外してロードする。
+    std::promise<Impl::FactoryPtr> promise;
+    pimpl_->loading_.emplace(module_path, promise.get_future().share());
+    lock.unlock();
+    
+    std::shared_ptr<Vst3PluginFactory> factory;
+    try {
+        factory = std::make_shared<Vst3PluginFactory>(module_path);
+    } catch(std::exception &e) {
+        hwm::dout << "Failed to create Vst3PluginFactory: " << e.what() << std::endl;
     }
     
-    return found->second;
+    lock.lock();
+    if(factory) {
+        pimpl_->table_.emplace(module_path, factory);
+    }
+    pimpl_->loading_.erase(module_path);
+    lock.unlock();
+    
+    promise.set_value(factory);
+    return factory;
 }
 
 void Vst3PluginFactoryList::Shrink()
 {
-    std::map<String, std::shared_ptr<Vst3PluginFactory>> tmp;
+    auto lock = pimpl_->lf_.make_lock();
     
     for(auto it = pimpl_->table_.begin(), end = pimpl_->table_.end();
         it != end;
@@ -433,6 +433,7 @@ void Vst3Plugin::Impl::SetParameterValueByIndex(UInt32 index, Vst::ParamValue va
 
 void Vst3Plugin::Impl::SetParameterValueByID(Vst::ParamID id, Vst::ParamValue value)
 {
+    NotifyStateChanged();
     edit_controller_->setParamNormalized(id, value);
 }
 
@@ -520,6 +521,7 @@ void Vst3Plugin::Impl::SetProgramIndex(UInt32 index, Vst::UnitID unit_id)
     
     auto const normalized_value = index / (double)param_info->step_count_;
     
+    NotifyStateChanged();
     GetEditController()->setParamNormalized(unit_info.program_change_param_, normalized_value);
     PushBackParameterChange(unit_info.program_change_param_, normalized_value);
 }
@@ -574,6 +576,8 @@ void Vst3Plugin::Impl::CloseEditor()
 	if(is_editor_opened_) {
 		plug_view_->removed();
 		is_editor_opened_ = false;
+        // エディタを開いている間に、通知なしで状態が変更されているかもしれない。
+        NotifyStateChanged();
 	}
 }
 
@@ -629,10 +633,14 @@ void Vst3Plugin::Impl::Resume()
 
     status_ = Status::kSetupDone;
     
-    auto prepare_bus_buffers = [&](AudioBusesInfo &buses, UInt32 block_size, Buffer<float> &buffer) {
+    auto prepare_bus_buffers = [&](AudioBusesInfo &buses, UInt32 block_size,
+                                   Buffer<float> &buffer, std::vector<float *> &channel_ptrs)
+    {
         buffer.resize(buses.GetNumChannels(), block_size);
+        channel_ptrs.assign(buffer.data(), buffer.data() + buffer.channels());
         
-        auto data = buffer.data();
+        // 各チャンネルが指すバッファは、Process()でフレームごとに差し替える。
+        auto data = channel_ptrs.data();
         auto *bus_buffers = buses.GetBusBuffers();
         for(int i = 0; i < buses.GetNumBuses(); ++i) {
             auto &buffer = bus_buffers[i];
@@ -647,8 +655,8 @@ void Vst3Plugin::Impl::Resume()
         }
     };
     
-    prepare_bus_buffers(input_audio_buses_info_, block_size_, input_buffer_);
-    prepare_bus_buffers(output_audio_buses_info_, block_size_, output_buffer_);
+    prepare_bus_buffers(input_audio_buses_info_, block_size_, input_buffer_, input_channel_ptrs_);
+    prepare_bus_buffers(output_audio_buses_info_, block_size_, output_buffer_, output_channel_ptrs_);
 
 	res = GetComponent()->setActive(true);
 	if(res != kResultOk && res != kNotImplemented) {
@@ -659,31 +667,28 @@ void Vst3Plugin::Impl::Resume()
 		
 	hwm::dout << "Latency samples : " << GetAudioProcessor()->getLatencySamples() << std::endl;
 
-	auto lock = lf_processing_.make_lock(std::try_to_lock);
-    
 	res = GetAudioProcessor()->setProcessing(true);
     ThrowIfNotFound(res, { kResultOk, kNotImplemented });
 
     status_ = Status::kProcessing;
+    // ここで初めてオーディオスレッドのProcess()が有効になる。
+    process_enabled_ = true;
 }
 
 void Vst3Plugin::Impl::Suspend()
 {
     if(IsResumed() == false) { return; }
     
-    for( ; ; ) {
-        auto lock = lf_processing_.make_lock(std::try_to_lock);
-        if(!lock) {
-            std::this_thread::yield();
-            continue;
-        }
-        
-        if(status_ == Status::kProcessing) {
-            GetAudioProcessor()->setProcessing(false);
-            status_ = Status::kActivated;
-        }
-        
-        break;
+    // オーディオスレッドにProcess()の停止を要求し、実行中のProcess()が抜けるのを待つ。
+    // オーディオスレッド側は待機しないので、Suspend()の呼び出しによってオーディオ処理が止まることはない。
+    process_enabled_ = false;
+    while(is_in_process_.load()) {
+        std::this_thread::yield();
+    }
+    
+    if(status_ == Status::kProcessing) {
+        GetAudioProcessor()->setProcessing(false);
+        status_ = Status::kActivated;
     }
 
 	GetComponent()->setActive(false);
@@ -707,6 +712,8 @@ void Vst3Plugin::Impl::SetSamplingRate(int sampling_rate)
 
 void Vst3Plugin::Impl::RestartComponent(Steinberg::int32 flags)
 {
+    NotifyStateChanged();
+    
 	//! `Controller`側のパラメータが変更された
 	if((flags & Vst::RestartFlags::kParamValuesChanged)) {
         hwm::dout << "Param values changed" << std::endl;
@@ -835,6 +842,8 @@ void Vst3Plugin::Impl::InputEvents(ProcessInfo::IEventBufferList const *buffers,
                 Vst::ParamID param_id = 0;
                 auto result = midi_mapping_->getMidiControllerAssignment(0, channel, cc, param_id);
                 if(result == kResultOk) {
+                    // MIDIで変更されたパラメータは、保存する状態に含まれる。
+                    NotifyStateChanged();
                     PushBackParameterChange(param_id, value, offset);
                 }
             };
@@ -880,9 +889,13 @@ void Vst3Plugin::Impl::OutputEvents(ProcessInfo::IEventBufferList *buffers,
 
 void Vst3Plugin::Impl::Process(ProcessInfo pi)
 {
-    auto lock = lf_processing_.make_lock();
+    // Suspend()との同期にロックを使わず、is_in_process_とprocess_enabled_で処理中であることを通知しあう。
+    // （どちらもseq_cstなので、Suspend()がis_in_process_をfalseと読んだ場合は、
+    //  こちらでは必ずprocess_enabled_をfalseと読む）
+    is_in_process_ = true;
+    HWM_SCOPE_EXIT([this] { is_in_process_ = false; });
     
-    if(status_ != Status::kProcessing) { return; }
+    if(process_enabled_.load() == false) { return; }
     
     assert(pi.time_info_);
     auto &ti = *pi.time_info_;
@@ -908,30 +921,38 @@ void Vst3Plugin::Impl::Process(ProcessInfo pi)
     output_events_.clear();
     input_params_.clearQueue();
     output_params_.clearQueue();
-    input_buffer_.fill();
-    output_buffer_.fill();
     
     InputEvents(pi.input_event_buffers_, process_context);
-	
-    auto copy_buffer = [&](BufferRef<const float> src, BufferRef<float> dest,
-                           SampleCount length_to_copy)
+    
+    // プラグインのバスのチャンネルを、グラフ側のバッファに直接割り当てて、コピーを省く。
+    // グラフ側に対応するチャンネルがない場合だけ、このクラスのバッファを使用する。
     {
-        size_t const min_ch = std::min(src.channels(), dest.channels());
-        if(min_ch == 0) { return; }
-
-        assert(src.samples() >= length_to_copy);
-        assert(dest.samples() >= length_to_copy);
+        auto &src = pi.input_audio_buffer_;
+        assert(src.channels() == 0 || src.samples() >= sample_length);
         
-        for(size_t ch = 0; ch < min_ch; ++ch) {
-            std::copy_n(src.get_channel_data(ch),
-                        length_to_copy,
-                        dest.get_channel_data(ch));
+        for(UInt32 ch = 0, end = input_channel_ptrs_.size(); ch < end; ++ch) {
+            if(ch < src.channels()) {
+                // VST3のAPIがconstなバッファを受け付けないのでconst_castしている。
+                // 入力バッファはノードが所有していて、このフレームの処理後に破棄されるので、
+                // プラグインが書き換えても問題はない。
+                input_channel_ptrs_[ch] = const_cast<float *>(src.get_channel_data(ch));
+            } else {
+                input_channel_ptrs_[ch] = input_buffer_.data()[ch];
+                std::fill_n(input_channel_ptrs_[ch], sample_length, 0.0f);
+            }
         }
-    };
-    
-    copy_buffer(pi.input_audio_buffer_, input_buffer_,
-                sample_length
-                );
+        
+        auto &dest = pi.output_audio_buffer_;
+        assert(dest.channels() == 0 || dest.samples() >= sample_length);
+        
+        for(UInt32 ch = 0, end = output_channel_ptrs_.size(); ch < end; ++ch) {
+            if(ch < dest.channels()) {
+                output_channel_ptrs_[ch] = dest.get_channel_data(ch);
+            } else {
+                output_channel_ptrs_[ch] = output_buffer_.data()[ch];
+            }
+        }
+    }
 
 	PopFrontParameterChanges(input_params_);
 
@@ -949,6 +970,9 @@ void Vst3Plugin::Impl::Process(ProcessInfo pi)
 	process_data.inputParameterChanges = &input_params_;
 	process_data.outputParameterChanges = &output_params_;
 
+    ResetOutputSilenceFlags(process_data.outputs, process_data.numOutputs,
+                            [this](int i) { return output_audio_buses_info_.IsActive(i); });
+    
 	auto const res = GetAudioProcessor()->process(process_data);
     
     OutputEvents(pi.output_event_buffers_, process_context);
@@ -959,9 +983,20 @@ void Vst3Plugin::Impl::Process(ProcessInfo pi)
         hwm::dout << "process failed: {}"_format(tresult_to_string(res)) << std::endl;
     }
     
-    copy_buffer(output_buffer_, pi.output_audio_buffer_,
-                sample_length
-                );
+    ClearSilentChannels(process_data.outputs, process_data.numOutputs, sample_length);
+
+    // プラグインがオーディオ処理の中で変更したパラメータも、保存する状態に含まれる。
+    // （メーターなどの読み取り専用のパラメータは、状態を変更しないものとして扱う）
+    for(int i = 0; i < output_params_.getParameterCount(); ++i) {
+        auto *queue = output_params_.getParameterData(i);
+        if(!queue || queue->getPointCount() == 0) { continue; }
+        
+        auto const index = parameter_info_list_.GetIndexByID(queue->getParameterId());
+        if(index == -1 || parameter_info_list_.GetItemByIndex(index).is_readonly_ == false) {
+            NotifyStateChanged();
+            break;
+        }
+    }
 
 	for(int i = 0; i < output_params_.getParameterCount(); ++i) {
 		auto *queue = output_params_.getParameterData(i);
@@ -973,42 +1008,31 @@ void Vst3Plugin::Impl::Process(ProcessInfo pi)
 
 void Vst3Plugin::Impl::PushBackParameterChange(Vst::ParamID id, Vst::ParamValue value, SampleCount offset)
 {
-	auto lock = lf_parameter_queue_.make_lock();
+    ParameterChange change;
+    change.id_ = id;
+    change.value_ = value;
+    change.offset_ = offset;
     
-	Steinberg::int32 parameter_index = 0;
-	auto *queue = param_changes_queue_.addParameterData(id, parameter_index);
-	Steinberg::int32 ref_point_index = 0;
-	queue->addPoint(offset, value, ref_point_index);
-    (void)ref_point_index; // currently unused.
+    if(param_changes_queue_.TryPush(change) == false) {
+        num_dropped_param_changes_.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 void Vst3Plugin::Impl::PopFrontParameterChanges(Vst::ParameterChanges &dest)
 {
-    auto lock = lf_parameter_queue_.make_lock();
-
-	for(size_t i = 0; i < param_changes_queue_.getParameterCount(); ++i) {
-		auto *src_queue = param_changes_queue_.getParameterData(i);
-        auto const src_id = src_queue->getParameterId();
+    // destのキューはInitialize()で確保済みなので、ここで新たにメモリが確保されることは基本的にない。
+    ParameterChange change;
+    while(param_changes_queue_.TryPop(change)) {
+        if(change.id_ == Vst::kNoParamId) { continue; }
         
-        if(src_id == Vst::kNoParamId || src_queue->getPointCount() == 0) {
-            continue;
-        }
-
-		Steinberg::int32 ref_queue_index;
-		auto dest_queue = dest.addParameterData(src_queue->getParameterId(), ref_queue_index);
-
-		for(size_t v = 0; v < src_queue->getPointCount(); ++v) {
-			Steinberg::int32 ref_offset;
-			Vst::ParamValue ref_value;
-			tresult result = src_queue->getPoint(v, ref_offset, ref_value);
-            if(result != kResultTrue) { continue; }
-            
-			Steinberg::int32 ref_point_index;
-			dest_queue->addPoint(ref_offset, ref_value, ref_point_index);
-		}
-	}
-
-	param_changes_queue_.clearQueue();
+        Steinberg::int32 ref_queue_index;
+        auto dest_queue = dest.addParameterData(change.id_, ref_queue_index);
+        if(!dest_queue) { continue; }
+        
+        // ParameterValueQueue::addPoint()はオフセット順に挿入する。
+        Steinberg::int32 ref_point_index;
+        dest_queue->addPoint(change.offset_, change.value_, ref_point_index);
+    }
 }
 
 void Vst3Plugin::Impl::LoadInterfaces(IPluginFactory *factory, ClassInfo const &info, FUnknown *host_context)
@@ -1395,6 +1419,8 @@ std::optional<Vst3Plugin::DumpData> Vst3Plugin::Impl::SaveData() const
 
 void Vst3Plugin::Impl::LoadData(DumpData const &dump)
 {
+    NotifyStateChanged();
+    
     //! Melodyne crashes if a non-owned version of MemoryStream is used.
     MemoryStream stream;
     stream.write((void *)dump.processor_data_.data(), dump.processor_data_.size(), nullptr);
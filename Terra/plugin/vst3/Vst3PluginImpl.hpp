@@ -26,7 +26,7 @@
 
 #include "../../misc/Flag.hpp"
 #include "../../misc/Buffer.hpp"
-#include "../../misc/LockFactory.hpp"
+#include "../../misc/MpscQueue.hpp"
 
 NS_HWM_BEGIN
 
@@ -197,6 +197,18 @@ public:
 	void SetSamplingRate(int sampling_rate);
 
 	void	RestartComponent(Steinberg::int32 flags);
+    
+    void NotifyStateChanged() { state_version_.fetch_add(1); }
+    UInt64 GetStateVersion() const { return state_version_.load(); }
+    
+    void BeginEdit() { num_edits_in_progress_.fetch_add(1); }
+    void EndEdit()
+    {
+        // beginEdit()とendEdit()の呼び出しが対応していないプラグインがあるので、負にならないようにする。
+        auto n = num_edits_in_progress_.load();
+        while(n > 0 && num_edits_in_progress_.compare_exchange_weak(n, n - 1) == false) {}
+    }
+    bool IsEditing() const { return num_edits_in_progress_.load() > 0; }
 
 	void    Process(ProcessInfo pi);
     
@@ -205,11 +217,17 @@ public:
 
 //! Parameter Change
 public:
-	//! PopFrontParameterChangesとの呼び出しはスレッドセーフ
+	//! 複数のスレッドから同時に呼び出せる。PopFrontParameterChangesとの呼び出しもスレッドセーフ
+    /*! ロックを取らないので、GUIスレッドからの呼び出しがオーディオスレッドをブロックすることはない。
+     *  キューが満杯の場合は、変更を破棄する。
+     */
 	void PushBackParameterChange(Vst::ParamID id, Vst::ParamValue value, SampleCount offset = 0);
     
+    //! キューが満杯で破棄したパラメータの変更の数を返して、0に戻す。
+    UInt64 TakeNumDroppedParameterChanges() { return num_dropped_param_changes_.exchange(0); }
+    
 private:
-    //! PushBackParameterChangeとの呼び出しはスレッドセーフ
+    //! オーディオスレッドから呼び出す。PushBackParameterChangeとの呼び出しはスレッドセーフ
     void PopFrontParameterChanges(Vst::ParameterChanges &dest);
     
     void InputEvents(ProcessInfo::IEventBufferList const *buffers,
@@ -263,17 +281,36 @@ private:
     MidiBusesInfo input_midi_buses_info_;
     MidiBusesInfo output_midi_buses_info_;
     
-    // Vst3Plugin側にバッファを持たせないで、外側にあるバッファを使い回すほうが、コピーの手間が減っていいが、
-    // ちょっと設計がややこしくなるので、いまはここにバッファを持たせるようにしておく。
+    // 各バスのchannelBuffers32が指す、チャンネルごとのバッファのアドレスの配列。
+    // Process()では、可能な限りグラフ側のバッファを直接指すようにする。
+    std::vector<float *> input_channel_ptrs_;
+    std::vector<float *> output_channel_ptrs_;
+    // グラフ側に対応するチャンネルがない場合に使用するバッファ
     Buffer<float> input_buffer_;
     Buffer<float> output_buffer_;
     
     std::atomic<Status> status_;
+    std::atomic<UInt64> state_version_ { 0 };
+    std::atomic<int> num_edits_in_progress_ { 0 };
+    //! オーディオスレッドからも変更を追加するので、ログは出力せずに数だけを記録する。
+    std::atomic<UInt64> num_dropped_param_changes_ { 0 };
     
 private:
-    LockFactory lf_processing_;
-    LockFactory lf_parameter_queue_;
-    Vst::ParameterChanges   param_changes_queue_;
+    //! Resume()の完了後にtrueになり、Suspend()の開始時にfalseになる。
+    std::atomic<bool> process_enabled_ { false };
+    //! オーディオスレッドがProcess()を実行中かどうか
+    std::atomic<bool> is_in_process_ { false };
+    
+    struct ParameterChange
+    {
+        Vst::ParamID id_ = Vst::kNoParamId;
+        Vst::ParamValue value_ = 0;
+        SampleCount offset_ = 0;
+    };
+    
+    //! 一度のProcess()の間に受け付けられるパラメータ変更の数
+    static constexpr UInt32 kParameterChangeQueueCapacity = 4096;
+    MpscQueue<ParameterChange> param_changes_queue_ { kParameterChangeQueueCapacity };
     
     Vst::ParameterChanges input_params_;
     Vst::ParameterChanges output_params_;
@@ -1,11 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 
 #include <pluginterfaces/base/ftypes.h>
 #include <pluginterfaces/base/ipluginbase.h>
 #include <pluginterfaces/vst/vstspeaker.h>
+#include <pluginterfaces/vst/ivstaudioprocessor.h>
 
 #include "../../misc/StrCnv.hpp"
 #include "../../misc/Either.hpp"
@@ -118,4 +120,33 @@ String GetSpeakerName(Steinberg::Vst::SpeakerArrangement arr, bool with_speaker_
     return to_wstr(Steinberg::Vst::SpeakerArr::getSpeakerArrangementString(arr, with_speaker_name));
 }
 
+//! process()を呼び出す前に、アクティブな出力バスのsilenceFlagsをクリアする。
+/*! silenceFlagsを書き込まないプラグインでは、前回のフレームのフラグが残ったままになり、
+ *  ClearSilentChannels() で実際の出力が消されてしまうため、毎回クリアする。
+ *  @tparam IsActive `bool(int bus_index)`
+ */
+template<class IsActive>
+void ResetOutputSilenceFlags(Steinberg::Vst::AudioBusBuffers *buses, int num_buses, IsActive is_active)
+{
+    for(int i = 0; i < num_buses; ++i) {
+        if(is_active(i)) { buses[i].silenceFlags = 0; }
+    }
+}
+
+//! process()のあとで、silenceFlagsが立っているチャンネルを0で埋める。
+/*! 無音のチャンネルには、プラグインが何も書き込んでいないことがあるので、ここでクリアする。
+ */
+inline
+void ClearSilentChannels(Steinberg::Vst::AudioBusBuffers const *buses, int num_buses, SampleCount length)
+{
+    for(int i = 0; i < num_buses; ++i) {
+        auto const &bus = buses[i];
+        for(int ch = 0; ch < bus.numChannels && ch < 64; ++ch) {
+            if(bus.silenceFlags & ((Steinberg::uint64)1 << ch)) {
+                std::fill_n(bus.channelBuffers32[ch], length, 0.0f);
+            }
+        }
+    }
+}
+
 NS_HWM_END
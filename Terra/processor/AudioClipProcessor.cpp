@@ -0,0 +1,144 @@
+#include "AudioClipProcessor.hpp"
+
+#include "../misc/StrCnv.hpp"
+#include "../log/LoggingSupport.hpp"
+
+NS_HWM_BEGIN
+
+namespace {
+    AudioFileStreamer::StreamPtr OpenStream(String const &path)
+    {
+        auto streamer = AudioFileStreamer::GetInstance();
+        if(!streamer) { return nullptr; }
+        
+        return streamer->OpenStream(path);
+    }
+}
+
+AudioClipProcessor::AudioClipProcessor(String const &path, SampleCount pos, UInt32 num_channels,
+                                       AudioFileStreamer::StreamPtr stream)
+:   path_(path)
+,   num_channels_(num_channels)
+,   pos_(pos)
+,   stream_(std::move(stream))
+{
+    if(stream_ && stream_->GetNumChannels() != num_channels_) {
+        // 保存したときとファイルが変わっている。グラフの接続を保つために、チャンネル数は変えない。
+        TERRA_WARN_LOG(L"The number of channels of {} was changed."_format(path));
+    }
+}
+
+AudioClipProcessor::~AudioClipProcessor()
+{}
+
+std::unique_ptr<AudioClipProcessor> AudioClipProcessor::Create(String const &path, SampleCount pos)
+{
+    auto stream = OpenStream(path);
+    if(!stream) { return nullptr; }
+    
+    auto const num_channels = stream->GetNumChannels();
+    return std::make_unique<AudioClipProcessor>(path, pos, num_channels, std::move(stream));
+}
+
+String AudioClipProcessor::GetName() const
+{
+    auto const found = path_.find_last_of(L"/\\");
+    return (found == String::npos) ? path_ : path_.substr(found + 1);
+}
+
+UInt32 AudioClipProcessor::GetAudioChannelCount(BusDirection dir) const
+{
+    return (dir == BusDirection::kOutputSide) ? num_channels_ : 0;
+}
+
+String const & AudioClipProcessor::GetPath() const
+{
+    return path_;
+}
+
+bool AudioClipProcessor::IsAvailable() const
+{
+    return stream_ != nullptr;
+}
+
+bool AudioClipProcessor::IsStreamedFromDisk() const
+{
+    return stream_ && stream_->IsPreloaded() == false;
+}
+
+SampleCount AudioClipProcessor::GetLength() const
+{
+    return stream_ ? stream_->GetNumSamples() : 0;
+}
+
+double AudioClipProcessor::GetSampleRate() const
+{
+    return stream_ ? stream_->GetSampleRate() : 0;
+}
+
+bool AudioClipProcessor::IsSampleRateMismatched(double sample_rate) const
+{
+    return stream_ && stream_->GetSampleRate() != sample_rate;
+}
+
+SampleCount AudioClipProcessor::GetPosition() const
+{
+    return pos_.load();
+}
+
+void AudioClipProcessor::SetPosition(SampleCount pos)
+{
+    pos_.store(pos);
+}
+
+UInt64 AudioClipProcessor::GetNumUnderruns() const
+{
+    return num_underruns_.load(std::memory_order_relaxed);
+}
+
+void AudioClipProcessor::doOnStartProcessing(double sample_rate, SampleCount block_size)
+{
+    // プロジェクトを開いたときや、デバイスのサンプリングレートを変更したときにも気づけるように、ログに残す。
+    if(IsSampleRateMismatched(sample_rate)) {
+        TERRA_WARN_LOG(L"The sample rate of {} ({}Hz) differs from the processing sample rate ({}Hz)."_format(path_, GetSampleRate(), sample_rate));
+    }
+}
+
+void AudioClipProcessor::doProcess(ProcessInfo &pi)
+{
+    auto &dest = pi.output_audio_buffer_;
+    
+    if(!stream_) {
+        dest.fill(0);
+        return;
+    }
+    
+    if(stream_->Read(*pi.time_info_, pos_.load(std::memory_order_relaxed), dest) == false) {
+        num_underruns_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+std::unique_ptr<schema::Processor> AudioClipProcessor::ToSchemaImpl() const
+{
+    auto schema = std::make_unique<schema::Processor>();
+    auto data = schema->mutable_audio_clip_data();
+    data->set_path(to_utf8(path_));
+    data->set_pos(GetPosition());
+    data->set_num_channels(num_channels_);
+    
+    return schema;
+}
+
+std::unique_ptr<AudioClipProcessor> AudioClipProcessor::FromSchemaImpl(schema::Processor const &schema)
+{
+    assert(schema.has_audio_clip_data());
+    
+    auto const &data = schema.audio_clip_data();
+    auto const path = to_wstr(data.path());
+    return std::make_unique<AudioClipProcessor>(path,
+                                                data.pos(),
+                                                std::max<UInt32>(data.num_channels(), 1),
+                                                OpenStream(path));
+}
+
+NS_HWM_END
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+
+#include "./Processor.hpp"
+#include "../file/AudioFileStreamer.hpp"
+
+NS_HWM_BEGIN
+
+//! オーディオファイルを、プロジェクトの再生位置に合わせて再生するプロセッサ
+/*! ファイルは AudioFileStreamer で先読みしながら再生するので、オーディオスレッドはファイルの読み込みを待たない。
+ *  先読みが間に合わなかったフレームは無音になる。
+ *  ファイルのサンプリングレートは変換しないので、処理のサンプリングレートと異なる場合は、再生速度とピッチが変わる。
+ *  （ IsSampleRateMismatched() で確認して、ユーザーに警告すること）
+ */
+class AudioClipProcessor
+:   public Processor
+{
+public:
+    //! @param pos ファイルの先頭を再生する位置（サンプル）
+    //! @param num_channels 出力チャンネル数。ファイルを開けない場合も、このチャンネル数で無音を出力する。
+    //! @param stream pathを開いたストリーム。ファイルを開けなかった場合はnullptr
+    AudioClipProcessor(String const &path, SampleCount pos, UInt32 num_channels,
+                       AudioFileStreamer::StreamPtr stream);
+    ~AudioClipProcessor();
+    
+    //! ファイルを開いてプロセッサを作成する。ファイルを開けない場合はnullptrを返す。
+    static
+    std::unique_ptr<AudioClipProcessor> Create(String const &path, SampleCount pos = 0);
+    
+    String GetName() const override;
+    UInt32 GetAudioChannelCount(BusDirection dir) const override;
+    
+    String const & GetPath() const;
+    
+    //! ファイルを開けているかどうか
+    bool IsAvailable() const;
+    
+    //! ファイル全体をメモリに読み込まずに、ディスクから先読みしながら再生しているかどうか
+    bool IsStreamedFromDisk() const;
+    
+    //! ファイルの長さ（サンプル）。ファイルを開けていない場合は0
+    SampleCount GetLength() const;
+    
+    //! ファイルのサンプリングレート。ファイルを開けていない場合は0
+    double GetSampleRate() const;
+    
+    //! ファイルのサンプリングレートが、sample_rateと異なるかどうか。ファイルを開けていない場合はfalse
+    bool IsSampleRateMismatched(double sample_rate) const;
+    
+    //! ファイルの先頭を再生する位置。再生中に変更してもよい。
+    SampleCount GetPosition() const;
+    void SetPosition(SampleCount pos);
+    
+    //! 先読みが間に合わずに無音を出力したフレームの数
+    UInt64 GetNumUnderruns() const;
+    
+    std::unique_ptr<schema::Processor> ToSchemaImpl() const override;
+    
+    static
+    std::unique_ptr<AudioClipProcessor> FromSchemaImpl(schema::Processor const &schema);
+    
+private:
+    String path_;
+    UInt32 num_channels_ = 0;
+    std::atomic<SampleCount> pos_;
+    std::atomic<UInt64> num_underruns_ { 0 };
+    AudioFileStreamer::StreamPtr stream_;
+    
+    void doOnStartProcessing(double sample_rate, SampleCount block_size) override;
+    void doProcess(ProcessInfo &pi) override;
+};
+
+NS_HWM_END
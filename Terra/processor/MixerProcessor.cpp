@@ -0,0 +1,275 @@
+#include "MixerProcessor.hpp"
+
+#include <cmath>
+
+#include "../misc/MathUtil.hpp"
+#include "../misc/VectorOps.hpp"
+
+NS_HWM_BEGIN
+
+namespace {
+    //! パラメータを変更したときに、ゲインが目的の値に近づく時定数（秒）
+    constexpr double kSmoothingTime = 0.01;
+    //! 目的のゲインとの差がこの値より小さくなったら、推移を終了する
+    constexpr float kSmoothingTolerance = 1e-5f;
+
+    float ToLinearGain(double db)
+    {
+        return (db <= MixerProcessor::kMinDB) ? 0.0f : (float)DBToLinear(db);
+    }
+
+    float GetNextGain(float current, float target, float coef)
+    {
+        auto const next = target + (current - target) * coef;
+        return (std::fabs(next - target) < kSmoothingTolerance) ? target : next;
+    }
+}
+
+struct MixerProcessor::Input
+{
+    Input(UInt32 num_sends)
+    :   send_levels_(std::make_unique<std::atomic<double>[]>(num_sends))
+    ,   current_gains_((num_sends + 1) * 2)
+    {
+        for(UInt32 i = 0; i < num_sends; ++i) {
+            send_levels_[i].store(kMinDB);
+        }
+    }
+
+    std::atomic<double> gain_ = { 0.0 };
+    std::atomic<double> pan_ = { 0.0 };
+    std::atomic<bool> mute_ = { false };
+    std::atomic<bool> solo_ = { false };
+    std::unique_ptr<std::atomic<double>[]> send_levels_;
+
+    //! オーディオスレッドで適用している、バスごとの L/R のゲイン
+    std::vector<float> current_gains_;
+};
+
+MixerProcessor::MixerProcessor(UInt32 num_inputs, UInt32 num_sends)
+:   num_sends_(std::min(num_sends, kMaxSends))
+,   input_meter_(Clamp<UInt32>(num_inputs, 1, kMaxInputs) * 2)
+,   output_meter_((std::min(num_sends, kMaxSends) + 1) * 2)
+{
+    num_inputs = Clamp<UInt32>(num_inputs, 1, kMaxInputs);
+    for(UInt32 i = 0; i < num_inputs; ++i) {
+        inputs_.push_back(std::make_unique<Input>(num_sends_));
+    }
+}
+
+MixerProcessor::~MixerProcessor()
+{}
+
+String MixerProcessor::GetName() const
+{
+    return L"Mixer";
+}
+
+UInt32 MixerProcessor::GetAudioChannelCount(BusDirection dir) const
+{
+    if(dir == BusDirection::kInputSide) {
+        return GetNumInputs() * 2;
+    } else {
+        return (num_sends_ + 1) * 2;
+    }
+}
+
+UInt32 MixerProcessor::GetNumInputs() const
+{
+    return inputs_.size();
+}
+
+UInt32 MixerProcessor::GetNumSends() const
+{
+    return num_sends_;
+}
+
+MixerProcessor::Input & MixerProcessor::GetInput(UInt32 input_index)
+{
+    assert(input_index < inputs_.size());
+    return *inputs_[input_index];
+}
+
+MixerProcessor::Input const & MixerProcessor::GetInput(UInt32 input_index) const
+{
+    assert(input_index < inputs_.size());
+    return *inputs_[input_index];
+}
+
+double MixerProcessor::GetGain(UInt32 input_index) const
+{
+    return GetInput(input_index).gain_.load();
+}
+
+void MixerProcessor::SetGain(UInt32 input_index, double db)
+{
+    GetInput(input_index).gain_.store(Clamp<double>(db, kMinDB, kMaxDB));
+}
+
+double MixerProcessor::GetPan(UInt32 input_index) const
+{
+    return GetInput(input_index).pan_.load();
+}
+
+void MixerProcessor::SetPan(UInt32 input_index, double pan)
+{
+    GetInput(input_index).pan_.store(Clamp<double>(pan, -1.0, 1.0));
+}
+
+bool MixerProcessor::IsMuted(UInt32 input_index) const
+{
+    return GetInput(input_index).mute_.load();
+}
+
+void MixerProcessor::SetMute(UInt32 input_index, bool mute)
+{
+    GetInput(input_index).mute_.store(mute);
+}
+
+bool MixerProcessor::IsSoloed(UInt32 input_index) const
+{
+    return GetInput(input_index).solo_.load();
+}
+
+void MixerProcessor::SetSolo(UInt32 input_index, bool solo)
+{
+    if(GetInput(input_index).solo_.exchange(solo) == solo) { return; }
+
+    if(solo) {
+        num_soloed_.fetch_add(1);
+    } else {
+        num_soloed_.fetch_sub(1);
+    }
+}
+
+bool MixerProcessor::IsEffectivelyMuted(UInt32 input_index) const
+{
+    auto const &in = GetInput(input_index);
+    return in.mute_.load() || (num_soloed_.load() > 0 && in.solo_.load() == false);
+}
+
+double MixerProcessor::GetSendLevel(UInt32 input_index, UInt32 send_index) const
+{
+    assert(send_index < num_sends_);
+    return GetInput(input_index).send_levels_[send_index].load();
+}
+
+void MixerProcessor::SetSendLevel(UInt32 input_index, UInt32 send_index, double db)
+{
+    assert(send_index < num_sends_);
+    GetInput(input_index).send_levels_[send_index].store(Clamp<double>(db, kMinDB, kMaxDB));
+}
+
+AudioMeter const & MixerProcessor::GetInputMeter() const
+{
+    return input_meter_;
+}
+
+AudioMeter const & MixerProcessor::GetOutputMeter() const
+{
+    return output_meter_;
+}
+
+void MixerProcessor::doOnStartProcessing(double sample_rate, SampleCount block_size)
+{
+    sample_rate_ = sample_rate;
+    input_meter_.SetSampleRate(sample_rate);
+    output_meter_.SetSampleRate(sample_rate);
+    input_meter_.Reset();
+    output_meter_.Reset();
+
+    // 処理を開始するときは、推移させずに現在のパラメータのゲインから始める。
+    snaps_to_target_ = true;
+}
+
+void MixerProcessor::doProcess(ProcessInfo &pi)
+{
+    auto &dest = pi.output_audio_buffer_;
+    auto const &src = pi.input_audio_buffer_;
+    SampleCount const num_samples = dest.samples();
+
+    dest.fill(0);
+    input_meter_.Process(src);
+
+    float const coef = (snaps_to_target_ ? 0.0f : std::exp(-num_samples / (kSmoothingTime * sample_rate_)));
+    snaps_to_target_ = false;
+
+    bool const any_soloed = (num_soloed_.load(std::memory_order_relaxed) > 0);
+
+    UInt32 const num_inputs = std::min<UInt32>(inputs_.size(), src.channels() / 2);
+    UInt32 const num_buses = std::min<UInt32>(num_sends_ + 1, dest.channels() / 2);
+
+    for(UInt32 i = 0; i < num_inputs; ++i) {
+        auto &in = *inputs_[i];
+
+        bool const audible = !in.mute_.load(std::memory_order_relaxed)
+                          && (!any_soloed || in.solo_.load(std::memory_order_relaxed));
+        float const fader = audible ? ToLinearGain(in.gain_.load(std::memory_order_relaxed)) : 0.0f;
+
+        // ステレオ入力のバランスとして、パンの反対側のチャンネルだけを減衰させる。
+        float const pan = in.pan_.load(std::memory_order_relaxed);
+        float const pan_gains[2] = { std::min(1.0f, 1.0f - pan), std::min(1.0f, 1.0f + pan) };
+
+        for(UInt32 bus = 0; bus < num_buses; ++bus) {
+            float const bus_gain = (bus == 0) ? 1.0f : ToLinearGain(in.send_levels_[bus - 1].load(std::memory_order_relaxed));
+
+            for(UInt32 lr = 0; lr < 2; ++lr) {
+                auto &current = in.current_gains_[bus * 2 + lr];
+                auto const next = GetNextGain(current, fader * pan_gains[lr] * bus_gain, coef);
+
+                if(current != 0 || next != 0) {
+                    auto const *s = src.data()[src.channel_from() + i * 2 + lr] + src.sample_from();
+                    auto *d = dest.get_channel_data(bus * 2 + lr);
+                    AddWithLinearRamp(s, d, num_samples, current, next);
+                }
+
+                current = next;
+            }
+        }
+    }
+
+    output_meter_.Process(dest);
+}
+
+std::unique_ptr<schema::Processor> MixerProcessor::ToSchemaImpl() const
+{
+    auto schema = std::make_unique<schema::Processor>();
+    auto data = schema->mutable_mixer_data();
+    data->set_num_sends(num_sends_);
+
+    for(UInt32 i = 0; i < GetNumInputs(); ++i) {
+        auto input = data->add_inputs();
+        input->set_gain(GetGain(i));
+        input->set_pan(GetPan(i));
+        input->set_mute(IsMuted(i));
+        input->set_solo(IsSoloed(i));
+        for(UInt32 j = 0; j < num_sends_; ++j) {
+            input->add_send_levels(GetSendLevel(i, j));
+        }
+    }
+
+    return schema;
+}
+
+std::unique_ptr<MixerProcessor> MixerProcessor::FromSchemaImpl(schema::Processor const &schema)
+{
+    assert(schema.has_mixer_data());
+
+    auto const &data = schema.mixer_data();
+    auto p = std::make_unique<MixerProcessor>(data.inputs_size(), data.num_sends());
+
+    for(UInt32 i = 0; i < p->GetNumInputs() && i < data.inputs_size(); ++i) {
+        auto const &input = data.inputs(i);
+        p->SetGain(i, input.gain());
+        p->SetPan(i, input.pan());
+        p->SetMute(i, input.mute());
+        p->SetSolo(i, input.solo());
+        for(UInt32 j = 0; j < p->GetNumSends() && j < input.send_levels_size(); ++j) {
+            p->SetSendLevel(i, j, input.send_levels(j));
+        }
+    }
+
+    return p;
+}
+
+NS_HWM_END
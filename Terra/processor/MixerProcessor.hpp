@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "./Processor.hpp"
+#include "../misc/AudioMeter.hpp"
+
+NS_HWM_BEGIN
+
+//! 複数のステレオ入力をミックスして、メインバスとセンドバスに出力するプロセッサ
+/*! オーディオ入力チャンネルは、入力iの L/R が 2*i / 2*i+1 番目のチャンネルになる。
+ *  オーディオ出力チャンネルは、0/1番目がメインバスの L/R、2+2*j / 3+2*j 番目がセンドjの L/R になる。
+ *
+ *  各入力のゲイン、パン、ミュート、ソロ、センドレベルは、どのスレッドから変更してもよい。
+ *  オーディオスレッドでは、変更された値に向かってブロック内で連続的にゲインを推移させるので、
+ *  パラメータを変更してもノイズが出ない。
+ *
+ *  センドは、ゲインとパンを適用した後（ポストフェーダー）の信号を送る。
+ *  ノードのゲインフェーダーは、メインバスとセンドバスのすべての出力に適用される。
+ */
+class MixerProcessor
+:   public Processor
+{
+public:
+    static constexpr UInt32 kMaxInputs = 64;
+    static constexpr UInt32 kMaxSends = 8;
+
+    //! この値以下のゲインやセンドレベルは、-inf dBとして扱う
+    static constexpr double kMinDB = -96.0;
+    static constexpr double kMaxDB = 12.0;
+
+    //! @param num_inputs ステレオ入力の数
+    //! @param num_sends ステレオのセンドバスの数
+    MixerProcessor(UInt32 num_inputs, UInt32 num_sends);
+    ~MixerProcessor();
+
+    String GetName() const override;
+    UInt32 GetAudioChannelCount(BusDirection dir) const override;
+
+    UInt32 GetNumInputs() const;
+    UInt32 GetNumSends() const;
+
+    //! 入力のゲイン（dB）
+    double GetGain(UInt32 input_index) const;
+    void SetGain(UInt32 input_index, double db);
+
+    //! 入力のパン。-1.0 (L) .. 1.0 (R)
+    /*! ステレオ入力のバランスとして扱う。中央では、両チャンネルをそのまま出力する。
+     */
+    double GetPan(UInt32 input_index) const;
+    void SetPan(UInt32 input_index, double pan);
+
+    bool IsMuted(UInt32 input_index) const;
+    void SetMute(UInt32 input_index, bool mute);
+
+    //! ソロに設定された入力がある場合は、ソロに設定されていない入力はミュートされる。
+    bool IsSoloed(UInt32 input_index) const;
+    void SetSolo(UInt32 input_index, bool solo);
+    
+    //! ミュートと、ほかの入力のソロを考慮して、入力が出力に含まれないかどうかを返す。
+    bool IsEffectivelyMuted(UInt32 input_index) const;
+
+    //! 入力からセンドバスへ送るレベル（dB）
+    double GetSendLevel(UInt32 input_index, UInt32 send_index) const;
+    void SetSendLevel(UInt32 input_index, UInt32 send_index, double db);
+
+    //! 入力チャンネルごとの、フェーダー前のレベル
+    AudioMeter const & GetInputMeter() const;
+    //! 出力チャンネルごとのレベル（ノードのゲインフェーダーを適用する前）
+    AudioMeter const & GetOutputMeter() const;
+
+    std::unique_ptr<schema::Processor> ToSchemaImpl() const override;
+
+    static
+    std::unique_ptr<MixerProcessor> FromSchemaImpl(schema::Processor const &schema);
+
+private:
+    struct Input;
+    std::vector<std::unique_ptr<Input>> inputs_;
+    UInt32 num_sends_ = 0;
+    std::atomic<UInt32> num_soloed_ = { 0 };
+    double sample_rate_ = 44100.0;
+    //! 次のブロックで、ゲインを推移させずに目的の値にするかどうか
+    bool snaps_to_target_ = true;
+
+    AudioMeter input_meter_;
+    AudioMeter output_meter_;
+
+    Input & GetInput(UInt32 input_index);
+    Input const & GetInput(UInt32 input_index) const;
+
+    void doOnStartProcessing(double sample_rate, SampleCount block_size) override;
+    void doProcess(ProcessInfo &pi) override;
+};
+
+NS_HWM_END
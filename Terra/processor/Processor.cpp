@@ -1,8 +1,14 @@
 #pragma once
 
+#include <thread>
+
 #include "./Processor.hpp"
+#include "./AudioClipProcessor.hpp"
+#include "./MixerProcessor.hpp"
 #include "../project/GraphProcessor.hpp"
 #include "../misc/StrCnv.hpp"
+#include "../misc/ScopeExit.hpp"
+#include "../file/ProjectContainer.hpp"
 #include "../App.hpp"
 
 NS_HWM_BEGIN
@@ -71,6 +77,10 @@ std::unique_ptr<Processor> Processor::FromSchema(schema::Processor const &schema
 {
     if(schema.has_vst3_data()) {
         return Vst3AudioProcessor::FromSchemaImpl(schema);
+    } else if(schema.has_audio_clip_data()) {
+        return AudioClipProcessor::FromSchemaImpl(schema);
+    } else if(schema.has_mixer_data()) {
+        return MixerProcessor::FromSchemaImpl(schema);
     }
     
     assert(false);
@@ -86,28 +96,22 @@ void Processor::OnStartProcessing(double sample_rate, SampleCount block_size)
 void Processor::Process(ProcessInfo &pi)
 {
     doProcess(pi);
-    
+    ApplyGainFader(pi);
+}
+
+void Processor::ProcessPreFader(ProcessInfo &pi)
+{
+    doProcess(pi);
+}
+
+void Processor::ApplyGainFader(ProcessInfo &pi)
+{
     if(IsGainFaderEnabled() == false) {
         volume_.update_transition(pi.time_info_->play_.duration_.sample_);
         return;
     }
     
-    auto gain = volume_.get_current_linear_gain();
-    if(gain == 1) {
-        //do nothing.
-    } else if(gain == 0) {
-        auto &buf = pi.output_audio_buffer_;
-        for(UInt32 ch = buf.channel_from(); ch < buf.channels(); ++ch) {
-            std::fill_n(buf.data()[ch], buf.samples(), 0);
-        }
-    } else {
-        auto &buf = pi.output_audio_buffer_;
-        for(UInt32 ch = buf.channel_from(); ch < buf.channels(); ++ch) {
-            std::for_each_n(buf.data()[ch], pi.time_info_->play_.duration_.sample_, [gain](auto &x) { x *= gain; });
-        }
-    }
-    
-    volume_.update_transition(pi.time_info_->play_.duration_.sample_);
+    volume_.apply(pi.output_audio_buffer_);
 }
 
 void Processor::OnStopProcessing()
@@ -157,6 +161,20 @@ PluginAudioProcessor::LoadResult PluginAudioProcessor::Load()
     return doLoad();
 }
 
+void PluginAudioProcessor::PrepareToLoad()
+{
+    if(IsLoaded()) { return; }
+    
+    doPrepareToLoad();
+}
+
+void PluginAudioProcessor::Unload()
+{
+    if(IsLoaded() == false) { return; }
+    
+    doUnload();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 
 schema::PluginDescription const & GetSavedDescription(schema::Processor const &proc)
@@ -165,16 +183,58 @@ schema::PluginDescription const & GetSavedDescription(schema::Processor const &p
     return proc.vst3_data().desc();
 }
 
+AutomationLane AutomationLaneFromSchema(schema::AutomationLane const &schema)
+{
+    std::vector<AutomationLane::Breakpoint> points;
+    for(auto const &bp: schema.breakpoints()) {
+        points.emplace_back(bp.pos(), bp.value());
+    }
+    
+    return AutomationLane(schema.param_id(), points);
+}
+
+void AutomationLaneToSchema(AutomationLane const &lane, schema::AutomationLane &schema)
+{
+    schema.set_param_id(lane.GetParamID());
+    for(auto const &bp: lane.GetBreakpoints()) {
+        auto new_bp = schema.add_breakpoints();
+        new_bp->set_pos(bp.pos_);
+        new_bp->set_value(bp.value_);
+    }
+}
+
 // lazy initialization
 Vst3AudioProcessor::Vst3AudioProcessor(schema::Processor const &schema)
 :   PluginAudioProcessor(GetSavedDescription(schema))
 ,   schema_(schema)
-{}
+{
+    AutomationLaneList lanes;
+    for(auto const &lane: schema.vst3_data().automation_lanes()) {
+        lanes.push_back(AutomationLaneFromSchema(lane));
+    }
+    
+    if(lanes.empty() == false) {
+        SetAutomationLanes(std::move(lanes));
+    }
+    
+    // スキーマに含まれている状態は、ToSchema()で毎回コピーしないように取り出しておく。
+    auto vst3 = schema_.mutable_vst3_data();
+    if(vst3->has_dump()) {
+        auto saved = std::make_shared<StateDump>();
+        saved->dump_ = std::move(*vst3->mutable_dump());
+        saved->hash_ = ProjectContainer::HashPluginDump(saved->dump_);
+        
+        vst3->clear_dump();
+        vst3->set_dump_hash(saved->hash_);
+        saved_dump_ = std::move(saved);
+    }
+}
 
 Vst3AudioProcessor::Vst3AudioProcessor(schema::PluginDescription const &desc,
                                        std::shared_ptr<Vst3Plugin> plugin)
 :   hwm::PluginAudioProcessor(desc)
 ,   plugin_(plugin)
+,   processing_plugin_(plugin.get())
 {}
 
 Vst3AudioProcessor::~Vst3AudioProcessor()
@@ -182,8 +242,13 @@ Vst3AudioProcessor::~Vst3AudioProcessor()
 
 bool Vst3AudioProcessor::IsLoaded() const
 {
-    auto lock = process_lock_.make_lock();
-    return plugin_ != nullptr;
+    return processing_plugin_.load() != nullptr;
+}
+
+UInt64 Vst3AudioProcessor::TakeNumDroppedParameterChanges()
+{
+    auto p = std::atomic_load(&plugin_);
+    return p ? p->TakeNumDroppedParameterChanges() : 0;
 }
 
 auto apply_process_setting = [](Vst3AudioProcessor::ProcessSetting const &setting,
@@ -198,16 +263,24 @@ auto apply_process_setting = [](Vst3AudioProcessor::ProcessSetting const &settin
 
 PluginAudioProcessor::LoadResult Vst3AudioProcessor::doLoad()
 {
+    // 複数のスレッドから同時にロードされた場合に、プラグインが重複して生成されないようにする。
+    auto load_lock = load_lock_.make_lock();
+    
     {
         auto lock = process_lock_.make_lock();
         if(plugin_) { return LoadResult{}; }
     }
     
     auto app = App::GetInstance();
-    auto p = app->CreateVst3Plugin(GetDescription());
+    std::shared_ptr<Vst3Plugin> p = app->CreateVst3Plugin(GetDescription());
+    if(!p) {
+        return LoadResult { "Failed to create the plugin: " + GetDescription().name() };
+    }
     
     assert(schema_.has_vst3_data());
     
+    // 処理中のグラフにプラグインを差し替える場合は、
+    // 処理の設定と状態の復元を済ませてから差し替えることで、初期状態のプラグインの音が出力されないようにする。
     for( ; ; ) {
         std::optional<ProcessSetting> copied_process_setting;
         
@@ -216,22 +289,81 @@ PluginAudioProcessor::LoadResult Vst3AudioProcessor::doLoad()
         process_setting_ = std::nullopt;
         
         if(!copied_process_setting) {
-            plugin_ = std::move(p);
+            std::atomic_store(&plugin_, p);
+            processing_plugin_ = p.get();
             break;
         }
         
         lock.unlock();
         apply_process_setting(*copied_process_setting, p.get());
-        
+        LoadDataImpl(p.get());
     }
  
-    LoadDataImpl();
     return LoadResult{};
 }
 
-void Vst3AudioProcessor::LoadDataImpl()
+void Vst3AudioProcessor::doPrepareToLoad()
+{
+    auto load_lock = load_lock_.make_lock();
+    if(std::atomic_load(&plugin_) || std::atomic_load(&saved_dump_)) { return; }
+    
+    auto loader = GetDumpLoader();
+    if(!loader) { return; }
+    
+    auto saved = std::make_shared<StateDump>();
+    if(loader(saved->dump_) == false) { return; }
+    
+    // schema_のdump_hashは、ファイルに保存されていた状態のハッシュ値
+    saved->hash_ = schema_.vst3_data().dump_hash();
+    std::atomic_store(&saved_dump_, std::shared_ptr<StateDump const>(std::move(saved)));
+    SetDumpLoader(nullptr);
+}
+
+void Vst3AudioProcessor::doUnload()
+{
+    auto load_lock = load_lock_.make_lock();
+    
+    // 次にロードするときに復元できるように、現在の状態を保存しておく。
+    auto saved = ToSchemaImpl();
+    std::shared_ptr<StateDump const> saved_dump;
+    if(auto loaded = std::atomic_load(&plugin_)) {
+        saved_dump = GetStateDump(*loaded, false);
+        saved->mutable_vst3_data()->set_dump_hash(saved_dump ? saved_dump->hash_ : 0);
+    }
+    
+    std::shared_ptr<Vst3Plugin> p;
+    {
+        auto lock = process_lock_.make_lock();
+        if(!plugin_) { return; }
+        
+        // オーディオスレッドが新たにプラグインを参照しないようにしてから、
+        // 実行中の doProcess() が抜けるのを待つ。（オーディオスレッド側は待機しない）
+        processing_plugin_ = nullptr;
+        while(is_in_process_.load()) {
+            std::this_thread::yield();
+        }
+        p = std::atomic_exchange(&plugin_, std::shared_ptr<Vst3Plugin>());
+        
+        schema_ = std::move(*saved);
+        std::atomic_store(&saved_dump_, saved_dump);
+        SetDumpLoader(nullptr);
+        
+        // 処理中にアンロードした場合は、次にロードしたときに処理を再開する。
+        if(p->IsResumed()) {
+            p->Suspend();
+            process_setting_ = active_process_setting_;
+        }
+    }
+    
+    {
+        auto lock = lf_dump_cache_.make_lock();
+        cached_dump_ = nullptr;
+        cached_dump_version_ = 0;
+    }
+}
+
+void Vst3AudioProcessor::LoadDataImpl(Vst3Plugin *p)
 {
-    auto p = std::atomic_load(&plugin_);
     if(!p) { return; }
     
     // for a newly created plugin processor.
@@ -244,10 +376,17 @@ void Vst3AudioProcessor::LoadDataImpl()
     }
 
     auto &vd = schema_.vst3_data();
-    if(vd.has_dump()) {
+    
+    schema::Processor::Vst3::Dump loaded_dump;
+    auto saved_dump = std::atomic_load(&saved_dump_);
+    auto loader = GetDumpLoader();
+    bool const has_loaded_dump = (!saved_dump && loader && loader(loaded_dump));
+    
+    if(saved_dump || has_loaded_dump) {
+        auto const &dump = (has_loaded_dump ? loaded_dump : saved_dump->dump_);
         Vst3Plugin::DumpData dd;
-        auto const &proc_data = vd.dump().processor_data();
-        auto const &edit_data = vd.dump().edit_controller_data();
+        auto const &proc_data = dump.processor_data();
+        auto const &edit_data = dump.edit_controller_data();
         
         dd.processor_data_.assign(proc_data.begin(), proc_data.end());
         dd.edit_controller_data_.assign(edit_data.begin(), edit_data.end());
@@ -257,8 +396,22 @@ void Vst3AudioProcessor::LoadDataImpl()
     }
     
     auto mvd = schema_.mutable_vst3_data();
-    mvd->clear_dump();
+    mvd->clear_dump_hash();
     mvd->clear_params();
+    std::atomic_store(&saved_dump_, std::shared_ptr<StateDump const>());
+    SetDumpLoader(nullptr);
+}
+
+void Vst3AudioProcessor::SetDumpLoader(DumpLoader loader)
+{
+    auto lock = lf_dump_loader_.make_lock();
+    dump_loader_ = std::move(loader);
+}
+
+Vst3AudioProcessor::DumpLoader Vst3AudioProcessor::GetDumpLoader() const
+{
+    auto lock = lf_dump_loader_.make_lock();
+    return dump_loader_;
 }
 
 String Vst3AudioProcessor::GetName() const
@@ -278,11 +431,12 @@ void Vst3AudioProcessor::doOnStartProcessing(double sample_rate, SampleCount blo
     ProcessSetting ps;
     ps.sample_rate_ = sample_rate;
     ps.block_size_ = block_size;
+    active_process_setting_ = ps;
 
     if(plugin_) {
         assert(plugin_->IsResumed() == false);
         apply_process_setting(ps, plugin_.get());
-        LoadDataImpl();
+        LoadDataImpl(plugin_.get());
     } else {
         process_setting_ = ps;
     }
@@ -290,15 +444,81 @@ void Vst3AudioProcessor::doOnStartProcessing(double sample_rate, SampleCount blo
 
 void Vst3AudioProcessor::doProcess(ProcessInfo &pi)
 {
-    auto lock = process_lock_.make_lock();
-    if(plugin_) {
-        plugin_->Process(pi);
+    // オーディオスレッドではロックを取らない。
+    // プラグインのSuspend/Resumeとの同期は、Vst3Plugin側でロックを使わずに行われる。
+    // Unload()との同期は、is_in_process_とprocessing_plugin_で行う。
+    // （どちらもseq_cstなので、Unload()がis_in_process_をfalseと読んだ場合は、
+    //  こちらでは必ずprocessing_plugin_をnullptrと読む）
+    is_in_process_ = true;
+    HWM_SCOPE_EXIT([this] { is_in_process_ = false; });
+    
+    auto p = processing_plugin_.load();
+    if(p) {
+        ApplyAutomation(p, pi);
+        p->Process(pi);
+    }
+}
+
+void Vst3AudioProcessor::SetAutomationLanes(AutomationLaneList lanes)
+{
+    auto data = std::make_shared<AutomationData>();
+    data->cursors_.resize(lanes.size());
+    data->lanes_ = std::move(lanes);
+    
+    std::shared_ptr<AutomationData> old_data;
+    {
+        auto lock = lf_automation_.make_lock();
+        old_data = std::move(automation_);
+        automation_ = data;
+        
+        // オーディオスレッドが古いデータを参照しなくなってから、このスレッドで解放する。
+        processing_automation_ = data.get();
+        while(is_in_process_.load()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+Vst3AudioProcessor::AutomationLaneList Vst3AudioProcessor::GetAutomationLanes() const
+{
+    auto lock = lf_automation_.make_lock();
+    if(!automation_) { return {}; }
+    
+    return automation_->lanes_;
+}
+
+void Vst3AudioProcessor::ApplyAutomation(Vst3Plugin *p, ProcessInfo const &pi)
+{
+    // doProcess() の中から呼び出されるので、参照している間にデータが解放されることはない。
+    auto data = processing_automation_.load();
+    if(!data) { return; }
+    
+    auto const &ti = *pi.time_info_;
+    if(ti.playing_ == false) {
+        was_playing_ = false;
+        return;
+    }
+    
+    // 停止中にGUIなどからパラメータが変更されているかもしれないので、再生開始時には値を送り直す。
+    if(was_playing_ == false) {
+        for(auto &cursor: data->cursors_) { cursor.Reset(); }
+        was_playing_ = true;
+    }
+    
+    for(size_t i = 0; i < data->lanes_.size(); ++i) {
+        auto const &lane = data->lanes_[i];
+        lane.Evaluate(ti.play_.begin_.tick_, ti.play_.end_.tick_, ti.play_.duration_.sample_,
+                      data->cursors_[i],
+                      [p, id = lane.GetParamID()](SampleCount offset, double value) {
+                          p->EnqueueAutomatedParameterChange(id, value, offset);
+                      });
     }
 }
 
 void Vst3AudioProcessor::doOnStopProcessing()
 {
     auto lock = process_lock_.make_lock();
+    active_process_setting_ = std::nullopt;
 
     if(plugin_) {
         plugin_->Suspend();
@@ -420,13 +640,12 @@ std::unique_ptr<schema::Processor> Vst3AudioProcessor::ToSchemaImpl() const
                       FillBusSchema(*vst3->add_event_output_buses(), bus_info);
                   });
         
-        auto dump = plugin_->SaveData();
+        // 状態そのものは大きいので、必要な場合にGetDump()で取得する。
+        // ここではハッシュ値だけが必要なので、エディタが開いていても状態を取得し直さない。
+        // （GetDump()が状態を取得するときに、ハッシュ値も設定し直される）
+        auto dump = GetStateDump(*p, true);
         if(dump) {
-            auto schema_dump = vst3->mutable_dump();
-            schema_dump->set_processor_data(dump->processor_data_.data(),
-                                            dump->processor_data_.size());
-            schema_dump->set_edit_controller_data(dump->edit_controller_data_.data(),
-                                                  dump->edit_controller_data_.size());
+            vst3->set_dump_hash(dump->hash_);
         } else {
             auto const num_params = plugin_->GetNumParams();
             for(int i = 0; i < num_params; ++i) {
@@ -442,9 +661,69 @@ std::unique_ptr<schema::Processor> Vst3AudioProcessor::ToSchemaImpl() const
         *schema = schema_;
     }
     
+    // schema_をコピーした場合はvst3が無効になっているので、取得し直す。
+    auto mvst3 = schema->mutable_vst3_data();
+
+    mvst3->clear_automation_lanes();
+    for(auto const &lane: GetAutomationLanes()) {
+        AutomationLaneToSchema(lane, *mvst3->add_automation_lanes());
+    }
+    
     return schema;
 }
 
+std::shared_ptr<Vst3AudioProcessor::StateDump const> Vst3AudioProcessor::GetStateDump(Vst3Plugin &p,
+                                                                                     bool use_cache_while_editor_opened) const
+{
+    auto lock = lf_dump_cache_.make_lock();
+    
+    // エディタが開いている間は、プラグインが状態の変化を通知するとは限らないので、通常はキャッシュを使用しない。
+    // （エディタを閉じたときには、状態が変化したものとして扱われる）
+    auto const version = p.GetStateVersion();
+    if(cached_dump_ && cached_dump_version_ == version
+       && (use_cache_while_editor_opened || p.IsEditorOpened() == false))
+    {
+        return cached_dump_;
+    }
+    
+    cached_dump_ = nullptr;
+    cached_dump_version_ = version;
+    
+    auto data = p.SaveData();
+    if(!data) { return nullptr; }
+    
+    auto dump = std::make_shared<StateDump>();
+    dump->dump_.set_processor_data(data->processor_data_.data(), data->processor_data_.size());
+    dump->dump_.set_edit_controller_data(data->edit_controller_data_.data(), data->edit_controller_data_.size());
+    dump->hash_ = ProjectContainer::HashPluginDump(dump->dump_);
+    
+    cached_dump_ = dump;
+    return cached_dump_;
+}
+
+bool Vst3AudioProcessor::GetDump(schema::Processor::Vst3::Dump &dump, UInt64 &dump_hash,
+                                 bool use_cache_while_editor_opened) const
+{
+    std::shared_ptr<StateDump const> state;
+    if(auto p = std::atomic_load(&plugin_)) {
+        state = GetStateDump(*p, use_cache_while_editor_opened);
+    } else {
+        state = std::atomic_load(&saved_dump_);
+    }
+    
+    if(!state) { return false; }
+    
+    dump = state->dump_;
+    dump_hash = state->hash_;
+    return true;
+}
+
+bool Vst3AudioProcessor::IsEditing() const
+{
+    auto p = std::atomic_load(&plugin_);
+    return p && p->IsEditing();
+}
+
 std::unique_ptr<Vst3AudioProcessor> Vst3AudioProcessor::FromSchemaImpl(schema::Processor const &schema)
 {
     assert(schema.has_vst3_data());
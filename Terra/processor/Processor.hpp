@@ -1,5 +1,8 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+
 #include "./ProcessInfo.hpp"
 #include <project.pb.h>
 #include <plugin_desc.pb.h>
@@ -38,6 +41,16 @@ public:
     void Process(ProcessInfo &pi);
     void OnStopProcessing();
     
+    //! ゲインフェーダーを適用せずに処理する。
+    /*! フリーズのために、フェーダー前の出力をレンダリングするときに使用する。
+     */
+    void ProcessPreFader(ProcessInfo &pi);
+    
+    //! 処理を行わずに、pi.output_audio_buffer_にゲインフェーダーだけを適用する。
+    /*! フリーズしたノードのように、出力を別の方法で用意した場合に使用する。
+     */
+    void ApplyGainFader(ProcessInfo &pi);
+    
     virtual
     SampleCount GetLatencySample() const { return 0; }
     
@@ -105,6 +118,7 @@ NS_HWM_END
 //===================================================================
 
 #include "../plugin/vst3/Vst3Plugin.hpp"
+#include "../project/AutomationLane.hpp"
 
 NS_HWM_BEGIN
 
@@ -131,8 +145,23 @@ public:
     };
     
     //! Do nothing and return a successful LoadResult if `IsLoaded() == true`.
+    /*! プラグインの生成と状態の復元を行うので、メインスレッドから呼び出すこと。
+     */
     LoadResult Load();
     
+    //! Load() で必要になるファイルの読み込みを、先に済ませておく。
+    /*! プラグインの生成などのメインスレッドで行う処理を含まないので、どのスレッドから呼び出してもよい。
+     *  Do nothing if `IsLoaded() == true`.
+     */
+    void PrepareToLoad();
+    
+    //! プラグインの状態を保存してから、プラグインを解放する。
+    /*! 再び Load() を呼び出すと、保存した状態を復元する。
+     *  オーディオスレッドがこのプロセッサを処理していないときに呼び出すこと。
+     *  Do nothing if `IsLoaded() == false`.
+     */
+    void Unload();
+    
     schema::PluginDescription const & GetDescription() const { return desc_; }
     
 private:
@@ -140,6 +169,12 @@ private:
     
     virtual
     LoadResult doLoad() = 0;
+    
+    virtual
+    void doPrepareToLoad() {}
+    
+    virtual
+    void doUnload() = 0;
 };
 
 class Vst3AudioProcessor
@@ -160,6 +195,9 @@ public:
     
     //! Do nothing and return a successful LoadResult if `IsLoaded() == true`.
     LoadResult doLoad() override;
+    //! 遅延して読み込むように設定されたプラグインの状態を読み込んでおく。
+    void doPrepareToLoad() override;
+    void doUnload() override;
 
     void doOnStartProcessing(double sample_rate, SampleCount block_size) override;
     void doProcess(ProcessInfo &pi) override;
@@ -171,14 +209,56 @@ public:
     bool HasEditor() const override;
     void CheckHavingEditor();
     
+    //! @sa Vst3Plugin::TakeNumDroppedParameterChanges()
+    UInt64 TakeNumDroppedParameterChanges();
+    
     std::unique_ptr<schema::Processor> ToSchemaImpl() const override;
     
     static
     std::unique_ptr<Vst3AudioProcessor> FromSchemaImpl(schema::Processor const &schema);
     
+    using AutomationLaneList = std::vector<AutomationLane>;
+    
+    //! オートメーションを設定する。再生中に呼び出してもよい。
+    void SetAutomationLanes(AutomationLaneList lanes);
+    AutomationLaneList GetAutomationLanes() const;
+    
+    using DumpLoader = std::function<bool(schema::Processor::Vst3::Dump &dump)>;
+    
+    //! プラグインの状態を、必要になったときに読み込むように設定する。
+    /*! プロジェクトを開くときに、すべてのプラグインの状態をメモリに展開しなくて済むように、
+     *  状態はプラグインをロードするとき（またはロードされる前に保存するとき）に初めて読み込まれる。
+     *  loaderは複数のスレッドから呼び出されることがある。
+     */
+    void SetDumpLoader(DumpLoader loader);
+    
+    //! プラグインの状態を取得する。
+    /*! ToSchema()は、プラグインの状態の代わりにそのハッシュ値（dump_hash）を設定するので、
+     *  状態を保存するときは、この関数で取得した状態とハッシュ値を設定し直す。
+     *  @return プラグインがまだロードされていなくて、状態がファイルから遅延して読み込まれる場合と、
+     *  状態を取得できない場合はfalse
+     *  @param use_cache_while_editor_opened エディタが開いている間も、状態が変化したと通知されていなければ前回のダンプを返すかどうか。
+     *  自動保存のように頻繁に呼び出す場合はtrueにして、プラグインから状態を取得し直す負荷を避ける。
+     */
+    bool GetDump(schema::Processor::Vst3::Dump &dump, UInt64 &dump_hash,
+                 bool use_cache_while_editor_opened = false) const;
+    
+    //! @sa Vst3Plugin::IsEditing()
+    bool IsEditing() const;
+    
     schema::Processor schema_;
     std::shared_ptr<Vst3Plugin> plugin_;
+    //! オーディオスレッドから参照するプラグイン（plugin_が所有する）
+    /*! オーディオスレッドではshared_ptrを使わずに、このポインタからプラグインを参照する。
+     *  Unload() はオーディオ処理中にも呼び出されるので、先にこのポインタをnullptrにして、
+     *  実行中の doProcess() が抜けるのを is_in_process_ で待ってから、plugin_を解放する。
+     */
+    std::atomic<Vst3Plugin *> processing_plugin_ { nullptr };
+    //! オーディオスレッドが doProcess() を実行中かどうか
+    std::atomic<bool> is_in_process_ { false };
+    //! ロードや処理の開始・停止など、オーディオスレッド以外での操作を排他するためのロック
     LockFactory process_lock_;
+    LockFactory load_lock_;
     
     struct ProcessSetting {
         double sample_rate_;
@@ -187,8 +267,59 @@ public:
     
 private:
     std::optional<ProcessSetting> process_setting_;
+    //! 処理を開始している間の設定。 Unload() したあとに、 Load() で処理を再開するために使用する。
+    std::optional<ProcessSetting> active_process_setting_;
     // apply saved data to the plugin if it has been resumed().
-    void LoadDataImpl();
+    void LoadDataImpl(Vst3Plugin *p);
+    
+    LockFactory mutable lf_dump_loader_;
+    DumpLoader dump_loader_;
+    DumpLoader GetDumpLoader() const;
+    
+    struct AutomationData {
+        AutomationLaneList lanes_;
+        //! オーディオスレッドだけが使用する
+        std::vector<AutomationLane::Cursor> cursors_;
+    };
+    
+    //! 設定を変更するときは、新しいAutomationDataを作成して差し替える。
+    /*! オーディオスレッド以外から、lf_automation_をロックして参照する。
+     */
+    std::shared_ptr<AutomationData> automation_;
+    LockFactory mutable lf_automation_;
+    //! オーディオスレッドから参照するAutomationData（automation_が所有する）
+    /*! 差し替えるときは、このポインタを先に新しいデータに置き換えて、
+     *  実行中の doProcess() が抜けるのを is_in_process_ で待ってから、古いデータを呼び出し元のスレッドで解放する。
+     *  オーディオスレッドがAutomationDataを解放することはない。
+     */
+    std::atomic<AutomationData *> processing_automation_ { nullptr };
+    bool was_playing_ = false;
+    
+    //! 現在のフレームで変化するパラメータの値を、サンプル位置とともにプラグインに送る。
+    void ApplyAutomation(Vst3Plugin *p, ProcessInfo const &pi);
+    
+    struct StateDump
+    {
+        schema::Processor::Vst3::Dump dump_;
+        UInt64 hash_ = 0;
+    };
+    
+    //! プラグインの状態のダンプを返す。
+    /*! 前回のダンプから状態が変化していなければ、プラグインから取得し直さずに前回のダンプを返す。
+     *  （状態の取得に時間のかかるプラグインがあるため）
+     *  @param use_cache_while_editor_opened @sa GetDump()
+     *  @return 状態を取得できない場合はnullptr
+     */
+    std::shared_ptr<StateDump const> GetStateDump(Vst3Plugin &p, bool use_cache_while_editor_opened) const;
+    
+    LockFactory mutable lf_dump_cache_;
+    std::shared_ptr<StateDump const> mutable cached_dump_;
+    UInt64 mutable cached_dump_version_ = 0;
+    
+    //! アンロードしたときに保存した状態（またはスキーマに含まれていた状態）
+    /*! 次にロードしたときに復元する。schema_のdump_hashにはこのハッシュ値が設定される。
+     */
+    std::shared_ptr<StateDump const> saved_dump_;
 };
 
 //class SequenceSourceProcessor
@@ -0,0 +1,99 @@
+#include "AnticipatedAudioQueue.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+NS_HWM_BEGIN
+
+AnticipatedAudioQueue::AnticipatedAudioQueue(UInt32 num_channels, SampleCount block_size, UInt32 num_blocks)
+:   num_channels_(num_channels)
+,   block_size_(block_size)
+,   blocks_(std::max<UInt32>(num_blocks, 1))
+{
+    for(auto &block: blocks_) {
+        block.buffer_.resize(num_channels, block_size);
+    }
+}
+
+Buffer<float> * AnticipatedAudioQueue::GetWritableBlock()
+{
+    auto const pushed = num_pushed_.load(std::memory_order_relaxed);
+    auto const popped = num_popped_.load(std::memory_order_acquire);
+    if(pushed - popped >= blocks_.size()) { return nullptr; }
+
+    return &GetBlock(pushed).buffer_;
+}
+
+void AnticipatedAudioQueue::PushBlock(UInt64 generation, UInt64 position, SampleCount length)
+{
+    auto const pushed = num_pushed_.load(std::memory_order_relaxed);
+    assert(pushed - num_popped_.load(std::memory_order_acquire) < blocks_.size());
+    assert(0 < length && length <= block_size_);
+
+    auto &block = GetBlock(pushed);
+    block.generation_ = generation;
+    block.position_ = position;
+    block.length_ = length;
+
+    num_pushed_.store(pushed + 1, std::memory_order_release);
+}
+
+bool AnticipatedAudioQueue::Pop(UInt64 generation, UInt64 position, SampleCount num_samples,
+                                BufferRef<float> dest)
+{
+    auto const pushed = num_pushed_.load(std::memory_order_acquire);
+    auto popped = num_popped_.load(std::memory_order_relaxed);
+
+    // 使われなくなったブロックを破棄する。
+    // 新しい世代のブロックは、読み出し側が新しい世代で読み出すときのために残しておく。
+    for( ; popped != pushed; ++popped) {
+        auto const &block = GetBlock(popped);
+        if(block.generation_ > generation) { break; }
+        if(block.generation_ == generation && block.GetEndPosition() > position) { break; }
+    }
+    num_popped_.store(popped, std::memory_order_release);
+
+    UInt64 const end_position = position + num_samples;
+
+    // 要求された範囲のデータが、途切れずに揃っているかを確認する。
+    UInt64 pos = position;
+    for(auto i = popped; pos < end_position; ++i) {
+        if(i == pushed) { return false; }
+
+        auto const &block = GetBlock(i);
+        if(block.generation_ != generation || block.position_ > pos) { return false; }
+        pos = block.GetEndPosition();
+    }
+
+    UInt32 const num_channels = std::min<UInt32>(dest.channels(), num_channels_);
+
+    pos = position;
+    for(auto i = popped; pos < end_position; ++i) {
+        auto const &block = GetBlock(i);
+        auto const offset = (SampleCount)(pos - block.position_);
+        auto const length = (SampleCount)(std::min(block.GetEndPosition(), end_position) - pos);
+        auto const dest_offset = (SampleCount)(pos - position);
+
+        for(UInt32 ch = 0; ch < num_channels; ++ch) {
+            std::copy_n(block.buffer_.data()[ch] + offset, length,
+                        dest.get_channel_data(ch) + dest_offset);
+        }
+
+        pos += length;
+
+        if(block.GetEndPosition() <= end_position) {
+            popped = i + 1;
+        }
+    }
+
+    num_popped_.store(popped, std::memory_order_release);
+    return true;
+}
+
+UInt32 AnticipatedAudioQueue::GetNumReadableBlocks() const
+{
+    return (UInt32)(num_pushed_.load(std::memory_order_acquire)
+                    - num_popped_.load(std::memory_order_acquire));
+}
+
+NS_HWM_END
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "../misc/Buffer.hpp"
+
+NS_HWM_BEGIN
+
+//! 先行処理したオーディオデータを、オーディオスレッドに渡すためのキュー
+/*! 書き込み側（先行処理のスレッド）と読み出し側（オーディオスレッド）がそれぞれ1つずつの場合に、ロックせずに使用できる。
+ *
+ *  各ブロックには、無効化の世代（generation）と、オーディオスレッドの処理位置を基準とした先頭位置（position）を付けて書き込む。
+ *  読み出し側は、古い世代のブロックや、読み出し位置より前に終わっているブロックを破棄しながら読み出す。
+ *  これにより、編集や再生位置の移動で先行処理の結果が無効になったときも、書き込み側のキューを直接クリアせずに済む。
+ */
+class AnticipatedAudioQueue
+{
+public:
+    AnticipatedAudioQueue(UInt32 num_channels, SampleCount block_size, UInt32 num_blocks);
+
+    UInt32 GetNumChannels() const { return num_channels_; }
+    SampleCount GetBlockSize() const { return block_size_; }
+    UInt32 GetNumBlocks() const { return (UInt32)blocks_.size(); }
+
+    //! 書き込み側から呼び出す。
+    //! 書き込み可能なブロックを返す。キューに空きがない場合はnullptrを返す。
+    /*! 返されたブロックは、 PushBlock() を呼び出すまで読み出し側に公開されない。
+     */
+    Buffer<float> * GetWritableBlock();
+
+    //! 書き込み側から呼び出す。
+    //! GetWritableBlock() で取得したブロックの先頭length分を、読み出し側に公開する。
+    void PushBlock(UInt64 generation, UInt64 position, SampleCount length);
+
+    //! 読み出し側から呼び出す。
+    //! positionからnum_samples分のデータをdestに書き込む。
+    /*! generationより古い世代のブロックや、positionより前に終わっているブロックは破棄する。
+     *  （読み出し側が世代の更新を知る前に書き込まれた、新しい世代のブロックは破棄しない）
+     *  @return 指定した範囲のデータがすべて揃っている場合はtrue。
+     *  揃っていない場合はdestに何も書き込まずにfalseを返す。
+     */
+    bool Pop(UInt64 generation, UInt64 position, SampleCount num_samples, BufferRef<float> dest);
+
+    //! 読み出し可能なブロックの数
+    UInt32 GetNumReadableBlocks() const;
+
+private:
+    struct Block
+    {
+        Buffer<float> buffer_;
+        UInt64 generation_ = 0;
+        UInt64 position_ = 0;
+        SampleCount length_ = 0;
+
+        UInt64 GetEndPosition() const { return position_ + length_; }
+    };
+
+    UInt32 num_channels_ = 0;
+    SampleCount block_size_ = 0;
+    std::vector<Block> blocks_;
+    //! 書き込んだブロックの総数
+    std::atomic<UInt64> num_pushed_ { 0 };
+    //! 読み出し終えたブロックの総数
+    std::atomic<UInt64> num_popped_ { 0 };
+
+    Block & GetBlock(UInt64 index) { return blocks_[index % blocks_.size()]; }
+};
+
+NS_HWM_END
@@ -0,0 +1,95 @@
+#include "AutomationLane.hpp"
+
+#include <algorithm>
+
+NS_HWM_BEGIN
+
+namespace {
+    //! この値以下の誤差は、直線上にあるとみなす
+    double const kRampTolerance = 1e-9;
+}
+
+AutomationLane::AutomationLane(UInt32 param_id, std::vector<Breakpoint> const &points)
+:   param_id_(param_id)
+{
+    SetBreakpoints(points);
+}
+
+void AutomationLane::SetBreakpoints(std::vector<Breakpoint> const &points)
+{
+    auto sorted = points;
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](auto const &lhs, auto const &rhs) { return lhs.pos_ < rhs.pos_; });
+
+    positions_.clear();
+    values_.clear();
+    positions_.reserve(sorted.size());
+    values_.reserve(sorted.size());
+
+    for(auto const &pt: sorted) {
+        // 直前の2点を結ぶ直線の延長上に新しい点があれば、中間の点は不要なので取り除く。
+        // 同じ位置にある2点（値の不連続な変化）は残す。
+        auto const n = positions_.size();
+        if(n >= 2) {
+            auto const x0 = positions_[n-2];
+            auto const x1 = positions_[n-1];
+            auto const y0 = values_[n-2];
+            auto const y1 = values_[n-1];
+
+            if(x0 < x1 && x1 < pt.pos_) {
+                auto const expected = y0 + (pt.value_ - y0) * (double)(x1 - x0) / (double)(pt.pos_ - x0);
+                if(std::abs(expected - y1) <= kRampTolerance) {
+                    positions_.back() = pt.pos_;
+                    values_.back() = pt.value_;
+                    continue;
+                }
+            }
+        }
+
+        positions_.push_back(pt.pos_);
+        values_.push_back(pt.value_);
+    }
+}
+
+std::vector<AutomationLane::Breakpoint> AutomationLane::GetBreakpoints() const
+{
+    std::vector<Breakpoint> points;
+    points.reserve(positions_.size());
+    for(size_t i = 0; i < positions_.size(); ++i) {
+        points.emplace_back(positions_[i], values_[i]);
+    }
+
+    return points;
+}
+
+double AutomationLane::GetValueAt(double tick) const
+{
+    if(IsEmpty()) { return 0; }
+
+    Cursor cursor;
+    Seek(tick, cursor);
+    return GetValueAt(tick, cursor.index_);
+}
+
+void AutomationLane::Seek(double tick, Cursor &cursor) const
+{
+    auto const num_points = positions_.size();
+    auto &i = cursor.index_;
+    if(i > num_points) { i = num_points; }
+
+    // 通常の再生では、カーソルは前回の位置のままか、少しだけ進んでいる。
+    bool const is_after_prev = (i == 0 || positions_[i-1] <= tick);
+    if(is_after_prev) {
+        int const kMaxLinearSteps = 4;
+        for(int step = 0; step < kMaxLinearSteps; ++step) {
+            if(i == num_points || tick < positions_[i]) { return; }
+            ++i;
+        }
+    }
+
+    // シークやループによって大きく移動した場合は二分探索する。
+    i = std::upper_bound(positions_.begin(), positions_.end(), tick,
+                         [](double t, Tick pos) { return t < pos; }) - positions_.begin();
+}
+
+NS_HWM_END
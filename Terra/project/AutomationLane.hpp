@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+NS_HWM_BEGIN
+
+//! 一つのパラメータのオートメーションを表すクラス
+/*! ブレークポイントは位置順にソートされ、位置と値を別々の配列に持つ。
+ *  （位置の探索で値を読み込まないようにするため）
+ *  ブレークポイント間の値は直線補間される。
+ *  最初のブレークポイントより前と最後のブレークポイントより後は、それぞれの値を維持する。
+ */
+class AutomationLane
+{
+public:
+    struct Breakpoint
+    {
+        Breakpoint() {}
+        Breakpoint(Tick pos, double value)
+        :   pos_(pos)
+        ,   value_(value)
+        {}
+
+        Tick pos_ = 0;
+        //! [0.0 .. 1.0] に正規化された値
+        double value_ = 0;
+    };
+
+    //! オーディオスレッドでの再生位置を保持するカーソル
+    /*! 連続したEvaluate()の呼び出しでは、前回の位置から探索を始めるので、ほとんどの場合に二分探索が不要になる。
+     */
+    struct Cursor
+    {
+        //! 再生位置より後にある最初のブレークポイントのインデックス
+        size_t index_ = 0;
+        //! 最後に送信した値（まだ送信していない場合はNaN）
+        double last_value_ = std::numeric_limits<double>::quiet_NaN();
+
+        void Reset() { *this = Cursor{}; }
+    };
+
+    AutomationLane() {}
+    AutomationLane(UInt32 param_id, std::vector<Breakpoint> const &points);
+
+    UInt32 GetParamID() const { return param_id_; }
+    void SetParamID(UInt32 param_id) { param_id_ = param_id; }
+
+    //! ブレークポイントを設定する。
+    /*! ブレークポイントは位置順にソートされ、直線上に並ぶ中間のブレークポイントは取り除かれる。
+     */
+    void SetBreakpoints(std::vector<Breakpoint> const &points);
+    std::vector<Breakpoint> GetBreakpoints() const;
+
+    size_t GetNumBreakpoints() const { return positions_.size(); }
+    bool IsEmpty() const { return positions_.empty(); }
+
+    //! 指定した位置の値を返す。ブレークポイントがない場合は0を返す。
+    double GetValueAt(double tick) const;
+
+    //! [begin_tick, end_tick) の範囲を num_samples サンプルとして評価し、
+    //! プラグインに送信するべき値を f(SampleCount offset, double value) で通知する。
+    /*! 直線補間される区間は、その両端だけを通知する。
+     *  値が変化しない区間では、何も通知しない。
+     *  この関数はメモリ確保を行わないので、オーディオスレッドから呼び出せる。
+     */
+    template<class F>
+    void Evaluate(double begin_tick, double end_tick, SampleCount num_samples, Cursor &cursor, F f) const
+    {
+        if(IsEmpty() || num_samples <= 0 || end_tick <= begin_tick) { return; }
+
+        auto const num_points = positions_.size();
+        auto const tick_to_offset = [&](double tick) {
+            auto const offset = (SampleCount)std::floor((tick - begin_tick) / (end_tick - begin_tick) * num_samples);
+            return std::max<SampleCount>(0, std::min<SampleCount>(offset, num_samples - 1));
+        };
+
+        auto const emit = [&](SampleCount offset, double value) {
+            if(value == cursor.last_value_) { return; }
+            f(offset, value);
+            cursor.last_value_ = value;
+        };
+
+        Seek(begin_tick, cursor);
+        emit(0, GetValueAt(begin_tick, cursor.index_));
+
+        for( ; cursor.index_ < num_points && positions_[cursor.index_] < end_tick; ++cursor.index_) {
+            emit(tick_to_offset(positions_[cursor.index_]), values_[cursor.index_]);
+        }
+
+        // 区間の終わりが直線補間の途中にある場合は、最後のサンプルの位置の値を送信する。
+        // （end_tickは次の区間の先頭のサンプルの位置なので、その値を最後のサンプルで送信すると1サンプル遅れる）
+        if(0 < cursor.index_ && cursor.index_ < num_points) {
+            auto const last_tick = begin_tick + (end_tick - begin_tick) * (num_samples - 1) / num_samples;
+            emit(num_samples - 1, GetValueAt(last_tick, cursor.index_));
+        }
+    }
+
+private:
+    UInt32 param_id_ = 0;
+    std::vector<Tick> positions_;
+    std::vector<double> values_;
+
+    //! tickより後にある最初のブレークポイントのインデックスをcursorに設定する
+    void Seek(double tick, Cursor &cursor) const;
+
+    //! @param index tickより後にある最初のブレークポイントのインデックス
+    double GetValueAt(double tick, size_t index) const
+    {
+        if(index == 0) { return values_.front(); }
+        if(index >= positions_.size()) { return values_.back(); }
+
+        auto const x0 = (double)positions_[index-1];
+        auto const x1 = (double)positions_[index];
+        auto const y0 = values_[index-1];
+        auto const y1 = values_[index];
+
+        return y0 + (y1 - y0) * (tick - x0) / (x1 - x0);
+    }
+};
+
+NS_HWM_END
@@ -1,4 +1,10 @@
 #include "./GraphProcessor.hpp"
+
+#include <chrono>
+#include <set>
+
+#include "../device/ProcessingStatistics.hpp"
+#include "./AnticipatedAudioQueue.hpp"
 #include "../processor/EventBuffer.hpp"
 #include "../misc/StrCnv.hpp"
 #include "../file/ProjectObjectTable.hpp"
@@ -220,6 +226,9 @@ public:
         ref_ = buf;
     }
     
+    void SetLive(bool is_live) override { is_live_ = is_live; }
+    bool IsLive() const override { return is_live_; }
+    
     String GetName() const override { return name_; }
     
     UInt32 GetMidiChannelCount(BusDirection dir) const override
@@ -266,6 +275,7 @@ private:
     String name_;
     std::function<void(MidiInput *, ProcessInfo const &)> callback_;
     BufferType ref_;
+    bool is_live_ = true;
 };
 
 class MidiOutputImpl : public GraphProcessor::MidiOutput
@@ -342,6 +352,15 @@ NodeImpl const * ToNodeImpl(GraphProcessor::Node const *node);
 GraphProcessor::Node::Node() {}
 GraphProcessor::Node::~Node() {}
 
+//! オーディオスレッドの処理で、先行処理されたノードの出力を読み出すための情報
+struct AnticipationReadContext
+{
+    UInt64 generation_ = 0;
+    UInt64 position_ = 0;
+    //! 先行処理の出力が間に合っていなかった場合はtrue
+    bool underrun_ = false;
+};
+
 class NodeImpl
 :   public GraphProcessor::Node
 {
@@ -354,6 +373,8 @@ public:
     
     NodeImpl(std::shared_ptr<Processor> processor)
     :   processor_(std::move(processor))
+    ,   output_meter_(processor_->GetAudioChannelCount(BusDirection::kOutputSide))
+    ,   anticipated_meter_(output_meter_.GetNumChannels())
     {}
     
     ~NodeImpl()
@@ -504,6 +525,11 @@ public:
         return result;
     }
     
+    AudioMeter const & GetOutputMeter() const override
+    {
+        return output_meter_;
+    }
+    
     void AddConnection(GraphProcessor::AudioConnectionPtr conn, BusDirection dir)
     {
         auto &audio = editable_connections_.audio_;
@@ -561,6 +587,12 @@ public:
     
     void OnStartProcessing(double sample_rate, SampleCount block_size)
     {
+        output_meter_.SetSampleRate(sample_rate);
+        output_meter_.Reset();
+        anticipated_meter_.SetSampleRate(sample_rate);
+        anticipated_meter_.Reset();
+        if(anticipated_levels_) { anticipated_levels_->Clear(); }
+        
         process_started_.store(true);
         
         sample_rate_ = sample_rate;
@@ -569,13 +601,17 @@ public:
         PrepareBuffers();
     }
     
-    void ProcessOnce(SampleCount num_samples)
+    //! @param ctx オーディオスレッドから呼び出す場合は、先行処理されたノードの出力を読み出すための情報を渡す。
+    //! 先行処理のスレッドから呼び出す場合はnullptr
+    void ProcessOnce(SampleCount num_samples, AnticipationReadContext *ctx)
     {
         if(process_started_.load() == false) { return; }
         
         if(processed_) { return; }
         else { processed_ = true; }
         
+        process_duration_ = 0;
+        
         auto pconn = std::atomic_load(&playback_connections_);
         if(!pconn) { return; }
         
@@ -584,12 +620,21 @@ public:
         auto callback = MakeTraversalCallback([&, this](TransportInfo const &ti) {
             auto const len = (UInt32)ti.play_.duration_.sample_;
             
-            auto process_upstream = [len](auto &upstream_conn) {
-                ToNodeImpl(upstream_conn->upstream_)->ProcessOnce(len);
+            auto process_upstream = [len, ctx, this](auto &upstream_conn) {
+                auto up = ToNodeImpl(upstream_conn->upstream_);
+                if(up->IsAnticipated() && IsAnticipated() == false) {
+                    assert(ctx);
+                    up->ReadAnticipatedOutputOnce(len, *ctx);
+                } else {
+                    up->ProcessOnce(len, ctx);
+                }
             };
             
-            for_each(pconn->audio_.input_, process_upstream);
-            for_each(pconn->midi_.input_, process_upstream);
+            // フリーズしたノードは、上流のノードを処理せずに、ストリームから出力を読み出す。
+            if(IsFrozen() == false) {
+                for_each(pconn->audio_.input_, process_upstream);
+                for_each(pconn->midi_.input_, process_upstream);
+            }
             
             input_event_buffers_.ApplyCachedNoteOffs();
             
@@ -616,7 +661,26 @@ public:
             pi.input_event_buffers_ = &input_event_buffers_;
             pi.output_event_buffers_ = &output_event_buffers_;
             
-            processor_->Process(pi);
+            auto const process_begin = std::chrono::steady_clock::now();
+            if(IsFrozen()) {
+                frozen_output_->Read(ti, pi.output_audio_buffer_);
+                processor_->ApplyGainFader(pi);
+            } else if(renders_pre_fader_) {
+                processor_->ProcessPreFader(pi);
+            } else {
+                processor_->Process(pi);
+            }
+            process_duration_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - process_begin).count();
+            
+            // オフラインレンダリングの出力は、再生中のレベルとして表示しない。
+            // 先行処理の出力のレベルは、オーディオスレッドがその位置を処理するまで公開しない。
+            if(is_rendering_) {
+                // do nothing.
+            } else if(IsAnticipated()) {
+                anticipated_meter_.Process(pi.output_audio_buffer_);
+            } else {
+                output_meter_.Process(pi.output_audio_buffer_);
+            }
             
             // ProcessOnceは、upstreamに遡るにつれてレイテンシの分だけ先読み量が増えるので、単にAddAudioするのでは足し合わせるオーディオの位置がずれる。
             // なので、何らかの方法で先読み量を取得できるようにし、AddAudio/AddMidiにその量を渡せるようにしたい。
@@ -627,6 +691,8 @@ public:
             = [&](GraphProcessor::AudioConnectionPtr const &c) {
                 auto up = ToNodeImpl(c->upstream_);
                 auto down = ToNodeImpl(c->downstream_);
+                
+                if(ShouldDeliverTo(down) == false) { return; }
 
                 BufferRef<float const> ref {
                     up->output_audio_buffer_, c->upstream_channel_index_,
@@ -643,6 +709,8 @@ public:
                 auto up = ToNodeImpl(c->upstream_);
                 auto down = ToNodeImpl(c->downstream_);
                 
+                if(ShouldDeliverTo(down) == false) { return; }
+                
                 down->AddMidi(up->output_event_buffers_.GetRef(c->upstream_channel_index_),
                               c->downstream_channel_index_,
                               num_processed);
@@ -660,12 +728,73 @@ public:
         tv.Traverse(processor_->GetTransporter(), num_samples, &callback);
     }
     
+    //! このノードの出力を、downstreamに渡すかどうか。
+    bool ShouldDeliverTo(NodeImpl const *downstream) const
+    {
+        // 処理されないノードには渡さない。
+        if(downstream->is_bypassed_by_freeze_) { return false; }
+        if(downstream->is_rendering_ != is_rendering_) { return false; }
+        
+        // 先行処理の対象のノードからライブ処理の対象のノードへの出力は、キューを介して渡す。
+        return downstream->IsAnticipated() == IsAnticipated();
+    }
+    
+    //! 先行処理のスレッドで処理された出力をキューから取り出し、ライブ処理の対象の下流のノードに渡す。
+    void ReadAnticipatedOutputOnce(SampleCount num_samples, AnticipationReadContext &ctx)
+    {
+        if(process_started_.load() == false) { return; }
+        
+        if(anticipated_output_read_) { return; }
+        else { anticipated_output_read_ = true; }
+        
+        auto pconn = std::atomic_load(&playback_connections_);
+        if(!pconn || !anticipated_output_) { return; }
+        
+        auto &buf = anticipated_output_buffer_;
+        BufferRef<float> dest { buf, 0, buf.channels(), 0, (UInt32)num_samples };
+        if(anticipated_output_->Pop(ctx.generation_, ctx.position_, num_samples, dest) == false) {
+            dest.fill(0);
+            ctx.underrun_ = true;
+        }
+        
+        for(auto const &c: pconn->audio_.output_) {
+            auto down = ToNodeImpl(c->downstream_);
+            if(down->IsAnticipated() || down->is_bypassed_by_freeze_) { continue; }
+            
+            BufferRef<float const> ref {
+                buf, c->upstream_channel_index_, c->num_channels_, 0, (UInt32)num_samples
+            };
+            down->AddAudio(ref, c->downstream_channel_index_, 0);
+        }
+    }
+    
+    //! 先行処理のスレッドで処理した出力を、キューに追加するブロックに書き込む。
+    void WriteAnticipatedOutput(SampleCount offset, SampleCount num_samples)
+    {
+        if(!anticipated_output_) { return; }
+        
+        auto block = anticipated_output_->GetWritableBlock();
+        assert(block);
+        
+        auto const num_channels = std::min(block->channels(), output_audio_buffer_.channels());
+        for(UInt32 ch = 0; ch < num_channels; ++ch) {
+            std::copy_n(output_audio_buffer_.data()[ch], num_samples, block->data()[ch] + offset);
+        }
+    }
+    
+    bool IsAnticipated() const { return is_anticipated_.load(std::memory_order_relaxed); }
+    
+    bool IsFrozen() const { return frozen_output_ != nullptr; }
+    
     void OnStopProcessing()
     {
         processor_->OnStopProcessing();
         sample_rate_ = 0;
         block_size_ = 0;
         process_started_.store(false);
+        output_meter_.Reset();
+        anticipated_meter_.Reset();
+        if(anticipated_levels_) { anticipated_levels_->Clear(); }
     }
     
     void PrepareBuffers()
@@ -682,6 +811,8 @@ public:
         
         input_event_buffers_.SetNumBuffers(num_event_inputs);
         output_event_buffers_.SetNumBuffers(num_event_outputs);
+        
+        anticipated_output_buffer_.resize(num_audio_outputs, block_size_);
     }
     
     void PopInputData(SampleCount len)
@@ -713,6 +844,30 @@ public:
         processed_ = false;
     }
     
+    void ClearAnticipatedOutput()
+    {
+        anticipated_output_read_ = false;
+    }
+    
+    //! 先行処理のスレッドから呼び出す。
+    //! 直前に処理したブロックの出力のレベルを、そのブロックの終わりの位置を付けてキューに追加する。
+    void PushAnticipatedLevels(UInt64 generation, UInt64 end_position)
+    {
+        if(!anticipated_levels_ || !processed_) { return; }
+        
+        // キューが一杯の場合は、オーディオスレッドが追いつくまでこのブロックのレベルを表示しない。
+        anticipated_levels_->Push(generation, end_position, anticipated_meter_);
+    }
+    
+    //! オーディオスレッドから呼び出す。
+    //! 先行処理したレベルのうち、positionまでに再生されたものをoutput_meter_に公開する。
+    void PublishAnticipatedLevels(UInt64 generation, UInt64 position)
+    {
+        if(!anticipated_levels_) { return; }
+        
+        anticipated_levels_->PublishUntil(generation, position, output_meter_);
+    }
+    
     void AddAudio(BufferRef<float const> src, Int32 channel_to_write_from, SampleCount sample_to_write_from)
     {
         auto &dest = input_audio_buffer_;
@@ -754,6 +909,17 @@ public:
     }
     
     std::shared_ptr<Processor> processor_;
+    //! ノードの出力のレベル。オーディオスレッドだけが更新する。
+    /*! 先行処理の対象のノードでは、anticipated_levels_から、再生された位置のレベルを公開する。
+     *  Reset() は、処理を開始・停止するとき（オーディオスレッドが処理していないとき）か、
+     *  先行処理のスレッドとオーディオスレッドの両方のロックを取得しているときにだけ呼び出す。
+     */
+    AudioMeter output_meter_;
+    //! 先行処理の対象のノードの出力のレベルを計算する。先行処理のスレッドだけが更新する。
+    AudioMeter anticipated_meter_;
+    //! 先行処理の対象のノードで、anticipated_meter_で計算したレベルをオーディオスレッドに渡すためのキュー
+    //! 先行処理のスレッドとオーディオスレッドの両方のロックを取得してから変更する。
+    std::unique_ptr<AudioLevelQueue> anticipated_levels_;
     
     struct ConnectionSet {
         template<class ConnectionPtrType>
@@ -797,6 +963,31 @@ public:
     EventBufferList input_event_buffers_;
     EventBufferList output_event_buffers_;
     bool processed_ = false;
+    //! 直前の ProcessOnce() で、processor_の処理にかかった時間（秒）
+    double process_duration_ = 0;
+    
+    //! 先行処理の対象になっているかどうか。
+    //! 先行処理のスレッドとオーディオスレッドの両方のロックを取得してから変更する。
+    std::atomic<bool> is_anticipated_ = false;
+    //! 先行処理の対象のノードのうち、下流に先行処理の対象のノードがないもの。
+    //! 先行処理のスレッドは、これらのノードから上流に遡って処理する。
+    bool is_anticipation_root_ = false;
+    //! ライブ処理の対象のノードへ出力する、先行処理の対象のノードの場合に、出力を渡すためのキュー
+    std::unique_ptr<AnticipatedAudioQueue> anticipated_output_;
+    //! オーディオスレッドで、キューから取り出した出力
+    Buffer<float> anticipated_output_buffer_;
+    bool anticipated_output_read_ = false;
+    
+    //! フリーズしたノードの場合に、プロセッサの代わりに出力を読み出すストリーム
+    //! 先行処理のスレッドとオーディオスレッドの両方のロックを取得してから変更する。
+    AudioFileStreamer::StreamPtr frozen_output_;
+    //! フリーズしたノードの上流にあるために、処理されないノードかどうか。
+    //! 先行処理のスレッドとオーディオスレッドの両方のロックを取得してから変更する。
+    bool is_bypassed_by_freeze_ = false;
+    //! GraphProcessor::RenderOffline() で処理しているノードかどうか。
+    bool is_rendering_ = false;
+    //! GraphProcessor::RenderOffline() で、ゲインフェーダーを適用せずに処理するノードかどうか。
+    bool renders_pre_fader_ = false;
 };
 
 NodeImpl * ToNodeImpl(GraphProcessor::Node *node)
@@ -872,14 +1063,189 @@ struct GraphProcessor::Impl
     
     LockFactory lf_;
     
+    //! 先行処理のスレッドが処理中に保持するロック
+    /*! lf_と両方を取得する場合は、オーディオスレッドを待たせないように、こちらを先に取得する。
+     */
+    LockFactory anticipation_lf_;
+    bool anticipation_started_ = false;
+    SampleCount anticipation_block_size_ = 0;
+    UInt32 num_anticipated_blocks_ = 0;
+    std::atomic<UInt64> anticipation_generation_ = 0;
+    std::atomic<UInt64> num_anticipation_underruns_ = 0;
+    //! Process() で処理したサンプル数の合計
+    std::atomic<UInt64> processed_position_ = 0;
+    
     void UpdatePlaybackGraph()
     {
         for(auto node: nodes_) {
             node->ReplacePlaybackConnectionSet(node->DuplicateConnectionSet());
         }
         
+        auto anticipation_lock = anticipation_lf_.make_lock();
         //! make sure that Process() function is finished.
         auto lock = lf_.make_lock();
+        
+        UpdateFreeze();
+        UpdateAnticipation();
+    }
+    
+    //! フリーズしたノードによって処理されなくなるノードを決め直す。
+    /*! 出力がすべて、フリーズしたノードか、処理されなくなったノードに繋がっているノードは処理しない。
+     *  anticipation_lf_とlf_の両方のロックを取得してから呼び出すこと。
+     */
+    void UpdateFreeze()
+    {
+        for(auto const &node: nodes_) { node->is_bypassed_by_freeze_ = false; }
+        
+        bool const has_frozen_node
+        = std::any_of(nodes_.begin(), nodes_.end(), [](auto const &node) { return node->IsFrozen(); });
+        if(has_frozen_node == false) { return; }
+        
+        auto is_skipped = [](GraphProcessor::Node const *node) {
+            auto p = ToNodeImpl(node);
+            return p->IsFrozen() || p->is_bypassed_by_freeze_;
+        };
+        
+        for(bool changed = true; changed; ) {
+            changed = false;
+            for(auto const &node: nodes_) {
+                if(node->IsFrozen() || node->is_bypassed_by_freeze_) { continue; }
+                
+                auto const audio_outputs = node->GetAudioConnections(BusDirection::kOutputSide);
+                auto const midi_outputs = node->GetMidiConnections(BusDirection::kOutputSide);
+                if(audio_outputs.empty() && midi_outputs.empty()) { continue; }
+                
+                bool const bypassed
+                =  std::all_of(audio_outputs.begin(), audio_outputs.end(), [&](auto const &c) { return is_skipped(c->downstream_); })
+                && std::all_of(midi_outputs.begin(), midi_outputs.end(), [&](auto const &c) { return is_skipped(c->downstream_); });
+                
+                if(bypassed) {
+                    node->is_bypassed_by_freeze_ = true;
+                    changed = true;
+                }
+            }
+        }
+        
+        // 処理されなくなったノードのメーターが、最後のレベルのまま止まらないようにする。
+        for(auto const &node: nodes_) {
+            if(node->is_bypassed_by_freeze_) { node->output_meter_.Reset(); }
+        }
+    }
+    
+    //! ノードを、先行処理の対象とライブ処理の対象に分類し直す。
+    /*! anticipation_lf_とlf_の両方のロックを取得してから呼び出すこと。
+     */
+    void UpdateAnticipation()
+    {
+        std::set<NodeImpl const *> live_nodes;
+        
+        auto is_live = [&](GraphProcessor::Node const *node) {
+            return live_nodes.count(ToNodeImpl(node)) != 0;
+        };
+        
+        //! 出力を受け取るライブ処理の対象のノードかどうか（処理されないノードを除く）
+        auto is_live_receiver = [&](GraphProcessor::Node const *node) {
+            return is_live(node) && ToNodeImpl(node)->is_bypassed_by_freeze_ == false;
+        };
+        
+        for(auto const &node: nodes_) {
+            auto proc = node->GetProcessor().get();
+            bool live = (anticipation_started_ == false);
+            live = live || dynamic_cast<AudioInput const *>(proc);
+            live = live || dynamic_cast<AudioOutput const *>(proc);
+            live = live || dynamic_cast<MidiOutput const *>(proc);
+            if(auto p = dynamic_cast<MidiInput const *>(proc)) {
+                live = live || p->IsLive();
+            }
+            // フリーズによって処理されないノードは、先行処理のスレッドでも処理しない。
+            live = live || node->is_bypassed_by_freeze_;
+            
+            if(live) { live_nodes.insert(node.get()); }
+        }
+        
+        // ライブ処理の対象のノードの下流のノードと、ライブ処理の対象のノードへMIDIを出力するノードは、
+        // ライブ処理の対象にする。（先行処理したMIDIメッセージはキューで渡せないため）
+        for(bool changed = true; changed; ) {
+            changed = false;
+            for(auto const &node: nodes_) {
+                if(is_live(node.get())) { continue; }
+                // フリーズしたノードは、上流のノードの出力を使用しない。
+                if(node->IsFrozen()) { continue; }
+                
+                auto const audio_inputs = node->GetAudioConnections(BusDirection::kInputSide);
+                auto const midi_inputs = node->GetMidiConnections(BusDirection::kInputSide);
+                auto const midi_outputs = node->GetMidiConnections(BusDirection::kOutputSide);
+                
+                bool const live
+                =  std::any_of(audio_inputs.begin(), audio_inputs.end(), [&](auto const &c) { return is_live(c->upstream_); })
+                || std::any_of(midi_inputs.begin(), midi_inputs.end(), [&](auto const &c) { return is_live(c->upstream_); })
+                || std::any_of(midi_outputs.begin(), midi_outputs.end(), [&](auto const &c) { return is_live_receiver(c->downstream_); });
+                
+                if(live) {
+                    live_nodes.insert(node.get());
+                    changed = true;
+                }
+            }
+        }
+        
+        for(auto const &node: nodes_) {
+            bool const anticipated = (is_live(node.get()) == false);
+            
+            // 先行処理の対象になるノードのレベルは、それまでのレベルから続けて計算する。
+            if(anticipated && node->IsAnticipated() == false) {
+                std::vector<AudioMeter::Level> levels(node->output_meter_.GetNumChannels());
+                node->output_meter_.GetLevels(levels.data());
+                node->anticipated_meter_.SetLevels(levels.data());
+            }
+            
+            auto const num_meter_channels = node->output_meter_.GetNumChannels();
+            auto &levels = node->anticipated_levels_;
+            if(anticipated && num_meter_channels > 0) {
+                // 先行処理のスレッドは、オーディオスレッドより最大でnum_anticipated_blocks_だけ先に進む。
+                auto const capacity = std::max<UInt32>(num_anticipated_blocks_ * 2, 2);
+                if(!levels || levels->GetCapacity() != capacity) {
+                    levels = std::make_unique<AudioLevelQueue>(num_meter_channels, capacity);
+                } else {
+                    levels->Clear();
+                }
+            } else {
+                levels.reset();
+            }
+            
+            node->is_anticipated_.store(anticipated);
+            listeners_.Invoke([&](GraphProcessor::Listener *li) {
+                li->OnAnticipationUpdated(node.get(), anticipated);
+            });
+            
+            auto const audio_outputs = node->GetAudioConnections(BusDirection::kOutputSide);
+            auto const midi_outputs = node->GetMidiConnections(BusDirection::kOutputSide);
+            
+            bool const has_live_audio_output
+            = std::any_of(audio_outputs.begin(), audio_outputs.end(), [&](auto const &c) { return is_live_receiver(c->downstream_); });
+            
+            node->is_anticipation_root_
+            =   anticipated
+            &&  std::none_of(audio_outputs.begin(), audio_outputs.end(), [&](auto const &c) { return !is_live(c->downstream_); })
+            &&  std::none_of(midi_outputs.begin(), midi_outputs.end(), [&](auto const &c) { return !is_live(c->downstream_); });
+            
+            if(anticipated && has_live_audio_output) {
+                auto const num_channels = node->GetProcessor()->GetAudioChannelCount(BusDirection::kOutputSide);
+                auto &queue = node->anticipated_output_;
+                if(!queue
+                   || queue->GetNumChannels() != num_channels
+                   || queue->GetBlockSize() != anticipation_block_size_
+                   || queue->GetNumBlocks() != num_anticipated_blocks_)
+                {
+                    queue = std::make_unique<AnticipatedAudioQueue>(num_channels,
+                                                                    anticipation_block_size_,
+                                                                    num_anticipated_blocks_);
+                }
+            } else {
+                node->anticipated_output_.reset();
+            }
+        }
+        
+        anticipation_generation_.fetch_add(1);
     }
     
     ListenerService<GraphProcessor::Listener> listeners_;
@@ -1002,6 +1368,7 @@ void GraphProcessor::StartProcessing(double sample_rate, SampleCount block_size)
     
     pimpl_->sample_rate_ = sample_rate;
     pimpl_->block_size_ = block_size;
+    pimpl_->processed_position_.store(0);
     for(auto &node: pimpl_->nodes_) {
         ToNodeImpl(node.get())->OnStartProcessing(sample_rate, block_size);
     }
@@ -1010,19 +1377,40 @@ void GraphProcessor::StartProcessing(double sample_rate, SampleCount block_size)
 }
 
 void GraphProcessor::Process(SampleCount num_samples)
+{
+    Process(num_samples, nullptr);
+}
+
+void GraphProcessor::Process(SampleCount num_samples, IPrepareCallback *prepare)
 {
     auto lock = pimpl_->lf_.make_lock();
     
+    // UpdateAnticipation() はlf_を取得して呼び出されるので、ここからは先行処理の対象が変わらない。
+    if(prepare) { prepare->Prepare(); }
+    
+    AnticipationReadContext ctx;
+    ctx.generation_ = pimpl_->anticipation_generation_.load();
+    ctx.position_ = pimpl_->processed_position_.load(std::memory_order_relaxed);
+    
+    auto const ti = GetTransportInfo();
+    
+    // 先行処理の対象のノードは、先行処理のスレッドが処理する。
     for(auto const &node: pimpl_->nodes_) {
-        node->Clear();
+        if(node->IsAnticipated()) {
+            node->ClearAnticipatedOutput();
+            node->PublishAnticipatedLevels(ctx.generation_, ctx.position_ + num_samples);
+        } else {
+            node->Clear();
+            node->processor_->SetTransportInfoWithPlaybackPosition(ti);
+        }
     }
     
     for(auto const &node: pimpl_->nodes_) {
-        if(node->HasConnections(BusDirection::kOutputSide)) {
+        if(node->IsAnticipated() || node->HasConnections(BusDirection::kOutputSide)) {
             continue;
         }
         
-        node->ProcessOnce(num_samples);
+        node->ProcessOnce(num_samples, &ctx);
     }
     
     for(auto const &node: pimpl_->nodes_) {
@@ -1030,6 +1418,256 @@ void GraphProcessor::Process(SampleCount num_samples)
             p->ProcessPostFader();
         }        
     }
+    
+    if(ctx.underrun_) {
+        pimpl_->num_anticipation_underruns_.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    pimpl_->processed_position_.store(ctx.position_ + num_samples, std::memory_order_relaxed);
+}
+
+void GraphProcessor::StartAnticipativeProcessing(SampleCount block_size, UInt32 num_blocks)
+{
+    assert(block_size <= pimpl_->block_size_);
+    
+    auto anticipation_lock = pimpl_->anticipation_lf_.make_lock();
+    auto lock = pimpl_->lf_.make_lock();
+    
+    pimpl_->anticipation_started_ = true;
+    pimpl_->anticipation_block_size_ = block_size;
+    pimpl_->num_anticipated_blocks_ = num_blocks;
+    pimpl_->UpdateAnticipation();
+}
+
+void GraphProcessor::StopAnticipativeProcessing()
+{
+    auto anticipation_lock = pimpl_->anticipation_lf_.make_lock();
+    auto lock = pimpl_->lf_.make_lock();
+    
+    pimpl_->anticipation_started_ = false;
+    pimpl_->UpdateAnticipation();
+}
+
+bool GraphProcessor::IsAnticipativeProcessingStarted() const
+{
+    auto anticipation_lock = pimpl_->anticipation_lf_.make_lock();
+    return pimpl_->anticipation_started_;
+}
+
+void GraphProcessor::InvalidateAnticipatedData()
+{
+    pimpl_->anticipation_generation_.fetch_add(1);
+}
+
+UInt64 GraphProcessor::GetAnticipationGeneration() const
+{
+    return pimpl_->anticipation_generation_.load();
+}
+
+UInt64 GraphProcessor::GetProcessedPosition() const
+{
+    return pimpl_->processed_position_.load(std::memory_order_relaxed);
+}
+
+UInt64 GraphProcessor::GetNumAnticipationUnderruns() const
+{
+    return pimpl_->num_anticipation_underruns_.load(std::memory_order_relaxed);
+}
+
+bool GraphProcessor::ProcessAnticipated(Transporter *tp,
+                                        UInt64 generation,
+                                        UInt64 position,
+                                        std::function<void(TransportInfo const &ti)> const &prepare)
+{
+    auto lock = pimpl_->anticipation_lf_.make_lock();
+    
+    if(pimpl_->anticipation_started_ == false) { return false; }
+    
+    // オーディオスレッドより先に進みすぎないようにする。（キューを持つノードがない場合にも必要）
+    auto const limit
+    = pimpl_->processed_position_.load(std::memory_order_relaxed)
+    + pimpl_->anticipation_block_size_ * pimpl_->num_anticipated_blocks_;
+    if(position >= limit) { return false; }
+    
+    // キューはオーディオスレッドがそれぞれ読み出すので、すべてのキューに空きがあるときだけ処理する。
+    for(auto const &node: pimpl_->nodes_) {
+        if(node->anticipated_output_ && node->anticipated_output_->GetWritableBlock() == nullptr) {
+            return false;
+        }
+    }
+    
+    SampleCount num_processed = 0;
+    
+    auto cb = MakeTraversalCallback([&, this](TransportInfo const &ti) {
+        auto const len = ti.play_.duration_.sample_;
+        
+        prepare(ti);
+        
+        for(auto const &node: pimpl_->nodes_) {
+            if(node->IsAnticipated()) {
+                node->Clear();
+                node->processor_->SetTransportInfoWithPlaybackPosition(ti);
+            }
+        }
+        
+        for(auto const &node: pimpl_->nodes_) {
+            if(node->is_anticipation_root_) { node->ProcessOnce(len, nullptr); }
+        }
+        
+        for(auto const &node: pimpl_->nodes_) {
+            node->WriteAnticipatedOutput(num_processed, len);
+        }
+        
+        num_processed += len;
+    });
+    
+    Transporter::Traverser tv;
+    tv.Traverse(tp, pimpl_->anticipation_block_size_, &cb);
+    
+    for(auto const &node: pimpl_->nodes_) {
+        if(node->anticipated_output_) {
+            node->anticipated_output_->PushBlock(generation, position, num_processed);
+        }
+        node->PushAnticipatedLevels(generation, position + num_processed);
+    }
+    
+    return true;
+}
+
+void GraphProcessor::SetFrozenOutput(Node const *node, AudioFileStreamer::StreamPtr stream)
+{
+    auto found = std::find_if(pimpl_->nodes_.begin(), pimpl_->nodes_.end(),
+                              [node](auto const &x) { return x.get() == node; });
+    if(found == pimpl_->nodes_.end()) { return; }
+    
+    auto anticipation_lock = pimpl_->anticipation_lf_.make_lock();
+    auto lock = pimpl_->lf_.make_lock();
+    
+    (*found)->frozen_output_ = std::move(stream);
+    pimpl_->UpdateFreeze();
+    pimpl_->UpdateAnticipation();
+}
+
+bool GraphProcessor::IsFrozen(Node const *node) const
+{
+    return ToNodeImpl(node)->IsFrozen();
+}
+
+bool GraphProcessor::IsBypassedByFreeze(Node const *node) const
+{
+    return ToNodeImpl(node)->is_bypassed_by_freeze_;
+}
+
+bool GraphProcessor::RenderOffline(Node const *node,
+                                   double sample_rate,
+                                   SampleCount block_size,
+                                   Transporter *tp,
+                                   SampleCount length,
+                                   std::function<void(TransportInfo const &ti)> const &prepare,
+                                   std::function<bool(BufferRef<float const> output)> const &write)
+{
+    assert(sample_rate > 0 && block_size > 0);
+    
+    auto anticipation_lock = pimpl_->anticipation_lf_.make_lock();
+    auto lock = pimpl_->lf_.make_lock();
+    
+    if(pimpl_->prepared_) { return false; }
+    
+    auto found = std::find_if(pimpl_->nodes_.begin(), pimpl_->nodes_.end(),
+                              [node](auto const &x) { return x.get() == node; });
+    if(found == pimpl_->nodes_.end()) { return false; }
+    
+    auto root = found->get();
+    
+    // nodeと、その上流のノードを集める。
+    std::vector<NodeImpl *> targets { root };
+    for(size_t i = 0; i < targets.size(); ++i) {
+        auto add_upstream = [&](auto const &c) {
+            auto up = ToNodeImpl(c->upstream_);
+            if(std::find(targets.begin(), targets.end(), up) == targets.end()) {
+                targets.push_back(up);
+            }
+        };
+        
+        auto audio_inputs = targets[i]->GetAudioConnections(BusDirection::kInputSide);
+        auto midi_inputs = targets[i]->GetMidiConnections(BusDirection::kInputSide);
+        for_each(audio_inputs, add_upstream);
+        for_each(midi_inputs, add_upstream);
+    }
+    
+    for(auto target: targets) {
+        target->is_rendering_ = true;
+        target->OnStartProcessing(sample_rate, block_size);
+    }
+    root->renders_pre_fader_ = true;
+    
+    auto const num_channels = root->output_audio_buffer_.channels();
+    bool canceled = false;
+    
+    auto cb = MakeTraversalCallback([&](TransportInfo const &ti) {
+        if(canceled) { return; }
+        
+        auto const len = (UInt32)ti.play_.duration_.sample_;
+        
+        prepare(ti);
+        
+        for(auto target: targets) {
+            target->Clear();
+            target->processor_->SetTransportInfoWithPlaybackPosition(ti);
+        }
+        
+        root->ProcessOnce(len, nullptr);
+        
+        canceled = !write(BufferRef<float const>{ root->output_audio_buffer_, 0, num_channels, 0, len });
+    });
+    
+    for(SampleCount remain = length; remain > 0 && !canceled; ) {
+        auto const len = std::min(remain, block_size);
+        Transporter::Traverser tv;
+        tv.Traverse(tp, len, &cb);
+        remain -= len;
+    }
+    
+    for(auto target: targets) {
+        target->Clear();
+        target->OnStopProcessing();
+        target->is_rendering_ = false;
+    }
+    root->renders_pre_fader_ = false;
+    
+    return !canceled;
+}
+
+void GraphProcessor::GetProcessingDetails(ProcessingIncident &incident) const
+{
+    auto &slowest = incident.slowest_nodes_;
+    UInt32 num_slowest = 0;
+    incident.num_active_nodes_ = 0;
+    incident.num_slowest_nodes_ = 0;
+    
+    // オーディオスレッドから呼び出されるので、グラフの編集中はロックを待たずに、詳細の記録を省略する。
+    auto lock = pimpl_->lf_.try_make_lock();
+    if(!lock) { return; }
+    
+    // 上位数件だけを求めればよいので、挿入ソートで処理時間の降順に並べる。
+    for(auto const &node: pimpl_->nodes_) {
+        // 先行処理の対象のノードは、別のスレッドで処理されている。
+        if(node->IsAnticipated() || node->processed_ == false) { continue; }
+        incident.num_active_nodes_ += 1;
+        
+        auto const duration = node->process_duration_;
+        if(num_slowest == slowest.size() && slowest.back().duration_ >= duration) { continue; }
+        
+        UInt32 pos = std::min<UInt32>(num_slowest, slowest.size() - 1);
+        for( ; pos > 0 && slowest[pos - 1].duration_ < duration; --pos) {
+            slowest[pos] = slowest[pos - 1];
+        }
+        slowest[pos].node_id_ = node->GetID();
+        slowest[pos].duration_ = duration;
+        num_slowest = std::min<UInt32>(num_slowest + 1, slowest.size());
+    }
+    
+    incident.num_slowest_nodes_ = num_slowest;
 }
 
 void GraphProcessor::StopProcessing()
@@ -1059,7 +1697,12 @@ GraphProcessor::NodePtr GraphProcessor::AddNode(std::shared_ptr<Processor> proce
     auto node = std::make_shared<NodeImpl>(processor);
     processor->ResetTransporter(GetTransporter()->GetMusicalTimeService());
     
-    pimpl_->nodes_.push_back(node);
+    {
+        // オーディオスレッドと先行処理のスレッドが、ノードのリストを参照していないときに変更する。
+        auto anticipation_lock = pimpl_->anticipation_lf_.make_lock();
+        auto lock = pimpl_->lf_.make_lock();
+        pimpl_->nodes_.push_back(node);
+    }
     pimpl_->RegisterIOProcessorIfNeeded(node->GetProcessor().get());
     
     if(pimpl_->prepared_) {
@@ -1097,8 +1740,13 @@ std::shared_ptr<Processor> GraphProcessor::RemoveNode(Node const *node)
     
     Disconnect(found->get());
     
-    auto moved = std::move(*found);
-    pimpl_->nodes_.erase(found);
+    NodePtr moved;
+    {
+        auto anticipation_lock = pimpl_->anticipation_lf_.make_lock();
+        auto lock = pimpl_->lf_.make_lock();
+        moved = std::move(*found);
+        pimpl_->nodes_.erase(found);
+    }
     pimpl_->UnregisterIOProcessorIfNeeded(moved->GetProcessor().get());
     
     if(should_stop_processing) {
@@ -1180,6 +1828,10 @@ bool GraphProcessor::ConnectAudio(Node *upstream,
     ToNodeImpl(downstream)->AddConnection(c, BusDirection::kInputSide);
     
     pimpl_->UpdatePlaybackGraph();
+    
+    pimpl_->listeners_.Invoke([&](Listener *li) {
+        li->OnAfterConnectionIsAdded(c.get());
+    });
     return true;
 }
 
@@ -1214,6 +1866,10 @@ bool GraphProcessor::ConnectMidi(Node *upstream, Node *downstream,
     ToNodeImpl(downstream)->AddConnection(c, BusDirection::kInputSide);
     
     pimpl_->UpdatePlaybackGraph();
+    
+    pimpl_->listeners_.Invoke([&](Listener *li) {
+        li->OnAfterConnectionIsAdded(c.get());
+    });
     return true;
 }
 
@@ -1249,6 +1905,10 @@ bool GraphProcessor::Disconnect(Node const *node)
     num += remove_connection(mutable_node->GetMidiConnections(BusDirection::kInputSide));
     num += remove_connection(mutable_node->GetMidiConnections(BusDirection::kOutputSide));
     
+    if(num != 0) {
+        pimpl_->UpdatePlaybackGraph();
+    }
+    
     return num != 0;
 }
 
@@ -1304,9 +1964,12 @@ std::unique_ptr<schema::NodeGraph> GraphProcessor::ToSchema() const
     return p;
 }
 
-std::unique_ptr<GraphProcessor> GraphProcessor::FromSchema(schema::NodeGraph const &schema)
+std::unique_ptr<GraphProcessor> GraphProcessor::FromSchema(schema::NodeGraph const &schema,
+                                                           IMusicalTimeService const *mts)
 {
     auto p = std::make_unique<GraphProcessor>();
+    // 各ノードのTransporterは、グラフのTransporterと同じIMusicalTimeServiceを使用して作成される。
+    p->ResetTransporter(mts);
     
     auto objects = ProjectObjectTable::GetInstance();
     assert(objects);
@@ -2,12 +2,16 @@
 #include "../plugin/vst3/Vst3Plugin.hpp"
 #include "../misc/ThreadSafeRingBuffer.hpp"
 #include "../misc/LockFactory.hpp"
+#include "../misc/AudioMeter.hpp"
 #include "../transport/TransportInfo.hpp"
 #include "../processor/Processor.hpp"
+#include "../file/AudioFileStreamer.hpp"
 #include "./Sequence.hpp"
 
 NS_HWM_BEGIN
 
+struct ProcessingIncident;
+
 class GraphProcessor
 :   public Processor
 {
@@ -28,6 +32,28 @@ public:
     public:
         virtual void OnAfterNodeIsAdded(Node *node) {};
         virtual void OnBeforeNodeIsRemoved(Node *node) {};
+        virtual void OnAfterConnectionIsAdded(Connection const *conn) {};
+        
+        //! ノードが先行処理の対象かどうかが決め直されたときに、ノードごとに呼び出される。
+        /*! オーディオスレッドの Process() と、先行処理のスレッドの ProcessAnticipated() が
+         *  どちらも処理していない状態で呼び出される。
+         *  ここで更新した状態は、 Process() のprepareと、 ProcessAnticipated() のprepareの中から、
+         *  ロックを取らずに参照できる。
+         */
+        virtual void OnAnticipationUpdated(Node const *node, bool anticipated) {};
+    };
+    
+    //! Process() の中で、グラフを処理する直前に呼び出されるコールバック
+    class IPrepareCallback
+    {
+    protected:
+        IPrepareCallback() {}
+    public:
+        virtual
+        ~IPrepareCallback() {}
+        
+        virtual
+        void Prepare() = 0;
     };
     
     using IListenerService = IListenerService<Listener>;
@@ -76,6 +102,17 @@ public:
         
         virtual
         void SetData(BufferType buf) = 0;
+        
+        //! MIDIデバイスからの入力のように、処理する時点まで内容が決まらない入力かどうか。
+        /*! シーケンスの再生のように、先の内容が決まっている入力ではfalseを設定する。
+         *  デフォルトはtrue。
+         *  @sa GraphProcessor::StartAnticipativeProcessing()
+         */
+        virtual
+        void SetLive(bool is_live) = 0;
+        
+        virtual
+        bool IsLive() const = 0;
     };
     
     class MidiOutput : public Processor {
@@ -120,9 +157,99 @@ public:
     MidiOutput const *  GetMidiOutput(UInt32 index) const;
     
     void StartProcessing(double sample_rate, SampleCount block_size);
+    
+    //! グラフを処理する。
+    /*! 呼び出す前に、 SetTransportInfoWithPlaybackPosition() で、処理する区間の再生位置を設定しておくこと。
+     *  設定した状態は、各ノードのプロセッサにも渡される。
+     */
     void Process(SampleCount num_samples);
+    
+    //! グラフを処理する。
+    /*! Process(SampleCount) と同じように処理するが、
+     *  先行処理の対象のノードの分類を変更できないようにしたあとで、グラフを処理する前にprepareを呼び出す。
+     *  prepareの中では、 Listener::OnAnticipationUpdated() で更新した状態を安全に参照できる。
+     */
+    void Process(SampleCount num_samples, IPrepareCallback *prepare);
     void StopProcessing();
     
+    //! 直前の Process() で処理したノードの数と、処理に時間がかかったノードをincidentに書き込む。
+    /*! Process() と同じスレッドから呼び出すこと。
+     *  ほかのスレッドがグラフを編集している場合は、ロックを待たずに、何も書き込まずに戻る。
+     */
+    void GetProcessingDetails(ProcessingIncident &incident) const;
+    
+    //! 先行処理（anticipative processing）を開始する。
+    /*! ライブ入力（AudioInputと、 IsLive() がtrueのMidiInput）に依存しないノードを先行処理の対象にし、
+     *  オーディオスレッドとは別のスレッドから ProcessAnticipated() で、block_sizeのブロック単位で先に処理できるようにする。
+     *  先行処理の対象のノードの出力は、num_blocks個のブロックまでキューに溜められ、
+     *  Process() では、ライブ入力に依存するノードだけを処理して、キューから取り出した出力と合わせる。
+     *
+     *  StartProcessing() のあとに呼び出すこと。
+     *  StartProcessing() のblock_sizeは、ここで指定するblock_size以上にしておくこと。
+     */
+    void StartAnticipativeProcessing(SampleCount block_size, UInt32 num_blocks);
+    void StopAnticipativeProcessing();
+    bool IsAnticipativeProcessingStarted() const;
+    
+    //! 先行処理したデータを無効にする。
+    /*! 編集や再生位置の移動のあとに呼び出す。どのスレッドから呼び出してもよい。
+     *  無効化したあとは、先行処理のスレッドが新しい位置から処理をやり直すまで、先行処理の対象のノードの出力は無音になる。
+     */
+    void InvalidateAnticipatedData();
+    
+    //! InvalidateAnticipatedData() を呼び出すたびに増える値
+    UInt64 GetAnticipationGeneration() const;
+    
+    //! Process() で処理したサンプル数の合計（ StartProcessing() からの処理位置）
+    /*! オーディオスレッドから呼び出すこと。
+     */
+    UInt64 GetProcessedPosition() const;
+    
+    //! 先行処理の出力が間に合わず、無音にしたブロックの数
+    UInt64 GetNumAnticipationUnderruns() const;
+    
+    //! 先行処理のスレッドから呼び出して、先行処理の対象のノードを1ブロック分処理する。
+    /*! tpの再生位置をブロックの長さだけ進めながら、ループ境界で分割した区間ごとにprepareを呼び出し、
+     *  そのあとで先行処理の対象のノードを処理する。
+     *  処理したブロックは、generationと、 GetProcessedPosition() を基準としたpositionを付けてキューに追加される。
+     *
+     *  @return キューに空きがなく、何もしなかった場合はfalse
+     */
+    bool ProcessAnticipated(Transporter *tp,
+                            UInt64 generation,
+                            UInt64 position,
+                            std::function<void(TransportInfo const &ti)> const &prepare);
+    
+    //! ノードをフリーズする。
+    /*! nodeのプロセッサで処理する代わりに、streamから出力を読み出すようにする。
+     *  （プロセッサのゲインフェーダーは、読み出した出力にも適用される）
+     *  nodeの上流のノードのうち、出力がすべてフリーズしたノード（またはそれによって処理されなくなったノード）に
+     *  繋がっているものは、処理されなくなる。
+     *  streamにnullptrを渡すと、フリーズを解除する。
+     */
+    void SetFrozenOutput(Node const *node, AudioFileStreamer::StreamPtr stream);
+    
+    bool IsFrozen(Node const *node) const;
+    
+    //! フリーズしたノードの上流にあるために、処理されなくなっているかどうか。
+    bool IsBypassedByFreeze(Node const *node) const;
+    
+    //! nodeとその上流のノードだけを処理して、nodeの出力をオフラインでレンダリングする。
+    /*! オーディオ処理を開始していないときに呼び出すこと。
+     *  tpの再生位置からlengthサンプル分を、block_sizeのブロック単位で、ループ境界で分割しながら処理する。
+     *  区間ごとに、処理の前にprepareを呼び出し、処理したあとでnodeの出力（ゲインフェーダーの適用前）をwriteに渡す。
+     *  writeがfalseを返した場合は、レンダリングを中止する。
+     *
+     *  @return オーディオ処理中の場合や中止した場合など、最後までレンダリングできなかった場合はfalse
+     */
+    bool RenderOffline(Node const *node,
+                       double sample_rate,
+                       SampleCount block_size,
+                       Transporter *tp,
+                       SampleCount length,
+                       std::function<void(TransportInfo const &ti)> const &prepare,
+                       std::function<bool(BufferRef<float const> output)> const &write);
+    
     class Connection
     {
     protected:
@@ -227,6 +354,15 @@ public:
         //! @return true if the any downstream connections reach to the specified node.
         virtual
         bool HasPathTo(Node const *downstream) const = 0;
+        
+        //! ノードのオーディオ出力のレベル
+        /*! 処理したスレッドで、ゲインフェーダーを適用した後の出力から計算される。
+         *  先行処理の対象のノードでは、先行処理のスレッドで計算したレベルを、
+         *  オーディオスレッドがその位置を処理したときに公開するので、レベルは再生位置に合わせて更新される。
+         *  レベルはどのスレッドから読み出してもよい。
+         */
+        virtual
+        AudioMeter const & GetOutputMeter() const = 0;
     };
     
     //! don't call this function on the realtime thread.
@@ -268,7 +404,8 @@ public:
     std::unique_ptr<schema::NodeGraph> ToSchema() const;
     
     static
-    std::unique_ptr<GraphProcessor> FromSchema(schema::NodeGraph const &schema);
+    std::unique_ptr<GraphProcessor> FromSchema(schema::NodeGraph const &schema,
+                                               IMusicalTimeService const *mts);
     
 //    virtual
 //    SampleCount GetLatencySample() const { return 0; }
@@ -309,4 +446,29 @@ private:
     std::unique_ptr<Impl> pimpl_;
 };
 
+template<class F>
+class GraphPrepareCallback
+:   public GraphProcessor::IPrepareCallback
+{
+public:
+    explicit
+    GraphPrepareCallback(F f) : f_(std::forward<F>(f)) {}
+    
+    void Prepare() override
+    {
+        f_();
+    }
+    
+    F f_;
+};
+
+//! Make IPrepareCallback object with a function object `f`.
+/*! @tparam F is a function or a function object having a signature `void()`
+ */
+template<class F>
+GraphPrepareCallback<F> MakeGraphPrepareCallback(F f)
+{
+    return GraphPrepareCallback<F>(std::forward<F>(f));
+}
+
 NS_HWM_END
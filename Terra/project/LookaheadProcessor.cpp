@@ -0,0 +1,225 @@
+#include "LookaheadProcessor.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../misc/Buffer.hpp"
+#include "../misc/ThreadSafeRingBuffer.hpp"
+
+NS_HWM_BEGIN
+
+struct LookaheadProcessor::Impl
+{
+    using RingBuffer = MultiChannelThreadSafeRingBuffer<float>;
+
+    Impl(int num_inputs, int num_outputs, SampleCount device_block_size, SampleCount block_size,
+         double period_sec, ProcessFunction process)
+    :   num_inputs_(num_inputs)
+    ,   num_outputs_(num_outputs)
+    ,   block_size_(block_size)
+    // 処理関数の呼び出しに、ブロック1つ分の時間までかかっても間に合うように、
+    // ブロック2つ分の無音を先に出力する。
+    ,   latency_(block_size * 2)
+    ,   input_queue_(std::max(num_inputs, 1), latency_ + block_size + device_block_size)
+    ,   output_queue_(std::max(num_outputs, 1), latency_ + block_size + device_block_size)
+    ,   process_(std::move(process))
+    {
+        input_buffer_.resize(num_inputs, block_size);
+        output_buffer_.resize(num_outputs, block_size);
+        output_ptrs_.resize(num_outputs);
+
+        Buffer<float> silence(std::max(num_outputs, 1), latency_);
+        output_queue_.Push(silence.data(), silence.channels(), latency_);
+        
+        statistics_.Reset(period_sec);
+    }
+
+    int num_inputs_ = 0;
+    int num_outputs_ = 0;
+    SampleCount block_size_ = 0;
+    SampleCount latency_ = 0;
+    RingBuffer input_queue_;
+    RingBuffer output_queue_;
+    Buffer<float> input_buffer_;
+    Buffer<float> output_buffer_;
+    ProcessFunction process_;
+    std::atomic<UInt64> num_underruns_ { 0 };
+
+    enum class Repriming {
+        kIdle,
+        //! オーディオスレッドが、入力キューの破棄を要求している。
+        kRequested,
+        //! ワーカースレッドが入力キューを破棄し、処理を止めている。
+        kInputDiscarded,
+    };
+    //! アンダーランのあと、キューを作り直して、遅延を latency_ に戻すための状態
+    std::atomic<Repriming> repriming_state_ { Repriming::kIdle };
+    //! キューを作り直したあと、出力を取り出さずに無音を出力する残りのサンプル数。（オーディオスレッドだけがアクセスする）
+    SampleCount num_samples_to_wait_ = 0;
+    //! 出力バッファの途中から書き込むためのチャンネルポインタ。（オーディオスレッドだけがアクセスする）
+    std::vector<float *> output_ptrs_;
+    //! ワーカースレッドだけが記録する。
+    ProcessingStatisticsRecorder statistics_;
+
+    std::thread th_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool quit_ = false;
+
+    bool IsReadyToProcess() const
+    {
+        return input_queue_.GetNumPoppable() >= block_size_
+        &&     output_queue_.GetNumPushable() >= block_size_;
+    }
+
+    void Run(RealtimeThreadOptions const &thread_options, double period_sec)
+    {
+        ConfigureRealtimeThread(thread_options, period_sec);
+
+        for( ; ; ) {
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                // オーディオスレッドはロックを取らずに通知するので、通知を取りこぼしても進むようにタイムアウトを設定する。
+                cv_.wait_for(lock, std::chrono::milliseconds(5), [this] {
+                    return quit_ || IsReadyToProcess() || repriming_state_ == Repriming::kRequested;
+                });
+
+                if(quit_) { return; }
+            }
+
+            for( ; ; ) {
+                // オーディオスレッドは、要求を出してから応答するまで入力を追加しないので、
+                // ここで入力キューを空にすると、処理済みのブロックを出力し終えた状態で処理が止まる。
+                if(repriming_state_ == Repriming::kRequested) {
+                    input_queue_.Clear();
+                    repriming_state_ = Repriming::kInputDiscarded;
+                }
+
+                if(IsReadyToProcess() == false) { break; }
+
+                EnableFlushDenormalsToZero();
+
+                input_queue_.PopOverwrite(input_buffer_.data(), num_inputs_, block_size_);
+                output_buffer_.fill(0);
+                
+                auto const begin = std::chrono::steady_clock::now();
+                process_(block_size_, input_buffer_.data(), output_buffer_.data());
+                auto const end = std::chrono::steady_clock::now();
+                
+                // デッドラインを超えても、出力が間に合わなくなるとは限らないので、問題としては記録しない。
+                ProcessingIncident incident;
+                statistics_.Record(std::chrono::duration<double>(end - begin).count(), 0, block_size_, incident);
+                
+                output_queue_.Push(output_buffer_.data(), num_outputs_, block_size_);
+            }
+        }
+    }
+};
+
+LookaheadProcessor::LookaheadProcessor(int num_inputs, int num_outputs,
+                                       SampleCount device_block_size, SampleCount block_size,
+                                       double period_sec,
+                                       RealtimeThreadOptions const &thread_options,
+                                       ProcessFunction process)
+:   pimpl_(std::make_unique<Impl>(num_inputs, num_outputs, device_block_size, block_size, period_sec,
+                                  std::move(process)))
+{
+    pimpl_->th_ = std::thread([this, thread_options, period_sec] {
+        pimpl_->Run(thread_options, period_sec);
+    });
+}
+
+LookaheadProcessor::~LookaheadProcessor()
+{
+    {
+        std::unique_lock<std::mutex> lock(pimpl_->mtx_);
+        pimpl_->quit_ = true;
+    }
+    pimpl_->cv_.notify_one();
+    pimpl_->th_.join();
+}
+
+void LookaheadProcessor::Process(SampleCount num_samples, float const * const * input, float **output)
+{
+    auto &m = *pimpl_;
+
+    auto fill_silence = [&](SampleCount begin, SampleCount end) {
+        for(int ch = 0; ch < m.num_outputs_; ++ch) {
+            std::fill(output[ch] + begin, output[ch] + end, 0);
+        }
+    };
+
+    // アンダーランや入力のあふれが起きると、入力と出力の時間関係が崩れる。
+    // その場合は、ワーカースレッドに入力キューを空にしてもらい、こちらで出力キューを空にしたあと、
+    // 初期状態と同じく latency_ 分の無音を出力してから処理を再開する。
+    auto request_repriming = [&] {
+        m.repriming_state_ = Impl::Repriming::kRequested;
+        m.num_underruns_.fetch_add(1, std::memory_order_relaxed);
+        fill_silence(0, num_samples);
+        m.cv_.notify_one();
+    };
+
+    auto const state = m.repriming_state_.load();
+    if(state == Impl::Repriming::kRequested) {
+        fill_silence(0, num_samples);
+        m.cv_.notify_one();
+        return;
+    }
+
+    if(state == Impl::Repriming::kInputDiscarded) {
+        m.output_queue_.Clear();
+        m.num_samples_to_wait_ = m.latency_;
+        m.repriming_state_ = Impl::Repriming::kIdle;
+    }
+
+    // 入力があふれた場合は、ワーカースレッドの処理が大幅に遅れている。
+    if(!m.input_queue_.Push(input, (input ? m.num_inputs_ : 0), num_samples)) {
+        request_repriming();
+        return;
+    }
+
+    auto const num_to_wait = std::min<SampleCount>(m.num_samples_to_wait_, num_samples);
+    fill_silence(0, num_to_wait);
+    m.num_samples_to_wait_ -= num_to_wait;
+
+    for(int ch = 0; ch < m.num_outputs_; ++ch) {
+        m.output_ptrs_[ch] = output[ch] + num_to_wait;
+    }
+
+    auto result = m.output_queue_.PopOverwrite(m.output_ptrs_.data(), m.num_outputs_, num_samples - num_to_wait);
+    if(!result) {
+        request_repriming();
+        return;
+    }
+
+    m.cv_.notify_one();
+}
+
+SampleCount LookaheadProcessor::GetLatency() const
+{
+    return pimpl_->latency_;
+}
+
+UInt64 LookaheadProcessor::GetNumUnderruns() const
+{
+    return pimpl_->num_underruns_.load(std::memory_order_relaxed);
+}
+
+ProcessingStatistics LookaheadProcessor::GetStatistics() const
+{
+    auto stat = pimpl_->statistics_.GetStatistics();
+    stat.num_output_underflows_ = GetNumUnderruns();
+    return stat;
+}
+
+SampleCount LookaheadProcessor::GetBlockSize() const
+{
+    return pimpl_->block_size_;
+}
+
+NS_HWM_END
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include "../misc/RealtimeThread.hpp"
+#include "../device/ProcessingStatistics.hpp"
+
+NS_HWM_BEGIN
+
+//! オーディオデバイスのブロックより大きなブロックで、別スレッドから先行して処理を行う。
+/*! デバイスのコールバックは、入力をキューに追加し、処理済みの出力をキューから取り出すだけになる。
+ *  ワーカースレッドは、入力がblock_size分溜まるたびに、処理関数を呼び出して出力をキューに追加する。
+ *
+ *  ブロックごとのオーバーヘッドが減り、処理時間のばらつきもブロック1つ分の時間で吸収できるので、
+ *  重いプロジェクトを安定して再生できる。
+ *  その代わりに、 GetLatency() の分だけ出力が遅れる。
+ */
+class LookaheadProcessor
+{
+public:
+    //! ワーカースレッドから呼び出される処理関数
+    /*! outputは0でクリアされた状態で渡される。
+     */
+    using ProcessFunction = std::function<void(SampleCount block_size,
+                                               float const * const * input,
+                                               float **output)>;
+
+    //! ワーカースレッドを開始する。
+    /*! @param device_block_size Process() に渡される最大のサンプル数
+     *  @param block_size 処理関数を呼び出すときのサンプル数
+     *  @param period_sec ワーカースレッドの優先度の設定に使用する、処理関数を呼び出す間隔（秒）
+     */
+    LookaheadProcessor(int num_inputs, int num_outputs,
+                       SampleCount device_block_size, SampleCount block_size,
+                       double period_sec,
+                       RealtimeThreadOptions const &thread_options,
+                       ProcessFunction process);
+
+    //! ワーカースレッドを停止する。
+    ~LookaheadProcessor();
+
+    //! 入力をキューに追加し、出力をキューから取り出す。
+    /*! オーディオデバイスのコールバックから呼び出す。
+     *  処理が間に合っていない場合、出力は無音になる。
+     *  その場合は、キューに残っているデータを捨て、GetLatency() 分の無音を出力してから処理を再開する。
+     *  そのため、再開後の遅延は常に GetLatency() と一致する。
+     */
+    void Process(SampleCount num_samples, float const * const * input, float **output);
+
+    //! 入力から出力までの遅延（サンプル数）
+    SampleCount GetLatency() const;
+
+    //! 処理が間に合わずに、キューを作り直した回数
+    UInt64 GetNumUnderruns() const;
+    
+    //! ワーカースレッドで処理関数を1回呼び出すのにかかった時間の統計を返す。
+    /*! デバイスのコールバックはキューのコピーしか行わないので、処理の重さはこちらで測る。
+     *  デッドラインは、処理関数を呼び出す間隔（period_sec）になる。
+     *  処理が間に合わずに無音を出力した回数は、num_output_underflows_に設定される。
+     *  問題の記録（recent_incidents_）は残さない。
+     */
+    ProcessingStatistics GetStatistics() const;
+
+    SampleCount GetBlockSize() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> pimpl_;
+};
+
+NS_HWM_END
@@ -4,13 +4,22 @@
 #include "../device/AudioDeviceManager.hpp"
 #include "../file/ProjectObjectTable.hpp"
 #include "./GraphProcessor.hpp"
+#include "./LookaheadProcessor.hpp"
 #include "../App.hpp"
 #include "../misc/MathUtil.hpp"
 #include "../misc/StrCnv.hpp"
 #include "../misc/Borrowable.hpp"
+#include "../file/WaveFile.hpp"
+#include "../file/AudioFileStreamer.hpp"
+#include "../processor/AudioClipProcessor.hpp"
+#include "../resource/ResourceHelper.hpp"
 #include <map>
+#include <optional>
+#include <chrono>
 #include <thread>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 
 NS_HWM_BEGIN
 
@@ -288,17 +297,34 @@ namespace {
     };
     
     VirtualMidiInDevice kSoftwareKeyboardMidiInput = { L"Software Keyboard" };
+    
+    //! 先行処理で、オーディオスレッドより先に処理しておくブロックの最大数
+    UInt32 const kNumAnticipatedBlocks = 4;
+    
+    //! フリーズするときに、シーケンスの最後のノートやクリップの最後のあとにレンダリングする長さ（秒）
+    double const kFreezeTailSec = 3.0;
 }
 
 struct Project::Impl
 :   public Transporter::ITransportStateListener
+,   public GraphProcessor::Listener
 {
     Impl(Project *pj)
-    :   tp_(pj)
+    :   pj_(pj)
+    ,   tp_(pj)
     {}
     
     ~Impl()
-    {}
+    {
+        if(graph_) {
+            graph_->GetListeners().RemoveListener(this);
+            for(auto &entry: frozen_nodes_) {
+                RemoveFrozenOutput(entry);
+            }
+        }
+    }
+    
+    Project *pj_ = nullptr;
     
     String file_name_;
     wxFileName dir_;
@@ -319,6 +345,60 @@ struct Project::Impl
     bool last_playing_ = false;
     std::unique_ptr<GraphProcessor> graph_;
     
+    //! graph_を置き換えて、新しいグラフのリスナーとして登録する。
+    /*! OnAnticipationUpdated() などを受け取れるように、グラフは必ずこの関数で設定すること。
+     */
+    void SetGraph(std::unique_ptr<GraphProcessor> graph)
+    {
+        if(graph_) { graph_->GetListeners().RemoveListener(this); }
+        graph_ = std::move(graph);
+        if(graph_) { graph_->GetListeners().AddListener(this); }
+    }
+    
+    ProcessingMode processing_mode_;
+    //! オーディオ処理中に使用している設定。StartProcessing()でprocessing_mode_から更新される。
+    ProcessingMode current_processing_mode_;
+    std::unique_ptr<LookaheadProcessor> lookahead_;
+    
+    //! 先行処理のスレッドが処理を始める位置を決めるための、オーディオスレッドの処理状態
+    struct AnticipationSnapshot
+    {
+        UInt64 generation_ = 0;
+        //! GraphProcessor::GetProcessedPosition() を基準とした処理位置
+        UInt64 position_ = 0;
+        TransportInfo ti_;
+        bool valid_ = false;
+    };
+    
+    LockFactory anticipation_lf_;
+    AnticipationSnapshot anticipation_snapshot_;
+    //! 先行処理のスレッドで再生位置を進めるTransporter。先行処理をしていないときはnullptr
+    std::unique_ptr<Transporter> anticipation_tp_;
+    std::thread anticipation_thread_;
+    std::mutex anticipation_mtx_;
+    std::condition_variable anticipation_cv_;
+    bool quit_anticipation_ = false;
+    //! 再生位置の移動を検出するための、オーディオスレッドの次のフレームの予想位置
+    SampleCount anticipation_expected_next_pos_ = 0;
+    bool anticipation_last_playing_ = false;
+    
+    bool IsAnticipating() const { return anticipation_tp_ != nullptr; }
+    
+    void StopAnticipation()
+    {
+        if(IsAnticipating() == false) { return; }
+        
+        {
+            std::unique_lock<std::mutex> lock(anticipation_mtx_);
+            quit_anticipation_ = true;
+        }
+        anticipation_cv_.notify_one();
+        anticipation_thread_.join();
+        
+        graph_->StopAnticipativeProcessing();
+        anticipation_tp_.reset();
+    }
+    
     //! input from device
     BufferRef<float const> input_;
     //! output to device
@@ -335,6 +415,13 @@ struct Project::Impl
     Borrowable<CachedSequence> cached_sequence_;
     
     std::vector<DeviceMidiMessage> device_midi_input_buffer_;
+    std::vector<DeviceMidiMessage> device_midi_output_buffer_;
+    
+    //! オーディオデバイスの出力レイテンシー（秒）
+    double device_output_latency_ = 0;
+    //! 現在処理中のフレームの先頭のサンプルがデバイスから出力される時刻。
+    //! MidiDeviceManager::GetTimestamp()と同じ基準の時刻を表す。
+    double frame_output_time_ = 0;
     
     class MidiProcessorData
     {
@@ -349,6 +436,15 @@ struct Project::Impl
         MidiDevice *device_;
         Processor *proc_;
         std::vector<ProcessInfo::MidiMessage> buffer_;
+        
+        //! 先行処理のスレッドで処理するかどうか
+        /*! OnAnticipationUpdated() で、オーディオスレッドと先行処理のスレッドが処理していないときに更新される。
+         *  GraphProcessor::Process() と GraphProcessor::ProcessAnticipated() のprepareの中から参照すること。
+         */
+        bool is_anticipated_ = false;
+        
+        //! オーディオスレッドで処理するかどうか
+        bool IsLive() const { return is_anticipated_ == false; }
     };
     
     class MidiProcessorList
@@ -454,6 +550,122 @@ struct Project::Impl
     
     MidiProcessorList midi_processors_;
     
+    //! predを満たすMidiInputに対応するシーケンスのイベントを、そのMidiInputのバッファに用意する。
+    template<class Pred>
+    void PrepareSequenceEvents(TransportInfo const &ti, bool need_stop_all_notes, Pred pred)
+    {
+        for(auto &seq_dev: sequence_devices_) {
+            auto entry = midi_processors_.GetEntryOf(seq_dev.get());
+            assert(entry);
+            
+            if(!entry || pred(*entry) == false) { continue; }
+            
+            if(need_stop_all_notes) {
+                seq_dev->Reset();
+            }
+            
+            if(ti.playing_) {
+                seq_dev->PrepareEvents(ti, pj_);
+            }
+            
+            auto ref = seq_dev->GetEvents();
+            entry->buffer_.clear();
+            std::copy(ref.begin(), ref.end(), std::back_inserter(entry->buffer_));
+            
+            seq_dev->OnAfterFrameProcess();
+        }
+    }
+    
+    struct FrozenNode
+    {
+        GraphProcessor::Node const *node_ = nullptr;
+        //! レンダリング結果のファイル
+        String path_;
+        //! path_から読み出すストリーム
+        AudioFileStreamer::StreamPtr stream_;
+        //! node_の出力がすべてnode_に繋がっているために、処理されなくなった上流のノード
+        std::vector<GraphProcessor::Node const *> bypassed_nodes_;
+        //! フリーズしたときにアンロードしたプラグイン
+        std::vector<std::shared_ptr<Processor>> unloaded_plugins_;
+        //! レンダリングに使用したシーケンス
+        std::vector<MidiDevice const *> sequence_devices_;
+        //! レンダリングしたときのサンプリングレート
+        double sample_rate_ = 0;
+        
+        bool Contains(GraphProcessor::Node const *node) const
+        {
+            return node == node_
+            || std::find(bypassed_nodes_.begin(), bypassed_nodes_.end(), node) != bypassed_nodes_.end();
+        }
+    };
+    
+    std::vector<FrozenNode> frozen_nodes_;
+    
+    //! フリーズしたノードの出力を、プロセッサの出力に戻して、レンダリング結果のファイルを削除する。
+    void RemoveFrozenOutput(FrozenNode &entry)
+    {
+        graph_->SetFrozenOutput(entry.node_, nullptr);
+        
+        // ストリームは、I/Oスレッドが先読みしている間も参照されているので、
+        // ファイルが閉じられるのを待ってから削除する。
+        std::weak_ptr<AudioFileStreamer::Stream> stream = entry.stream_;
+        entry.stream_.reset();
+        while(stream.expired() == false) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        
+        wxRemoveFile(entry.path_);
+    }
+    
+    //! predを満たすフリーズをすべて解除する。
+    template<class Pred>
+    void UnfreezeIf(Pred pred)
+    {
+        std::vector<GraphProcessor::Node const *> nodes;
+        for(auto const &entry: frozen_nodes_) {
+            if(pred(entry)) { nodes.push_back(entry.node_); }
+        }
+        
+        for(auto node: nodes) {
+            auto const msg = pj_->UnfreezeNode(node);
+            if(msg.empty() == false) {
+                TERRA_ERROR_LOG(msg);
+            }
+        }
+    }
+    
+    void OnBeforeNodeIsRemoved(GraphProcessor::Node *node) override
+    {
+        // 削除されるノードのプラグインは、ロードし直さなくてよい。
+        auto proc = node->GetProcessor();
+        for(auto &entry: frozen_nodes_) {
+            auto &list = entry.unloaded_plugins_;
+            list.erase(std::remove(list.begin(), list.end(), proc), list.end());
+        }
+        
+        UnfreezeIf([node](FrozenNode const &entry) {
+            return node == entry.node_ || node->HasPathTo(entry.node_);
+        });
+    }
+    
+    void OnAnticipationUpdated(GraphProcessor::Node const *node, bool anticipated) override
+    {
+        if(auto entry = midi_processors_.GetEntryOf(node->GetProcessor().get())) {
+            entry->is_anticipated_ = anticipated;
+        }
+    }
+    
+    void OnAfterConnectionIsAdded(GraphProcessor::Connection const *conn) override
+    {
+        // レンダリングした結果が変わる場合や、処理されなくなっていたノードが処理されるようになる場合は、
+        // フリーズを解除する。
+        UnfreezeIf([conn](FrozenNode const &entry) {
+            return conn->downstream_ == entry.node_
+            || conn->downstream_->HasPathTo(entry.node_)
+            || entry.Contains(conn->upstream_);
+        });
+    }
+    
     void OnChanged(TransportInfo const &prev_state,
                    TransportInfo const &new_state) override
     {
@@ -464,13 +676,14 @@ struct Project::Impl
 Project::Project()
 :   pimpl_(std::make_unique<Impl>(this))
 {
-    pimpl_->graph_ = std::make_unique<GraphProcessor>();
+    pimpl_->SetGraph(std::make_unique<GraphProcessor>());
     pimpl_->graph_->ResetTransporter(this);
     
     pimpl_->playing_sequence_notes_.Clear();
     pimpl_->requested_sample_notes_.Clear();
     pimpl_->playing_sample_notes_.Clear();
     pimpl_->device_midi_input_buffer_.reserve(2048);
+    pimpl_->device_midi_output_buffer_.reserve(2048);
 }
 
 Project::~Project()
@@ -535,6 +748,8 @@ void Project::AddAudioOutput(String name, UInt32 channel_index, UInt32 num_chann
 void Project::AddMidiInput(MidiDevice *device)
 {
     auto proc = GraphProcessor::CreateMidiInput(device->GetDeviceInfo().name_id_);
+    // シーケンスの内容は先に決まっているので、先行処理の対象にできる。
+    proc->SetLive(dynamic_cast<MidiSequenceDevice *>(device) == nullptr);
     proc->SetCallback([this, device](GraphProcessor::MidiInput *proc, ProcessInfo const &info) {
         OnSetMidi(proc, info, device);
     });
@@ -625,10 +840,25 @@ SequencePtr Project::GetSequence(UInt32 index) const
     return pimpl_->sequence_devices_[index]->GetSequence();
 }
 
+bool Project::IsSequenceAnticipated(UInt32 index) const
+{
+    assert(index < GetNumSequences());
+    auto entry = pimpl_->midi_processors_.GetEntryOf(pimpl_->sequence_devices_[index].get());
+    return entry && entry->is_anticipated_;
+}
+
 void Project::CacheSequence(UInt32 index)
 {
     assert(index < GetNumSequences());
-    pimpl_->sequence_devices_[index]->CacheSequence(this);
+    auto device = pimpl_->sequence_devices_[index].get();
+    
+    pimpl_->UnfreezeIf([device](Impl::FrozenNode const &entry) {
+        auto const &list = entry.sequence_devices_;
+        return std::find(list.begin(), list.end(), device) != list.end();
+    });
+    
+    device->CacheSequence(this);
+    pimpl_->graph_->InvalidateAnticipatedData();
 }
 
 Transporter & Project::GetTransporter()
@@ -726,6 +956,276 @@ bool Project::IsActive() const
     return pimpl_->is_active_;
 }
 
+namespace {
+    bool IsIOProcessor(Processor const *proc)
+    {
+        return dynamic_cast<GraphProcessor::AudioInput const *>(proc)
+        || dynamic_cast<GraphProcessor::AudioOutput const *>(proc)
+        || dynamic_cast<GraphProcessor::MidiInput const *>(proc)
+        || dynamic_cast<GraphProcessor::MidiOutput const *>(proc);
+    }
+    
+    String MakeFreezeFilePath(GraphProcessor::Node const *node)
+    {
+        auto dir = wxFileName(GetTerraDir(), "");
+        dir.AppendDir("Freeze");
+        wxFileName::Mkdir(dir.GetPath(), wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+        
+        auto const now = std::chrono::system_clock::now().time_since_epoch();
+        auto const timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+        
+        auto path = dir;
+        path.SetName(L"{:x}_{}"_format(reinterpret_cast<UInt64>(node), timestamp));
+        path.SetExt("wav");
+        return path.GetFullPath().ToStdWstring();
+    }
+}
+
+String Project::FreezeNode(GraphProcessor::Node const *node,
+                           std::function<bool(double progress)> progress)
+{
+    assert(node);
+    
+    auto &graph = *pimpl_->graph_;
+    if(graph.IsFrozen(node)) { return L""; }
+    if(graph.IsBypassedByFreeze(node)) {
+        return L"The node is a part of a frozen node.";
+    }
+    
+    auto const proc = node->GetProcessor();
+    if(IsIOProcessor(proc.get())) {
+        return L"Input and output nodes cannot be frozen.";
+    }
+    
+    auto const num_channels = proc->GetAudioChannelCount(BusDirection::kOutputSide);
+    if(num_channels == 0) {
+        return L"The node has no audio outputs.";
+    }
+    
+    // レンダリングするノード（nodeと、その上流のノード）を調べる。
+    std::vector<GraphProcessor::NodePtr> upstream_nodes;
+    for(auto &n: graph.GetNodes()) {
+        if(n.get() != node && n->HasPathTo(node)) {
+            upstream_nodes.push_back(n);
+        }
+    }
+    
+    // シーケンスの最後のノートや、クリップの最後までをレンダリングする。
+    SampleCount content_end = 0;
+    
+    for(auto &n: upstream_nodes) {
+        auto const up = n->GetProcessor();
+        if(dynamic_cast<GraphProcessor::AudioInput const *>(up.get())) {
+            return L"The node depends on an audio input.";
+        }
+        
+        if(auto clip = dynamic_cast<AudioClipProcessor const *>(up.get())) {
+            // オフラインでのレンダリングは、ストリーミングの先読みを待たずに進むので、
+            // ファイル全体をメモリに読み込んでいないクリップは正しく再生できない。
+            if(clip->IsStreamedFromDisk()) {
+                return L"The node depends on an audio clip streamed from the disk.";
+            }
+            content_end = std::max<SampleCount>(content_end, clip->GetPosition() + clip->GetLength());
+        }
+        
+        if(auto midi_in = dynamic_cast<GraphProcessor::MidiInput const *>(up.get())) {
+            if(midi_in->IsLive()) {
+                return L"The node depends on a live midi input.";
+            }
+        }
+        
+        if(graph.IsFrozen(n.get()) || graph.IsBypassedByFreeze(n.get())) {
+            return L"The node depends on a frozen node.";
+        }
+    }
+    
+    std::vector<MidiSequenceDevice *> used_sequences;
+    std::vector<MidiDevice const *> used_devices;
+    for(auto &seq_dev: pimpl_->sequence_devices_) {
+        auto seq_node = graph.GetNodeOf(pimpl_->midi_processors_.GetProcessorOf(seq_dev.get()));
+        if(seq_node && seq_node->HasPathTo(node)) {
+            used_sequences.push_back(seq_dev.get());
+            used_devices.push_back(seq_dev.get());
+        }
+    }
+    
+    Tick sequence_end = 0;
+    for(auto seq_dev: used_sequences) {
+        for(auto const &note: seq_dev->GetSequence()->notes_) {
+            sequence_end = std::max<Tick>(sequence_end, note->pos_ + note->length_);
+        }
+    }
+    content_end = std::max<SampleCount>(content_end, Round<SampleCount>(TickToSample(sequence_end)));
+    
+    if(content_end <= 0) {
+        return L"The node does not play any sequences or audio clips.";
+    }
+    
+    auto const render_length = content_end + Round<SampleCount>(kFreezeTailSec * pimpl_->sample_rate_);
+    
+    // レンダリングにはプラグインの状態が必要なので、ロードしておく。
+    auto load_plugin = [](Processor *p) -> String {
+        auto plugin = dynamic_cast<PluginAudioProcessor *>(p);
+        if(!plugin || plugin->IsLoaded()) { return L""; }
+        if(!plugin->Load()) {
+            return L"Failed to reload {}"_format(plugin->GetName());
+        }
+        return L"";
+    };
+    
+    if(auto error = load_plugin(proc.get()); error.empty() == false) { return error; }
+    for(auto &n: upstream_nodes) {
+        if(auto error = load_plugin(n->GetProcessor().get()); error.empty() == false) { return error; }
+    }
+    
+    auto const path = MakeFreezeFilePath(node);
+    auto writer = WaveFileWriter::Create(path, num_channels, pimpl_->sample_rate_);
+    if(!writer) {
+        return L"Failed to create {}"_format(path);
+    }
+    
+    // オフラインでのレンダリングは、オーディオ処理を止めて行う。
+    std::optional<ScopedAudioDeviceStopper> stopper;
+    if(auto adm = AudioDeviceManager::GetInstance()) {
+        if(auto dev = adm->GetDevice(); dev && IsActive()) {
+            stopper.emplace(dev);
+        }
+    }
+    
+    for(auto seq_dev: used_sequences) {
+        seq_dev->CacheSequence(this);
+    }
+    
+    auto is_used = [&](Impl::MidiProcessorData const &entry) {
+        return std::find(used_devices.begin(), used_devices.end(), entry.device_) != used_devices.end();
+    };
+    
+    Transporter tp(this);
+    tp.MoveTo(0);
+    tp.SetLoopEnabled(false);
+    tp.SetPlaying(true);
+    
+    bool need_stop_all_sequence_notes = true;
+    bool write_succeeded = true;
+    bool rendered = false;
+    std::atomic<SampleCount> num_rendered { 0 };
+    std::atomic<bool> canceled { false };
+    std::atomic<bool> done { false };
+    
+    // UIを止めないように、レンダリングはワーカースレッドで行う。
+    std::thread th([&] {
+        rendered = graph.RenderOffline(
+            node, pimpl_->sample_rate_, pimpl_->block_size_, &tp, render_length,
+            [&](TransportInfo const &ti) {
+                pimpl_->PrepareSequenceEvents(ti, need_stop_all_sequence_notes, is_used);
+                need_stop_all_sequence_notes = false;
+            },
+            [&](BufferRef<float const> output) {
+                write_succeeded = write_succeeded && writer->Write(output);
+                num_rendered += output.samples();
+                return write_succeeded && canceled.load() == false;
+            });
+        done = true;
+    });
+    
+    while(done.load() == false) {
+        if(progress && progress(num_rendered.load() / (double)render_length) == false) {
+            canceled = true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    th.join();
+    
+    // オーディオスレッドでの再生に影響しないように、シーケンスの再生状態を戻しておく。
+    for(auto seq_dev: used_sequences) {
+        seq_dev->Reset();
+        seq_dev->OnAfterFrameProcess();
+        pimpl_->midi_processors_.GetEntryOf(seq_dev)->buffer_.clear();
+    }
+    
+    write_succeeded = writer->Close() && write_succeeded;
+    writer.reset();
+    
+    if(canceled) {
+        wxRemoveFile(path);
+        return L"";
+    }
+    
+    if(!rendered || !write_succeeded) {
+        wxRemoveFile(path);
+        return L"Failed to render {}"_format(proc->GetName());
+    }
+    
+    auto streamer = AudioFileStreamer::GetInstance();
+    auto stream = (streamer ? streamer->OpenStream(path) : nullptr);
+    if(!stream) {
+        wxRemoveFile(path);
+        return L"Failed to open {}"_format(path);
+    }
+    
+    graph.SetFrozenOutput(node, stream);
+    
+    Impl::FrozenNode entry;
+    entry.node_ = node;
+    entry.path_ = path;
+    entry.stream_ = stream;
+    entry.sequence_devices_ = used_devices;
+    entry.sample_rate_ = pimpl_->sample_rate_;
+    
+    // 処理されなくなったノードのプラグインは、オーディオ処理を止めている間にアンロードする。
+    auto unload_plugin = [&entry](std::shared_ptr<Processor> const &p) {
+        auto plugin = dynamic_cast<PluginAudioProcessor *>(p.get());
+        if(!plugin || plugin->IsLoaded() == false) { return; }
+        plugin->Unload();
+        entry.unloaded_plugins_.push_back(p);
+    };
+    
+    unload_plugin(proc);
+    for(auto &n: upstream_nodes) {
+        if(graph.IsBypassedByFreeze(n.get()) == false) { continue; }
+        entry.bypassed_nodes_.push_back(n.get());
+        unload_plugin(n->GetProcessor());
+    }
+    
+    pimpl_->frozen_nodes_.push_back(std::move(entry));
+    
+    return L"";
+}
+
+String Project::UnfreezeNode(GraphProcessor::Node const *node)
+{
+    auto &list = pimpl_->frozen_nodes_;
+    auto found = std::find_if(list.begin(), list.end(), [node](auto const &entry) {
+        return entry.node_ == node;
+    });
+    if(found == list.end()) { return L""; }
+    
+    auto entry = std::move(*found);
+    list.erase(found);
+    
+    // ロードし終えてから、プロセッサでの処理に戻す。
+    String error;
+    for(auto const &p: entry.unloaded_plugins_) {
+        auto plugin = static_cast<PluginAudioProcessor *>(p.get());
+        if(!plugin->Load()) {
+            if(error.empty() == false) { error += L"\n"; }
+            error += L"Failed to reload {}"_format(plugin->GetName());
+        }
+    }
+    
+    pimpl_->RemoveFrozenOutput(entry);
+    
+    return error;
+}
+
+bool Project::IsFrozen(GraphProcessor::Node const *node) const
+{
+    auto const &list = pimpl_->frozen_nodes_;
+    return std::any_of(list.begin(), list.end(), [node](auto const &entry) {
+        return entry.node_ == node;
+    });
+}
+
 double Project::GetSampleRate() const
 {
     return pimpl_->sample_rate_;
@@ -829,6 +1329,21 @@ std::unique_ptr<schema::Project> Project::ToSchema() const
     p->set_block_size(pimpl_->block_size_);
     p->set_sample_rate(pimpl_->sample_rate_);
     
+    auto const &mode = pimpl_->processing_mode_;
+    auto schema_mode = p->mutable_processing_mode();
+    switch(mode.kind_) {
+        case ProcessingMode::Kind::kDeviceBlock:
+            schema_mode->set_kind(schema::ProcessingMode::kDeviceBlock); break;
+        case ProcessingMode::Kind::kFixedSubBlock:
+            schema_mode->set_kind(schema::ProcessingMode::kFixedSubBlock); break;
+        case ProcessingMode::Kind::kLookahead:
+            schema_mode->set_kind(schema::ProcessingMode::kLookahead); break;
+        case ProcessingMode::Kind::kAnticipative:
+            schema_mode->set_kind(schema::ProcessingMode::kAnticipative); break;
+    }
+    schema_mode->set_sub_block_size(mode.sub_block_size_);
+    schema_mode->set_lookahead_block_size(mode.lookahead_block_size_);
+    
     auto mps = p->mutable_musical_parameters();
     
     auto tempo = mps->add_tempo_events();
@@ -877,6 +1392,28 @@ std::unique_ptr<Project> Project::FromSchema(schema::Project const &schema)
     p->pimpl_->sample_rate_ = std::max<double>(schema.sample_rate(), 22050.0);
     p->pimpl_->block_size_ = std::max<UInt32>(schema.block_size(), 16);
     
+    if(schema.has_processing_mode()) {
+        auto const &schema_mode = schema.processing_mode();
+        ProcessingMode mode;
+        switch(schema_mode.kind()) {
+            case schema::ProcessingMode::kFixedSubBlock:
+                mode.kind_ = ProcessingMode::Kind::kFixedSubBlock; break;
+            case schema::ProcessingMode::kLookahead:
+                mode.kind_ = ProcessingMode::Kind::kLookahead; break;
+            case schema::ProcessingMode::kAnticipative:
+                mode.kind_ = ProcessingMode::Kind::kAnticipative; break;
+            default:
+                mode.kind_ = ProcessingMode::Kind::kDeviceBlock; break;
+        }
+        if(schema_mode.sub_block_size() > 0) {
+            mode.sub_block_size_ = schema_mode.sub_block_size();
+        }
+        if(schema_mode.lookahead_block_size() > 0) {
+            mode.lookahead_block_size_ = schema_mode.lookahead_block_size();
+        }
+        p->SetProcessingMode(mode);
+    }
+    
     if(schema.has_musical_parameters()) {
         auto &mp = schema.musical_parameters();
         // not supported yet.
@@ -914,7 +1451,7 @@ std::unique_ptr<Project> Project::FromSchema(schema::Project const &schema)
     };
     
     if(schema.has_graph()) {
-        p->pimpl_->graph_ = GraphProcessor::FromSchema(schema.graph());
+        p->pimpl_->SetGraph(GraphProcessor::FromSchema(schema.graph(), p.get()));
         auto &new_graph = p->pimpl_->graph_;
         assert(new_graph);
         
@@ -998,6 +1535,7 @@ std::unique_ptr<Project> Project::FromSchema(schema::Project const &schema)
                                   pj->OnSetMidi(proc, pi, device);
                               });
             p->pimpl_->midi_processors_.Add(device, proc);
+            proc->SetLive(sequence_device == nullptr);
             if(sequence_device) {
                 p->pimpl_->sequence_devices_.push_back(std::move(sequence_device));
             }
@@ -1073,7 +1611,33 @@ void Project::StartProcessing(double sample_rate,
     pimpl_->block_size_ = max_block_size;
     pimpl_->num_device_inputs_ = num_input_channels;
     pimpl_->num_device_outputs_ = num_output_channels;
-    pimpl_->graph_->StartProcessing(sample_rate, max_block_size);
+    pimpl_->device_output_latency_ = 0;
+    if(auto adm = AudioDeviceManager::GetInstance()) {
+        if(auto dev = adm->GetDevice()) {
+            pimpl_->device_output_latency_ = dev->GetOutputLatency();
+        }
+    }
+    
+    pimpl_->current_processing_mode_ = pimpl_->processing_mode_;
+    auto const &mode = pimpl_->current_processing_mode_;
+    bool const use_lookahead = (mode.kind_ == ProcessingMode::Kind::kLookahead);
+    bool const use_anticipation = (mode.kind_ == ProcessingMode::Kind::kAnticipative);
+    
+    SampleCount graph_block_size = max_block_size;
+    if(use_lookahead) {
+        graph_block_size = mode.lookahead_block_size_;
+    } else if(use_anticipation) {
+        graph_block_size = std::max(max_block_size, mode.lookahead_block_size_);
+    }
+    
+    // レンダリング結果はサンプリングレートを変換せずに再生されるので、
+    // 異なるサンプリングレートでレンダリングしたフリーズは解除する。
+    // （プラグインのロードし直しは、グラフの処理を開始する前に済ませておく）
+    pimpl_->UnfreezeIf([sample_rate](Impl::FrozenNode const &entry) {
+        return entry.sample_rate_ != sample_rate;
+    });
+    
+    pimpl_->graph_->StartProcessing(sample_rate, graph_block_size);
     
     auto const info = pimpl_->tp_.GetCurrentState();
     SampleCount const sample = Round<SampleCount>(TickToSample(info.play_.begin_.tick_));
@@ -1083,9 +1647,44 @@ void Project::StartProcessing(double sample_rate,
     SampleCount const loop_end_sample = Round<SampleCount>(TickToSample(info.loop_.end_.tick_));
     pimpl_->tp_.SetLoopRange(loop_begin_sample, loop_end_sample);
     
-    auto const num_seqs = GetNumSequences();
-    for(UInt32 i = 0; i < num_seqs; ++i) {
-        CacheSequence(i);
+    // サンプル位置が変わるだけなので、フリーズは解除しない。
+    for(auto &seq_dev: pimpl_->sequence_devices_) {
+        seq_dev->CacheSequence(this);
+    }
+    pimpl_->graph_->InvalidateAnticipatedData();
+    
+    RealtimeThreadOptions thread_options;
+    if(auto adm = AudioDeviceManager::GetInstance()) {
+        thread_options = adm->GetRealtimeThreadOptions();
+    }
+    
+    if(use_lookahead) {
+
+        auto const block_size = mode.lookahead_block_size_;
+        pimpl_->lookahead_ = std::make_unique<LookaheadProcessor>(
+            num_input_channels, num_output_channels, max_block_size, block_size,
+            block_size / sample_rate, thread_options,
+            [this](SampleCount len, float const * const * input, float **output) {
+                ProcessImpl(len, input, output, 0);
+            });
+        
+        // 先行して処理した分だけ、処理したフレームが出力されるまでの時間が延びる。
+        pimpl_->device_output_latency_ += pimpl_->lookahead_->GetLatency() / sample_rate;
+    }
+    
+    if(use_anticipation) {
+        auto const block_size = mode.lookahead_block_size_;
+        pimpl_->graph_->StartAnticipativeProcessing(block_size, kNumAnticipatedBlocks);
+        
+        pimpl_->anticipation_snapshot_ = Impl::AnticipationSnapshot();
+        pimpl_->anticipation_expected_next_pos_ = 0;
+        pimpl_->anticipation_last_playing_ = false;
+        pimpl_->quit_anticipation_ = false;
+        pimpl_->anticipation_tp_ = std::make_unique<Transporter>(this);
+        pimpl_->anticipation_thread_ = std::thread([this, thread_options, period = block_size / sample_rate] {
+            ConfigureRealtimeThread(thread_options, period);
+            RunAnticipativeProcessing();
+        });
     }
 }
 
@@ -1104,9 +1703,26 @@ void CheckIterValidity(Iter it, Container const &cont)
 }
 
 void Project::Process(SampleCount block_size, float const * const * input, float **output)
+{
+    if(pimpl_->lookahead_) {
+        pimpl_->lookahead_->Process(block_size, input, output);
+        return;
+    }
+    
+    auto const &mode = pimpl_->current_processing_mode_;
+    SampleCount const max_slice_length
+    = (mode.kind_ == ProcessingMode::Kind::kFixedSubBlock ? mode.sub_block_size_ : 0);
+    
+    ProcessImpl(block_size, input, output, max_slice_length);
+}
+
+void Project::ProcessImpl(SampleCount block_size, float const * const * input, float **output,
+                          SampleCount max_slice_length)
 {
     ScopedBypassGuard guard;
     
+    bool const anticipating = pimpl_->IsAnticipating();
+    
     for(int i = 0; i < 50; ++i) {
         guard = ScopedBypassGuard(pimpl_->bypass_);
         if(guard) { break; }
@@ -1115,84 +1731,76 @@ void Project::Process(SampleCount block_size, float const * const * input, float
     if(!guard) { return; }
     
     SampleCount num_processed = 0;
+    auto const block_begin_time = MidiDeviceManager::GetTimestamp();
     
     auto cb = MakeTraversalCallback([&, this](TransportInfo const &ti) {
-        for(auto &entry: pimpl_->midi_processors_) {
-            entry.buffer_.clear();
-        }
-        
-        if(auto mdm = MidiDeviceManager::GetInstance()) {
-            auto const timestamp = mdm->GetMessages(pimpl_->device_midi_input_buffer_);
-            auto frame_length = ti.play_.duration_.sec_;
-            auto frame_begin_time = timestamp - frame_length;
-            for(auto dm: pimpl_->device_midi_input_buffer_) {
-                auto entry = pimpl_->midi_processors_.GetEntryOf(dm.device_);
-                if(!entry) { continue; }
+        // MIDIのバッファは、先行処理の対象が変わらないようにしてから用意する。
+        // （エントリーの状態は、グラフの処理中にだけ参照できる）
+        auto prepare = MakeGraphPrepareCallback([&, this] {
+            for(auto &entry: pimpl_->midi_processors_) {
+                // 先行処理の対象のシーケンスのバッファは、先行処理のスレッドが使用している。
+                if(entry.IsLive() == false) { continue; }
+                entry.buffer_.clear();
+            }
+            
+            if(auto mdm = MidiDeviceManager::GetInstance()) {
+                auto const timestamp = mdm->GetMessages(pimpl_->device_midi_input_buffer_);
+                auto frame_length = ti.play_.duration_.sec_;
+                auto frame_begin_time = timestamp - frame_length;
+                for(auto dm: pimpl_->device_midi_input_buffer_) {
+                    auto entry = pimpl_->midi_processors_.GetEntryOf(dm.device_);
+                    if(!entry) { continue; }
                 
-                auto const pos = std::max<double>(0, dm.time_stamp_ - frame_begin_time);
-                ProcessInfo::MidiMessage pm((SampleCount)std::round(pos * pimpl_->sample_rate_),
-                                            dm.channel_, 0, dm.data_);
-                entry->buffer_.push_back(pm);
+                    auto const pos = std::max<double>(0, dm.time_stamp_ - frame_begin_time);
+                    ProcessInfo::MidiMessage pm((SampleCount)std::round(pos * pimpl_->sample_rate_),
+                                                dm.channel_, 0, dm.data_);
+                    entry->buffer_.push_back(pm);
+                }
             }
-        }
-        
-        auto add_note = [&, this](SampleCount sample_abs_pos,
-                                  UInt8 channel, UInt8 pitch, UInt8 velocity, bool is_note_on,
-                                  MidiDevice *device
-                                  )
-        {
-            ProcessInfo::MidiMessage mm;
-            mm.offset_ = sample_abs_pos - ti.play_.begin_.sample_;
-            mm.channel_ = channel;
-            mm.ppq_pos_ = SampleToTick(sample_abs_pos) / GetTpqn();
-            SetNoteData(mm, is_note_on, pitch, velocity);
             
-            auto entry = pimpl_->midi_processors_.GetEntryOf(device);
-            assert(entry);
-            entry->buffer_.push_back(mm);
-        };
+            auto add_note = [&, this](SampleCount sample_abs_pos,
+                                      UInt8 channel, UInt8 pitch, UInt8 velocity, bool is_note_on,
+                                      MidiDevice *device
+                                      )
+            {
+                ProcessInfo::MidiMessage mm;
+                mm.offset_ = sample_abs_pos - ti.play_.begin_.sample_;
+                mm.channel_ = channel;
+                mm.ppq_pos_ = SampleToTick(sample_abs_pos) / GetTpqn();
+                SetNoteData(mm, is_note_on, pitch, velocity);
+            
+                auto entry = pimpl_->midi_processors_.GetEntryOf(device);
+                assert(entry);
+                entry->buffer_.push_back(mm);
+            };
 
-        bool const need_stop_all_sequence_notes
-        = (pimpl_->last_playing_ && (ti.playing_ == false))
-        || (ti.play_.begin_.sample_ != pimpl_->expected_next_pos_)
-        ;
-        
-        pimpl_->last_playing_ = ti.playing_;
-        pimpl_->expected_next_pos_ = (ti.playing_ ? ti.play_.end_ : ti.play_.begin_).sample_;
-        
-        //hwm::dout << "#2 " << std::this_thread::get_id() << ": " << cache.get() << ", " << pimpl_->cached_sequence_ << std::endl;
-        
-        for(auto &seq_dev: pimpl_->sequence_devices_) {
-            if(need_stop_all_sequence_notes) {
-                seq_dev->Reset();
-            }
+            bool const need_stop_all_sequence_notes
+            = (pimpl_->last_playing_ && (ti.playing_ == false))
+            || (ti.play_.begin_.sample_ != pimpl_->expected_next_pos_)
+            ;
             
-            if(ti.playing_) {
-                seq_dev->PrepareEvents(ti, this);
-            }
+            pimpl_->last_playing_ = ti.playing_;
+            pimpl_->expected_next_pos_ = (ti.playing_ ? ti.play_.end_ : ti.play_.begin_).sample_;
             
-            auto entry = pimpl_->midi_processors_.GetEntryOf(seq_dev.get());
-            assert(entry);
+            //hwm::dout << "#2 " << std::this_thread::get_id() << ": " << cache.get() << ", " << pimpl_->cached_sequence_ << std::endl;
             
-            auto ref = seq_dev->GetEvents();
-            entry->buffer_.clear();
-            std::copy(ref.begin(), ref.end(), std::back_inserter(entry->buffer_));
+            pimpl_->PrepareSequenceEvents(ti, need_stop_all_sequence_notes, [](Impl::MidiProcessorData const &entry) {
+                return entry.IsLive();
+            });
             
-            seq_dev->OnAfterFrameProcess();
-        }
-        
-        pimpl_->requested_sample_notes_.Traverse([&](auto ch, auto pi, auto &x) {
-            auto note = x.exchange(InternalPlayingNoteInfo());
-            auto playing_note = pimpl_->playing_sample_notes_.Get(ch, pi);
-            bool const playing = (playing_note && playing_note.IsNoteOn());
-            if(!note) { return; }
-            if(note.IsNoteOn() && !playing) {
-                add_note(ti.play_.begin_.sample_, ch, pi, note.velocity_, true, &kSoftwareKeyboardMidiInput);
-                pimpl_->playing_sample_notes_.SetNoteOn(ch, pi, note.velocity_);
-            } else if(note.IsNoteOff()) {
-                add_note(ti.play_.begin_.sample_, ch, pi, note.velocity_, false, &kSoftwareKeyboardMidiInput);
-                pimpl_->playing_sample_notes_.ClearNote(ch, pi);
-            }
+            pimpl_->requested_sample_notes_.Traverse([&](auto ch, auto pi, auto &x) {
+                auto note = x.exchange(InternalPlayingNoteInfo());
+                auto playing_note = pimpl_->playing_sample_notes_.Get(ch, pi);
+                bool const playing = (playing_note && playing_note.IsNoteOn());
+                if(!note) { return; }
+                if(note.IsNoteOn() && !playing) {
+                    add_note(ti.play_.begin_.sample_, ch, pi, note.velocity_, true, &kSoftwareKeyboardMidiInput);
+                    pimpl_->playing_sample_notes_.SetNoteOn(ch, pi, note.velocity_);
+                } else if(note.IsNoteOff()) {
+                    add_note(ti.play_.begin_.sample_, ch, pi, note.velocity_, false, &kSoftwareKeyboardMidiInput);
+                    pimpl_->playing_sample_notes_.ClearNote(ch, pi);
+                }
+            });
         });
         
         if(pimpl_->graph_->GetNumAudioInputs() > 0) {
@@ -1215,20 +1823,164 @@ void Project::Process(SampleCount block_size, float const * const * input, float
             (UInt32)ti.play_.duration_.sample_,
         };
         
-        pimpl_->graph_->Process(ti.play_.duration_.sample_);
+        pimpl_->frame_output_time_
+        = block_begin_time
+        + pimpl_->device_output_latency_
+        + num_processed / pimpl_->sample_rate_;
+        
+        if(anticipating) {
+            // 再生位置が移動したときは、先行処理した結果を使えない。
+            // （ループによる移動は、先行処理のスレッドでも同じように処理されるので除く）
+            bool const jumped
+            =  (ti.playing_ != pimpl_->anticipation_last_playing_)
+            || (ti.play_.begin_.sample_ != pimpl_->anticipation_expected_next_pos_);
+            
+            SampleCount next_pos = ti.play_.begin_.sample_;
+            if(ti.playing_) {
+                next_pos = ti.play_.end_.sample_;
+                if(ti.IsLooping() && next_pos == ti.loop_.end_.sample_) {
+                    next_pos = ti.loop_.begin_.sample_;
+                }
+            }
+            pimpl_->anticipation_last_playing_ = ti.playing_;
+            pimpl_->anticipation_expected_next_pos_ = next_pos;
+            
+            if(jumped) {
+                pimpl_->graph_->InvalidateAnticipatedData();
+            }
+            
+            // 先行処理のスレッドが処理を再開する位置を決められるように、現在の処理状態を渡しておく。
+            // 取得できなかった場合は、次のフレームで渡せばよい。
+            if(auto lock = pimpl_->anticipation_lf_.try_make_lock()) {
+                auto &snapshot = pimpl_->anticipation_snapshot_;
+                snapshot.generation_ = pimpl_->graph_->GetAnticipationGeneration();
+                snapshot.position_ = pimpl_->graph_->GetProcessedPosition();
+                snapshot.ti_ = ti;
+                snapshot.valid_ = true;
+            }
+        }
+        
+        pimpl_->graph_->SetTransportInfoWithPlaybackPosition(ti);
+        pimpl_->graph_->Process(ti.play_.duration_.sample_, &prepare);
 
         num_processed += ti.play_.duration_.sample_;
     });
     
     Transporter::Traverser tv;
-    tv.Traverse(&pimpl_->tp_, block_size, &cb);
+    tv.Traverse(&pimpl_->tp_, block_size, &cb, max_slice_length);
+    
+    if(anticipating) {
+        // 先行処理のスレッドはロックを取らずに通知するので、取りこぼしてもタイムアウトで処理を進める。
+        pimpl_->anticipation_cv_.notify_one();
+    }
 }
 
 void Project::StopProcessing()
 {
+    pimpl_->lookahead_.reset();
+    pimpl_->StopAnticipation();
     pimpl_->graph_->StopProcessing();
 }
 
+void Project::RunAnticipativeProcessing()
+{
+    auto &graph = *pimpl_->graph_;
+    auto &tp = *pimpl_->anticipation_tp_;
+    SampleCount const block_size = pimpl_->current_processing_mode_.lookahead_block_size_;
+    
+    bool synchronized = false;
+    UInt64 generation = 0;
+    UInt64 position = 0;
+    bool need_stop_all_sequence_notes = true;
+    SampleCount expected_next_pos = 0;
+    
+    // 先行処理の対象のシーケンスのイベントを準備する。
+    auto prepare = [&, this](TransportInfo const &ti) {
+        need_stop_all_sequence_notes
+        = need_stop_all_sequence_notes
+        || (ti.play_.begin_.sample_ != expected_next_pos);
+        expected_next_pos = (ti.playing_ ? ti.play_.end_ : ti.play_.begin_).sample_;
+        
+        // ProcessAnticipated() の中から呼び出されるので、エントリーの状態は変わらない。
+        pimpl_->PrepareSequenceEvents(ti, need_stop_all_sequence_notes, [](Impl::MidiProcessorData const &entry) {
+            return entry.is_anticipated_;
+        });
+        
+        need_stop_all_sequence_notes = false;
+    };
+    
+    for( ; ; ) {
+        {
+            std::unique_lock<std::mutex> lock(pimpl_->anticipation_mtx_);
+            pimpl_->anticipation_cv_.wait_for(lock, std::chrono::milliseconds(5));
+            if(pimpl_->quit_anticipation_) { return; }
+        }
+        
+        for( ; ; ) {
+            auto const current_generation = graph.GetAnticipationGeneration();
+            
+            if(synchronized == false || generation != current_generation) {
+                Impl::AnticipationSnapshot snapshot;
+                {
+                    auto lock = pimpl_->anticipation_lf_.make_lock();
+                    snapshot = pimpl_->anticipation_snapshot_;
+                }
+                
+                // オーディオスレッドが、無効化されたあとの状態で処理を始めるまで待つ。
+                if(snapshot.valid_ == false || snapshot.generation_ != current_generation) {
+                    synchronized = false;
+                    break;
+                }
+                
+                // オーディオスレッドの処理位置から、1ブロック分先の位置から処理を再開する。
+                // それまでの間、先行処理の対象のノードの出力は無音になる。
+                tp.SetCurrentStateWithPlaybackPosition(snapshot.ti_);
+                auto skip = MakeTraversalCallback([](TransportInfo const &) {});
+                Transporter::Traverser tv;
+                tv.Traverse(&tp, block_size, &skip);
+                
+                synchronized = true;
+                generation = current_generation;
+                position = snapshot.position_ + block_size;
+                need_stop_all_sequence_notes = true;
+            }
+            
+            if(graph.ProcessAnticipated(&tp, generation, position, prepare) == false) { break; }
+            
+            position += block_size;
+        }
+    }
+}
+
+void Project::GetProcessingDetails(ProcessingIncident &incident) const
+{
+    // 先行処理中のグラフは別スレッドで処理されていて、デバイスのコールバックの処理時間とは関係しない。
+    if(pimpl_->lookahead_) { return; }
+    
+    pimpl_->graph_->GetProcessingDetails(incident);
+}
+
+bool Project::GetLookaheadStatistics(ProcessingStatistics &stat) const
+{
+    if(!pimpl_->lookahead_) { return false; }
+    
+    stat = pimpl_->lookahead_->GetStatistics();
+    return true;
+}
+
+void Project::SetProcessingMode(ProcessingMode const &mode)
+{
+    auto &dest = pimpl_->processing_mode_;
+    dest = mode;
+    dest.sub_block_size_ = Clamp<SampleCount>(mode.sub_block_size_, 8, 4096);
+    dest.lookahead_block_size_ = Clamp<SampleCount>(mode.lookahead_block_size_, 64, 16384);
+}
+
+Project::ProcessingMode Project::GetProcessingMode() const
+{
+    return pimpl_->processing_mode_;
+}
+
 void Project::OnSetAudio(GraphProcessor::AudioInput *input, ProcessInfo const &pi, UInt32 channel_index)
 {
     if(pimpl_->input_.samples() == 0) { return; }
@@ -1305,6 +2057,28 @@ void Project::OnSetMidi(GraphProcessor::MidiInput *input, ProcessInfo const &pi,
 
 void Project::OnGetMidi(GraphProcessor::MidiOutput *output, ProcessInfo const &pi, MidiDevice *device)
 {
+    if(!device) { return; }
+    
+    auto mdm = MidiDeviceManager::GetInstance();
+    if(!mdm) { return; }
+    
+    auto const src = output->GetData();
+    if(src.size() == 0) { return; }
+    
+    auto &buffer = pimpl_->device_midi_output_buffer_;
+    buffer.clear();
+    
+    for(auto const &m: src) {
+        DeviceMidiMessage dm;
+        dm.device_ = device;
+        dm.time_stamp_ = m.offset_ / pimpl_->sample_rate_;
+        dm.channel_ = m.channel_;
+        dm.data_ = m.data_;
+        buffer.push_back(dm);
+    }
+    
+    //! 送信は送信スレッドで、各メッセージのサンプル位置に対応する時刻に行われる
+    mdm->SendMessages(buffer, pimpl_->frame_output_time_);
 }
 
 NS_HWM_END
@@ -67,6 +67,16 @@ public:
     void RemoveSequence(UInt32 index);
     SequencePtr GetSequence(UInt32 index);
     SequencePtr GetSequence(UInt32 index) const;
+    
+    //! シーケンスのイベントを、先行処理のスレッドで準備しているかどうか。
+    /*! ProcessingMode::Kind::kAnticipativeで処理していて、シーケンスのノードが先行処理の対象になっている場合にtrueを返す。
+     *  メインスレッドから呼び出すこと。
+     */
+    bool IsSequenceAnticipated(UInt32 index) const;
+    
+    //! シーケンスの変更を再生に反映する。
+    /*! シーケンスを使用してフリーズしたノードは、フリーズを解除する。
+     */
     void CacheSequence(UInt32 index);
     
     Transporter & GetTransporter();
@@ -74,6 +84,30 @@ public:
     
     GraphProcessor & GetGraph();
     
+    //! ノードをフリーズする。
+    /*! ノードの出力（ゲインフェーダーの適用前）を、シーケンスやオーディオクリップの最後までオフラインでレンダリングしてファイルに書き出し、
+     *  再生時はノードを処理する代わりに、ファイルからストリーミングで読み出す。
+     *  ノードと、ノードにだけ出力している上流のノードは処理されなくなり、それらのプラグインはアンロードされる。
+     *  ライブ入力（AudioInputや、MIDIデバイスからの入力）に依存するノードはフリーズできない。
+     *
+     *  レンダリングはワーカースレッドで行い、その間メインスレッドからprogressを定期的に呼び出す。
+     *  レンダリング中は、ノードのプロセッサを使用するので、オーディオデバイスを停止する。
+     *  フリーズした状態はプロジェクトには保存されない。
+     *  オーディオデバイスのサンプリングレートが変わったときは、フリーズは解除される。
+     *
+     *  @param progress レンダリングの進捗（0.0 〜 1.0）を受け取る。falseを返すとレンダリングを中止する。
+     *  @return エラーメッセージ。成功した場合と、中止した場合は空文字列
+     */
+    String FreezeNode(GraphProcessor::Node const *node,
+                      std::function<bool(double progress)> progress = {});
+    
+    //! フリーズを解除して、アンロードしたプラグインをロードし直す。
+    /*! @return プラグインのロードに失敗した場合はエラーメッセージ。成功した場合は空文字列
+     */
+    String UnfreezeNode(GraphProcessor::Node const *node);
+    
+    bool IsFrozen(GraphProcessor::Node const *node) const;
+    
     //! 再生中のシーケンスノート情報のリストが返る。
     std::vector<PlayingNoteInfo> GetPlayingSequenceNotes() const;
     //! 再生中のサンプルノート情報のリストが返る。
@@ -86,6 +120,42 @@ public:
     void Deactivate();
     bool IsActive() const;
     
+    //! オーディオ処理のブロックの分割方法
+    struct ProcessingMode
+    {
+        enum class Kind {
+            //! オーディオデバイスのブロック単位で処理する。（ループの境界でだけ分割する）
+            kDeviceBlock,
+            //! sub_block_size_以下のブロックに分割して処理する。
+            //! MIDIやオートメーションが、デバイスのブロックサイズによらず、sub_block_size_の精度で反映される。
+            kFixedSubBlock,
+            //! lookahead_block_size_のブロックで、別スレッドから先行して処理する。
+            //! レイテンシが増える代わりに、重いプロジェクトを安定して再生できる。
+            kLookahead,
+            //! ライブ入力に依存しないノード（シーケンスで演奏するトラックなど）だけを、
+            //! lookahead_block_size_のブロックで、別スレッドから先行して処理する。
+            //! ライブ入力に依存するノードは、レイテンシを増やさずにデバイスのブロック単位で処理する。
+            kAnticipative,
+        };
+        
+        Kind kind_ = Kind::kDeviceBlock;
+        SampleCount sub_block_size_ = 32;
+        SampleCount lookahead_block_size_ = 2048;
+    };
+    
+    //! オーディオ処理のブロックの分割方法を設定する。
+    /*! 変更は、次にオーディオ処理を開始したときから反映される。
+     */
+    void SetProcessingMode(ProcessingMode const &mode);
+    ProcessingMode GetProcessingMode() const;
+    
+    //! ProcessingMode::Kind::kLookaheadで処理している場合に、ワーカースレッドでの処理時間の統計を取得する。
+    /*! このモードでは、デバイスのコールバックの処理時間はキューのコピーの時間しか表さない。
+     *  オーディオ処理の開始・停止と同じスレッド（メインスレッド）から呼び出すこと。
+     *  @return このモードで処理していない場合はfalse
+     */
+    bool GetLookaheadStatistics(ProcessingStatistics &stat) const;
+    
     double GetSampleRate() const override;
     Tick GetTpqn() const override;
     double TickToSec(double tick) const override;
@@ -101,10 +171,15 @@ public:
     double GetTempoAt(double tick) const override;
     Meter GetMeterAt(double tick) const override;
     
+    //! プロジェクトの状態をスキーマに変換する。
+    /*! プラグインの状態は大きいので、その代わりにハッシュ値（Processor.Vst3.dump_hash）が設定される。
+     *  ファイルに保存するときは、Vst3AudioProcessor::GetDump()で取得した状態を設定する。
+     */
     std::unique_ptr<schema::Project> ToSchema() const;
     static
     std::unique_ptr<Project> FromSchema(schema::Project const &schema);
     
+    //! 保存済みの状態。ToSchema()と同じく、プラグインの状態はハッシュ値だけを持つ。
     schema::Project * GetLastSchema() const;
     void UpdateLastSchema(std::unique_ptr<schema::Project> schema);
     
@@ -119,8 +194,17 @@ private:
     
     void Process(SampleCount block_size, float const * const * input, float **output) override;
     
+    //! @param max_slice_length 0より大きい場合は、このサンプル数以下に分割してグラフを処理する。
+    void ProcessImpl(SampleCount block_size, float const * const * input, float **output,
+                     SampleCount max_slice_length);
+    
     void StopProcessing() override;
     
+    //! 先行処理のスレッドの処理
+    void RunAnticipativeProcessing();
+    
+    void GetProcessingDetails(ProcessingIncident &incident) const override;
+    
     void OnSetAudio(GraphProcessor::AudioInput *input, ProcessInfo const &pi, UInt32 channel_index);
     void OnGetAudio(GraphProcessor::AudioOutput *output, ProcessInfo const &pi, UInt32 channel_index);
     void OnSetMidi(GraphProcessor::MidiInput *input, ProcessInfo const &pi, MidiDevice *device);
@@ -0,0 +1,111 @@
+#include "catch2/catch.hpp"
+
+#include <vector>
+
+#include "../project/AnticipatedAudioQueue.hpp"
+
+TEST_CASE("AnticipatedAudioQueue test", "[anticipation]")
+{
+    using namespace hwm;
+
+    SampleCount const kBlockSize = 16;
+    AnticipatedAudioQueue q(2, kBlockSize, 3);
+
+    // ブロックの各サンプルに、チャンネル番号と処理位置から決まる値を書き込む。
+    auto push = [&](UInt64 generation, UInt64 position) {
+        auto block = q.GetWritableBlock();
+        if(!block) { return false; }
+        for(UInt32 ch = 0; ch < block->channels(); ++ch) {
+            for(SampleCount i = 0; i < kBlockSize; ++i) {
+                block->data()[ch][i] = (float)(ch * 10000 + position + i);
+            }
+        }
+        q.PushBlock(generation, position, kBlockSize);
+        return true;
+    };
+
+    Buffer<float> dest(2, kBlockSize);
+
+    auto is_filled_from = [&](UInt64 position, SampleCount length) {
+        for(UInt32 ch = 0; ch < dest.channels(); ++ch) {
+            for(SampleCount i = 0; i < length; ++i) {
+                if(dest.data()[ch][i] != (float)(ch * 10000 + position + i)) { return false; }
+            }
+        }
+        return true;
+    };
+
+    SECTION("read across block boundaries") {
+        REQUIRE(push(0, 100));
+        REQUIRE(push(0, 116));
+        REQUIRE(push(0, 132));
+        REQUIRE_FALSE(push(0, 148));
+        REQUIRE(q.GetNumReadableBlocks() == 3);
+
+        REQUIRE(q.Pop(0, 100, 10, dest));
+        REQUIRE(is_filled_from(100, 10));
+        REQUIRE(q.GetNumReadableBlocks() == 3);
+
+        REQUIRE(q.Pop(0, 110, 12, dest));
+        REQUIRE(is_filled_from(110, 12));
+        REQUIRE(q.GetNumReadableBlocks() == 2);
+
+        REQUIRE(push(0, 148));
+        REQUIRE(q.Pop(0, 122, 16, dest));
+        REQUIRE(is_filled_from(122, 16));
+        REQUIRE(q.GetNumReadableBlocks() == 2);
+    }
+
+    SECTION("data not yet rendered") {
+        REQUIRE(push(0, 100));
+
+        dest.fill(-1);
+        REQUIRE_FALSE(q.Pop(0, 90, 16, dest));
+        REQUIRE(dest.data()[0][0] == -1);
+
+        REQUIRE_FALSE(q.Pop(0, 110, 16, dest));
+        REQUIRE(dest.data()[0][0] == -1);
+        REQUIRE(q.GetNumReadableBlocks() == 1);
+
+        REQUIRE(push(0, 116));
+        REQUIRE(q.Pop(0, 110, 16, dest));
+        REQUIRE(is_filled_from(110, 16));
+    }
+
+    SECTION("invalidated blocks are discarded") {
+        REQUIRE(push(0, 100));
+        REQUIRE(push(0, 116));
+        REQUIRE(push(1, 200));
+
+        REQUIRE(q.Pop(1, 200, 16, dest));
+        REQUIRE(is_filled_from(200, 16));
+        REQUIRE(q.GetNumReadableBlocks() == 0);
+
+        REQUIRE(push(1, 216));
+        REQUIRE(push(1, 232));
+        REQUIRE(push(1, 248));
+
+        // 読み出し位置より前に終わっているブロックも破棄される。
+        REQUIRE(q.Pop(1, 240, 8, dest));
+        REQUIRE(is_filled_from(240, 8));
+        REQUIRE(q.GetNumReadableBlocks() == 1);
+    }
+
+    SECTION("blocks of a newer generation are kept") {
+        REQUIRE(push(0, 100));
+        REQUIRE(push(1, 300));
+        REQUIRE(push(1, 316));
+
+        // 読み出し側がまだ古い世代で読み出している間は、新しい世代のブロックを破棄しない。
+        dest.fill(-1);
+        REQUIRE_FALSE(q.Pop(0, 116, 16, dest));
+        REQUIRE(dest.data()[0][0] == -1);
+        REQUIRE(q.GetNumReadableBlocks() == 2);
+
+        REQUIRE(q.Pop(1, 300, 16, dest));
+        REQUIRE(is_filled_from(300, 16));
+        REQUIRE(q.Pop(1, 316, 16, dest));
+        REQUIRE(is_filled_from(316, 16));
+        REQUIRE(q.GetNumReadableBlocks() == 0);
+    }
+}
@@ -0,0 +1,42 @@
+#include "catch2/catch.hpp"
+
+#include <wx/filename.h>
+
+#include "../file/AudioFileStreamer.hpp"
+#include "../file/WaveFile.hpp"
+#include "../processor/AudioClipProcessor.hpp"
+
+#include "./TestApp.hpp"
+#include "./PathUtil.hpp"
+
+TEST_CASE("AudioClipProcessor sample rate test", "[file]")
+{
+    using namespace hwm;
+
+    TestApp app;
+    AudioFileStreamer streamer(1);
+    auto scoped_dir = ScopedTemporaryDirectoryProvider(L"audio-clip-processor-test");
+    auto const path = wxFileName(scoped_dir.GetPath(), L"test.wav").GetFullPath().ToStdWstring();
+
+    {
+        Buffer<float> src(2, 1000);
+        src.fill(0.5);
+        auto writer = WaveFileWriter::Create(path, 2, 22050);
+        REQUIRE(writer);
+        REQUIRE(writer->Write(BufferRef<float const>(src, 0, 2, 0, 1000)));
+        REQUIRE(writer->Close());
+    }
+
+    auto proc = AudioClipProcessor::Create(path);
+    REQUIRE(proc);
+    CHECK(proc->GetSampleRate() == 22050);
+
+    // サンプリングレートは変換しないので、異なるレートで処理する場合は検出できる。
+    CHECK(proc->IsSampleRateMismatched(22050) == false);
+    CHECK(proc->IsSampleRateMismatched(44100));
+
+    // ファイルを開けていないクリップは、サンプリングレートが異なるものとして扱わない。
+    AudioClipProcessor unavailable(L"missing.wav", 0, 2, nullptr);
+    CHECK(unavailable.GetSampleRate() == 0);
+    CHECK(unavailable.IsSampleRateMismatched(44100) == false);
+}
@@ -0,0 +1,87 @@
+#include "catch2/catch.hpp"
+
+#include <vector>
+
+#include "../misc/AudioMeter.hpp"
+
+TEST_CASE("AudioLevelQueue test", "[meter]")
+{
+    using namespace hwm;
+
+    UInt32 const num_channels = 2;
+    SampleCount const block_size = 128;
+
+    AudioMeter source(num_channels);
+    AudioMeter dest(num_channels);
+    source.SetSampleRate(44100);
+    dest.SetSampleRate(44100);
+
+    Buffer<float> buf(num_channels, block_size);
+    auto process_block = [&](float value) {
+        buf.fill(value);
+        source.Process(BufferRef<float const>(buf));
+    };
+
+    auto get_peak = [&](AudioMeter const &meter) {
+        std::vector<AudioMeter::Level> levels(num_channels);
+        meter.GetLevels(levels.data());
+        return levels[0].peak_;
+    };
+
+    AudioLevelQueue queue(num_channels, 4);
+
+    SECTION("levels are published when the position is reached") {
+        process_block(0.5);
+        REQUIRE(queue.Push(0, block_size, source));
+
+        queue.PublishUntil(0, block_size - 1, dest);
+        REQUIRE(get_peak(dest) == 0);
+
+        queue.PublishUntil(0, block_size, dest);
+        REQUIRE(get_peak(dest) == Approx(0.5));
+    }
+
+    SECTION("only the latest reached levels are published") {
+        process_block(0.25);
+        REQUIRE(queue.Push(0, block_size, source));
+        process_block(1.0);
+        REQUIRE(queue.Push(0, block_size * 2, source));
+        process_block(1.0);
+        REQUIRE(queue.Push(0, block_size * 3, source));
+
+        queue.PublishUntil(0, block_size * 2, dest);
+        REQUIRE(get_peak(dest) == Approx(1.0));
+        auto const count = dest.GetUpdateCount();
+
+        // 残っているレベルは、まだ再生されていない。
+        queue.PublishUntil(0, block_size * 2, dest);
+        REQUIRE(dest.GetUpdateCount() == count);
+    }
+
+    SECTION("levels of older generations are discarded and newer ones are kept") {
+        process_block(1.0);
+        REQUIRE(queue.Push(0, block_size, source));
+        process_block(0.5);
+        REQUIRE(queue.Push(1, block_size * 2, source));
+
+        // 読み出し側が、まだ世代の更新を知らない。
+        queue.PublishUntil(0, block_size * 2, dest);
+        REQUIRE(get_peak(dest) == Approx(1.0));
+
+        dest.Reset();
+        queue.PublishUntil(1, block_size * 2, dest);
+        REQUIRE(get_peak(dest) > 0);
+        REQUIRE(get_peak(dest) < 1.0);
+    }
+
+    SECTION("levels are not pushed when the queue is full") {
+        for(int i = 0; i < 4; ++i) {
+            process_block(0.5);
+            REQUIRE(queue.Push(0, block_size * (i + 1), source));
+        }
+        REQUIRE(queue.Push(0, block_size * 5, source) == false);
+
+        queue.PublishUntil(0, block_size, dest);
+        REQUIRE(queue.Push(0, block_size * 5, source));
+    }
+}
@@ -0,0 +1,87 @@
+#include "catch2/catch.hpp"
+
+#include <utility>
+
+#include "../project/AutomationLane.hpp"
+
+TEST_CASE("AutomationLane test", "[automation]")
+{
+    using namespace hwm;
+    using BP = AutomationLane::Breakpoint;
+    using Points = std::vector<std::pair<SampleCount, double>>;
+
+    auto evaluate = [](AutomationLane const &lane, double begin, double end,
+                       SampleCount num_samples, AutomationLane::Cursor &cursor)
+    {
+        Points points;
+        lane.Evaluate(begin, end, num_samples, cursor, [&](SampleCount offset, double value) {
+            points.emplace_back(offset, value);
+        });
+        return points;
+    };
+
+    SECTION("breakpoints are sorted and collinear points are removed") {
+        AutomationLane lane(1, { BP(480, 1.0), BP(0, 0.0), BP(240, 0.5), BP(960, 1.0), BP(960, 0.25) });
+        auto const points = lane.GetBreakpoints();
+
+        REQUIRE(points.size() == 4);
+        REQUIRE(points[0].pos_ == 0);
+        REQUIRE(points[1].pos_ == 480);
+        REQUIRE(points[2].pos_ == 960);
+        REQUIRE(points[2].value_ == 1.0);
+        REQUIRE(points[3].pos_ == 960);
+        REQUIRE(points[3].value_ == 0.25);
+    }
+
+    SECTION("values are interpolated linearly") {
+        AutomationLane lane(1, { BP(100, 0.0), BP(200, 1.0) });
+
+        REQUIRE(lane.GetValueAt(0) == 0.0);
+        REQUIRE(lane.GetValueAt(150) == Approx(0.5));
+        REQUIRE(lane.GetValueAt(300) == 1.0);
+        REQUIRE(AutomationLane().GetValueAt(100) == 0.0);
+    }
+
+    SECTION("a ramp is emitted as its endpoints") {
+        AutomationLane lane(1, { BP(0, 0.0), BP(1000, 1.0) });
+        AutomationLane::Cursor cursor;
+
+        auto p1 = evaluate(lane, 0, 100, 10, cursor);
+        REQUIRE(p1.size() == 2);
+        REQUIRE(p1[0] == std::make_pair<SampleCount, double>(0, 0.0));
+        REQUIRE(p1[1].first == 9);
+        // the last point has the value at the last sample (tick 90), not at the end of the slice.
+        REQUIRE(p1[1].second == Approx(lane.GetValueAt(90)));
+        REQUIRE(p1[1].second == Approx(0.09));
+
+        // the ramp continues from the value at the first sample of the next slice.
+        auto p2 = evaluate(lane, 100, 200, 10, cursor);
+        REQUIRE(p2.size() == 2);
+        REQUIRE(p2[0].first == 0);
+        REQUIRE(p2[0].second == Approx(0.1));
+        REQUIRE(p2[1].first == 9);
+        REQUIRE(p2[1].second == Approx(0.19));
+    }
+
+    SECTION("breakpoints in a slice are emitted at their sample offsets and steady values are skipped") {
+        AutomationLane lane(1, { BP(0, 0.0), BP(50, 0.0), BP(50, 1.0) });
+        AutomationLane::Cursor cursor;
+
+        auto p1 = evaluate(lane, 0, 100, 10, cursor);
+        REQUIRE(p1 == Points{ { 0, 0.0 }, { 5, 1.0 } });
+
+        auto p2 = evaluate(lane, 100, 200, 10, cursor);
+        REQUIRE(p2.empty());
+    }
+
+    SECTION("the cursor follows a jump backwards") {
+        AutomationLane lane(1, { BP(0, 0.0), BP(100, 1.0), BP(200, 0.0) });
+        AutomationLane::Cursor cursor;
+
+        evaluate(lane, 150, 160, 10, cursor);
+        auto p = evaluate(lane, 0, 10, 10, cursor);
+        REQUIRE(p.size() == 2);
+        REQUIRE(p[0] == std::make_pair<SampleCount, double>(0, 0.0));
+        REQUIRE(p[1].second == Approx(0.09));
+    }
+}
@@ -0,0 +1,34 @@
+#include "catch2/catch.hpp"
+
+#include <vector>
+
+#include "../misc/Interleave.hpp"
+
+TEST_CASE("Interleave test", "[interleave]")
+{
+    using namespace hwm;
+
+    int const num_channels = GENERATE(1, 2, 3, 4, 6, 8, 32);
+    SampleCount const num_samples = GENERATE(0, 1, 7, 64, 67);
+
+    std::vector<float> interleaved(num_channels * num_samples);
+    for(size_t i = 0; i < interleaved.size(); ++i) {
+        interleaved[i] = (float)i;
+    }
+
+    std::vector<std::vector<float>> channels(num_channels, std::vector<float>(num_samples, -1));
+    std::vector<float *> channel_ptrs;
+    for(auto &ch: channels) { channel_ptrs.push_back(ch.data()); }
+
+    Deinterleave(interleaved.data(), channel_ptrs.data(), num_channels, num_samples);
+
+    for(int ch = 0; ch < num_channels; ++ch) {
+        for(SampleCount smp = 0; smp < num_samples; ++smp) {
+            REQUIRE(channels[ch][smp] == (float)(smp * num_channels + ch));
+        }
+    }
+
+    std::vector<float> reinterleaved(interleaved.size(), -1);
+    Interleave(channel_ptrs.data(), reinterleaved.data(), num_channels, num_samples);
+    REQUIRE(reinterleaved == interleaved);
+}
@@ -0,0 +1,125 @@
+#include "catch2/catch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../project/LookaheadProcessor.hpp"
+
+TEST_CASE("LookaheadProcessor test", "[lookahead]")
+{
+    using namespace hwm;
+
+    SampleCount const device_block_size = 64;
+    SampleCount const block_size = 256;
+    int const num_callbacks = 64;
+
+    // 処理関数はワーカースレッドから呼ばれるので、REQUIREせずに結果を記録しておく。
+    std::atomic<bool> all_blocks_have_block_size { true };
+
+    LookaheadProcessor lp(1, 2, device_block_size, block_size, 0.01, RealtimeThreadOptions{},
+                          [&](SampleCount len, float const * const * input, float **output) {
+                              if(len != block_size) { all_blocks_have_block_size = false; }
+                              for(SampleCount i = 0; i < len; ++i) {
+                                  output[0][i] = input[0][i];
+                                  output[1][i] = -input[0][i];
+                              }
+                          });
+
+    auto const latency = lp.GetLatency();
+    REQUIRE(latency >= block_size);
+
+    std::vector<float> input(device_block_size);
+    std::vector<float> output_l(device_block_size);
+    std::vector<float> output_r(device_block_size);
+    float const *input_ptrs[] = { input.data() };
+    float *output_ptrs[] = { output_l.data(), output_r.data() };
+
+    std::vector<float> received;
+    for(int n = 0; n < num_callbacks; ++n) {
+        for(SampleCount i = 0; i < device_block_size; ++i) {
+            input[i] = (float)(n * device_block_size + i + 1);
+        }
+
+        lp.Process(device_block_size, input_ptrs, output_ptrs);
+        for(SampleCount i = 0; i < device_block_size; ++i) {
+            REQUIRE(output_r[i] == -output_l[i]);
+        }
+        received.insert(received.end(), output_l.begin(), output_l.end());
+
+        // ワーカースレッドの処理が間に合うように、デバイスのブロックの間隔を模擬する。
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    REQUIRE(lp.GetNumUnderruns() == 0);
+    
+    // ワーカースレッドでの処理時間が、ブロックごとに記録される。
+    auto const stat = lp.GetStatistics();
+    REQUIRE(stat.num_callbacks_ > 0);
+    REQUIRE(stat.num_callbacks_ <= (UInt64)(num_callbacks * device_block_size / block_size));
+    REQUIRE(stat.deadline_ == 0.01);
+    REQUIRE(stat.num_output_underflows_ == 0);
+
+    for(size_t i = 0; i < received.size(); ++i) {
+        auto const expected = (i < (size_t)latency ? 0.0f : (float)(i - latency + 1));
+        REQUIRE(received[i] == expected);
+    }
+
+    REQUIRE(all_blocks_have_block_size);
+}
+
+TEST_CASE("LookaheadProcessor realigns after underruns", "[lookahead]")
+{
+    using namespace hwm;
+
+    SampleCount const device_block_size = 64;
+    SampleCount const block_size = 256;
+    int const num_callbacks = 200;
+
+    // 3ブロック目の処理を止めて、出力を間に合わなくする。
+    std::atomic<int> num_processed { 0 };
+    LookaheadProcessor lp(1, 1, device_block_size, block_size, 0.01, RealtimeThreadOptions{},
+                          [&](SampleCount len, float const * const * input, float **output) {
+                              if(num_processed++ == 2) {
+                                  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+                              }
+                              std::copy_n(input[0], len, output[0]);
+                          });
+
+    auto const latency = lp.GetLatency();
+
+    std::vector<float> input(device_block_size);
+    std::vector<float> output(device_block_size);
+    float const *input_ptrs[] = { input.data() };
+    float *output_ptrs[] = { output.data() };
+
+    std::vector<float> received;
+    for(int n = 0; n < num_callbacks; ++n) {
+        for(SampleCount i = 0; i < device_block_size; ++i) {
+            input[i] = (float)(n * device_block_size + i + 1);
+        }
+
+        lp.Process(device_block_size, input_ptrs, output_ptrs);
+        received.insert(received.end(), output.begin(), output.end());
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    REQUIRE(lp.GetNumUnderruns() > 0);
+
+    // 無音になった部分以外は、常にちょうどGetLatency()だけ遅れて出力される。
+    bool all_samples_are_aligned = true;
+    for(size_t i = 0; i < received.size(); ++i) {
+        if(received[i] != 0 && received[i] != (float)(i - latency + 1)) {
+            all_samples_are_aligned = false;
+        }
+    }
+    REQUIRE(all_samples_are_aligned);
+
+    // 処理が追いついたあとは、途切れずに出力される。
+    auto const num_last_samples = device_block_size * 16;
+    for(size_t i = received.size() - num_last_samples; i < received.size(); ++i) {
+        REQUIRE(received[i] == (float)(i - latency + 1));
+    }
+}
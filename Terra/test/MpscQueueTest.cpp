@@ -0,0 +1,75 @@
+#include "catch2/catch.hpp"
+
+#include <thread>
+#include <vector>
+
+#include "../misc/MpscQueue.hpp"
+
+TEST_CASE("MpscQueue test", "[mpsc]")
+{
+    using namespace hwm;
+
+    SECTION("capacity is rounded up to a power of two") {
+        MpscQueue<int> q(5);
+        REQUIRE(q.GetCapacity() == 8);
+    }
+
+    SECTION("push and pop in FIFO order") {
+        MpscQueue<int> q(4);
+        int x = 0;
+        REQUIRE(q.TryPop(x) == false);
+
+        for(int i = 0; i < 4; ++i) { REQUIRE(q.TryPush(i)); }
+        REQUIRE(q.TryPush(100) == false);
+
+        for(int i = 0; i < 4; ++i) {
+            REQUIRE(q.TryPop(x));
+            REQUIRE(x == i);
+        }
+        REQUIRE(q.TryPop(x) == false);
+
+        // wrap around
+        for(int i = 0; i < 10; ++i) {
+            REQUIRE(q.TryPush(i));
+            REQUIRE(q.TryPop(x));
+            REQUIRE(x == i);
+        }
+    }
+
+    SECTION("multiple producers") {
+        int const kNumProducers = 4;
+        int const kNumValues = 10000;
+        MpscQueue<int> q(256);
+
+        std::vector<std::thread> producers;
+        for(int p = 0; p < kNumProducers; ++p) {
+            producers.emplace_back([&, p] {
+                for(int i = 0; i < kNumValues; ++i) {
+                    while(q.TryPush(p * kNumValues + i) == false) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+
+        // 各プロデューサーから追加された値が、その順序のまま取り出されることを確認する。
+        std::vector<int> last(kNumProducers, -1);
+        bool in_order = true;
+        for(int n = 0; n < kNumProducers * kNumValues; ) {
+            int x = 0;
+            if(q.TryPop(x) == false) { std::this_thread::yield(); continue; }
+
+            auto const p = x / kNumValues;
+            auto const i = x % kNumValues;
+            in_order = in_order && (last[p] + 1 == i);
+            last[p] = i;
+            ++n;
+        }
+
+        for(auto &th: producers) { th.join(); }
+
+        REQUIRE(in_order);
+        int x = 0;
+        REQUIRE(q.TryPop(x) == false);
+    }
+}
@@ -0,0 +1,30 @@
+#include "catch2/catch.hpp"
+
+#include "../misc/ParallelFor.hpp"
+
+TEST_CASE("ParallelFor test", "[parallel]")
+{
+    using namespace hwm;
+
+    SECTION("every index is visited exactly once") {
+        std::vector<std::atomic<int>> counts(1000);
+        for(auto &c: counts) { c = 0; }
+
+        ParallelFor(counts.size(), [&](size_t i) { counts[i].fetch_add(1); }, 4);
+
+        REQUIRE(std::all_of(counts.begin(), counts.end(), [](auto const &c) { return c.load() == 1; }));
+    }
+
+    SECTION("empty range") {
+        bool called = false;
+        ParallelFor(0, [&](size_t) { called = true; });
+        REQUIRE(called == false);
+    }
+
+    SECTION("single worker runs on the calling thread") {
+        auto const this_id = std::this_thread::get_id();
+        bool same_thread = true;
+        ParallelFor(10, [&](size_t) { same_thread = same_thread && (std::this_thread::get_id() == this_id); }, 1);
+        REQUIRE(same_thread);
+    }
+}
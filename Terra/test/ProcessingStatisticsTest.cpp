@@ -0,0 +1,75 @@
+#include "catch2/catch.hpp"
+
+#include "../device/ProcessingStatistics.hpp"
+
+TEST_CASE("ProcessingStatistics test", "[statistics]")
+{
+    using namespace hwm;
+    using PI = ProcessingIncident;
+
+    double const deadline = 0.01;
+
+    ProcessingStatisticsRecorder rec;
+    rec.Reset(deadline);
+
+    ProcessingIncident incident;
+    for(int i = 0; i < 1000; ++i) {
+        REQUIRE(rec.Record(deadline * 0.25, 0, 441, incident) == false);
+    }
+
+    SECTION("percentiles") {
+        for(int i = 0; i < 10; ++i) {
+            REQUIRE(rec.Record(deadline * 0.75, 0, 441, incident) == false);
+        }
+
+        auto stat = rec.GetStatistics();
+        REQUIRE(stat.num_callbacks_ == 1010);
+        REQUIRE(stat.num_deadline_misses_ == 0);
+        REQUIRE(stat.GetNumXruns() == 0);
+        REQUIRE(stat.worst_callback_duration_ == Approx(deadline * 0.75));
+        REQUIRE(stat.median_callback_duration_ == Approx(deadline * 0.25).margin(deadline / 64));
+        REQUIRE(stat.p99_callback_duration_ == Approx(deadline * 0.25).margin(deadline / 64));
+        REQUIRE(stat.p999_callback_duration_ == Approx(deadline * 0.75).margin(deadline / 64));
+        REQUIRE(stat.recent_incidents_.empty());
+    }
+
+    SECTION("incidents") {
+        REQUIRE(rec.Record(deadline * 3, 0, 441, incident));
+        REQUIRE(incident.index_ == 0);
+        REQUIRE(incident.flags_ == PI::kDeadlineMiss);
+        REQUIRE(incident.callback_duration_ == deadline * 3);
+        incident.num_active_nodes_ = 3;
+        rec.AddIncident(incident);
+
+        REQUIRE(rec.Record(deadline * 0.5, PI::kOutputUnderflow, 441, incident));
+        REQUIRE(incident.index_ == 1);
+        REQUIRE(incident.flags_ == PI::kOutputUnderflow);
+        rec.AddIncident(incident);
+
+        auto stat = rec.GetStatistics();
+        REQUIRE(stat.num_deadline_misses_ == 1);
+        REQUIRE(stat.num_output_underflows_ == 1);
+        REQUIRE(stat.GetNumXruns() == 1);
+        REQUIRE(stat.worst_callback_duration_ == deadline * 3);
+        REQUIRE(stat.p999_callback_duration_ == Approx(deadline * 0.5).margin(deadline / 64));
+        REQUIRE(stat.recent_incidents_.size() == 2);
+        REQUIRE(stat.recent_incidents_[0].num_active_nodes_ == 3);
+
+        // 取り出した記録は、次の呼び出しでも返される。
+        REQUIRE(rec.GetStatistics().recent_incidents_.size() == 2);
+
+        for(UInt32 i = 0; i < ProcessingStatisticsRecorder::kMaxRecentIncidents; ++i) {
+            REQUIRE(rec.Record(0, PI::kInputOverflow, 441, incident));
+            rec.AddIncident(incident);
+        }
+
+        stat = rec.GetStatistics();
+        REQUIRE(stat.recent_incidents_.size() == ProcessingStatisticsRecorder::kMaxRecentIncidents);
+        REQUIRE(stat.recent_incidents_.back().index_ == ProcessingStatisticsRecorder::kMaxRecentIncidents + 1);
+
+        rec.Reset(deadline);
+        stat = rec.GetStatistics();
+        REQUIRE(stat.num_callbacks_ == 0);
+        REQUIRE(stat.recent_incidents_.empty());
+    }
+}
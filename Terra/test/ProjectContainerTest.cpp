@@ -0,0 +1,176 @@
+#include "catch2/catch.hpp"
+
+#include <wx/filename.h>
+
+#include "../file/ProjectContainer.hpp"
+#include "../misc/Compression.hpp"
+#include "../misc/FileStream.hpp"
+
+#include "./TestApp.hpp"
+#include "./PathUtil.hpp"
+
+TEST_CASE("ProjectContainer test", "[container]")
+{
+    using namespace hwm;
+
+    schema::Project project;
+    project.set_name("test.trproj");
+    project.mutable_transport()->set_pos(1000);
+
+    auto plugin_node = project.mutable_graph()->add_nodes();
+    plugin_node->set_id(10);
+    auto dump = plugin_node->mutable_processor()->mutable_vst3_data()->mutable_dump();
+    dump->set_processor_data(std::string(100000, 'p'));
+    dump->set_edit_controller_data("edit");
+
+    auto input_node = project.mutable_graph()->add_nodes();
+    input_node->set_id(5);
+    input_node->mutable_processor()->mutable_audio_input_data()->set_name("input");
+
+    auto conn = project.mutable_graph()->add_connections();
+    conn->set_upstream_id(5);
+    conn->set_downstream_id(10);
+
+    project.add_sequences()->set_name("seq1");
+    project.add_sequences()->set_name("seq2");
+    
+    for(int i = 0; i < 100; ++i) {
+        auto note = project.mutable_sequences(1)->add_notes();
+        note->set_pos(i * 480);
+        note->set_length(480);
+        note->set_pitch(60);
+    }
+
+    bool const compress = GENERATE(false, true);
+    
+    std::string data;
+    REQUIRE(ProjectContainer::Serialize(project, data, compress));
+    if(compress) {
+        REQUIRE(data.size() < project.ByteSizeLong() / 10);
+    }
+    REQUIRE(ProjectContainer::IsContainer(data.data(), data.size()));
+
+    SECTION("the project is read without plugin dumps") {
+        auto reader = ProjectContainerReader::FromData(data);
+        REQUIRE(reader);
+
+        auto loaded = reader->ReadProject();
+        REQUIRE(loaded);
+
+        // プラグインの状態の代わりに、そのハッシュ値が設定される。
+        auto expected = project;
+        ProjectContainer::StripPluginDumps(expected);
+        REQUIRE(expected.graph().nodes(0).processor().vst3_data().dump_hash()
+                == ProjectContainer::HashPluginDump(*dump));
+        REQUIRE(loaded->SerializeAsString() == expected.SerializeAsString());
+        
+        REQUIRE(reader->ReadPluginDumps(*loaded));
+        REQUIRE(loaded->graph().nodes(0).processor().vst3_data().dump().SerializeAsString()
+                == dump->SerializeAsString());
+    }
+    
+    SECTION("dumps are found by their hash") {
+        auto reader = ProjectContainerReader::FromData(data);
+        REQUIRE(reader);
+        
+        auto const hash = ProjectContainer::HashPluginDump(*dump);
+        REQUIRE(reader->HasPluginDumpWithHash(hash));
+        REQUIRE(reader->HasPluginDumpWithHash(hash + 1) == false);
+        
+        schema::Processor::Vst3::Dump loaded_dump;
+        REQUIRE(reader->ReadPluginDumpWithHash(hash, loaded_dump));
+        REQUIRE(loaded_dump.SerializeAsString() == dump->SerializeAsString());
+        
+        // ノードのIDが変わっていても、ハッシュ値が同じ状態が読み込まれる。
+        auto loaded = reader->ReadProject();
+        REQUIRE(loaded);
+        loaded->mutable_graph()->mutable_nodes(0)->set_id(20);
+        REQUIRE(reader->ReadPluginDumps(*loaded));
+        
+        auto vst3 = loaded->mutable_graph()->mutable_nodes(0)->mutable_processor()->mutable_vst3_data();
+        vst3->clear_dump();
+        vst3->set_dump_hash(hash + 1);
+        REQUIRE(reader->ReadPluginDumps(*loaded) == false);
+    }
+    
+    SECTION("a project without the dumps of its plugins is not serialized") {
+        auto stripped = project;
+        ProjectContainer::StripPluginDumps(stripped);
+        
+        std::string stripped_data;
+        REQUIRE(ProjectContainer::Serialize(stripped, stripped_data, compress) == false);
+    }
+
+    SECTION("plugin dumps are read on demand") {
+        auto reader = ProjectContainerReader::FromData(data);
+        REQUIRE(reader);
+
+        schema::Processor::Vst3::Dump loaded_dump;
+        REQUIRE(reader->ReadPluginDump(10, loaded_dump));
+        REQUIRE(loaded_dump.SerializeAsString() == dump->SerializeAsString());
+        REQUIRE(reader->ReadPluginDump(5, loaded_dump) == false);
+    }
+
+    SECTION("dumps can be read after the file is released") {
+        TestApp app;
+        auto scoped_dir = ScopedTemporaryDirectoryProvider(L"project-container-test");
+        auto const path = wxFileName(scoped_dir.GetPath(), L"test.trproj").GetFullPath().ToStdWstring();
+        {
+            auto ofs = open_ofstream(path, std::ios::binary|std::ios::trunc);
+            ofs.write(data.data(), data.size());
+        }
+        
+        auto reader = ProjectContainerReader::Open(path);
+        REQUIRE(reader);
+        
+        reader->ReleaseFile();
+        REQUIRE(wxRemoveFile(path));
+        
+        schema::Processor::Vst3::Dump loaded_dump;
+        REQUIRE(reader->ReadPluginDump(10, loaded_dump));
+        REQUIRE(loaded_dump.SerializeAsString() == dump->SerializeAsString());
+    }
+
+    SECTION("broken data is rejected") {
+        REQUIRE(ProjectContainer::IsContainer(project.SerializeAsString().data(),
+                                              project.SerializeAsString().size()) == false);
+        REQUIRE(ProjectContainerReader::FromData(project.SerializeAsString()) == nullptr);
+        REQUIRE(ProjectContainerReader::FromData(data.substr(0, data.size() - 1)) == nullptr);
+    }
+    
+    SECTION("a forged uncompressed size is rejected before allocating") {
+        std::string const payload(1000, 'x');
+        std::string compressed;
+        REQUIRE(CompressData(payload.data(), payload.size(), {}, compressed));
+        
+        std::string out;
+        REQUIRE(DecompressData(compressed.data(), compressed.size(), payload.size(), {}, out));
+        REQUIRE(out == payload);
+        REQUIRE(DecompressData(compressed.data(), compressed.size(), (size_t)1 << 40, {}, out) == false);
+    }
+
+    SECTION("dumps of the same plugin are compressed with a shared dictionary") {
+        auto dumps_project = project;
+        for(int i = 0; i < 3; ++i) {
+            auto node = dumps_project.mutable_graph()->add_nodes();
+            node->set_id(100 + i);
+            auto vst3 = node->mutable_processor()->mutable_vst3_data();
+            vst3->mutable_desc()->mutable_vst3info()->set_cid("cid");
+            std::string state;
+            for(int j = 0; j < 64; ++j) { state += "chunk " + std::to_string((i + 1) * j) + ";"; }
+            vst3->mutable_dump()->set_processor_data(state);
+        }
+        
+        std::string dumps_data;
+        REQUIRE(ProjectContainer::Serialize(dumps_project, dumps_data, compress));
+        auto reader = ProjectContainerReader::FromData(dumps_data);
+        REQUIRE(reader);
+        
+        for(int i = 0; i < 3; ++i) {
+            schema::Processor::Vst3::Dump loaded_dump;
+            REQUIRE(reader->ReadPluginDump(100 + i, loaded_dump));
+            auto const &expected = dumps_project.graph().nodes(2 + i).processor().vst3_data().dump();
+            REQUIRE(loaded_dump.SerializeAsString() == expected.SerializeAsString());
+        }
+    }
+}
@@ -0,0 +1,154 @@
+#include "catch2/catch.hpp"
+
+#include <sstream>
+
+#include "../file/ProjectJournal.hpp"
+
+TEST_CASE("ProjectJournal test", "[journal]")
+{
+    using namespace hwm;
+
+    auto add_node = [](schema::Project &pj, UInt64 id, int x) {
+        auto node = pj.mutable_graph()->add_nodes();
+        node->set_id(id);
+        node->mutable_pos()->set_x(x);
+    };
+
+    auto add_note = [](schema::Sequence &seq, Tick pos, int pitch) {
+        auto note = seq.add_notes();
+        note->set_pos(pos);
+        note->set_length(480);
+        note->set_pitch(pitch);
+    };
+
+    schema::Project base;
+    add_node(base, 1, 10);
+    add_node(base, 2, 20);
+    add_node(base, 3, 30);
+    auto conn = base.mutable_graph()->add_connections();
+    conn->set_upstream_id(1);
+    conn->set_downstream_id(2);
+    add_note(*base.add_sequences(), 0, 60);
+    add_note(*base.add_sequences(), 0, 64);
+
+    SECTION("no record is made for an unchanged project") {
+        REQUIRE(ProjectJournal::MakeRecord(base, base) == nullptr);
+    }
+
+    SECTION("plugin states are compared by their hash") {
+        auto vst3 = base.mutable_graph()->mutable_nodes(0)->mutable_processor()->mutable_vst3_data();
+        vst3->set_dump_hash(100);
+        
+        auto current = base;
+        current.mutable_graph()->mutable_nodes(0)->mutable_processor()->mutable_vst3_data()
+        ->mutable_dump()->set_processor_data("state");
+        REQUIRE(ProjectJournal::MakeRecord(base, current) == nullptr);
+        
+        current.mutable_graph()->mutable_nodes(0)->mutable_processor()->mutable_vst3_data()->set_dump_hash(101);
+        auto record = ProjectJournal::MakeRecord(base, current);
+        REQUIRE(record);
+        REQUIRE(record->updated_nodes_size() == 1);
+        REQUIRE(record->updated_nodes(0).processor().vst3_data().dump().processor_data() == "state");
+    }
+
+    SECTION("unchanged plugin states are inherited from the previous project") {
+        auto vst3 = base.mutable_graph()->mutable_nodes(0)->mutable_processor()->mutable_vst3_data();
+        vst3->set_dump_hash(100);
+        vst3->mutable_dump()->set_processor_data("state");
+        
+        // 状態を含まず、ハッシュ値だけが設定されたノード
+        auto current = base;
+        current.mutable_graph()->mutable_nodes(0)->mutable_processor()->mutable_vst3_data()->clear_dump();
+        current.mutable_graph()->mutable_nodes(1)->mutable_pos()->set_x(25);
+        
+        auto record = ProjectJournal::MakeRecord(base, current);
+        REQUIRE(record);
+        
+        auto replayed = base;
+        ProjectJournal::ApplyRecord(replayed, *record);
+        REQUIRE(replayed.graph().nodes(0).processor().vst3_data().dump().processor_data() == "state");
+        REQUIRE(replayed.graph().nodes(1).pos().x() == 25);
+        
+        auto previous = base;
+        ProjectJournal::InheritPluginDumps(current, previous);
+        REQUIRE(current.graph().nodes(0).processor().vst3_data().dump().processor_data() == "state");
+        
+        // ハッシュ値が異なる場合は引き継がない
+        current.mutable_graph()->mutable_nodes(0)->mutable_processor()->mutable_vst3_data()->clear_dump();
+        current.mutable_graph()->mutable_nodes(0)->mutable_processor()->mutable_vst3_data()->set_dump_hash(101);
+        previous = base;
+        ProjectJournal::InheritPluginDumps(current, previous);
+        REQUIRE(current.graph().nodes(0).processor().vst3_data().has_dump() == false);
+    }
+
+    SECTION("a record contains only the changed parts and reproduces the current project") {
+        auto current = base;
+        current.mutable_graph()->mutable_nodes(1)->mutable_pos()->set_x(25);
+        current.mutable_graph()->mutable_nodes()->erase(current.mutable_graph()->mutable_nodes()->begin());
+        add_node(current, 4, 40);
+        current.mutable_graph()->mutable_connections()->Clear();
+        add_note(*current.mutable_sequences(1), 480, 67);
+        add_note(*current.add_sequences(), 0, 72);
+        current.mutable_processing_mode()->set_kind(schema::ProcessingMode::kFixedSubBlock);
+
+        auto record = ProjectJournal::MakeRecord(base, current);
+        REQUIRE(record);
+        REQUIRE(record->has_transport() == false);
+        REQUIRE(record->has_processing_mode());
+        REQUIRE(record->updated_nodes_size() == 2);
+        REQUIRE(record->removed_node_ids_size() == 1);
+        REQUIRE(record->removed_node_ids(0) == 1);
+        REQUIRE(record->has_connections());
+        REQUIRE(record->connections().list_size() == 0);
+        REQUIRE(record->num_sequences() == 3);
+        REQUIRE(record->updated_sequences_size() == 2);
+
+        auto applied = base;
+        ProjectJournal::ApplyRecord(applied, *record);
+        REQUIRE(ProjectJournal::MakeRecord(applied, current) == nullptr);
+    }
+
+    SECTION("records are replayed on a snapshot of the same generation") {
+        schema::ProjectJournalSnapshot snapshot;
+        snapshot.set_generation(2);
+        *snapshot.mutable_project() = base;
+
+        auto v1 = base;
+        v1.mutable_transport()->set_pos(100);
+        auto v2 = v1;
+        v2.mutable_sequences()->RemoveLast();
+
+        auto stale = ProjectJournal::MakeRecord(base, v2);
+        stale->set_generation(1);
+        auto r1 = ProjectJournal::MakeRecord(base, v1);
+        r1->set_generation(2);
+        auto r2 = ProjectJournal::MakeRecord(v1, v2);
+        r2->set_generation(2);
+
+        std::stringstream ss;
+        REQUIRE(ProjectJournal::WriteRecord(ss, *stale));
+        REQUIRE(ProjectJournal::WriteRecord(ss, *r1));
+        REQUIRE(ProjectJournal::WriteRecord(ss, *r2));
+
+        auto const data = ss.str();
+
+        std::stringstream is(data);
+        auto records = ProjectJournal::ReadRecords(is);
+        REQUIRE(records.size() == 3);
+
+        auto replayed = ProjectJournal::Replay(snapshot, { records[1] });
+        REQUIRE(ProjectJournal::MakeRecord(*replayed, v1) == nullptr);
+
+        replayed = ProjectJournal::Replay(snapshot, records);
+        REQUIRE(ProjectJournal::MakeRecord(*replayed, v2) == nullptr);
+
+        // a record truncated by a crash and the following data are ignored.
+        std::stringstream truncated(data.substr(0, data.size() - 1));
+        REQUIRE(ProjectJournal::ReadRecords(truncated).size() == 2);
+
+        auto corrupted = data;
+        corrupted[corrupted.size() - 1] ^= 0xFF;
+        std::stringstream corrupted_is(corrupted);
+        REQUIRE(ProjectJournal::ReadRecords(corrupted_is).size() == 2);
+    }
+}
@@ -0,0 +1,28 @@
+#include "catch2/catch.hpp"
+
+#include "../project/Project.hpp"
+
+#include "./TestApp.hpp"
+
+TEST_CASE("Project anticipation test", "[project][anticipation]")
+{
+    using namespace hwm;
+
+    TestApp app;
+    Project pj;
+    pj.AddSequence(L"Sequence");
+    REQUIRE(pj.IsSequenceAnticipated(0) == false);
+
+    Project::ProcessingMode mode;
+    mode.kind_ = Project::ProcessingMode::Kind::kAnticipative;
+    mode.lookahead_block_size_ = 512;
+    pj.SetProcessingMode(mode);
+
+    // ノードをフリーズしていなくても、シーケンスのイベントは先行処理のスレッドで準備される。
+    IAudioDeviceCallback &cb = pj;
+    cb.StartProcessing(44100, 256, 0, 2);
+    CHECK(pj.IsSequenceAnticipated(0));
+
+    cb.StopProcessing();
+    CHECK(pj.IsSequenceAnticipated(0) == false);
+}
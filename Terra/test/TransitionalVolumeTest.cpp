@@ -1,6 +1,7 @@
 #include "catch2/catch.hpp"
 
 #include "../misc/TransitionalVolume.hpp"
+#include "../misc/MathUtil.hpp"
 
 TEST_CASE("Transitional volume test", "[transitional]")
 {
@@ -57,3 +58,59 @@ TEST_CASE("Transitional volume test", "[transitional]")
     REQUIRE(std::fabs(tr.get_current_db() - tr.get_max_db()) < kTolerance);
     REQUIRE(tr.get_current_linear_gain() != 0);
 }
+
+TEST_CASE("Transitional volume apply test", "[transitional]")
+{
+    using namespace hwm;
+    
+    // 1サンプルで約0.1dB変化する
+    TransitionalVolume tr(1000, 60, -48, 12);
+    auto const kAmountPerSample = log10(2) * 20 / 60;
+    
+    Buffer<float> buf(2, 64);
+    
+    // 推移していない場合は、一定のゲインを掛ける。
+    buf.fill(1.0);
+    tr.apply(buf);
+    REQUIRE(buf.data()[0][0] == 1.0);
+    REQUIRE(buf.data()[1][63] == 1.0);
+    
+    tr.set_target_db_immediately(-6);
+    tr.apply(buf);
+    for(int ch = 0; ch < 2; ++ch) {
+        for(int i = 0; i < 64; ++i) {
+            REQUIRE(buf.data()[ch][i] == Approx(DBToLinear(-6)));
+        }
+    }
+    
+    // 推移中は、サンプルごとにゲインが変化し、目的の値に達したあとは一定になる。
+    tr.set_target_db(-3);
+    buf.fill(1.0);
+    tr.apply(buf);
+    REQUIRE(tr.get_current_db() == -3);
+    for(int ch = 0; ch < 2; ++ch) {
+        for(int i = 0; i < 64; ++i) {
+            auto const db = std::min(-6 + kAmountPerSample * i, -3.0);
+            REQUIRE(buf.data()[ch][i] == Approx(DBToLinear(db)).epsilon(1e-4));
+        }
+    }
+    
+    // ブロックをまたいで推移する場合も、ゲインは連続する。
+    tr.set_target_db(-48);
+    buf.fill(1.0);
+    tr.apply(buf);
+    auto const last = buf.data()[0][63];
+    REQUIRE(tr.get_current_db() == Approx(-3 - kAmountPerSample * 64));
+    buf.fill(1.0);
+    tr.apply(buf);
+    REQUIRE(buf.data()[0][0] == Approx(last * DBToLinear(-kAmountPerSample)).epsilon(1e-4));
+    
+    // 最小のdB値に達したら無音になる。
+    for(int i = 0; i < 10; ++i) {
+        buf.fill(1.0);
+        tr.apply(buf);
+    }
+    REQUIRE(tr.get_current_linear_gain() == 0);
+    REQUIRE(buf.data()[0][0] == 0);
+    REQUIRE(buf.data()[1][63] == 0);
+}
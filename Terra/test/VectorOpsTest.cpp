@@ -0,0 +1,109 @@
+#include "catch2/catch.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "../misc/VectorOps.hpp"
+#include "../misc/AudioMeter.hpp"
+
+TEST_CASE("Vector ops test", "[vector_ops]")
+{
+    using namespace hwm;
+
+    SampleCount const num_samples = GENERATE(0, 1, 3, 4, 7, 64, 67);
+
+    std::vector<float> src(num_samples);
+    for(SampleCount i = 0; i < num_samples; ++i) {
+        src[i] = (i % 2 == 0 ? 1 : -1) * (float)(i + 1);
+    }
+
+    SECTION("add with gain") {
+        std::vector<float> dest(num_samples, 1.0f);
+        AddWithGain(src.data(), dest.data(), num_samples, 0.5f);
+        for(SampleCount i = 0; i < num_samples; ++i) {
+            REQUIRE(dest[i] == 1.0f + src[i] * 0.5f);
+        }
+    }
+
+    SECTION("add with linear ramp") {
+        std::vector<float> dest(num_samples, 1.0f);
+        AddWithLinearRamp(src.data(), dest.data(), num_samples, 1.0f, 0.0f);
+        for(SampleCount i = 0; i < num_samples; ++i) {
+            float const gain = 1.0f - (float)i / num_samples;
+            REQUIRE(dest[i] == Approx(1.0f + src[i] * gain).margin(1e-4));
+        }
+    }
+
+    SECTION("multiply by gain") {
+        std::vector<float> data = src;
+        MultiplyByGain(data.data(), num_samples, 0.25f);
+        for(SampleCount i = 0; i < num_samples; ++i) {
+            REQUIRE(data[i] == src[i] * 0.25f);
+        }
+    }
+
+    SECTION("multiply by exponential ramp") {
+        std::vector<float> data = src;
+        MultiplyByExponentialRamp(data.data(), num_samples, 0.5f, 0.99f);
+        for(SampleCount i = 0; i < num_samples; ++i) {
+            float const gain = 0.5f * std::pow(0.99f, (float)i);
+            REQUIRE(data[i] == Approx(src[i] * gain).epsilon(1e-4));
+        }
+    }
+
+    SECTION("peak and square sum") {
+        float peak = 0.5f;
+        float square_sum = 2.0f;
+        AccumulatePeakAndSquareSum(src.data(), num_samples, peak, square_sum);
+
+        float expected_sum = 2.0f;
+        for(auto x: src) { expected_sum += x * x; }
+        REQUIRE(peak == (num_samples == 0 ? 0.5f : (float)num_samples));
+        REQUIRE(square_sum == Approx(expected_sum));
+    }
+}
+
+TEST_CASE("Audio meter test", "[vector_ops]")
+{
+    using namespace hwm;
+
+    AudioMeter meter(2);
+    meter.SetSampleRate(44100);
+    REQUIRE(meter.GetNumChannels() == 2);
+
+    std::vector<AudioMeter::Level> levels(2);
+    REQUIRE(meter.GetLevels(levels.data()) == 0);
+    REQUIRE(levels[0].peak_ == 0);
+    REQUIRE(levels[0].rms_ == 0);
+
+    Buffer<float> buf(1, 441);
+    buf.fill(0.5f);
+
+    // 十分な時間入力して、RMSを収束させる。
+    for(int i = 0; i < 500; ++i) {
+        meter.Process(BufferRef<float const>(buf));
+    }
+
+    REQUIRE(meter.GetUpdateCount() == 500);
+    REQUIRE(meter.GetLevels(levels.data()) == 500);
+    REQUIRE(levels[0].peak_ == 0.5f);
+    REQUIRE(levels[0].rms_ == Approx(0.5f).margin(1e-4));
+    // bufに含まれないチャンネルは無音として扱われる
+    REQUIRE(levels[1].peak_ == 0);
+    REQUIRE(levels[1].rms_ == 0);
+
+    // 1秒間の無音で、ピークはkPeakReleaseDBPerSecだけ下がる
+    buf.fill(0);
+    for(int i = 0; i < 100; ++i) {
+        meter.Process(BufferRef<float const>(buf));
+    }
+    meter.GetLevels(levels.data());
+    auto const expected_peak = 0.5 * std::pow(10.0, -AudioMeter::kPeakReleaseDBPerSec / 20.0);
+    REQUIRE(levels[0].peak_ == Approx(expected_peak).epsilon(1e-3));
+    REQUIRE(levels[0].rms_ < 0.5f * 0.2f);
+
+    meter.Reset();
+    meter.GetLevels(levels.data());
+    REQUIRE(levels[0].peak_ == 0);
+    REQUIRE(levels[0].rms_ == 0);
+}
@@ -0,0 +1,56 @@
+#include "catch2/catch.hpp"
+
+#include <vector>
+
+#include "../plugin/vst3/Vst3Utils.hpp"
+
+TEST_CASE("Vst3 silence flags test", "[vst3]")
+{
+    using namespace hwm;
+    namespace Vst = Steinberg::Vst;
+
+    SampleCount const kLength = 16;
+    std::vector<float> left(kLength);
+    std::vector<float> right(kLength);
+    std::vector<float> inactive(kLength);
+    float *active_channels[] = { left.data(), right.data() };
+    float *inactive_channels[] = { inactive.data() };
+
+    Vst::AudioBusBuffers buses[2] = {};
+    buses[0].numChannels = 2;
+    buses[0].channelBuffers32 = active_channels;
+    buses[1].numChannels = 1;
+    buses[1].channelBuffers32 = inactive_channels;
+    buses[1].silenceFlags = (Steinberg::uint64)-1;
+
+    auto is_active = [](int bus_index) { return bus_index == 0; };
+
+    // silenceFlagsを書き込まずに、出力だけを書き込むプラグインの処理
+    auto process_without_flags = [&] {
+        std::fill(left.begin(), left.end(), 0.5f);
+        std::fill(right.begin(), right.end(), -0.5f);
+        std::fill(inactive.begin(), inactive.end(), 1.0f);
+    };
+
+    // 前回のフレームで、プラグインがすべてのチャンネルを無音として通知していた。
+    buses[0].silenceFlags = 0x3;
+
+    ResetOutputSilenceFlags(buses, 2, is_active);
+    process_without_flags();
+    ClearSilentChannels(buses, 2, kLength);
+
+    CHECK(buses[0].silenceFlags == 0);
+    CHECK(buses[1].silenceFlags == (Steinberg::uint64)-1);
+    CHECK(std::all_of(left.begin(), left.end(), [](float x) { return x == 0.5f; }));
+    CHECK(std::all_of(right.begin(), right.end(), [](float x) { return x == -0.5f; }));
+    CHECK(std::all_of(inactive.begin(), inactive.end(), [](float x) { return x == 0.0f; }));
+
+    // プラグインが無音として通知したチャンネルは、0で埋められる。
+    ResetOutputSilenceFlags(buses, 2, is_active);
+    process_without_flags();
+    buses[0].silenceFlags = 0x2;
+    ClearSilentChannels(buses, 2, kLength);
+
+    CHECK(std::all_of(left.begin(), left.end(), [](float x) { return x == 0.5f; }));
+    CHECK(std::all_of(right.begin(), right.end(), [](float x) { return x == 0.0f; }));
+}
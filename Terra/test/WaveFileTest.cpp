@@ -0,0 +1,178 @@
+#include "catch2/catch.hpp"
+
+#include <cstring>
+#include <wx/filename.h>
+
+#include "../file/WaveFile.hpp"
+#include "../misc/FileStream.hpp"
+
+#include "./TestApp.hpp"
+#include "./PathUtil.hpp"
+
+TEST_CASE("WaveFile test", "[file]")
+{
+    using namespace hwm;
+
+    TestApp app;
+    auto scoped_dir = ScopedTemporaryDirectoryProvider(L"wave-file-test");
+    auto const path = wxFileName(scoped_dir.GetPath(), L"test.wav").GetFullPath().ToStdWstring();
+
+    SampleCount const kNumSamples = 1000;
+    Buffer<float> src(2, kNumSamples);
+    for(UInt32 ch = 0; ch < src.channels(); ++ch) {
+        for(SampleCount i = 0; i < kNumSamples; ++i) {
+            src.data()[ch][i] = (ch == 0 ? 1 : -1) * (float)i / kNumSamples;
+        }
+    }
+
+    {
+        auto writer = WaveFileWriter::Create(path, 2, 48000);
+        REQUIRE(writer);
+        // 複数回に分けて書き込む。
+        REQUIRE(writer->Write(BufferRef<float const>(src, 0, 2, 0, 300)));
+        REQUIRE(writer->Write(BufferRef<float const>(src, 0, 2, 300, kNumSamples - 300)));
+        REQUIRE(writer->GetNumSamples() == kNumSamples);
+        REQUIRE(writer->Close());
+    }
+
+    auto reader = WaveFileReader::Open(path);
+    REQUIRE(reader);
+    REQUIRE(reader->GetNumChannels() == 2);
+    REQUIRE(reader->GetSampleRate() == 48000);
+    REQUIRE(reader->GetNumSamples() == kNumSamples);
+
+    SECTION("read a range in the file") {
+        Buffer<float> dest(2, 100);
+        REQUIRE(reader->Read(450, dest));
+        for(UInt32 ch = 0; ch < dest.channels(); ++ch) {
+            for(SampleCount i = 0; i < dest.samples(); ++i) {
+                REQUIRE(dest.data()[ch][i] == src.data()[ch][450 + i]);
+            }
+        }
+    }
+
+    SECTION("out of range samples are filled with silence") {
+        Buffer<float> dest(2, 100);
+        dest.fill(1);
+        REQUIRE(reader->Read(kNumSamples - 40, dest));
+        for(UInt32 ch = 0; ch < dest.channels(); ++ch) {
+            for(SampleCount i = 0; i < 40; ++i) {
+                REQUIRE(dest.data()[ch][i] == src.data()[ch][kNumSamples - 40 + i]);
+            }
+            for(SampleCount i = 40; i < dest.samples(); ++i) {
+                REQUIRE(dest.data()[ch][i] == 0);
+            }
+        }
+
+        dest.fill(1);
+        REQUIRE(reader->Read(-60, dest));
+        for(SampleCount i = 0; i < 60; ++i) {
+            REQUIRE(dest.data()[0][i] == 0);
+        }
+        for(SampleCount i = 60; i < dest.samples(); ++i) {
+            REQUIRE(dest.data()[0][i] == src.data()[0][i - 60]);
+        }
+    }
+
+    SECTION("read into a buffer with fewer channels") {
+        Buffer<float> dest(1, 100);
+        REQUIRE(reader->Read(0, dest));
+        for(SampleCount i = 0; i < dest.samples(); ++i) {
+            REQUIRE(dest.data()[0][i] == src.data()[0][i]);
+        }
+    }
+}
+
+namespace {
+    //! 整数形式のWAVファイルを書き出す
+    void WritePcmWaveFile(hwm::String const &path, hwm::UInt16 num_channels, hwm::UInt16 bits_per_sample,
+                          std::vector<char> const &data)
+    {
+        using namespace hwm;
+        
+        auto write = [](std::ostream &os, auto value) {
+            os.write(reinterpret_cast<char const *>(&value), sizeof(value));
+        };
+        
+        UInt16 const block_align = num_channels * bits_per_sample / 8;
+        
+        auto ofs = open_ofstream(path, std::ios::binary|std::ios::trunc);
+        ofs.write("RIFF", 4);
+        write(ofs, (UInt32)(4 + 8 + 16 + 8 + data.size()));
+        ofs.write("WAVE", 4);
+        ofs.write("fmt ", 4);
+        write(ofs, (UInt32)16);
+        write(ofs, (UInt16)1);
+        write(ofs, num_channels);
+        write(ofs, (UInt32)44100);
+        write(ofs, (UInt32)(44100 * block_align));
+        write(ofs, block_align);
+        write(ofs, bits_per_sample);
+        ofs.write("data", 4);
+        write(ofs, (UInt32)data.size());
+        ofs.write(data.data(), data.size());
+    }
+}
+
+TEST_CASE("WaveFileReader PCM test", "[file]")
+{
+    using namespace hwm;
+    
+    TestApp app;
+    auto scoped_dir = ScopedTemporaryDirectoryProvider(L"wave-file-pcm-test");
+    auto const path = wxFileName(scoped_dir.GetPath(), L"test.wav").GetFullPath().ToStdWstring();
+    
+    SECTION("16bit") {
+        std::vector<Int16> values { 0, 16384, -16384, 32767, -32768, 1 };
+        std::vector<char> data(values.size() * 2);
+        std::memcpy(data.data(), values.data(), data.size());
+        WritePcmWaveFile(path, 2, 16, data);
+        
+        auto reader = WaveFileReader::Open(path);
+        REQUIRE(reader);
+        REQUIRE(reader->GetNumChannels() == 2);
+        REQUIRE(reader->GetSampleRate() == 44100);
+        REQUIRE(reader->GetNumSamples() == 3);
+        
+        Buffer<float> dest(2, 3);
+        REQUIRE(reader->Read(0, dest));
+        REQUIRE(dest.data()[0][0] == 0);
+        REQUIRE(dest.data()[1][0] == 0.5);
+        REQUIRE(dest.data()[0][1] == -0.5);
+        REQUIRE(dest.data()[1][1] == Approx(1.0).epsilon(0.0001));
+        REQUIRE(dest.data()[0][2] == -1.0);
+        REQUIRE(dest.data()[1][2] == 1.0f / 32768);
+    }
+    
+    SECTION("24bit") {
+        // 0x400000 (0.5), 0xC00000 (-0.5), 0x7FFFFF, 0x800000 (-1.0)
+        std::vector<char> data {
+            0x00, 0x00, 0x40,
+            0x00, 0x00, (char)0xC0,
+            (char)0xFF, (char)0xFF, 0x7F,
+            0x00, 0x00, (char)0x80,
+        };
+        WritePcmWaveFile(path, 1, 24, data);
+        
+        auto reader = WaveFileReader::Open(path);
+        REQUIRE(reader);
+        REQUIRE(reader->GetNumChannels() == 1);
+        REQUIRE(reader->GetNumSamples() == 4);
+        
+        // モノラルのファイルは、すべてのチャンネルに同じデータを書き込む。
+        Buffer<float> dest(2, 4);
+        REQUIRE(reader->Read(0, dest));
+        for(UInt32 ch = 0; ch < 2; ++ch) {
+            REQUIRE(dest.data()[ch][0] == 0.5);
+            REQUIRE(dest.data()[ch][1] == -0.5);
+            REQUIRE(dest.data()[ch][2] == Approx(1.0).epsilon(0.0001));
+            REQUIRE(dest.data()[ch][3] == -1.0);
+        }
+    }
+    
+    SECTION("unsupported format") {
+        std::vector<char> data(12);
+        WritePcmWaveFile(path, 1, 12, data);
+        REQUIRE(WaveFileReader::Open(path) == nullptr);
+    }
+}
@@ -5,11 +5,14 @@ NS_HWM_BEGIN
 Transporter::Traverser::Traverser()
 {}
 
-void Transporter::Traverser::Traverse(Transporter *tp, SampleCount length, ITraversalCallback *cb)
+void Transporter::Traverser::Traverse(Transporter *tp, SampleCount length, ITraversalCallback *cb,
+                                     SampleCount max_slice_length)
 {
     SampleCount remain = length;
     
     for( ; remain > 0 ; ) {
+        auto const slice = (max_slice_length > 0 ? std::min(remain, max_slice_length) : remain);
+        
         // 現在のTransportInfoのend位置を更新してフレーム処理。
         // そのあと、begin位置を更新して、次のフレームへ。
         TransportInfo ti;
@@ -23,17 +26,17 @@ void Transporter::Traverser::Traverse(Transporter *tp, SampleCount length, ITrav
         
         if(ti.IsLooping() && ti.playing_) {
             if(ti.play_.begin_.sample_ < ti.loop_.begin_.sample_) {
-                ti.play_.end_.sample_ = std::min(ti.play_.begin_.sample_ + remain, ti.loop_.begin_.sample_);
+                ti.play_.end_.sample_ = std::min(ti.play_.begin_.sample_ + slice, ti.loop_.begin_.sample_);
             } else if(ti.play_.begin_.sample_ < ti.loop_.end_.sample_) {
-                ti.play_.end_.sample_ = std::min(ti.play_.begin_.sample_ + remain, ti.loop_.end_.sample_);
+                ti.play_.end_.sample_ = std::min(ti.play_.begin_.sample_ + slice, ti.loop_.end_.sample_);
                 if(ti.play_.end_.sample_ == ti.loop_.end_.sample_) {
                     need_jump_to_begin = true;
                 }
             } else {
-                ti.play_.end_.sample_ = ti.play_.begin_.sample_ + remain;
+                ti.play_.end_.sample_ = ti.play_.begin_.sample_ + slice;
             }
         } else {
-            ti.play_.end_.sample_ = ti.play_.begin_.sample_ + remain;
+            ti.play_.end_.sample_ = ti.play_.begin_.sample_ + slice;
         }
         
         auto mt = tp->GetMusicalTimeService();
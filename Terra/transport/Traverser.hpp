@@ -34,8 +34,11 @@ public:
      *         ITraversalCallback::Process for each part of the frame.
      *      - If the playback position reaches to the end of the loop range,
      *        jump the playback position to the begin position of the loop range.
+     *  If max_slice_length is greater than 0, the frame is also split so that
+     *  each part of the frame is not longer than max_slice_length.
      */
-    void Traverse(Transporter *tp, SampleCount length, ITraversalCallback *cb);
+    void Traverse(Transporter *tp, SampleCount length, ITraversalCallback *cb,
+                  SampleCount max_slice_length = 0);
 };
 
 template<class F>